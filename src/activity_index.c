@@ -0,0 +1,867 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi, Sampo Savola
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* This module */
+#include "activity_index.h"
+
+/* System */
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/* GLib */
+#include <glib/gstdio.h>
+
+/* Other modules */
+#include "gpx_parser.h"
+
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+#define ACTIVITY_INDEX_GROUP_HEADER	"ActivityIndex"
+#define ACTIVITY_INDEX_KEY_VERSION	"version"
+
+#define ACTIVITY_INDEX_KEY_MTIME	"mtime"
+#define ACTIVITY_INDEX_KEY_SIZE		"size"
+#define ACTIVITY_INDEX_KEY_TRACKS	"tracks"
+#define ACTIVITY_INDEX_KEY_POINTS	"points"
+#define ACTIVITY_INDEX_KEY_HEART_RATES	"heart_rates"
+#define ACTIVITY_INDEX_KEY_START	"start"
+#define ACTIVITY_INDEX_KEY_END		"end"
+#define ACTIVITY_INDEX_KEY_DISTANCE	"distance"
+#define ACTIVITY_INDEX_KEY_HR_MIN	"heart_rate_min"
+#define ACTIVITY_INDEX_KEY_HR_MAX	"heart_rate_max"
+#define ACTIVITY_INDEX_KEY_HR_AVG	"heart_rate_average"
+
+struct _ActivityIndex {
+	gchar *folder;
+
+	/** @brief Path of the index file */
+	gchar *index_path;
+
+	/** @brief Pointers to #ActivityIndexEntry, newest first */
+	GPtrArray *entries;
+
+	/** @brief The entries by the file names of the GPX files */
+	GHashTable *entries_by_name;
+
+	/** @brief The scan that is in progress, or NULL */
+	struct _ActivityIndexScanJob *scan_job;
+
+	/** @brief Whether to scan again when the current scan completes */
+	gboolean rescan;
+
+	ActivityIndexCallback callback;
+	gpointer user_data;
+};
+
+/**
+ * @brief A scan of a folder. The job owns all of its data, so that the
+ * scanner thread shares nothing with the main loop.
+ */
+typedef struct _ActivityIndexScanJob {
+	/** @brief The index to update, or NULL if it has been freed */
+	ActivityIndex *index;
+
+	gchar *folder;
+	gchar *index_path;
+
+	/** @brief Copies of the entries that were known before the scan,
+	 * by the file names of the GPX files */
+	GHashTable *known;
+
+	/** @brief Pointers to #ActivityIndexEntry that were found */
+	GPtrArray *entries;
+
+	/** @brief Whether anything was added, updated or removed */
+	gboolean changed;
+} ActivityIndexScanJob;
+
+/**
+ * @brief The scanner thread. Only one scan is run at a time.
+ */
+static GThreadPool *activity_index_scanner = NULL;
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+static ActivityIndexEntry *activity_index_entry_copy(
+		const ActivityIndexEntry *entry);
+
+static void activity_index_entry_free(ActivityIndexEntry *entry);
+
+/**
+ * @brief Get the file name of the GPX file of an entry
+ *
+ * @param entry Pointer to #ActivityIndexEntry
+ *
+ * @return The file name. It points to the path of the entry.
+ */
+static const gchar *activity_index_entry_get_name(
+		const ActivityIndexEntry *entry);
+
+/**
+ * @brief Replace the entries of the index
+ *
+ * @param self Pointer to #ActivityIndex
+ * @param entries Pointers to #ActivityIndexEntry. The index takes the
+ * ownership of the array and the entries.
+ */
+static void activity_index_set_entries(
+		ActivityIndex *self,
+		GPtrArray *entries);
+
+/**
+ * @brief Compare the entries by start time, newest first
+ */
+static gint activity_index_compare_entries(gconstpointer a, gconstpointer b);
+
+/**
+ * @brief Read the index file
+ *
+ * @param folder The indexed folder
+ * @param index_path Path of the index file
+ *
+ * @return Pointers to #ActivityIndexEntry. If the index file does not
+ * exist or cannot be read, the array is empty.
+ */
+static GPtrArray *activity_index_read(
+		const gchar *folder,
+		const gchar *index_path);
+
+/**
+ * @brief Write the index file
+ *
+ * @param index_path Path of the index file
+ * @param entries Pointers to #ActivityIndexEntry
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean activity_index_write(
+		const gchar *index_path,
+		GPtrArray *entries,
+		GError **error);
+
+/**
+ * @brief Summarize a GPX file
+ *
+ * The summary is read from the binary copy of the file if it is up to
+ * date. Otherwise the file is parsed, which also writes the binary copy.
+ *
+ * @param path Path of the GPX file
+ * @param summary Return location for the summary
+ *
+ * @return TRUE on success, FALSE if the file could not be parsed
+ */
+static gboolean activity_index_summarize(
+		const gchar *path,
+		GpxBinarySummary *summary);
+
+/**
+ * @brief Scan a folder. Runs in the scanner thread.
+ *
+ * @param data Pointer to #ActivityIndexScanJob
+ * @param user_data Not used
+ */
+static void activity_index_scanner_func(gpointer data, gpointer user_data);
+
+/**
+ * @brief Complete a scan in the main loop
+ *
+ * @param user_data Pointer to #ActivityIndexScanJob
+ *
+ * @return Always FALSE
+ */
+static gboolean activity_index_scan_done(gpointer user_data);
+
+static void activity_index_scan_job_free(ActivityIndexScanJob *job);
+
+static gint64 activity_index_get_int64(
+		GKeyFile *key_file,
+		const gchar *group,
+		const gchar *key,
+		GError **error);
+
+static void activity_index_set_int64(
+		GKeyFile *key_file,
+		const gchar *group,
+		const gchar *key,
+		gint64 value);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+/*===========================================================================*
+ * Public functions                                                          *
+ *===========================================================================*/
+
+ActivityIndex *activity_index_new(const gchar *folder)
+{
+	ActivityIndex *self = NULL;
+
+	g_return_val_if_fail(folder != NULL, NULL);
+	DEBUG_BEGIN();
+
+	self = g_new0(ActivityIndex, 1);
+	self->folder = g_strdup(folder);
+	self->index_path = g_build_filename(folder, ACTIVITY_INDEX_FILE_NAME,
+			NULL);
+	self->entries_by_name = g_hash_table_new(g_str_hash, g_str_equal);
+	activity_index_set_entries(self,
+			activity_index_read(self->folder, self->index_path));
+
+	DEBUG_END();
+	return self;
+}
+
+void activity_index_free(ActivityIndex *self)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	if(self->scan_job)
+	{
+		/* Let the scan complete, but do not touch the index anymore */
+		self->scan_job->index = NULL;
+	}
+
+	g_hash_table_destroy(self->entries_by_name);
+	g_ptr_array_foreach(self->entries, (GFunc)activity_index_entry_free,
+			NULL);
+	g_ptr_array_free(self->entries, TRUE);
+	g_free(self->index_path);
+	g_free(self->folder);
+	g_free(self);
+
+	DEBUG_END();
+}
+
+void activity_index_set_callback(
+		ActivityIndex *self,
+		ActivityIndexCallback callback,
+		gpointer user_data)
+{
+	g_return_if_fail(self != NULL);
+
+	self->callback = callback;
+	self->user_data = user_data;
+}
+
+void activity_index_scan(ActivityIndex *self)
+{
+	ActivityIndexScanJob *job = NULL;
+	ActivityIndexEntry *entry = NULL;
+	GError *error = NULL;
+	guint i;
+
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	if(self->scan_job)
+	{
+		self->rescan = TRUE;
+		DEBUG_END();
+		return;
+	}
+
+	if(!activity_index_scanner)
+	{
+		activity_index_scanner = g_thread_pool_new(
+				activity_index_scanner_func,
+				NULL,
+				1,
+				FALSE,
+				&error);
+		if(!activity_index_scanner)
+		{
+			g_warning("Unable to start the activity scanner: %s",
+					error->message);
+			g_error_free(error);
+			DEBUG_END();
+			return;
+		}
+	}
+
+	job = g_new0(ActivityIndexScanJob, 1);
+	job->index = self;
+	job->folder = g_strdup(self->folder);
+	job->index_path = g_strdup(self->index_path);
+	job->known = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+			(GDestroyNotify)activity_index_entry_free);
+	for(i = 0; i < self->entries->len; i++)
+	{
+		entry = activity_index_entry_copy(
+				g_ptr_array_index(self->entries, i));
+		g_hash_table_insert(job->known,
+				(gpointer)activity_index_entry_get_name(entry),
+				entry);
+	}
+	job->entries = g_ptr_array_new();
+
+	self->scan_job = job;
+	self->rescan = FALSE;
+	g_thread_pool_push(activity_index_scanner, job, NULL);
+
+	DEBUG_END();
+}
+
+guint activity_index_get_count(ActivityIndex *self)
+{
+	g_return_val_if_fail(self != NULL, 0);
+	return self->entries->len;
+}
+
+const ActivityIndexEntry *activity_index_get_entry(
+		ActivityIndex *self,
+		guint i)
+{
+	g_return_val_if_fail(self != NULL, NULL);
+	g_return_val_if_fail(i < self->entries->len, NULL);
+	return g_ptr_array_index(self->entries, i);
+}
+
+const ActivityIndexEntry *activity_index_lookup(
+		ActivityIndex *self,
+		const gchar *path)
+{
+	ActivityIndexEntry *entry = NULL;
+	gchar *name = NULL;
+
+	g_return_val_if_fail(self != NULL, NULL);
+	g_return_val_if_fail(path != NULL, NULL);
+
+	name = g_path_get_basename(path);
+	entry = g_hash_table_lookup(self->entries_by_name, name);
+	g_free(name);
+
+	/* The file might have the same name but be in another folder */
+	if(entry && strcmp(entry->path, path) != 0)
+	{
+		return NULL;
+	}
+
+	return entry;
+}
+
+void activity_index_get_totals(
+		ActivityIndex *self,
+		ActivityIndexTotals *totals)
+{
+	ActivityIndexEntry *entry = NULL;
+	gdouble heart_rate_sum = 0;
+	guint heart_rates = 0;
+	guint i;
+
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(totals != NULL);
+	DEBUG_BEGIN();
+
+	memset(totals, 0, sizeof(ActivityIndexTotals));
+	for(i = 0; i < self->entries->len; i++)
+	{
+		entry = g_ptr_array_index(self->entries, i);
+		totals->activities++;
+		totals->distance += entry->summary.distance;
+		totals->duration += entry->summary.end_time.tv_sec -
+			entry->summary.start_time.tv_sec;
+		heart_rate_sum += entry->summary.heart_rate_average *
+			entry->summary.heart_rates;
+		heart_rates += entry->summary.heart_rates;
+	}
+
+	if(heart_rates > 0)
+	{
+		totals->heart_rate_average = heart_rate_sum / heart_rates;
+	}
+
+	DEBUG_END();
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static ActivityIndexEntry *activity_index_entry_copy(
+		const ActivityIndexEntry *entry)
+{
+	ActivityIndexEntry *copy = NULL;
+
+	copy = g_new(ActivityIndexEntry, 1);
+	*copy = *entry;
+	copy->path = g_strdup(entry->path);
+
+	return copy;
+}
+
+static void activity_index_entry_free(ActivityIndexEntry *entry)
+{
+	g_return_if_fail(entry != NULL);
+
+	g_free(entry->path);
+	g_free(entry);
+}
+
+static const gchar *activity_index_entry_get_name(
+		const ActivityIndexEntry *entry)
+{
+	const gchar *name = NULL;
+
+	name = strrchr(entry->path, G_DIR_SEPARATOR);
+	return name ? name + 1 : entry->path;
+}
+
+static void activity_index_set_entries(
+		ActivityIndex *self,
+		GPtrArray *entries)
+{
+	ActivityIndexEntry *entry = NULL;
+	guint i;
+
+	g_hash_table_remove_all(self->entries_by_name);
+	if(self->entries)
+	{
+		g_ptr_array_foreach(self->entries,
+				(GFunc)activity_index_entry_free, NULL);
+		g_ptr_array_free(self->entries, TRUE);
+	}
+
+	g_ptr_array_sort(entries, activity_index_compare_entries);
+	self->entries = entries;
+
+	for(i = 0; i < entries->len; i++)
+	{
+		entry = g_ptr_array_index(entries, i);
+		g_hash_table_insert(self->entries_by_name,
+				(gpointer)activity_index_entry_get_name(entry),
+				entry);
+	}
+}
+
+static gint activity_index_compare_entries(gconstpointer a, gconstpointer b)
+{
+	const ActivityIndexEntry *entry_a = *(ActivityIndexEntry **)a;
+	const ActivityIndexEntry *entry_b = *(ActivityIndexEntry **)b;
+
+	if(entry_a->summary.start_time.tv_sec !=
+			entry_b->summary.start_time.tv_sec)
+	{
+		return entry_a->summary.start_time.tv_sec <
+			entry_b->summary.start_time.tv_sec ? 1 : -1;
+	}
+	return strcmp(entry_a->path, entry_b->path);
+}
+
+static GPtrArray *activity_index_read(
+		const gchar *folder,
+		const gchar *index_path)
+{
+	GKeyFile *key_file = NULL;
+	GPtrArray *entries = NULL;
+	ActivityIndexEntry *entry = NULL;
+	GpxBinarySummary *summary = NULL;
+	GError *error = NULL;
+	gchar **groups = NULL;
+	gint version;
+	guint i;
+
+	DEBUG_BEGIN();
+
+	entries = g_ptr_array_new();
+
+	key_file = g_key_file_new();
+	if(!g_key_file_load_from_file(key_file, index_path, G_KEY_FILE_NONE,
+				NULL))
+	{
+		/* The folder has not been indexed yet */
+		g_key_file_free(key_file);
+		DEBUG_END();
+		return entries;
+	}
+
+	version = g_key_file_get_integer(key_file,
+			ACTIVITY_INDEX_GROUP_HEADER,
+			ACTIVITY_INDEX_KEY_VERSION,
+			NULL);
+	if(version != ACTIVITY_INDEX_VERSION)
+	{
+		g_key_file_free(key_file);
+		DEBUG_END();
+		return entries;
+	}
+
+	groups = g_key_file_get_groups(key_file, NULL);
+	for(i = 0; groups[i]; i++)
+	{
+		if(strcmp(groups[i], ACTIVITY_INDEX_GROUP_HEADER) == 0)
+		{
+			continue;
+		}
+
+		entry = g_new0(ActivityIndexEntry, 1);
+		summary = &entry->summary;
+		entry->path = g_build_filename(folder, groups[i], NULL);
+		entry->mtime = activity_index_get_int64(key_file, groups[i],
+				ACTIVITY_INDEX_KEY_MTIME, &error);
+		entry->size = activity_index_get_int64(key_file, groups[i],
+				ACTIVITY_INDEX_KEY_SIZE, &error);
+		summary->tracks = activity_index_get_int64(key_file,
+				groups[i], ACTIVITY_INDEX_KEY_TRACKS, &error);
+		summary->points = activity_index_get_int64(key_file,
+				groups[i], ACTIVITY_INDEX_KEY_POINTS, &error);
+		summary->heart_rates = activity_index_get_int64(key_file,
+				groups[i], ACTIVITY_INDEX_KEY_HEART_RATES,
+				&error);
+		summary->start_time.tv_sec = activity_index_get_int64(
+				key_file, groups[i], ACTIVITY_INDEX_KEY_START,
+				&error);
+		summary->end_time.tv_sec = activity_index_get_int64(
+				key_file, groups[i], ACTIVITY_INDEX_KEY_END,
+				&error);
+		summary->distance = g_key_file_get_double(key_file,
+				groups[i], ACTIVITY_INDEX_KEY_DISTANCE,
+				error ? NULL : &error);
+		summary->heart_rate_min = g_key_file_get_integer(key_file,
+				groups[i], ACTIVITY_INDEX_KEY_HR_MIN,
+				error ? NULL : &error);
+		summary->heart_rate_max = g_key_file_get_integer(key_file,
+				groups[i], ACTIVITY_INDEX_KEY_HR_MAX,
+				error ? NULL : &error);
+		summary->heart_rate_average = g_key_file_get_double(key_file,
+				groups[i], ACTIVITY_INDEX_KEY_HR_AVG,
+				error ? NULL : &error);
+
+		if(error)
+		{
+			/* The file will be summarized again */
+			DEBUG("Invalid index entry for %s: %s", groups[i],
+					error->message);
+			g_error_free(error);
+			error = NULL;
+			activity_index_entry_free(entry);
+			continue;
+		}
+
+		g_ptr_array_add(entries, entry);
+	}
+
+	g_strfreev(groups);
+	g_key_file_free(key_file);
+
+	DEBUG_END();
+	return entries;
+}
+
+static gboolean activity_index_write(
+		const gchar *index_path,
+		GPtrArray *entries,
+		GError **error)
+{
+	GKeyFile *key_file = NULL;
+	ActivityIndexEntry *entry = NULL;
+	GpxBinarySummary *summary = NULL;
+	gchar *name = NULL;
+	gchar *data = NULL;
+	gsize length = 0;
+	gboolean success = FALSE;
+	guint i;
+
+	DEBUG_BEGIN();
+
+	key_file = g_key_file_new();
+	g_key_file_set_integer(key_file, ACTIVITY_INDEX_GROUP_HEADER,
+			ACTIVITY_INDEX_KEY_VERSION, ACTIVITY_INDEX_VERSION);
+
+	for(i = 0; i < entries->len; i++)
+	{
+		entry = g_ptr_array_index(entries, i);
+		summary = &entry->summary;
+		name = g_path_get_basename(entry->path);
+
+		activity_index_set_int64(key_file, name,
+				ACTIVITY_INDEX_KEY_MTIME, entry->mtime);
+		activity_index_set_int64(key_file, name,
+				ACTIVITY_INDEX_KEY_SIZE, entry->size);
+		g_key_file_set_integer(key_file, name,
+				ACTIVITY_INDEX_KEY_TRACKS, summary->tracks);
+		g_key_file_set_integer(key_file, name,
+				ACTIVITY_INDEX_KEY_POINTS, summary->points);
+		g_key_file_set_integer(key_file, name,
+				ACTIVITY_INDEX_KEY_HEART_RATES,
+				summary->heart_rates);
+		activity_index_set_int64(key_file, name,
+				ACTIVITY_INDEX_KEY_START,
+				summary->start_time.tv_sec);
+		activity_index_set_int64(key_file, name,
+				ACTIVITY_INDEX_KEY_END,
+				summary->end_time.tv_sec);
+		g_key_file_set_double(key_file, name,
+				ACTIVITY_INDEX_KEY_DISTANCE,
+				summary->distance);
+		g_key_file_set_integer(key_file, name,
+				ACTIVITY_INDEX_KEY_HR_MIN,
+				summary->heart_rate_min);
+		g_key_file_set_integer(key_file, name,
+				ACTIVITY_INDEX_KEY_HR_MAX,
+				summary->heart_rate_max);
+		g_key_file_set_double(key_file, name,
+				ACTIVITY_INDEX_KEY_HR_AVG,
+				summary->heart_rate_average);
+
+		g_free(name);
+	}
+
+	data = g_key_file_to_data(key_file, &length, NULL);
+	success = g_file_set_contents(index_path, data, length, error);
+
+	g_free(data);
+	g_key_file_free(key_file);
+
+	DEBUG_END();
+	return success;
+}
+
+static gboolean activity_index_summarize(
+		const gchar *path,
+		GpxBinarySummary *summary)
+{
+	GpxBinary *binary = NULL;
+	GpxParserStatus status;
+	GError *error = NULL;
+
+	DEBUG_BEGIN();
+
+	if(gpx_binary_read_summary(path, summary, &error))
+	{
+		DEBUG_END();
+		return TRUE;
+	}
+	if(error)
+	{
+		g_error_free(error);
+		error = NULL;
+	}
+
+	binary = gpx_binary_new();
+	status = gpx_parser_parse_file_batched(path, gpx_binary_add, binary,
+			&error);
+	if(status == GPX_PARSER_STATUS_FAILED)
+	{
+		DEBUG("Unable to index %s: %s", path, error->message);
+		g_error_free(error);
+		gpx_binary_free(binary);
+		DEBUG_END();
+		return FALSE;
+	}
+	if(error)
+	{
+		g_error_free(error);
+	}
+
+	gpx_binary_get_summary(binary, summary);
+	gpx_binary_free(binary);
+
+	DEBUG_END();
+	return TRUE;
+}
+
+static void activity_index_scanner_func(gpointer data, gpointer user_data)
+{
+	ActivityIndexScanJob *job = (ActivityIndexScanJob *)data;
+	ActivityIndexEntry *entry = NULL;
+	ActivityIndexEntry *known = NULL;
+	struct stat file_stat;
+	GDir *dir = NULL;
+	GError *error = NULL;
+	const gchar *name = NULL;
+	gchar *path = NULL;
+
+	g_return_if_fail(job != NULL);
+	DEBUG_BEGIN();
+
+	dir = g_dir_open(job->folder, 0, NULL);
+	while(dir && (name = g_dir_read_name(dir)) != NULL)
+	{
+		if(!g_str_has_suffix(name, ".gpx"))
+		{
+			continue;
+		}
+
+		path = g_build_filename(job->folder, name, NULL);
+		if(g_stat(path, &file_stat) < 0 ||
+				!S_ISREG(file_stat.st_mode))
+		{
+			g_free(path);
+			continue;
+		}
+
+		known = g_hash_table_lookup(job->known, name);
+		if(known && known->mtime == file_stat.st_mtime &&
+				known->size == file_stat.st_size)
+		{
+			g_hash_table_steal(job->known, name);
+			g_ptr_array_add(job->entries, known);
+			g_free(path);
+			continue;
+		}
+
+		entry = g_new0(ActivityIndexEntry, 1);
+		entry->path = path;
+		entry->mtime = file_stat.st_mtime;
+		entry->size = file_stat.st_size;
+		if(!activity_index_summarize(path, &entry->summary))
+		{
+			activity_index_entry_free(entry);
+			continue;
+		}
+		g_ptr_array_add(job->entries, entry);
+		job->changed = TRUE;
+	}
+	if(dir)
+	{
+		g_dir_close(dir);
+	}
+
+	/* Anything left was removed or could not be summarized anymore */
+	if(g_hash_table_size(job->known) > 0)
+	{
+		job->changed = TRUE;
+	}
+
+	if(job->changed && !activity_index_write(job->index_path,
+				job->entries, &error))
+	{
+		g_warning("Unable to write the activity index: %s",
+				error->message);
+		g_error_free(error);
+	}
+
+	g_idle_add(activity_index_scan_done, job);
+
+	DEBUG_END();
+}
+
+static gboolean activity_index_scan_done(gpointer user_data)
+{
+	ActivityIndexScanJob *job = (ActivityIndexScanJob *)user_data;
+	ActivityIndex *self = NULL;
+
+	g_return_val_if_fail(job != NULL, FALSE);
+	DEBUG_BEGIN();
+
+	self = job->index;
+	if(self)
+	{
+		self->scan_job = NULL;
+		if(job->changed)
+		{
+			activity_index_set_entries(self, job->entries);
+			job->entries = NULL;
+		}
+
+		if(self->callback)
+		{
+			self->callback(self, job->changed, self->user_data);
+		}
+
+		if(self->rescan)
+		{
+			activity_index_scan(self);
+		}
+	}
+
+	activity_index_scan_job_free(job);
+
+	DEBUG_END();
+	return FALSE;
+}
+
+static void activity_index_scan_job_free(ActivityIndexScanJob *job)
+{
+	g_return_if_fail(job != NULL);
+
+	g_hash_table_destroy(job->known);
+	if(job->entries)
+	{
+		g_ptr_array_foreach(job->entries,
+				(GFunc)activity_index_entry_free, NULL);
+		g_ptr_array_free(job->entries, TRUE);
+	}
+	g_free(job->index_path);
+	g_free(job->folder);
+	g_free(job);
+}
+
+static gint64 activity_index_get_int64(
+		GKeyFile *key_file,
+		const gchar *group,
+		const gchar *key,
+		GError **error)
+{
+	gchar *value = NULL;
+	gchar *end = NULL;
+	gint64 result = 0;
+
+	/* Only the first error is reported */
+	if(*error)
+	{
+		return 0;
+	}
+
+	value = g_key_file_get_value(key_file, group, key, error);
+	if(!value)
+	{
+		return 0;
+	}
+
+	result = g_ascii_strtoll(value, &end, 10);
+	if(end == value || *end != '\0')
+	{
+		g_set_error(error, G_KEY_FILE_ERROR,
+				G_KEY_FILE_ERROR_INVALID_VALUE,
+				"Invalid value for %s: %s", key, value);
+	}
+	g_free(value);
+
+	return result;
+}
+
+static void activity_index_set_int64(
+		GKeyFile *key_file,
+		const gchar *group,
+		const gchar *key,
+		gint64 value)
+{
+	gchar buf[32];
+
+	g_snprintf(buf, sizeof(buf), "%" G_GINT64_FORMAT, value);
+	g_key_file_set_value(key_file, group, key, buf);
+}
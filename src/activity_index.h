@@ -0,0 +1,208 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi, Sampo Savola
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/**
+ * @file activity_index.h
+ *
+ * @brief Index of the activities in a folder, with a summary of each
+ *
+ * The summaries (start time, duration, distance, heart rates) of all GPX
+ * files in the folder are kept in a single key file in the folder
+ * (#ACTIVITY_INDEX_FILE_NAME), one group per GPX file:
+ *
+ * <pre>
+ * [2009-06-01-Running.gpx]
+ * mtime=1243865400
+ * size=125362
+ * start=1243861800
+ * ...
+ * </pre>
+ *
+ * The index is updated by activity_index_scan() in a background thread.
+ * Only the GPX files whose size or modification time have changed are
+ * parsed again, so listing the activities and computing totals never
+ * needs to read the GPX files themselves.
+ */
+
+#ifndef _ACTIVITY_INDEX_H
+#define _ACTIVITY_INDEX_H
+
+/* Configuration */
+#include "config.h"
+
+/* GLib */
+#include <glib.h>
+
+/* Other modules */
+#include "gpx_binary.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+#define ACTIVITY_INDEX_FILE_NAME	".ecoach_index"
+#define ACTIVITY_INDEX_VERSION		1
+
+/*****************************************************************************
+ * Data structures                                                           *
+ *****************************************************************************/
+
+typedef struct _ActivityIndex ActivityIndex;
+
+typedef struct _ActivityIndexEntry {
+	/** @brief Full path of the GPX file */
+	gchar *path;
+
+	/** @brief Modification time of the GPX file when it was indexed */
+	gint64 mtime;
+
+	/** @brief Size of the GPX file when it was indexed */
+	gint64 size;
+
+	/**
+	 * @brief Summary of the tracks in the file. The times are stored
+	 * with a precision of one second.
+	 */
+	GpxBinarySummary summary;
+} ActivityIndexEntry;
+
+typedef struct _ActivityIndexTotals {
+	guint activities;
+
+	/** @brief Total duration in seconds */
+	gdouble duration;
+
+	/** @brief Total distance in meters */
+	gdouble distance;
+
+	/** @brief Average of all heart rates, or 0 if there are none */
+	gdouble heart_rate_average;
+} ActivityIndexTotals;
+
+/**
+ * @brief Function to call when a scan has completed
+ *
+ * @param index Pointer to #ActivityIndex
+ * @param changed Whether any activities were added, updated or removed
+ * @param user_data User data that was given with the callback
+ */
+typedef void (*ActivityIndexCallback)(
+		ActivityIndex *index,
+		gboolean changed,
+		gpointer user_data);
+
+/*****************************************************************************
+ * Function prototypes                                                       *
+ *****************************************************************************/
+
+/**
+ * @brief Create an index of a folder, and read the existing index file
+ *
+ * The index is not scanned; call activity_index_scan() to bring it up to
+ * date.
+ *
+ * @param folder The folder whose activities to index
+ *
+ * @return Newly allocated #ActivityIndex
+ */
+ActivityIndex *activity_index_new(const gchar *folder);
+
+/**
+ * @brief Free an index
+ *
+ * A scan that is in progress is completed in the background, but the
+ * callback is not called anymore.
+ *
+ * @param self Pointer to #ActivityIndex
+ */
+void activity_index_free(ActivityIndex *self);
+
+/**
+ * @brief Set the function to call when a scan has completed
+ *
+ * @param self Pointer to #ActivityIndex
+ * @param callback The callback, or NULL
+ * @param user_data User data to pass to the callback
+ */
+void activity_index_set_callback(
+		ActivityIndex *self,
+		ActivityIndexCallback callback,
+		gpointer user_data);
+
+/**
+ * @brief Update the index in a background thread
+ *
+ * New and changed GPX files are summarized and removed files are dropped,
+ * and the index file is written if anything changed. The entries are
+ * replaced in the main loop when the scan completes. If a scan is already
+ * in progress, another one is done after it.
+ *
+ * @param self Pointer to #ActivityIndex
+ */
+void activity_index_scan(ActivityIndex *self);
+
+/**
+ * @brief Get the amount of activities in the index
+ *
+ * @param self Pointer to #ActivityIndex
+ *
+ * @return Amount of activities
+ */
+guint activity_index_get_count(ActivityIndex *self);
+
+/**
+ * @brief Get an activity, newest first
+ *
+ * @param self Pointer to #ActivityIndex
+ * @param i Index of the activity, less than activity_index_get_count()
+ *
+ * @return The activity. It is valid until the next scan completes or the
+ * index is freed.
+ */
+const ActivityIndexEntry *activity_index_get_entry(
+		ActivityIndex *self,
+		guint i);
+
+/**
+ * @brief Find the activity of a GPX file
+ *
+ * @param self Pointer to #ActivityIndex
+ * @param path Path of the GPX file
+ *
+ * @return The activity or NULL if the file is not indexed. It is valid
+ * until the next scan completes or the index is freed.
+ */
+const ActivityIndexEntry *activity_index_lookup(
+		ActivityIndex *self,
+		const gchar *path);
+
+/**
+ * @brief Compute the totals of all activities
+ *
+ * @param self Pointer to #ActivityIndex
+ * @param totals Return location for the totals
+ */
+void activity_index_get_totals(
+		ActivityIndex *self,
+		ActivityIndexTotals *totals);
+
+#endif /* _ACTIVITY_INDEX_H */
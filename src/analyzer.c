@@ -27,6 +27,15 @@
 #define ANALYZER_VIEW_HEIGHT	325
 #define ANALYZER_VIEW_WIDTH	760
 
+/** @brief Amount of intervals that the speed in a waypoint is averaged from */
+#define ANALYZER_VIEW_SPEED_WINDOW	5
+
+/**
+ * @brief Altitude change (in metres) that is needed before it counts to the
+ * ascent or descent. This filters out the noise in the GPS altitudes.
+ */
+#define ANALYZER_VIEW_ALTITUDE_THRESHOLD	5.0
+
 /*****************************************************************************
  * Includes                                                                  *
  *****************************************************************************/
@@ -80,11 +89,53 @@ typedef enum
  * Data structures                                                           *
  *****************************************************************************/
 
+/**
+ * @brief The points of a graph series that fall on one pixel column
+ */
+typedef struct _AnalyzerViewGraphColumn {
+	/** @brief Amount of points in the column */
+	guint count;
+
+	/** @brief Whether or not the line is broken before this column */
+	gboolean new_line;
+
+	/**
+	 * @brief Whether or not the line is broken after this column. This
+	 * is set when a break falls on a column that already has points.
+	 */
+	gboolean break_after;
+
+	gdouble first;
+	gdouble last;
+	gdouble min;
+	gdouble max;
+} AnalyzerViewGraphColumn;
+
+/**
+ * @brief A graph series decimated to columns
+ *
+ * Drawing a series only needs the first, last, minimum and maximum value
+ * in each column, so a track with tens of thousands of points can be
+ * redrawn in time that depends only on the amount of columns. There is a
+ * column for each pixel of the width of the view, and the columns are
+ * scaled to the width of the graph when drawn, so they stay valid when
+ * the graph area changes with the shown scales.
+ */
+typedef struct _AnalyzerViewGraphSeries {
+	/** @brief Amount of columns */
+	gint width;
+
+	/** @brief Array of #AnalyzerViewGraphColumn, or NULL if not created */
+	GArray *columns;
+} AnalyzerViewGraphSeries;
+
 typedef struct _AnalyzerViewTrack {
 	/* These come directly from the parser */
 	gchar *name;
 	gchar *comment;
 	gint number;
+
+	/** @brief Time per kilometre while moving (duration / distance) */
 	gchar *min_per_km;
 
 	/** @brief A list to pointers of type AnalyzerViewTrackSegment */
@@ -109,15 +160,18 @@ typedef struct _AnalyzerViewTrack {
 	/**
 	 * @brief Duration of the track
 	 *
-	 * This is the duration of the track, excluding all pauses between
-	 * track segments
+	 * This is the sum of the durations of the track segments, so the
+	 * pauses between the track segments are not included. It can thus
+	 * be shorter than the time from start_time to end_time. The average
+	 * speed, the time per kilometre and the time axis of the graphs are
+	 * all based on this duration.
 	 */
 	struct timeval duration;
 
 	/** @brief Travelled distance in metres */
 	gdouble distance;
 
-	/** @brief Average speed in km/h */
+	/** @brief Average speed while moving (distance / duration) in km/h */
 	gdouble speed_avg;
 
 	/** @brief Maximum sustained speed */
@@ -135,6 +189,12 @@ typedef struct _AnalyzerViewTrack {
 	/** @brief Minimum altitude in metres */
 	gdouble altitude_min;
 
+	/** @brief Total ascent, in the same unit as the altitudes */
+	gdouble altitude_gain;
+
+	/** @brief Total descent, in the same unit as the altitudes */
+	gdouble altitude_loss;
+
 	/**
 	 * @brief Whether or not the minimum and maximum heart rates
 	 * are sane
@@ -155,64 +215,89 @@ typedef struct _AnalyzerViewTrack {
 
 	/** @brief Minimum heart rate */
 	gint heart_rate_min;
+
+	/* Graph series, decimated when the graphs are first drawn with a
+	 * given width */
+	AnalyzerViewGraphSeries graph_speed;
+	AnalyzerViewGraphSeries graph_altitude;
+	AnalyzerViewGraphSeries graph_heart_rate;
 } AnalyzerViewTrack;
 
 typedef struct _AnalyzerViewTrackSegment {
 	/** @brief Whether or not the time values are set */
 	gboolean times_set;
 
+	/**
+	 * @brief Times of the earliest and the latest track point or heart
+	 * rate of the track segment
+	 */
 	struct timeval start_time;
 	struct timeval end_time;
+
+	/** @brief Time from start_time to end_time */
 	struct timeval duration;
 
-	/**
-	 * @brief List of waypoints associated with this track segment
-	 *
-	 * The pointers are of type AnalyzerViewWaypoint
+	/*
+	 * The track points and heart rates are stored as columns: the items
+	 * with the same index in the arrays belong to the same point. This
+	 * keeps the memory use per point small and the loops simple.
 	 */
-	GSList *track_points;
 
-	/**
-	 * @brief List of heart rates associated with this track segment
-	 *
-	 * The pointers are of type AnalyzerViewHeartRate
-	 */
-	GSList *heart_rates;
-} AnalyzerViewTrackSegment;
+	/** @brief Times of the track points (gint64, ms from Epoch) */
+	GArray *times;
 
-/**
- * @brief Waypoint structure used in analyzer view
- *
- * This structure is quite similar to the #GpxStorageWaypoint, but has
- * some additional statistics
- */
-typedef struct _AnalyzerViewWaypoint {
-	GpxStoragePointType point_type;
+	/** @brief Latitudes of the track points (gdouble) */
+	GArray *latitudes;
 
-	gdouble latitude;
-	gdouble longitude;
+	/** @brief Longitudes of the track points (gdouble) */
+	GArray *longitudes;
 
-	gboolean altitude_is_set;
-	gdouble altitude;
+	/** @brief Altitudes of the track points (gdouble), NAN if not set */
+	GArray *altitudes;
 
-	struct timeval timestamp;
+	/** @brief Distances to the previous track points in metres (gdouble) */
+	GArray *distances;
 
-	gdouble distance_to_prev;
-	struct timeval time_to_prev;
+	/** @brief Slightly averaged speeds in the track points (gdouble) */
+	GArray *speeds;
 
-	/* Slightly averaged speed in the waypoint */
-	gdouble speed_averaged;
-} AnalyzerViewWaypoint;
+	/** @brief Times of the heart rates (gint64, ms from Epoch) */
+	GArray *heart_rate_times;
 
-/**
- * @brief Heart rate structure used in analyzer view
- *
- * This structure is at the moment exactly like #GpxParserDataHeartRate
- */
-typedef struct _AnalyzerViewHeartRate {
-	struct timeval timestamp;
-	gint value;
-} AnalyzerViewHeartRate;
+	/** @brief Heart rates in beats per minute (gint) */
+	GArray *heart_rates;
+
+	/* The rest is the state of the analysis, which is done while the
+	 * track segment is being parsed */
+
+	/** @brief Whether or not the track segment has been analyzed */
+	gboolean is_analyzed;
+
+	/** @brief Whether or not the altitude reference is set */
+	gboolean altitude_reference_set;
+
+	/** @brief Altitude that the ascent and descent are measured from */
+	gdouble altitude_reference;
+
+	/** @brief Distances between the latest track points in metres */
+	gdouble speed_distances[ANALYZER_VIEW_SPEED_WINDOW];
+
+	/** @brief Times between the latest track points in seconds */
+	gdouble speed_times[ANALYZER_VIEW_SPEED_WINDOW];
+
+	/** @brief Index of the oldest item, once the window is full */
+	guint speed_next;
+
+	/** @brief Amount of items in the window */
+	guint speed_count;
+
+	/**
+	 * @brief Amount of track points at the beginning of the track
+	 * segment, which get their speed when the speed window has been
+	 * filled (or the track segment ends)
+	 */
+	guint speed_pending;
+} AnalyzerViewTrackSegment;
 
 typedef struct _AnalyzerViewColor {
 	double r;
@@ -361,6 +446,13 @@ static void analyzer_view_destroy_widget(
  */
 static void analyzer_view_clear_data(AnalyzerView *self);
 
+/**
+ * @brief Add the points of the parsed track segment to the map
+ *
+ * @param self Pointer to #AnalyzerView
+ */
+static void analyzer_view_map_segment_flush(AnalyzerView *self);
+
 /**
  * @brief Callback for the GPX parser
  *
@@ -414,39 +506,112 @@ static void analyzer_view_add_heart_rate(
 		GpxParserDataHeartRate *parser_heart_rate);
 
 /**
- * @brief Analyze details of a track
+ * @brief Finish the analysis of a track. After this, all the details of the
+ * track are known.
  *
  * @param self Pointer to #AnalyzerView
- * @param track Pointer to the track to be analyzed
+ * @param track Pointer to the track
  */
-static void analyzer_view_analyze_track(
+static void analyzer_view_finish_track(
 		AnalyzerView *self,
 		AnalyzerViewTrack *track);
 
 /**
- * @brief Analyze details of a track segment
+ * @brief Finish the analysis of a track segment
  *
  * @param self Pointer to #AnalyzerView
  * @param track Pointer to the track where the track segment is
- * @param track_segment Pointer to the track segment to analyze
+ * @param track_segment Pointer to the track segment
  */
-static void analyzer_view_analyze_track_segment(
+static void analyzer_view_finish_track_segment(
 		AnalyzerView *self,
 		AnalyzerViewTrack *track,
 		AnalyzerViewTrackSegment *track_segment);
 
 /**
- * @brief Analyze heart rate information of a given track segment
+ * @brief Create a new track segment with empty point columns
+ *
+ * @return Newly allocated track segment. Free with
+ * analyzer_view_track_segment_free()
+ */
+static AnalyzerViewTrackSegment *analyzer_view_track_segment_new();
+
+/**
+ * @brief Free a track segment and its point columns
+ *
+ * @param track_segment Pointer to the track segment
+ */
+static void analyzer_view_track_segment_free(
+		AnalyzerViewTrackSegment *track_segment);
+
+/**
+ * @brief Extend the start and end times of a track segment to a time stamp
+ *
+ * @param track_segment Pointer to the track segment
+ * @param timestamp The time stamp
+ */
+static void analyzer_view_track_segment_add_time(
+		AnalyzerViewTrackSegment *track_segment,
+		const struct timeval *timestamp);
+
+/**
+ * @brief Get the position of a time on the time axis of the graphs
+ *
+ * The time axis is as long as the duration of the track. Each track
+ * segment starts where the previous one ended, so the pauses between the
+ * track segments are left out.
+ *
+ * @param track_segment Pointer to the track segment where the time is
+ * @param segment_offset Seconds of the track before the track segment
+ * @param time Time in milliseconds from Epoch
+ *
+ * @return Seconds from the start of the time axis
+ */
+static gdouble analyzer_view_track_segment_graph_time(
+		AnalyzerViewTrackSegment *track_segment,
+		gdouble segment_offset,
+		gint64 time);
+
+/**
+ * @brief Compute an average speed from the speed window of a track segment
+ *
+ * @param self Pointer to #AnalyzerView
+ * @param track_segment Pointer to the track segment
+ * @param count Amount of the oldest items in the window to use
+ *
+ * @return The speed in km/h or mph, depending on the units
+ */
+static gdouble analyzer_view_track_segment_speed(
+		AnalyzerView *self,
+		AnalyzerViewTrackSegment *track_segment,
+		guint count);
+
+/**
+ * @brief Analyze the newest track point of a track segment
  *
  * @param self Pointer to #AnalyzerView
  * @param track Pointer to the track where the track segment is
- * @param track_segment Pointer to the track segment to analyze
+ * @param track_segment Pointer to the track segment
  */
-static void analyzer_view_analyze_track_segment_heart_rates(
+static void analyzer_view_analyze_track_point(
 		AnalyzerView *self,
 		AnalyzerViewTrack *track,
 		AnalyzerViewTrackSegment *track_segment);
 
+/**
+ * @brief Analyze the newest heart rate of a track segment
+ *
+ * @param self Pointer to #AnalyzerView
+ * @param track Pointer to the track where the track segment is
+ * @param track_segment Pointer to the track segment
+ * @param timestamp Time of the heart rate
+ */
+static void analyzer_view_analyze_heart_rate(
+		AnalyzerView *self,
+		AnalyzerViewTrack *track,
+		AnalyzerViewTrackSegment *track_segment,
+		const struct timeval *timestamp);
+
 /**
  * @brief Display information of a given track
  *
@@ -505,6 +670,78 @@ static gboolean analyzer_view_graphs_drawing_area_exposed(
 		GdkEventExpose *event,
 		gpointer user_data);
 
+/**
+ * @brief Render the graph layers for the shown graphs
+ *
+ * The base layer with the axes, the legends and the scales is always
+ * rendered, because the layout depends on which graphs are shown. The line
+ * of a graph is only drawn if its layer is not already drawn for the same
+ * graph area. The lines are drawn from the decimated series, which do not
+ * depend on the graph area, so this takes time that depends only on the
+ * width of the view.
+ *
+ * @param self Pointer to #AnalyzerView
+ * @param details Size, track and colors of the graphs, and which graphs
+ * to show. The graphs that cannot be drawn are set not to be shown.
+ */
+static void analyzer_view_create_graph_layers(
+		AnalyzerView *self,
+		AnalyzerViewPixbufDetails *details);
+
+/**
+ * @brief Tell whether a line layer is drawn for a graph area
+ *
+ * @param self Pointer to #AnalyzerView
+ * @param layer The layer
+ * @param graph_area Area of the graph
+ *
+ * @return TRUE if the layer exists and is drawn for the graph area
+ */
+static gboolean analyzer_view_graph_layer_is_valid(
+		AnalyzerView *self,
+		AnalyzerViewGraphLayer layer,
+		GdkRectangle *graph_area);
+
+/**
+ * @brief Create a graph layer surface and a context for drawing to it
+ *
+ * @param self Pointer to #AnalyzerView
+ * @param details Size of the graphs
+ * @param layer The layer to create
+ *
+ * @return Cairo context with the graph font set. Destroy with
+ * cairo_destroy(); the surface is kept in the #AnalyzerView.
+ */
+static cairo_t *analyzer_view_create_graph_layer(
+		AnalyzerView *self,
+		AnalyzerViewPixbufDetails *details,
+		AnalyzerViewGraphLayer layer);
+
+/**
+ * @brief Free a cached graph layer
+ *
+ * @param self Pointer to #AnalyzerView
+ * @param layer The layer to free
+ */
+static void analyzer_view_destroy_graph_layer(
+		AnalyzerView *self,
+		AnalyzerViewGraphLayer layer);
+
+/**
+ * @brief Free the cached graph layers
+ *
+ * @param self Pointer to #AnalyzerView
+ */
+static void analyzer_view_destroy_graph_layers(AnalyzerView *self);
+
+/**
+ * @brief Compose the graph layers of the shown graphs to a pixbuf
+ *
+ * @param self Pointer to #AnalyzerView
+ * @param details The graphs to show
+ *
+ * @return The pixbuf, or NULL if the layers have not been created
+ */
 static GdkPixbuf *analyzer_view_create_pixbuf(
 		AnalyzerView *self,
 		AnalyzerViewPixbufDetails *details);
@@ -552,11 +789,79 @@ static void analyzer_view_draw_heart_rate(
 		GdkRectangle *graph_area,
 		gdouble pixels_per_unit);
 
+/**
+ * @brief Empty a graph series and set its amount of columns
+ *
+ * @param series Pointer to #AnalyzerViewGraphSeries
+ * @param width Amount of columns
+ */
+static void analyzer_view_graph_series_reset(
+		AnalyzerViewGraphSeries *series,
+		gint width);
+
+/**
+ * @brief Add a value to a graph series
+ *
+ * Values outside of the graph are dropped.
+ *
+ * @param series Pointer to #AnalyzerViewGraphSeries
+ * @param x X coordinate of the value in columns, from 0 to the amount of
+ * columns
+ * @param value The value
+ * @param new_line Whether or not the line is broken before the value
+ */
+static void analyzer_view_graph_series_add(
+		AnalyzerViewGraphSeries *series,
+		gdouble x,
+		gdouble value,
+		gboolean new_line);
+
+/**
+ * @brief Draw a decimated graph series
+ *
+ * @param cr Cairo context, translated to the graph area
+ * @param series Pointer to #AnalyzerViewGraphSeries
+ * @param graph_area Area of the graph. The columns are scaled to its
+ * width.
+ * @param value_min Value at the bottom of the graph
+ * @param pixels_per_unit Height of one unit in pixels
+ * @param from_left_edge Whether or not to start the line from the left
+ * edge of the graph
+ */
+static void analyzer_view_graph_series_draw(
+		cairo_t *cr,
+		AnalyzerViewGraphSeries *series,
+		GdkRectangle *graph_area,
+		gdouble value_min,
+		gdouble pixels_per_unit,
+		gboolean from_left_edge);
+
+/**
+ * @brief Free the columns of a graph series
+ *
+ * @param series Pointer to #AnalyzerViewGraphSeries
+ */
+static void analyzer_view_graph_series_free(
+		AnalyzerViewGraphSeries *series);
+
 static void analyzer_view_set_units(AnalyzerView *self);
 static void create_map(gpointer user_data);
 static void upload_button_clicked (GtkButton *button, gpointer user_data);
 static void reset_button_clicked (GtkButton *button, gpointer user_data);
 
+/**
+ * @brief Show the totals of all activities in the default folder
+ *
+ * The totals are computed from the activity index, so the GPX files are
+ * not read.
+ *
+ * @param button The button that was clicked
+ * @param user_data Pointer to #AnalyzerView
+ */
+static void analyzer_view_totals_button_clicked(
+		GtkButton *button,
+		gpointer user_data);
+
 
 /**
  * @brief Free memory used by a #AnalyzerViewTrack
@@ -584,6 +889,7 @@ AnalyzerView *analyzer_view_new(
 	self = g_new0(AnalyzerView, 1);
 	self->parent_window = parent_window;
 	self->gconf_helper = gconf_helper;
+	self->map_segment = g_array_new(FALSE, FALSE, sizeof(coord_t));
 
 
 
@@ -621,6 +927,13 @@ void analyzer_view_set_default_folder(
 	g_free(self->default_folder_name);
 	self->default_folder_name = g_strdup(folder);
 
+	if(self->activity_index)
+	{
+		activity_index_free(self->activity_index);
+	}
+	self->activity_index = activity_index_new(folder);
+	activity_index_scan(self->activity_index);
+
 	DEBUG_END();
 }
 /*legacy code */
@@ -660,6 +973,7 @@ void analyzer_view_show(AnalyzerView *self)
 {
 	gint i;
 	PangoFontDescription *desc;
+	GtkWidget *totals_button = NULL;
 	
 	g_return_if_fail(self != NULL);
 	DEBUG_BEGIN();
@@ -699,6 +1013,20 @@ void analyzer_view_show(AnalyzerView *self)
                             self);
  	hildon_app_menu_append (HILDON_APP_MENU(self->menu), GTK_BUTTON (self->reset_button));
 
+	totals_button = hildon_gtk_button_new(HILDON_SIZE_AUTO);
+	gtk_button_set_label(GTK_BUTTON(totals_button), _("Activity totals"));
+	g_signal_connect_after(totals_button, "clicked",
+			G_CALLBACK(analyzer_view_totals_button_clicked),
+			self);
+	hildon_app_menu_append(HILDON_APP_MENU(self->menu),
+			GTK_BUTTON(totals_button));
+
+	/* Pick up the activities recorded since the last scan */
+	if(self->activity_index)
+	{
+		activity_index_scan(self->activity_index);
+	}
+
 
 
 	hildon_window_set_app_menu (HILDON_WINDOW (self->win),HILDON_APP_MENU(self->menu));
@@ -955,6 +1283,12 @@ static GtkWidget *analyzer_view_create_view_info(AnalyzerView *self)
 	self->info_labels[ANALYZER_VIEW_INFO_LABEL_HEART_RATE_MAX][0] =
 		gtk_label_new(_("Maximum heart rate"));
 
+	self->info_labels[ANALYZER_VIEW_INFO_LABEL_ASCENT][0] =
+		gtk_label_new(_("Ascent"));
+
+	self->info_labels[ANALYZER_VIEW_INFO_LABEL_DESCENT][0] =
+		gtk_label_new(_("Descent"));
+
 	for(i = 0; i < ANALYZER_VIEW_INFO_LABEL_COUNT; i++)
 	{
 		self->info_labels[i][1] = gtk_label_new(_("N/A"));
@@ -1288,9 +1622,7 @@ static void analyzer_view_destroy_widget(
 static void analyzer_view_show_last_activity(gpointer user_data,gchar* file_name){
   
   	GSList *temp = NULL;
-	GSList *temp2 = NULL;
 	AnalyzerViewTrack *track = NULL;
-	AnalyzerViewTrackSegment *track_segment = NULL;
 	GpxParserStatus parser_status;
 	//gchar *file_name = NULL;
 	GError *error = NULL;
@@ -1309,11 +1641,18 @@ static void analyzer_view_show_last_activity(gpointer user_data,gchar* file_name
 
 	analyzer_view_clear_data(self);
 	osm_gps_map_clear_gps(OSM_GPS_MAP(self->map));
-	parser_status = gpx_parser_parse_file(
+	parser_status = gpx_parser_parse_file_batched(
 			file_name,
 			analyzer_view_gpx_parser_callback,
 			self,
 			&error);
+	analyzer_view_map_segment_flush(self);
+	osm_gps_map_zoom_fit_tracks(OSM_GPS_MAP(self->map));
+	if(self->tracks)
+	{
+		analyzer_view_finish_track(self,
+				(AnalyzerViewTrack *)self->tracks->data);
+	}
 
 	if(parser_status == GPX_PARSER_STATUS_PARTIALLY_OK)
 	{
@@ -1341,16 +1680,6 @@ static void analyzer_view_show_last_activity(gpointer user_data,gchar* file_name
 			track = (AnalyzerViewTrack *)temp->data;
 			track->track_segments = g_slist_reverse(
 					track->track_segments);
-			for(temp2 = track->track_segments; temp2;
-					temp2 = g_slist_next(temp2))
-			{
-				track_segment = (AnalyzerViewTrackSegment *)
-					temp2->data;
-				track_segment->track_points = g_slist_reverse(
-						track_segment->track_points);
-				track_segment->heart_rates = g_slist_reverse(
-					track_segment->heart_rates);
-			}
 		}
 
 		analyzer_view_show_track_information(
@@ -1367,9 +1696,7 @@ static void analyzer_view_btn_open_clicked(
 		gpointer user_data)
 {
 	GSList *temp = NULL;
-	GSList *temp2 = NULL;
 	AnalyzerViewTrack *track = NULL;
-	AnalyzerViewTrackSegment *track_segment = NULL;
 	GpxParserStatus parser_status;
 	gchar *file_name = NULL;
 	GError *error = NULL;
@@ -1394,11 +1721,18 @@ static void analyzer_view_btn_open_clicked(
 	self->filename =  g_strdup(file_name);
 	analyzer_view_clear_data(self);
 	osm_gps_map_clear_gps(OSM_GPS_MAP(self->map));
-	parser_status = gpx_parser_parse_file(
+	parser_status = gpx_parser_parse_file_batched(
 			file_name,
 			analyzer_view_gpx_parser_callback,
 			self,
 			&error);
+	analyzer_view_map_segment_flush(self);
+	osm_gps_map_zoom_fit_tracks(OSM_GPS_MAP(self->map));
+	if(self->tracks)
+	{
+		analyzer_view_finish_track(self,
+				(AnalyzerViewTrack *)self->tracks->data);
+	}
 
 	if(parser_status == GPX_PARSER_STATUS_PARTIALLY_OK)
 	{
@@ -1426,16 +1760,6 @@ static void analyzer_view_btn_open_clicked(
 			track = (AnalyzerViewTrack *)temp->data;
 			track->track_segments = g_slist_reverse(
 					track->track_segments);
-			for(temp2 = track->track_segments; temp2;
-					temp2 = g_slist_next(temp2))
-			{
-				track_segment = (AnalyzerViewTrackSegment *)
-					temp2->data;
-				track_segment->track_points = g_slist_reverse(
-						track_segment->track_points);
-				track_segment->heart_rates = g_slist_reverse(
-					track_segment->heart_rates);
-			}
 		}
 
 		analyzer_view_show_track_information(
@@ -1612,7 +1936,12 @@ static void analyzer_view_btn_map_clicked(
   
 
   gtk_widget_show_all(self->map_win);
-  osm_gps_map_set_mapcenter(OSM_GPS_MAP(self->map),self->lat, self->lon,14);
+  if(osm_gps_map_get_tracks_bbox(OSM_GPS_MAP(self->map), NULL, NULL))
+  {
+	osm_gps_map_zoom_fit_tracks(OSM_GPS_MAP(self->map));
+  } else {
+	osm_gps_map_set_mapcenter(OSM_GPS_MAP(self->map),self->lat, self->lon,14);
+  }
   DEBUG_END();
   
 }
@@ -1708,6 +2037,7 @@ static void analyzer_view_clear_data(AnalyzerView *self)
 		g_object_unref(G_OBJECT(self->graphs_pixbuf));
 		self->graphs_pixbuf = NULL;
 	}
+	analyzer_view_destroy_graph_layers(self);
 
 	/* Clear the info labels */
 	for(i = 0; i < ANALYZER_VIEW_INFO_LABEL_COUNT; i++)
@@ -1729,6 +2059,9 @@ static void analyzer_view_clear_data(AnalyzerView *self)
 	g_slist_free(self->tracks);
 	self->tracks = NULL;
 
+	g_array_set_size(self->map_segment, 0);
+	osm_gps_map_clear_tracks(OSM_GPS_MAP(self->map));
+
 	self->current_track_number = 0;
 	gtk_widget_set_sensitive(self->menu_button,FALSE);
 	gtk_widget_queue_draw(self->graphs_drawing_area);
@@ -1736,12 +2069,31 @@ static void analyzer_view_clear_data(AnalyzerView *self)
 	DEBUG_END();
 }
 
+static void analyzer_view_map_segment_flush(AnalyzerView *self)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	if(self->map_segment->len > 0)
+	{
+		osm_gps_map_add_track_array(OSM_GPS_MAP(self->map),
+				(const coord_t *)self->map_segment->data,
+				self->map_segment->len);
+		g_array_set_size(self->map_segment, 0);
+	}
+
+	DEBUG_END();
+}
+
 static void analyzer_view_gpx_parser_callback(
 		GpxParserDataType data_type,
 		const GpxParserData *data,
 		gpointer user_data)
 {
 	AnalyzerView *self = (AnalyzerView *)user_data;
+	GpxParserDataWaypoint *waypoint = NULL;
+	guint i;
+
 	g_return_if_fail(self != NULL);
 	DEBUG_BEGIN();
 
@@ -1772,6 +2124,29 @@ static void analyzer_view_gpx_parser_callback(
 		case GPX_PARSER_DATA_TYPE_HEART_RATE:
 			analyzer_view_add_heart_rate(self, data->heart_rate);
 			break;
+		case GPX_PARSER_DATA_TYPE_WAYPOINT_BATCH:
+			for(i = 0; i < data->waypoint_batch->count; i++)
+			{
+				waypoint = &data->waypoint_batch->waypoints[i];
+				/* Routes are not yet supported */
+				if(waypoint->point_type !=
+					GPX_STORAGE_POINT_TYPE_ROUTE_START &&
+				   waypoint->point_type !=
+					GPX_STORAGE_POINT_TYPE_ROUTE)
+				{
+					analyzer_view_add_track_point(
+							self,
+							waypoint);
+				}
+			}
+			break;
+		case GPX_PARSER_DATA_TYPE_HEART_RATE_BATCH:
+			for(i = 0; i < data->heart_rate_batch->count; i++)
+			{
+				analyzer_view_add_heart_rate(self,
+					&data->heart_rate_batch->heart_rates[i]);
+			}
+			break;
 		default:
 			break;
 	}
@@ -1788,6 +2163,13 @@ static void analyzer_view_add_track(
 	g_return_if_fail(parser_track != NULL);
 	DEBUG_BEGIN();
 
+	analyzer_view_map_segment_flush(self);
+	if(self->tracks)
+	{
+		analyzer_view_finish_track(self,
+				(AnalyzerViewTrack *)self->tracks->data);
+	}
+
 	track = g_new0(AnalyzerViewTrack, 1);
 	self->tracks = g_slist_prepend(self->tracks, track);
 
@@ -1798,6 +2180,11 @@ static void analyzer_view_add_track(
 	}
 	track->number = parser_track->number;
 
+	/* The track is analyzed while it is parsed */
+	track->distance = -1;
+	track->altitude_min = G_MAXDOUBLE;
+	track->altitude_max = -G_MAXDOUBLE;
+
 	/* All other data is initialized correctly with g_new0 */
 
 	DEBUG_END();
@@ -1813,11 +2200,21 @@ static void analyzer_view_add_track_segment(
 	g_return_if_fail(self != NULL);
 	g_return_if_fail(self->tracks != NULL);
 
+	analyzer_view_map_segment_flush(self);
+
 	/* Get the newest track */
 	track = (AnalyzerViewTrack *)self->tracks->data;
+	if(track->track_segments)
+	{
+		analyzer_view_finish_track_segment(self, track,
+				(AnalyzerViewTrackSegment *)
+				track->track_segments->data);
+	}
 
-	track_segment = g_new0(AnalyzerViewTrackSegment, 1);
-	track->track_segments = g_slist_append(track->track_segments,
+	/* The newest track segment is kept first, like the tracks. The
+	 * list is reversed after parsing. */
+	track_segment = analyzer_view_track_segment_new();
+	track->track_segments = g_slist_prepend(track->track_segments,
 			track_segment);
 }
 
@@ -1827,7 +2224,10 @@ static void analyzer_view_add_track_point(
 {
 	AnalyzerViewTrack *track = NULL;
 	AnalyzerViewTrackSegment *track_segment = NULL;
-	AnalyzerViewWaypoint *waypoint = NULL;
+	coord_t coord;
+	gint64 time;
+	gdouble altitude;
+	gdouble zero = 0;
 
 	g_return_if_fail(self != NULL);
 	g_return_if_fail(parser_waypoint != NULL);
@@ -1844,25 +2244,35 @@ static void analyzer_view_add_track_point(
 
 	track_segment = (AnalyzerViewTrackSegment *)track->track_segments->data;
 
-	osm_gps_map_draw_gps(OSM_GPS_MAP(self->map),parser_waypoint->latitude,parser_waypoint->longitude,0);
+	/* The segment is drawn when it is complete */
+	coord.rlat = parser_waypoint->latitude * M_PI / 180.0;
+	coord.rlon = parser_waypoint->longitude * M_PI / 180.0;
+	g_array_append_val(self->map_segment, coord);
+
 	self->lat = parser_waypoint->latitude;
 	self->lon = parser_waypoint->longitude;
-	waypoint = g_new0(AnalyzerViewWaypoint, 1);
 
-	/* Copy the data from the parser waypoint to the analyzer view
-	 * waypoint */
-	waypoint->point_type = parser_waypoint->point_type;
-	waypoint->latitude = parser_waypoint->latitude;
-	waypoint->longitude = parser_waypoint->longitude;
-	waypoint->altitude_is_set = parser_waypoint->altitude_is_set;
-	waypoint->altitude = parser_waypoint->altitude;
+	/* Append the point to the columns. The distance and the speed are
+	 * filled in by the analysis. */
+	time = (gint64)parser_waypoint->timestamp.tv_sec * 1000 +
+		parser_waypoint->timestamp.tv_usec / 1000;
+	if(parser_waypoint->altitude_is_set)
+	{
+		altitude = parser_waypoint->altitude;
+	} else {
+		altitude = NAN;
+	}
 
-	memcpy(&waypoint->timestamp, &parser_waypoint->timestamp,
-			sizeof(struct timeval));
+	g_array_append_val(track_segment->times, time);
+	g_array_append_val(track_segment->latitudes,
+			parser_waypoint->latitude);
+	g_array_append_val(track_segment->longitudes,
+			parser_waypoint->longitude);
+	g_array_append_val(track_segment->altitudes, altitude);
+	g_array_append_val(track_segment->distances, zero);
+	g_array_append_val(track_segment->speeds, zero);
 
-	track_segment->track_points = g_slist_prepend(
-			track_segment->track_points,
-			waypoint);
+	analyzer_view_analyze_track_point(self, track, track_segment);
 
 	DEBUG_END();
 }
@@ -1873,7 +2283,7 @@ static void analyzer_view_add_heart_rate(
 {
 	AnalyzerViewTrack *track = NULL;
 	AnalyzerViewTrackSegment *track_segment = NULL;
-	AnalyzerViewHeartRate *heart_rate = NULL;
+	gint64 time;
 
 	g_return_if_fail(self != NULL);
 	g_return_if_fail(parser_heart_rate != NULL);
@@ -1888,78 +2298,43 @@ static void analyzer_view_add_heart_rate(
 		return;
 	}
 
-	track = (AnalyzerViewTrack *)self->tracks->data;
 	track_segment = (AnalyzerViewTrackSegment *)track->track_segments->data;
-	heart_rate = g_new0(AnalyzerViewHeartRate, 1);
-
-	/* Copy the data from the parser heart rate to the analyzer view
-	 * heart rate */
-	memcpy(&heart_rate->timestamp, &parser_heart_rate->timestamp,
-			sizeof(struct timeval));
 
-	heart_rate->value = parser_heart_rate->value;
+	time = (gint64)parser_heart_rate->timestamp.tv_sec * 1000 +
+		parser_heart_rate->timestamp.tv_usec / 1000;
+	g_array_append_val(track_segment->heart_rate_times, time);
+	g_array_append_val(track_segment->heart_rates,
+			parser_heart_rate->value);
 
-	track_segment->heart_rates = g_slist_prepend(
-			track_segment->heart_rates,
-			heart_rate);
+	analyzer_view_analyze_heart_rate(self, track, track_segment,
+			&parser_heart_rate->timestamp);
 
 	DEBUG_END();
-
 }
 
-static void analyzer_view_analyze_track(
+static void analyzer_view_finish_track(
 		AnalyzerView *self,
 		AnalyzerViewTrack *track)
 {
-	gboolean times_set = FALSE;
-	GSList *seg_temp = NULL;
-	AnalyzerViewTrackSegment *track_segment = NULL;
+	GSList *temp = NULL;
 	gdouble secs = 0;
+	gdouble mins, seconds;
+	gdouble minkm;
 
 	g_return_if_fail(self != NULL);
 	g_return_if_fail(track != NULL);
 	DEBUG_BEGIN();
 
-	track->altitude_min = G_MAXDOUBLE;
-	track->altitude_max = -G_MAXDOUBLE;
-
-	track->distance = -1;
+	if(track->data_is_analyzed)
+	{
+		DEBUG_END();
+		return;
+	}
 
-	for(seg_temp = track->track_segments; seg_temp;
-			seg_temp = g_slist_next(seg_temp))
+	for(temp = track->track_segments; temp; temp = g_slist_next(temp))
 	{
-		track_segment = (AnalyzerViewTrackSegment *)seg_temp->data;
-		analyzer_view_analyze_track_segment(self, track, track_segment);
-		if(track_segment->times_set)
-		{
-			if(!times_set)
-			{
-				times_set = TRUE;
-				memcpy(&track->start_time,
-						&track_segment->start_time,
-						sizeof(struct timeval));
-				memcpy(&track->end_time,
-						&track_segment->end_time,
-						sizeof(struct timeval));
-			} else {
-				if(util_compare_timevals(
-						&track_segment->start_time,
-						&track->start_time) == -1)
-				{
-					memcpy(&track->start_time,
-						&track_segment->start_time,
-						sizeof(struct timeval));
-				}
-				if(util_compare_timevals(
-						&track_segment->end_time,
-						&track->end_time) == 1)
-				{
-					memcpy(&track->end_time,
-						&track_segment->start_time,
-						sizeof(struct timeval));
-				}
-			}
-		}
+		analyzer_view_finish_track_segment(self, track,
+				(AnalyzerViewTrackSegment *)temp->data);
 	}
 
 	if(track->heart_rate_count > 0)
@@ -1974,367 +2349,382 @@ static void analyzer_view_analyze_track(
 	{
 		DEBUG("Secs: %f; distance: %f", secs, track->distance);
 		track->speed_avg = track->distance / secs * 3.6;
-		
-//		DEBUG("KULUNEET SEKUNTIT %d", result.tv_sec);
-//		DEBUG("KULUNUT MATKA %f", travelled_distance);
-	gdouble mins,seconds;
-	gdouble minkm = (secs / (track->distance/1000)/60);
-	seconds = modf(minkm,&mins);
-	DEBUG("MIN / KM  %02.f:%02.f ",mins,(60*seconds));
-	
-	track->min_per_km = g_strdup_printf(_("%02.f:%02.f"),mins,(60*seconds));
+
+		minkm = (secs / (track->distance / 1000) / 60);
+		seconds = modf(minkm, &mins);
+		DEBUG("MIN / KM  %02.f:%02.f ", mins, (60 * seconds));
+
+		track->min_per_km = g_strdup_printf(_("%02.f:%02.f"),
+				mins, (60 * seconds));
 	}
-	
-	
+
 	track->data_is_analyzed = TRUE;
 
 	DEBUG_END();
 }
 
-static void analyzer_view_analyze_track_segment(
+static void analyzer_view_finish_track_segment(
 		AnalyzerView *self,
 		AnalyzerViewTrack *track,
 		AnalyzerViewTrackSegment *track_segment)
 {
-	AnalyzerViewWaypoint *waypoint = NULL;
-	AnalyzerViewWaypoint *prev = NULL;
-	gdouble elapsed_temp;
-	GSList *temp = NULL;
-	GSList *temp2 = NULL;
-
-	AnalyzerViewWaypoint *waypoint_temp = NULL;
-
-	gint i = 0;
-	gdouble distance_array[5];
-	gdouble time_array[5];
-	gint fill_counter;
-	gdouble dist_sum;
-	gdouble time_sum;
-	gdouble speed_temp;
+	gdouble speed;
+	guint i;
 
 	g_return_if_fail(self != NULL);
 	g_return_if_fail(track != NULL);
 	g_return_if_fail(track_segment != NULL);
-
 	DEBUG_BEGIN();
 
-	if((track_segment->track_points != NULL) && track->distance == -1)
+	if(track_segment->is_analyzed)
 	{
-		/* The track has at least one track point, so set the distance
-		 * to 0 instead of undefined (-1) */
-		track->distance = 0;
-	} else {
-		/* Don't analyze the track points, since there aren't
-		 * any... */
-		temp = NULL;
+		DEBUG_END();
+		return;
 	}
 
-	prev = NULL;
-	/* On the first round, calculate the distance and time to
-	 * previous waypoint for each waypoint and get the maximum and
-	 * minimum altitude */
-	for(temp = track_segment->track_points; temp; temp = g_slist_next(temp))
+	/* If the speed window was never filled, use the achieved speed for
+	 * all track points (except if there were no intervals, in which
+	 * case, leave the speed to zero) */
+	if(track_segment->speed_count > 0 && track_segment->speed_pending > 0)
 	{
-		waypoint = (AnalyzerViewWaypoint *)temp->data;
-		if(prev)
+		speed = analyzer_view_track_segment_speed(self, track_segment,
+				track_segment->speed_count);
+		for(i = 0; i < track_segment->speed_pending; i++)
 		{
-			waypoint->distance_to_prev = location_distance_between(
-					waypoint->latitude,
-					waypoint->longitude,
-					prev->latitude,
-					prev->longitude) * 1000.0;
-			track->distance += waypoint->distance_to_prev;
-
-			util_subtract_time(
-					&waypoint->timestamp,
-					&prev->timestamp,
-					&waypoint->time_to_prev);
-			prev = waypoint;
-		} else {
-			/* Set the track start and end times to the timestamps
-			 * of first waypoint. These are not yet definite, so
-			 * though, so do not yet calculate the track segment
-			 * duration (or set any information to the track) */
-			track_segment->times_set = TRUE;
-			memcpy(&track_segment->start_time,
-					&waypoint->timestamp,
-					sizeof(struct timeval));
-			memcpy(&track_segment->end_time,
-					&waypoint->timestamp,
-					sizeof(struct timeval));
+			g_array_index(track_segment->speeds, gdouble, i) =
+				speed;
 		}
-
-		if(waypoint->altitude_is_set)
+		if(speed > track->speed_max)
 		{
-			if(!self->metric)
-			{
-				waypoint->altitude= waypoint->altitude * 3.280;
-			}
-			if(waypoint->altitude > track->altitude_max)
-			{
-				track->altitude_max = waypoint->altitude;
-				track->altitude_bounds_set = TRUE;
-			}
-			if(waypoint->altitude < track->altitude_min)
-			{
-				track->altitude_min = waypoint->altitude;
-			}
+			track->speed_max = speed;
 		}
-		prev = waypoint;
 	}
+	track_segment->speed_pending = 0;
 
-	if(waypoint)
+	if(track_segment->times_set)
 	{
-		/* If this is a different waypoint than from which the
-		 * end time was taken earlier, it should be also later.
-		 * If it is the same, it does not really matter even if
-		 * it is copied again. */
-		memcpy(&track_segment->end_time, &waypoint->timestamp,
-				sizeof(struct timeval));
-	}
-
-	DEBUG("Total distance so far: %f metres", track->distance);
-
-	/* Analyze the speed for each point and at the same time, derive
-	 * the maximum speed. Use slight interpolation here.
-	 *
-	 * Because of the interpolation and some checks, this
-	 * certainly is not the nicest code that I have written.
-	 */
+		/* Calculate the track segment duration and add it to the
+		 * track duration */
+		util_subtract_time(&track_segment->end_time,
+				&track_segment->start_time,
+				&track_segment->duration);
 
-	fill_counter = 0;
+		util_add_time(&track->duration, &track_segment->duration,
+				&track->duration);
 
-	prev = NULL;
-	for(temp = track_segment->track_points; temp; temp = g_slist_next(temp))
-	{
-		waypoint = (AnalyzerViewWaypoint *)temp->data;
-		if(!prev)
-		{
-			prev = waypoint;
-			continue;
-		}
-		elapsed_temp = (gdouble)waypoint->time_to_prev.tv_sec +
-			(gdouble)waypoint->time_to_prev.tv_usec / 1000000.0;
-		if(elapsed_temp != 0)
+		if(track->start_time.tv_sec == 0 ||
+				util_compare_timevals(
+					&track_segment->start_time,
+					&track->start_time) == -1)
 		{
-			if(fill_counter == 5)
-			{
-				/* Shift the data in the array */
-				for(i = 0; i < 4; i++)
-				{
-					distance_array[i] = distance_array[i+1];
-					time_array[i] = time_array[i+1];
-				}
-				distance_array[4] = waypoint->distance_to_prev;
-				time_array[4] = elapsed_temp;
-			} else if(fill_counter == 4) {
-				/* Use the current speed for the beginning of
-				 * the list */
-				distance_array[4] = waypoint->distance_to_prev;
-				time_array[4] = elapsed_temp;
-
-				time_sum = 0;
-				dist_sum = 0;
-				for(i = 0; i < 4; i++)
-				{
-					dist_sum += distance_array[i];
-					time_sum += time_array[i];
-				}
-				if(self->metric)
-				{
-				speed_temp = dist_sum / time_sum * 3.6;
-				}
-				else
-				{
-				speed_temp = dist_sum / time_sum * 3.6;
-				speed_temp = speed_temp * 0.621;
-				}
-
-
-				for(temp2 = track_segment->track_points;
-				    temp2 != temp;
-				    temp2 = g_slist_next(temp2))
-				{
-					waypoint_temp = (AnalyzerViewWaypoint *)
-							temp2->data;
-					waypoint_temp->speed_averaged
-						= speed_temp;
-				}
-				fill_counter = 5;
-				if(speed_temp > track->speed_max)
-				{
-					track->speed_max = speed_temp;
-				}
-			} else {
-				distance_array[fill_counter] =
-					waypoint->distance_to_prev;
-				time_array[fill_counter] = elapsed_temp;
-				fill_counter++;
-			}
+			memcpy(&track->start_time, &track_segment->start_time,
+					sizeof(struct timeval));
 		}
-		if(fill_counter == 5)
+		if(util_compare_timevals(&track_segment->end_time,
+					&track->end_time) == 1)
 		{
-			time_sum = 0;
-			dist_sum = 0;
-			for(i = 0; i < 5; i++)
-			{
-				dist_sum += distance_array[i];
-				time_sum += time_array[i];
-			}
-			if(self->metric)
-			{
-			speed_temp = dist_sum / time_sum * 3.6;
-			}
-			else
-			{
-				speed_temp = dist_sum / time_sum * 3.6;
-				speed_temp = speed_temp * 0.621;
-			}
-				waypoint->speed_averaged = speed_temp;
-			if(speed_temp > track->speed_max)
-			{
-				track->speed_max = speed_temp;
-			}
+			memcpy(&track->end_time, &track_segment->end_time,
+					sizeof(struct timeval));
 		}
-		prev = waypoint;
 	}
 
-	/* If the fill_counter is less than five, it means that the speeds
-	 * were not yet calculated. Use the achieved speeds for all
-	 * waypoints (except if there were none, in which case, leave
-	 * the speed to zero) */
-	if((fill_counter < 5) && (fill_counter > 0))
-	{
-		time_sum = 0;
-		dist_sum = 0;
-		for(i = 0; i < fill_counter; i++)
-		{
-			dist_sum += distance_array[i];
-			time_sum += time_array[i];
-		}
-		if(self->metric)
-		{
-		speed_temp = dist_sum / time_sum * 3.6;
-		}
-		else
-		{
-			speed_temp = dist_sum / time_sum * 3.6;
-			speed_temp = speed_temp * 0.621;
-		}
+	track_segment->is_analyzed = TRUE;
 
-		for(temp2 = track_segment->track_points;
-			temp2;
-			temp2 = g_slist_next(temp2))
-		{
-			waypoint_temp =
-				(AnalyzerViewWaypoint *)
-				temp2->data;
-			waypoint_temp->speed_averaged =
-				speed_temp;
-		}
-		if(speed_temp > track->speed_max)
-		{
-			track->speed_max = speed_temp;
-		}
+	DEBUG_END();
+}
+
+static AnalyzerViewTrackSegment *analyzer_view_track_segment_new()
+{
+	AnalyzerViewTrackSegment *track_segment = NULL;
+
+	track_segment = g_new0(AnalyzerViewTrackSegment, 1);
+
+	track_segment->times = g_array_new(FALSE, FALSE, sizeof(gint64));
+	track_segment->latitudes = g_array_new(FALSE, FALSE, sizeof(gdouble));
+	track_segment->longitudes = g_array_new(FALSE, FALSE, sizeof(gdouble));
+	track_segment->altitudes = g_array_new(FALSE, FALSE, sizeof(gdouble));
+	track_segment->distances = g_array_new(FALSE, FALSE, sizeof(gdouble));
+	track_segment->speeds = g_array_new(FALSE, FALSE, sizeof(gdouble));
+
+	track_segment->heart_rate_times = g_array_new(FALSE, FALSE,
+			sizeof(gint64));
+	track_segment->heart_rates = g_array_new(FALSE, FALSE, sizeof(gint));
+
+	return track_segment;
+}
+
+static void analyzer_view_track_segment_free(
+		AnalyzerViewTrackSegment *track_segment)
+{
+	g_return_if_fail(track_segment != NULL);
+
+	g_array_free(track_segment->times, TRUE);
+	g_array_free(track_segment->latitudes, TRUE);
+	g_array_free(track_segment->longitudes, TRUE);
+	g_array_free(track_segment->altitudes, TRUE);
+	g_array_free(track_segment->distances, TRUE);
+	g_array_free(track_segment->speeds, TRUE);
+	g_array_free(track_segment->heart_rate_times, TRUE);
+	g_array_free(track_segment->heart_rates, TRUE);
+
+	g_free(track_segment);
+}
+
+static void analyzer_view_track_segment_add_time(
+		AnalyzerViewTrackSegment *track_segment,
+		const struct timeval *timestamp)
+{
+	g_return_if_fail(track_segment != NULL);
+	g_return_if_fail(timestamp != NULL);
+
+	if(!track_segment->times_set)
+	{
+		track_segment->times_set = TRUE;
+		memcpy(&track_segment->start_time, timestamp,
+				sizeof(struct timeval));
+		memcpy(&track_segment->end_time, timestamp,
+				sizeof(struct timeval));
+	} else if(util_compare_timevals(timestamp,
+				&track_segment->start_time) == -1) {
+		memcpy(&track_segment->start_time, timestamp,
+				sizeof(struct timeval));
+	} else if(util_compare_timevals(timestamp,
+				&track_segment->end_time) == 1) {
+		memcpy(&track_segment->end_time, timestamp,
+				sizeof(struct timeval));
 	}
+}
 
-	analyzer_view_analyze_track_segment_heart_rates(
-			self,
-			track,
-			track_segment);
+static gdouble analyzer_view_track_segment_graph_time(
+		AnalyzerViewTrackSegment *track_segment,
+		gdouble segment_offset,
+		gint64 time)
+{
+	gint64 start;
 
-	if(track_segment->times_set)
+	g_return_val_if_fail(track_segment != NULL, 0);
+
+	start = (gint64)track_segment->start_time.tv_sec * 1000 +
+		track_segment->start_time.tv_usec / 1000;
+
+	return segment_offset + (gdouble)(time - start) / 1000.0;
+}
+
+static gdouble analyzer_view_track_segment_speed(
+		AnalyzerView *self,
+		AnalyzerViewTrackSegment *track_segment,
+		guint count)
+{
+	gdouble dist_sum = 0;
+	gdouble time_sum = 0;
+	gdouble speed;
+	guint first;
+	guint i;
+	guint j;
+
+	g_return_val_if_fail(self != NULL, 0);
+	g_return_val_if_fail(track_segment != NULL, 0);
+
+	/* Until the window is full, the oldest item is the first one */
+	if(track_segment->speed_count < ANALYZER_VIEW_SPEED_WINDOW)
 	{
-		/* Calculate the track segment duration and add it to the
-		 * track duration */
-		util_subtract_time(&track_segment->end_time,
-				&track_segment->start_time,
-				&track_segment->duration);
+		first = 0;
+	} else {
+		first = track_segment->speed_next;
+	}
 
-		util_add_time(&track->duration, &track_segment->duration,
-				&track->duration);
+	/* Sum from the oldest to the newest, as the window is so short
+	 * that keeping running sums would not pay off */
+	for(i = 0; i < count; i++)
+	{
+		j = (first + i) % ANALYZER_VIEW_SPEED_WINDOW;
+		dist_sum += track_segment->speed_distances[j];
+		time_sum += track_segment->speed_times[j];
 	}
 
-	DEBUG_END();
+	speed = dist_sum / time_sum * 3.6;
+	if(!self->metric)
+	{
+		speed = speed * 0.621;
+	}
+	return speed;
 }
 
-static void analyzer_view_analyze_track_segment_heart_rates(
+static void analyzer_view_analyze_track_point(
 		AnalyzerView *self,
 		AnalyzerViewTrack *track,
 		AnalyzerViewTrackSegment *track_segment)
 {
-	GSList *temp = NULL;
-	AnalyzerViewHeartRate *heart_rate = NULL;
-	gboolean first = TRUE;
+	struct timeval timestamp;
+	gdouble *altitude;
+	gdouble *distance;
+	gdouble elapsed;
+	gdouble speed;
+	gdouble threshold;
+	gint64 time;
+	guint n;
+	guint i;
 
 	g_return_if_fail(self != NULL);
 	g_return_if_fail(track != NULL);
 	g_return_if_fail(track_segment != NULL);
+	g_return_if_fail(track_segment->times->len > 0);
 	DEBUG_BEGIN();
 
-	if(!track_segment->heart_rates)
+	/* Index of the new point */
+	n = track_segment->times->len - 1;
+
+	if(track->distance == -1)
+	{
+		/* The track has at least one track point, so set the distance
+		 * to 0 instead of undefined (-1) */
+		track->distance = 0;
+	}
+
+	time = g_array_index(track_segment->times, gint64, n);
+	timestamp.tv_sec = time / 1000;
+	timestamp.tv_usec = (time % 1000) * 1000;
+	analyzer_view_track_segment_add_time(track_segment, &timestamp);
+
+	altitude = &g_array_index(track_segment->altitudes, gdouble, n);
+	if(!isnan(*altitude))
+	{
+		if(!self->metric)
+		{
+			*altitude = *altitude * 3.280;
+			threshold = ANALYZER_VIEW_ALTITUDE_THRESHOLD * 3.280;
+		} else {
+			threshold = ANALYZER_VIEW_ALTITUDE_THRESHOLD;
+		}
+		if(*altitude > track->altitude_max)
+		{
+			track->altitude_max = *altitude;
+			track->altitude_bounds_set = TRUE;
+		}
+		if(*altitude < track->altitude_min)
+		{
+			track->altitude_min = *altitude;
+		}
+
+		if(!track_segment->altitude_reference_set)
+		{
+			track_segment->altitude_reference_set = TRUE;
+			track_segment->altitude_reference = *altitude;
+		} else if(*altitude - track_segment->altitude_reference
+				>= threshold) {
+			track->altitude_gain += *altitude -
+				track_segment->altitude_reference;
+			track_segment->altitude_reference = *altitude;
+		} else if(track_segment->altitude_reference - *altitude
+				>= threshold) {
+			track->altitude_loss += track_segment->altitude_reference
+				- *altitude;
+			track_segment->altitude_reference = *altitude;
+		}
+	}
+
+	if(n == 0)
 	{
-		DEBUG("Empty heart rate list");
+		/* The first point gets its speed from the following ones */
+		track_segment->speed_pending++;
 		DEBUG_END();
 		return;
 	}
 
-	track->heart_rate_min = G_MAXINT;
-	track->heart_rate_max = G_MININT;
-
-	for(temp = track_segment->heart_rates; temp; temp = g_slist_next(temp))
+	distance = &g_array_index(track_segment->distances, gdouble, n);
+	*distance = location_distance_between(
+			g_array_index(track_segment->latitudes, gdouble, n),
+			g_array_index(track_segment->longitudes, gdouble, n),
+			g_array_index(track_segment->latitudes, gdouble, n - 1),
+			g_array_index(track_segment->longitudes, gdouble, n - 1))
+		* 1000.0;
+	track->distance += *distance;
+
+	/* Add the interval to the speed window, replacing the oldest one
+	 * when the window is full */
+	elapsed = (gdouble)(time -
+			g_array_index(track_segment->times, gint64, n - 1))
+		/ 1000.0;
+	if(elapsed != 0)
 	{
-		heart_rate = (AnalyzerViewHeartRate *)temp->data;
+		i = track_segment->speed_next;
+		track_segment->speed_distances[i] = *distance;
+		track_segment->speed_times[i] = elapsed;
+		track_segment->speed_next = (i + 1) %
+			ANALYZER_VIEW_SPEED_WINDOW;
 
-		if(first)
+		if(track_segment->speed_count < ANALYZER_VIEW_SPEED_WINDOW)
 		{
-			first = FALSE;
-			track->heart_rate_bounds_set = TRUE;
-			track->heart_rate_max = heart_rate->value;
-			track->heart_rate_min = heart_rate->value;
-			if(!track_segment->times_set)
+			track_segment->speed_count++;
+			if(track_segment->speed_count ==
+					ANALYZER_VIEW_SPEED_WINDOW)
 			{
-				track_segment->times_set = TRUE;
-				memcpy(&track_segment->start_time,
-						&heart_rate->timestamp,
-						sizeof(struct timeval));
-				memcpy(&track_segment->end_time,
-						&heart_rate->timestamp,
-						sizeof(struct timeval));
-			} else if(util_compare_timevals(&heart_rate->timestamp,
-						&track_segment->start_time)
-					== -1)
-			{
-				/* This is earlier than the track start.
-				 * Set it to this */
-				track_segment->times_set = TRUE;
-				memcpy(&track_segment->start_time,
-						&heart_rate->timestamp,
-						sizeof(struct timeval));
+				/* The window just became full. Use the speed
+				 * before this point for the beginning of the
+				 * track segment */
+				speed = analyzer_view_track_segment_speed(
+						self, track_segment,
+						ANALYZER_VIEW_SPEED_WINDOW - 1);
+				for(i = 0; i < track_segment->speed_pending; i++)
+				{
+					g_array_index(track_segment->speeds,
+							gdouble, i) = speed;
+				}
+				track_segment->speed_pending = 0;
+				if(speed > track->speed_max)
+				{
+					track->speed_max = speed;
+				}
 			}
 		}
+	}
 
-		if(heart_rate->value > track->heart_rate_max)
+	if(track_segment->speed_count < ANALYZER_VIEW_SPEED_WINDOW)
+	{
+		track_segment->speed_pending++;
+	} else {
+		speed = analyzer_view_track_segment_speed(self, track_segment,
+				ANALYZER_VIEW_SPEED_WINDOW);
+		g_array_index(track_segment->speeds, gdouble, n) = speed;
+		if(speed > track->speed_max)
 		{
-			track->heart_rate_max = heart_rate->value;
-		} else if(heart_rate->value < track->heart_rate_min) {
-			track->heart_rate_min = heart_rate->value;
+			track->speed_max = speed;
 		}
-
-		track->heart_rate_sum += heart_rate->value;
-		track->heart_rate_count++;
 	}
 
-	if(util_compare_timevals(&heart_rate->timestamp,
-				&track_segment->start_time) == 1)
+	DEBUG_END();
+}
+
+static void analyzer_view_analyze_heart_rate(
+		AnalyzerView *self,
+		AnalyzerViewTrack *track,
+		AnalyzerViewTrackSegment *track_segment,
+		const struct timeval *timestamp)
+{
+	gint value;
+
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(track != NULL);
+	g_return_if_fail(track_segment != NULL);
+	g_return_if_fail(track_segment->heart_rates->len > 0);
+
+	analyzer_view_track_segment_add_time(track_segment, timestamp);
+
+	value = g_array_index(track_segment->heart_rates, gint,
+			track_segment->heart_rates->len - 1);
+	if(!track->heart_rate_bounds_set)
 	{
-		/* This is later than the track segment end.
-		 * Set it to this */
-		memcpy(&track_segment->end_time, &heart_rate->timestamp,
-				sizeof(struct timeval));
+		track->heart_rate_bounds_set = TRUE;
+		track->heart_rate_max = value;
+		track->heart_rate_min = value;
+	} else if(value > track->heart_rate_max) {
+		track->heart_rate_max = value;
+	} else if(value < track->heart_rate_min) {
+		track->heart_rate_min = value;
 	}
 
-	DEBUG_END();
+	track->heart_rate_sum += value;
+	track->heart_rate_count++;
 }
 
 static void analyzer_view_show_track_information(
@@ -2364,10 +2754,9 @@ static void analyzer_view_show_track_information(
 	gtk_label_set_text(GTK_LABEL(self->lbl_track_number), buffer);
 	g_free(buffer);
 
-	if(!track->data_is_analyzed)
-	{
-		analyzer_view_analyze_track(self, track);
-	}
+	/* Tracks are analyzed while they are parsed, so this only makes
+	 * sure that the analysis of the track has been finished */
+	analyzer_view_finish_track(self, track);
 
 	if((track->name != NULL) && (strcmp(track->name, "") != 0))
 	{
@@ -2621,6 +3010,34 @@ static void analyzer_view_show_track_information(
 			buffer);
 	g_free(buffer);
 
+	/* The altitudes are already in feet if the units are not metric */
+	if(track->altitude_bounds_set)
+	{
+		if(self->metric)
+		{
+			buffer = g_strdup_printf(_("%.0f m"),
+					track->altitude_gain);
+			buffer2 = g_strdup_printf(_("%.0f m"),
+					track->altitude_loss);
+		} else {
+			buffer = g_strdup_printf(_("%.0f ft"),
+					track->altitude_gain);
+			buffer2 = g_strdup_printf(_("%.0f ft"),
+					track->altitude_loss);
+		}
+	} else {
+		buffer = g_strdup(_("N/A"));
+		buffer2 = g_strdup(_("N/A"));
+	}
+	gtk_label_set_text(GTK_LABEL(self->info_labels
+				[ANALYZER_VIEW_INFO_LABEL_ASCENT][1]),
+			buffer);
+	gtk_label_set_text(GTK_LABEL(self->info_labels
+				[ANALYZER_VIEW_INFO_LABEL_DESCENT][1]),
+			buffer2);
+	g_free(buffer);
+	g_free(buffer2);
+
 	self->graphs_update_data = TRUE;
 	if(self->current_view == ANALYZER_VIEW_GRAPHS)
 	{
@@ -2716,7 +3133,14 @@ static void analyzer_view_graphs_toggle_button(
 				GFXDIR "ec_button_small_bg_down.png");
 	}
 
-	self->graphs_update_data = TRUE;
+	/* The layout is made again for the shown graphs. The lines are
+	 * drawn again only if their area changes, and then from the
+	 * decimated columns, so the points are not gone through again. */
+	if(self->graphs_pixbuf)
+	{
+		g_object_unref(G_OBJECT(self->graphs_pixbuf));
+		self->graphs_pixbuf = NULL;
+	}
 	gtk_widget_queue_draw(self->graphs_drawing_area);
 
 	DEBUG_END();
@@ -2739,6 +3163,7 @@ static gboolean analyzer_view_graphs_drawing_area_exposed(
 	gint i = 0;
 
 	AnalyzerViewPixbufDetails details;
+	cairo_surface_t *base = NULL;
 
 	g_return_val_if_fail(self != NULL, FALSE);
 
@@ -2749,7 +3174,14 @@ static gboolean analyzer_view_graphs_drawing_area_exposed(
 	track = (AnalyzerViewTrack *)
 		g_slist_nth_data(self->tracks, self->current_track_number);
 
-	if(!self->graphs_pixbuf || self->graphs_update_data)
+	/* None of the layers can be used if the track or the size has
+	 * changed */
+	base = self->graphs_layers[ANALYZER_VIEW_GRAPH_LAYER_BASE];
+	if(self->graphs_update_data || (base &&
+			(cairo_image_surface_get_width(base) !=
+			 widget->allocation.width ||
+			 cairo_image_surface_get_height(base) !=
+			 widget->allocation.height)))
 	{
 		self->graphs_update_data = FALSE;
 		if(self->graphs_pixbuf)
@@ -2757,6 +3189,11 @@ static gboolean analyzer_view_graphs_drawing_area_exposed(
 			g_object_unref(G_OBJECT(self->graphs_pixbuf));
 			self->graphs_pixbuf = NULL;
 		}
+		analyzer_view_destroy_graph_layers(self);
+	}
+
+	if(!self->graphs_pixbuf)
+	{
 		details.w = widget->allocation.width;
 		details.h = widget->allocation.height;
 
@@ -2787,9 +3224,14 @@ static gboolean analyzer_view_graphs_drawing_area_exposed(
 
 		details.scale_count = 5;
 
-		self->graphs_pixbuf = analyzer_view_create_pixbuf(
-				self,
+		analyzer_view_create_graph_layers(self, &details);
+
+		self->graphs_pixbuf = analyzer_view_create_pixbuf(self,
 				&details);
+		if(!self->graphs_pixbuf)
+		{
+			return FALSE;
+		}
 	}
 
 	drawable = GDK_DRAWABLE(widget->window);
@@ -2816,7 +3258,7 @@ static gboolean analyzer_view_graphs_drawing_area_exposed(
 	return FALSE;
 }
 
-static GdkPixbuf *analyzer_view_create_pixbuf(
+static void analyzer_view_create_graph_layers(
 		AnalyzerView *self,
 		AnalyzerViewPixbufDetails *details)
 {
@@ -2824,14 +3266,10 @@ static GdkPixbuf *analyzer_view_create_pixbuf(
 	 * surprise. Work around it switching the blue and red during
 	 * drawing so that no switch operations need to be done. */
 
-	GdkPixbuf *pixbuf = NULL;
-
 	cairo_text_extents_t extents;
 	cairo_text_extents_t extents2;
-	cairo_surface_t *surface = NULL;
 	cairo_t *cr = NULL;
-
-	guchar *data = NULL;
+	cairo_t *cr_line = NULL;
 
 	gint i, j;
 	gint scale_height;
@@ -2851,16 +3289,15 @@ static GdkPixbuf *analyzer_view_create_pixbuf(
 
 	AnalyzerViewUnitType unit_type;
 
-	g_return_val_if_fail(details != NULL, NULL);
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(details != NULL);
 
 	DEBUG_BEGIN();
 
-	surface = cairo_image_surface_create(
-			CAIRO_FORMAT_ARGB32,
-			details->w,
-			details->h);
-
-	cr = cairo_create(surface);
+	/* The axes, the legends and the scales of the shown graphs go to
+	 * the base layer */
+	cr = analyzer_view_create_graph_layer(self, details,
+			ANALYZER_VIEW_GRAPH_LAYER_BASE);
 
 	/* Do the actual drawing */
 	graph.x = 0;
@@ -2868,14 +3305,9 @@ static GdkPixbuf *analyzer_view_create_pixbuf(
 	graph.y = 0;
 	graph.height = details->h;
 
-	/* Calculate the height for the time scale */
-	cairo_select_font_face(cr, "Nokia Sans",
-			CAIRO_FONT_SLANT_NORMAL,
-			CAIRO_FONT_WEIGHT_NORMAL);
-
-	cairo_set_font_size(cr, 20.0);
-
-	/* The scale extent calculations go as follows:
+	/* Calculate the height for the time scale.
+	 *
+	 * The scale extent calculations go as follows:
 	 *
 	 * The time scale height only depends on the height of the text,
 	 * which consists only of the characters "0123456789:" (or other
@@ -2919,7 +3351,7 @@ static GdkPixbuf *analyzer_view_create_pixbuf(
 
 	if(!details->track->altitude_bounds_set)
 	{
-		details->show_speed = FALSE;
+		details->show_altitude = FALSE;
 	}
 
 	if(details->track->heart_rate_max == 0)
@@ -3156,65 +3588,220 @@ static GdkPixbuf *analyzer_view_create_pixbuf(
 			extents.height / 2.0 - extents.y_bearing / 2.0 + 1.0);
 	cairo_show_text(cr, scale_text);
 
-	/* Limit the graphs to the graph area (they might exceed it by
-	 * a couple of pixels because of the line width etc)*/
-	cairo_rectangle(cr, graph.x, graph.y, graph.width, graph.height);
-	cairo_clip(cr);
-
+	cairo_destroy(cr);
 
-	if(details->show_speed)
+	/* Draw the lines of the shown graphs to their layers, unless they
+	 * are already drawn for this graph area. Limit them to the graph
+	 * area (they might exceed it by a couple of pixels because of the
+	 * line width etc) */
+	if(details->show_speed && !analyzer_view_graph_layer_is_valid(self,
+				ANALYZER_VIEW_GRAPH_LAYER_SPEED, &graph))
 	{
+		cr_line = analyzer_view_create_graph_layer(self, details,
+				ANALYZER_VIEW_GRAPH_LAYER_SPEED);
+		self->graphs_layer_areas[ANALYZER_VIEW_GRAPH_LAYER_SPEED] =
+			graph;
+		cairo_rectangle(cr_line, graph.x, graph.y,
+				graph.width, graph.height);
+		cairo_clip(cr_line);
 		analyzer_view_draw_speed(
 				self,
-				cr,
+				cr_line,
 				details,
 				&graph,
 				speed_pixels_per_unit);
+		cairo_destroy(cr_line);
 	}
 
-	if(details->show_altitude)
+	if(details->show_altitude && !analyzer_view_graph_layer_is_valid(self,
+				ANALYZER_VIEW_GRAPH_LAYER_ALTITUDE, &graph))
 	{
+		cr_line = analyzer_view_create_graph_layer(self, details,
+				ANALYZER_VIEW_GRAPH_LAYER_ALTITUDE);
+		self->graphs_layer_areas[ANALYZER_VIEW_GRAPH_LAYER_ALTITUDE] =
+			graph;
+		cairo_rectangle(cr_line, graph.x, graph.y,
+				graph.width, graph.height);
+		cairo_clip(cr_line);
 		analyzer_view_draw_altitude(
 				self,
-				cr,
+				cr_line,
 				details,
 				&graph,
 				altitude_pixels_per_unit);
+		cairo_destroy(cr_line);
 	}
 
-	if(details->show_heart_rate)
+	if(details->show_heart_rate && !analyzer_view_graph_layer_is_valid(
+				self, ANALYZER_VIEW_GRAPH_LAYER_HEART_RATE,
+				&graph))
 	{
+		cr_line = analyzer_view_create_graph_layer(self, details,
+				ANALYZER_VIEW_GRAPH_LAYER_HEART_RATE);
+		self->graphs_layer_areas[ANALYZER_VIEW_GRAPH_LAYER_HEART_RATE] =
+			graph;
+		cairo_rectangle(cr_line, graph.x, graph.y,
+				graph.width, graph.height);
+		cairo_clip(cr_line);
 		analyzer_view_draw_heart_rate(
 				self,
-				cr,
+				cr_line,
 				details,
 				&graph,
 				heart_rate_pixels_per_unit);
+		cairo_destroy(cr_line);
 	}
 
-	/* Make a pixbuf from the data */
-	data = cairo_image_surface_get_data(surface);
-	pixbuf = gdk_pixbuf_new_from_data(
-			data,
-			GDK_COLORSPACE_RGB,
-			TRUE,
-			8,
-			details->w,
-			details->h,
-			cairo_image_surface_get_stride(surface),
-			analyzer_view_destroy_pixbuf_data,
-			cr);
-
 	DEBUG_END();
-	return pixbuf;
 }
 
-static void analyzer_view_destroy_pixbuf_data(
-		guchar *pixels,
-		gpointer user_data)
+static gboolean analyzer_view_graph_layer_is_valid(
+		AnalyzerView *self,
+		AnalyzerViewGraphLayer layer,
+		GdkRectangle *graph_area)
 {
-	cairo_surface_t *surface = NULL;
-	cairo_t *cr = (cairo_t *)user_data;
+	GdkRectangle *area = NULL;
+
+	g_return_val_if_fail(self != NULL, FALSE);
+	g_return_val_if_fail(graph_area != NULL, FALSE);
+
+	if(!self->graphs_layers[layer])
+	{
+		return FALSE;
+	}
+
+	area = &self->graphs_layer_areas[layer];
+	return area->x == graph_area->x && area->y == graph_area->y &&
+		area->width == graph_area->width &&
+		area->height == graph_area->height;
+}
+
+static cairo_t *analyzer_view_create_graph_layer(
+		AnalyzerView *self,
+		AnalyzerViewPixbufDetails *details,
+		AnalyzerViewGraphLayer layer)
+{
+	cairo_t *cr = NULL;
+
+	g_return_val_if_fail(self != NULL, NULL);
+	g_return_val_if_fail(details != NULL, NULL);
+	DEBUG_BEGIN();
+
+	analyzer_view_destroy_graph_layer(self, layer);
+
+	self->graphs_layers[layer] = cairo_image_surface_create(
+			CAIRO_FORMAT_ARGB32,
+			details->w,
+			details->h);
+
+	cr = cairo_create(self->graphs_layers[layer]);
+
+	cairo_select_font_face(cr, "Nokia Sans",
+			CAIRO_FONT_SLANT_NORMAL,
+			CAIRO_FONT_WEIGHT_NORMAL);
+
+	cairo_set_font_size(cr, 20.0);
+
+	DEBUG_END();
+	return cr;
+}
+
+static void analyzer_view_destroy_graph_layer(
+		AnalyzerView *self,
+		AnalyzerViewGraphLayer layer)
+{
+	g_return_if_fail(self != NULL);
+
+	if(self->graphs_layers[layer])
+	{
+		cairo_surface_destroy(self->graphs_layers[layer]);
+		self->graphs_layers[layer] = NULL;
+	}
+}
+
+static void analyzer_view_destroy_graph_layers(AnalyzerView *self)
+{
+	gint i;
+
+	g_return_if_fail(self != NULL);
+
+	for(i = 0; i < ANALYZER_VIEW_GRAPH_LAYER_COUNT; i++)
+	{
+		analyzer_view_destroy_graph_layer(self, i);
+	}
+}
+
+static GdkPixbuf *analyzer_view_create_pixbuf(
+		AnalyzerView *self,
+		AnalyzerViewPixbufDetails *details)
+{
+	GdkPixbuf *pixbuf = NULL;
+	cairo_surface_t *base = NULL;
+	cairo_surface_t *surface = NULL;
+	cairo_t *cr = NULL;
+	guchar *data = NULL;
+	gboolean shown[ANALYZER_VIEW_GRAPH_LAYER_COUNT];
+	gint w;
+	gint h;
+	gint i;
+
+	g_return_val_if_fail(self != NULL, NULL);
+	g_return_val_if_fail(details != NULL, NULL);
+	DEBUG_BEGIN();
+
+	base = self->graphs_layers[ANALYZER_VIEW_GRAPH_LAYER_BASE];
+	if(!base)
+	{
+		DEBUG_END();
+		return NULL;
+	}
+	w = cairo_image_surface_get_width(base);
+	h = cairo_image_surface_get_height(base);
+
+	shown[ANALYZER_VIEW_GRAPH_LAYER_BASE] = TRUE;
+	shown[ANALYZER_VIEW_GRAPH_LAYER_SPEED] = details->show_speed;
+	shown[ANALYZER_VIEW_GRAPH_LAYER_ALTITUDE] = details->show_altitude;
+	shown[ANALYZER_VIEW_GRAPH_LAYER_HEART_RATE] =
+		details->show_heart_rate;
+
+	surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, w, h);
+	cr = cairo_create(surface);
+
+	/* Compose the layers of the shown graphs */
+	for(i = 0; i < ANALYZER_VIEW_GRAPH_LAYER_COUNT; i++)
+	{
+		if(shown[i] && self->graphs_layers[i])
+		{
+			cairo_set_source_surface(cr, self->graphs_layers[i],
+					0, 0);
+			cairo_paint(cr);
+		}
+	}
+	cairo_surface_flush(surface);
+
+	/* Make a pixbuf from the data */
+	data = cairo_image_surface_get_data(surface);
+	pixbuf = gdk_pixbuf_new_from_data(
+			data,
+			GDK_COLORSPACE_RGB,
+			TRUE,
+			8,
+			w,
+			h,
+			cairo_image_surface_get_stride(surface),
+			analyzer_view_destroy_pixbuf_data,
+			cr);
+
+	DEBUG_END();
+	return pixbuf;
+}
+
+static void analyzer_view_destroy_pixbuf_data(
+		guchar *pixels,
+		gpointer user_data)
+{
+	cairo_surface_t *surface = NULL;
+	cairo_t *cr = (cairo_t *)user_data;
 
 	g_return_if_fail(pixels != NULL);
 	DEBUG_BEGIN();
@@ -3486,23 +4073,19 @@ static void analyzer_view_draw_speed(
 		GdkRectangle *graph_area,
 		gdouble pixels_per_unit)
 {
-	/* Pixels per units ("how many pixels wide is a second") */
-	gdouble pixels_per_sec = 0;
-
-	gdouble mile_speed = 0;
+	/* Columns per second */
+	gdouble columns_per_sec = 0;
 
 	gdouble duration_secs = 0;
-	guint counter = 0;
-
-	gdouble x = 0;
-	gdouble y = 0;
+	gdouble segment_offset = 0;
 
 	GSList *temp = NULL;
-	GSList *temp2 = NULL;
+	guint i;
 
 	AnalyzerViewTrack *track = NULL;
 	AnalyzerViewTrackSegment *track_segment = NULL;
-	AnalyzerViewWaypoint *waypoint = NULL;
+	const gint64 *times = NULL;
+	const gdouble *speeds = NULL;
 
 	g_return_if_fail(self != NULL);
 	g_return_if_fail(cr != NULL);
@@ -3520,7 +4103,45 @@ static void analyzer_view_draw_speed(
 		DEBUG_END();
 		return;
 	}
-	pixels_per_sec = (gdouble)graph_area->width / (gdouble)duration_secs;
+
+	/* Decimate the speeds to the width of the view, unless already
+	 * done. The columns do not depend on the graph area, so they are
+	 * not decimated again when the shown scales change. */
+	if(!track->graph_speed.columns ||
+			track->graph_speed.width != details->w)
+	{
+		analyzer_view_graph_series_reset(&track->graph_speed,
+				details->w);
+		columns_per_sec = (gdouble)details->w /
+			(gdouble)duration_secs;
+
+		for(temp = track->track_segments; temp;
+				temp = g_slist_next(temp))
+		{
+			track_segment = (AnalyzerViewTrackSegment *)temp->data;
+			if(!track_segment->times_set)
+			{
+				continue;
+			}
+			times = (const gint64 *)track_segment->times->data;
+			speeds = (const gdouble *)track_segment->speeds->data;
+			for(i = 0; i < track_segment->times->len; i++)
+			{
+				analyzer_view_graph_series_add(
+						&track->graph_speed,
+						columns_per_sec *
+						analyzer_view_track_segment_graph_time(
+							track_segment,
+							segment_offset,
+							times[i]),
+						speeds[i], FALSE);
+			}
+			segment_offset += (gdouble)
+				track_segment->duration.tv_sec +
+				(gdouble)track_segment->duration.tv_usec /
+				1000000.0;
+		}
+	}
 
 	/* Start drawing */
 
@@ -3535,40 +4156,9 @@ static void analyzer_view_draw_speed(
 
 	cairo_set_line_width(cr, 3.0);
 
-	for(temp = track->track_segments; temp; temp = g_slist_next(temp))
-	{
-		track_segment = (AnalyzerViewTrackSegment *)temp->data;
-		for(temp2 = track_segment->track_points; temp2;
-				temp2 = g_slist_next(temp2))
-		{
-			waypoint = (AnalyzerViewWaypoint *)temp2->data;
-			if(self->metric)
-			{
-			y = graph_area->height - waypoint->speed_averaged *
-				pixels_per_unit;
-			}
-			else
-			{
-				mile_speed  = 	waypoint->speed_averaged;
-			y = graph_area->height - mile_speed *
-				pixels_per_unit;
-
-			}
+	analyzer_view_graph_series_draw(cr, &track->graph_speed, graph_area,
+			0, pixels_per_unit, FALSE);
 
-			if(counter == 0)
-			{
-				cairo_move_to(cr, x, y);
-			} else {
-				x += pixels_per_sec *
-				((gdouble)waypoint->time_to_prev.tv_sec +
-				 (gdouble)waypoint->time_to_prev.tv_usec /
-					 1000000.0);
-				cairo_line_to(cr, x, y);
-			}
-			counter++;
-		}
-	}
-	cairo_stroke(cr);
 	cairo_restore(cr);
 
 	DEBUG_END();
@@ -3581,22 +4171,20 @@ static void analyzer_view_draw_altitude(
 		GdkRectangle *graph_area,
 		gdouble pixels_per_unit)
 {
-	/* Pixels per units ("how many pixels wide is a second") */
-	gdouble pixels_per_sec = 0;
+	/* Columns per second */
+	gdouble columns_per_sec = 0;
 
 	gdouble duration_secs = 0;
-	gboolean first_point = TRUE;
-	gboolean draw_line = FALSE;
-
-	gdouble x = 0;
-	gdouble y = 0;
+	gdouble segment_offset = 0;
+	gboolean new_line = TRUE;
 
 	GSList *temp = NULL;
-	GSList *temp2 = NULL;
+	guint i;
 
 	AnalyzerViewTrack *track = NULL;
 	AnalyzerViewTrackSegment *track_segment = NULL;
-	AnalyzerViewWaypoint *waypoint = NULL;
+	const gint64 *times = NULL;
+	const gdouble *altitudes = NULL;
 
 	g_return_if_fail(self != NULL);
 	g_return_if_fail(cr != NULL);
@@ -3614,7 +4202,53 @@ static void analyzer_view_draw_altitude(
 		DEBUG_END();
 		return;
 	}
-	pixels_per_sec = (gdouble)graph_area->width / (gdouble)duration_secs;
+
+	/* Decimate the altitudes like the speeds */
+	if(!track->graph_altitude.columns ||
+			track->graph_altitude.width != details->w)
+	{
+		analyzer_view_graph_series_reset(&track->graph_altitude,
+				details->w);
+		columns_per_sec = (gdouble)details->w /
+			(gdouble)duration_secs;
+
+		for(temp = track->track_segments; temp;
+				temp = g_slist_next(temp))
+		{
+			track_segment = (AnalyzerViewTrackSegment *)temp->data;
+			if(!track_segment->times_set)
+			{
+				continue;
+			}
+			times = (const gint64 *)track_segment->times->data;
+			altitudes = (const gdouble *)
+				track_segment->altitudes->data;
+			for(i = 0; i < track_segment->times->len; i++)
+			{
+				/* Break the line where the altitude is not
+				 * known */
+				if(isnan(altitudes[i]))
+				{
+					new_line = TRUE;
+					continue;
+				}
+
+				analyzer_view_graph_series_add(
+						&track->graph_altitude,
+						columns_per_sec *
+						analyzer_view_track_segment_graph_time(
+							track_segment,
+							segment_offset,
+							times[i]),
+						altitudes[i], new_line);
+				new_line = FALSE;
+			}
+			segment_offset += (gdouble)
+				track_segment->duration.tv_sec +
+				(gdouble)track_segment->duration.tv_usec /
+				1000000.0;
+		}
+	}
 
 	/* Start drawing */
 
@@ -3629,43 +4263,10 @@ static void analyzer_view_draw_altitude(
 
 	cairo_set_line_width(cr, 3.0);
 
-	for(temp = track->track_segments; temp; temp = g_slist_next(temp))
-	{
-		track_segment = (AnalyzerViewTrackSegment *)temp->data;
-		for(temp2 = track_segment->track_points; temp2;
-				temp2 = g_slist_next(temp2))
-		{
-			waypoint = (AnalyzerViewWaypoint *)temp2->data;
-
-			if(!first_point)
-			{
-				x += pixels_per_sec *
-				((gdouble)waypoint->time_to_prev.tv_sec +
-				 (gdouble)waypoint->time_to_prev.tv_usec /
-					 1000000.0);
-			}
+	analyzer_view_graph_series_draw(cr, &track->graph_altitude,
+			graph_area, track->altitude_min, pixels_per_unit,
+			FALSE);
 
-			if(!waypoint->altitude_is_set)
-			{
-				draw_line = FALSE;
-				continue;
-			}
-
-			y = graph_area->height -
-				(waypoint->altitude - track->altitude_min) *
-				pixels_per_unit;
-
-			if(!draw_line)
-			{
-				cairo_move_to(cr, x, y);
-			} else {
-				cairo_line_to(cr, x, y);
-			}
-			first_point = FALSE;
-			draw_line = TRUE;
-		}
-	}
-	cairo_stroke(cr);
 	cairo_restore(cr);
 
 	DEBUG_END();
@@ -3678,24 +4279,19 @@ static void analyzer_view_draw_heart_rate(
 		GdkRectangle *graph_area,
 		gdouble pixels_per_unit)
 {
-	/* Pixels per units ("how many pixels wide is one second") */
-	gdouble pixels_per_sec = 0;
-
-	gdouble hr_secs = 0;
-	gdouble start_secs = 0;
+	/* Columns per second */
+	gdouble columns_per_sec = 0;
 
 	gdouble duration_secs = 0;
-	gboolean first_point = TRUE;
-
-	gdouble x = 0;
-	gdouble y = 0;
+	gdouble segment_offset = 0;
 
 	GSList *temp = NULL;
-	GSList *temp2 = NULL;
+	guint i;
 
 	AnalyzerViewTrack *track = NULL;
 	AnalyzerViewTrackSegment *track_segment = NULL;
-	AnalyzerViewHeartRate *heart_rate = NULL;
+	const gint64 *times = NULL;
+	const gint *heart_rates = NULL;
 
 	g_return_if_fail(self != NULL);
 	g_return_if_fail(cr != NULL);
@@ -3705,9 +4301,6 @@ static void analyzer_view_draw_heart_rate(
 
 	track = details->track;
 
-	start_secs = (gdouble)track->start_time.tv_sec +
-		(gdouble)track->duration.tv_usec / 1000000.0;
-
 	duration_secs = (gdouble)track->duration.tv_sec +
 		(gdouble)track->duration.tv_usec / 1000000.0;
 
@@ -3716,7 +4309,45 @@ static void analyzer_view_draw_heart_rate(
 		DEBUG_END();
 		return;
 	}
-	pixels_per_sec = (gdouble)graph_area->width / (gdouble)duration_secs;
+
+	/* Decimate the heart rates like the speeds */
+	if(!track->graph_heart_rate.columns ||
+			track->graph_heart_rate.width != details->w)
+	{
+		analyzer_view_graph_series_reset(&track->graph_heart_rate,
+				details->w);
+		columns_per_sec = (gdouble)details->w /
+			(gdouble)duration_secs;
+
+		for(temp = track->track_segments; temp;
+				temp = g_slist_next(temp))
+		{
+			track_segment = (AnalyzerViewTrackSegment *)temp->data;
+			if(!track_segment->times_set)
+			{
+				continue;
+			}
+			times = (const gint64 *)
+				track_segment->heart_rate_times->data;
+			heart_rates = (const gint *)
+				track_segment->heart_rates->data;
+			for(i = 0; i < track_segment->heart_rates->len; i++)
+			{
+				analyzer_view_graph_series_add(
+						&track->graph_heart_rate,
+						columns_per_sec *
+						analyzer_view_track_segment_graph_time(
+							track_segment,
+							segment_offset,
+							times[i]),
+						heart_rates[i], FALSE);
+			}
+			segment_offset += (gdouble)
+				track_segment->duration.tv_sec +
+				(gdouble)track_segment->duration.tv_usec /
+				1000000.0;
+		}
+	}
 
 	/* Start drawing */
 
@@ -3731,48 +4362,186 @@ static void analyzer_view_draw_heart_rate(
 
 	cairo_set_line_width(cr, 3.0);
 
-	for(temp = track->track_segments; temp; temp = g_slist_next(temp))
+	analyzer_view_graph_series_draw(cr, &track->graph_heart_rate,
+			graph_area, track->heart_rate_min, pixels_per_unit,
+			TRUE);
+
+	cairo_restore(cr);
+
+	DEBUG_END();
+
+}
+
+static void analyzer_view_graph_series_reset(
+		AnalyzerViewGraphSeries *series,
+		gint width)
+{
+	g_return_if_fail(series != NULL);
+
+	if(!series->columns)
+	{
+		series->columns = g_array_new(FALSE, FALSE,
+				sizeof(AnalyzerViewGraphColumn));
+	}
+	if(width < 0)
 	{
-		track_segment = (AnalyzerViewTrackSegment *)temp->data;
-		for(temp2 = track_segment->heart_rates; temp2;
-				temp2 = g_slist_next(temp2))
+		width = 0;
+	}
+	series->width = width;
+
+	g_array_set_size(series->columns, width);
+	if(width > 0)
+	{
+		memset(series->columns->data, 0,
+				width * sizeof(AnalyzerViewGraphColumn));
+	}
+}
+
+static void analyzer_view_graph_series_add(
+		AnalyzerViewGraphSeries *series,
+		gdouble x,
+		gdouble value,
+		gboolean new_line)
+{
+	AnalyzerViewGraphColumn *column = NULL;
+	gint i;
+
+	g_return_if_fail(series != NULL);
+	g_return_if_fail(series->columns != NULL);
+
+	if(series->width == 0)
+	{
+		return;
+	}
+
+	/* The values at the ends of the time axis may be off by a rounding
+	 * error. Anything further out is not a part of the graph. */
+	if(x < -0.5 || x > series->width + 0.5)
+	{
+		return;
+	}
+	i = (gint)floor(x);
+	if(i < 0)
+	{
+		i = 0;
+	} else if(i >= series->width) {
+		i = series->width - 1;
+	}
+
+	column = &g_array_index(series->columns, AnalyzerViewGraphColumn, i);
+	if(column->count == 0)
+	{
+		column->new_line = new_line;
+		column->first = value;
+		column->min = value;
+		column->max = value;
+	} else {
+		/* The column already has the end of the previous line, so
+		 * the break can only be drawn after the column */
+		if(new_line)
 		{
-			heart_rate = (AnalyzerViewHeartRate *)temp2->data;
+			column->break_after = TRUE;
+		}
+		if(value < column->min)
+		{
+			column->min = value;
+		} else if(value > column->max) {
+			column->max = value;
+		}
+	}
+	column->last = value;
+	column->count++;
+}
 
-			hr_secs = (gdouble)heart_rate->timestamp.tv_sec +
-				(gdouble)heart_rate->timestamp.tv_usec /
-				1000000.0;
+static void analyzer_view_graph_series_draw(
+		cairo_t *cr,
+		AnalyzerViewGraphSeries *series,
+		GdkRectangle *graph_area,
+		gdouble value_min,
+		gdouble pixels_per_unit,
+		gboolean from_left_edge)
+{
+	AnalyzerViewGraphColumn *column = NULL;
+	gboolean drawing = FALSE;
+	gboolean broken = FALSE;
+	gdouble pixels_per_column;
+	gdouble x;
+	gdouble y_first;
+	gint i;
 
-			x = pixels_per_sec * (hr_secs - start_secs);
+	g_return_if_fail(cr != NULL);
+	g_return_if_fail(series != NULL);
+	g_return_if_fail(graph_area != NULL);
 
-			y = graph_area->height -
-				(heart_rate->value - track->heart_rate_min) *
-				pixels_per_unit;
+	if(!series->columns || series->width == 0)
+	{
+		return;
+	}
 
-			if(first_point)
-			{
-				cairo_move_to(cr, 0, y);
-			}
-			cairo_line_to(cr, x, y);
-			first_point = FALSE;
+	/* Only the coordinates are scaled, so that the width of the line
+	 * stays the same */
+	pixels_per_column = (gdouble)graph_area->width /
+		(gdouble)series->width;
+
+	for(i = 0; i < series->width; i++)
+	{
+		column = &g_array_index(series->columns,
+				AnalyzerViewGraphColumn, i);
+		if(column->count == 0)
+		{
+			continue;
+		}
+
+		x = i * pixels_per_column;
+		y_first = graph_area->height -
+			(column->first - value_min) * pixels_per_unit;
+
+		if(!drawing && from_left_edge)
+		{
+			cairo_move_to(cr, 0, y_first);
+			cairo_line_to(cr, x, y_first);
+		} else if(!drawing || broken || column->new_line) {
+			cairo_move_to(cr, x, y_first);
+		} else {
+			cairo_line_to(cr, x, y_first);
+		}
+
+		/* Draw the envelope of the column as a vertical line */
+		if(column->count > 1)
+		{
+			cairo_line_to(cr, x, graph_area->height -
+					(column->min - value_min) *
+					pixels_per_unit);
+			cairo_line_to(cr, x, graph_area->height -
+					(column->max - value_min) *
+					pixels_per_unit);
+			cairo_line_to(cr, x, graph_area->height -
+					(column->last - value_min) *
+					pixels_per_unit);
 		}
+		drawing = TRUE;
+		broken = column->break_after;
 	}
 
 	cairo_stroke(cr);
-	cairo_restore(cr);
+}
 
-	DEBUG_END();
+static void analyzer_view_graph_series_free(
+		AnalyzerViewGraphSeries *series)
+{
+	g_return_if_fail(series != NULL);
 
+	if(series->columns)
+	{
+		g_array_free(series->columns, TRUE);
+		series->columns = NULL;
+	}
+	series->width = 0;
 }
 
 static void analyzer_view_track_destroy(AnalyzerViewTrack *track)
 {
-	AnalyzerViewTrackSegment *track_segment = NULL;
-	AnalyzerViewWaypoint *waypoint = NULL;
-	AnalyzerViewHeartRate *heart_rate = NULL;
-
 	GSList *temp = NULL;
-	GSList *temp2 = NULL;
 
 	g_return_if_fail(track != NULL);
 	DEBUG_BEGIN();
@@ -3783,27 +4552,16 @@ static void analyzer_view_track_destroy(AnalyzerViewTrack *track)
 
 	for(temp = track->track_segments; temp; temp = g_slist_next(temp))
 	{
-		track_segment = (AnalyzerViewTrackSegment *)temp->data;
-		for(temp2 = track_segment->track_points; temp2;
-				temp2 = g_slist_next(temp2))
-		{
-			waypoint = (AnalyzerViewWaypoint *)temp2->data;
-			g_free(waypoint);
-		}
-		g_slist_free(track_segment->track_points);
-
-		for(temp2 = track_segment->heart_rates; temp2;
-				temp2 = g_slist_next(temp2))
-		{
-			heart_rate = (AnalyzerViewHeartRate *)temp2->data;
-			g_free(heart_rate);
-		}
-		g_slist_free(track_segment->heart_rates);
-		g_free(track_segment);
+		analyzer_view_track_segment_free(
+				(AnalyzerViewTrackSegment *)temp->data);
 	}
 
 	g_slist_free(track->track_segments);
 
+	analyzer_view_graph_series_free(&track->graph_speed);
+	analyzer_view_graph_series_free(&track->graph_altitude);
+	analyzer_view_graph_series_free(&track->graph_heart_rate);
+
 	g_free(track);
 
 	DEBUG_END();
@@ -3861,3 +4619,66 @@ gtk_widget_set_sensitive(self->reset_button,FALSE);
 DEBUG("Reset clicked");
 
 }
+
+static void analyzer_view_totals_button_clicked(
+		GtkButton *button,
+		gpointer user_data)
+{
+	AnalyzerView *self = (AnalyzerView *)user_data;
+	ActivityIndexTotals totals;
+	GtkWidget *note = NULL;
+	gchar *distance = NULL;
+	gchar *heart_rate = NULL;
+	gchar *text = NULL;
+	gint duration;
+
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	if(!self->activity_index)
+	{
+		DEBUG_END();
+		return;
+	}
+
+	activity_index_get_totals(self->activity_index, &totals);
+
+	if(self->metric)
+	{
+		distance = g_strdup_printf(_("%.1f km"),
+				totals.distance / 1000.0);
+	} else {
+		distance = g_strdup_printf(_("%.1f mi"),
+				(totals.distance / 1000.0) * 0.621);
+	}
+
+	if(totals.heart_rate_average > 0)
+	{
+		heart_rate = g_strdup_printf(_("%d bpm"),
+				(gint)(totals.heart_rate_average + 0.5));
+	} else {
+		heart_rate = g_strdup(_("N/A"));
+	}
+
+	duration = (gint)totals.duration;
+	text = g_strdup_printf(_("Activities: %u\n"
+				"Duration: %d:%02d:%02d\n"
+				"Distance: %s\n"
+				"Average heart rate: %s"),
+			totals.activities,
+			duration / 3600,
+			(duration / 60) % 60,
+			duration % 60,
+			distance,
+			heart_rate);
+
+	note = hildon_note_new_information(GTK_WINDOW(self->win), text);
+	gtk_dialog_run(GTK_DIALOG(note));
+	gtk_widget_destroy(note);
+
+	g_free(text);
+	g_free(heart_rate);
+	g_free(distance);
+
+	DEBUG_END();
+}
@@ -33,6 +33,7 @@
 #include <gtk/gtk.h>
 
 /* Other modules */
+#include "activity_index.h"
 #include "gpx_parser.h"
 #include "gconf_helper.h"
 
@@ -60,9 +61,25 @@ typedef enum _AnalyzerViewInfoLabel {
 	ANALYZER_VIEW_INFO_LABEL_MIN_PER_KM,
 	ANALYZER_VIEW_INFO_LABEL_HEART_RATE_AVG,
 	ANALYZER_VIEW_INFO_LABEL_HEART_RATE_MAX,
+	ANALYZER_VIEW_INFO_LABEL_ASCENT,
+	ANALYZER_VIEW_INFO_LABEL_DESCENT,
 	ANALYZER_VIEW_INFO_LABEL_COUNT
 } AnalyzerViewInfoLabel;
 
+/**
+ * @brief Layers that the graph view is composed of
+ */
+typedef enum _AnalyzerViewGraphLayer {
+	/** @brief Axes, time scale, and the legends and scales of the
+	 * shown graphs */
+	ANALYZER_VIEW_GRAPH_LAYER_BASE,
+	/* Lines of the graphs */
+	ANALYZER_VIEW_GRAPH_LAYER_SPEED,
+	ANALYZER_VIEW_GRAPH_LAYER_ALTITUDE,
+	ANALYZER_VIEW_GRAPH_LAYER_HEART_RATE,
+	ANALYZER_VIEW_GRAPH_LAYER_COUNT
+} AnalyzerViewGraphLayer;
+
 /*****************************************************************************
  * Data structures                                                           *
  *****************************************************************************/
@@ -80,6 +97,9 @@ typedef struct _AnalyzerView {
 	GtkWidget *map_win;
 	gchar *default_folder_name;
 
+	/** @brief Summaries of the activities in the default folder */
+	ActivityIndex *activity_index;
+
 	
 		/*for heiaheia */
 	gdouble distance;
@@ -137,6 +157,17 @@ typedef struct _AnalyzerView {
 
 	GdkPixbuf *graphs_pixbuf;
 
+	/**
+	 * @brief Layers of the graphs, composed to #graphs_pixbuf. The base
+	 * layer is rendered again for the shown graphs whenever a graph is
+	 * toggled. The line layers are kept until the track or the size
+	 * changes, and are drawn again only when the graph area changes.
+	 */
+	cairo_surface_t *graphs_layers[ANALYZER_VIEW_GRAPH_LAYER_COUNT];
+
+	/** @brief Graph areas that the line layers are drawn for */
+	GdkRectangle graphs_layer_areas[ANALYZER_VIEW_GRAPH_LAYER_COUNT];
+
 	GtkWidget *graphs_table;
 
 	GtkWidget *graphs_btn_speed;
@@ -160,6 +191,13 @@ typedef struct _AnalyzerView {
 	gint map_provider;
 	GtkWidget *map;
 	gdouble lat,lon;
+
+	/**
+	 * @brief Points of the track segment that is being parsed, as
+	 * coord_t of the map. They are added to the map in one go when the
+	 * segment ends.
+	 */
+	GArray *map_segment;
 	GdkPixbuf *zoom_in;
 	GdkPixbuf *zoom_out;
 	osso_context_t *osso;
@@ -33,7 +33,6 @@
 #endif
 
 /* OSEA */
-#include "osea/bdac.h"
 #include "osea/ecgcodes.h"
 
 /* Other modules */
@@ -45,10 +44,15 @@
  * Private function prototypes                                               *
  *****************************************************************************/
 
-static gboolean _beat_detector_initialized = FALSE;
-
 static void beat_detector_reset(BeatDetector *self);
 
+/**
+ * @brief Configure the beat detector for the sample rate of the ECG data
+ *
+ * @param self Pointer to #BeatDetector
+ */
+static void beat_detector_configure(BeatDetector *self);
+
 /**
  * @brief Analyze ECG data arriving from #EcgData
  *
@@ -95,17 +99,21 @@ BeatDetector *beat_detector_new(EcgData *ecg_data)
 
 	DEBUG_BEGIN();
 
-	if(_beat_detector_initialized)
+	self = g_new0(BeatDetector, 1);
+	if(!self)
 	{
-		g_critical("Only one beat detector can be created at the\n"
-				"time because of library constraints");
+		g_critical("Not enough memory");
 		return NULL;
 	}
 
-	self = g_new0(BeatDetector, 1);
-	if(!self)
+	/* OseaCreate() also resets the beat detector and classifier. The
+	 * sample rate is configured again when the data arrives. */
+	self->sample_rate = DEFAULT_SAMPLE_RATE;
+	self->osea = OseaCreate(self->sample_rate);
+	if(!self->osea)
 	{
 		g_critical("Not enough memory");
+		g_free(self);
 		return NULL;
 	}
 
@@ -113,14 +121,9 @@ BeatDetector *beat_detector_new(EcgData *ecg_data)
 
 	beat_detector_set_beat_interval_mean_count(self, 20);
 
-	_beat_detector_initialized = TRUE;
-
 	self->beat_found = FALSE;
 	self->previous_beat_distance = 0;
 
-	/* Reset the beat detector and classifier */
-	ResetBDAC();
-
 	DEBUG_END();
 	return self;
 }
@@ -278,8 +281,8 @@ void beat_detector_destroy(BeatDetector *self)
 	g_return_if_fail(self != NULL);
 	DEBUG_BEGIN();
 
+	OseaDestroy(self->osea);
 	g_free(self);
-	_beat_detector_initialized = FALSE;
 	DEBUG_END();
 }
 
@@ -295,7 +298,40 @@ static void beat_detector_reset(BeatDetector *self)
 	self->parameters_configured = FALSE;
 	self->previous_beat_distance = 0;
 	self->beat_found = FALSE;
-	ResetBDAC();
+	ResetBDAC(self->osea);
+
+	DEBUG_END();
+}
+
+static void beat_detector_configure(BeatDetector *self)
+{
+	gint sample_rate;
+
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	sample_rate = ecg_data_get_sample_rate(self->ecg_data);
+	if(sample_rate <= 0)
+	{
+		/* Not known until the first ECG data block arrives */
+		DEBUG_END();
+		return;
+	}
+
+	if(sample_rate != self->sample_rate)
+	{
+		DEBUG("Sample rate changed from %d to %d",
+				self->sample_rate, sample_rate);
+		if(OseaInit(self->osea, sample_rate) != 0)
+		{
+			g_warning("Unsupported sample rate: %d", sample_rate);
+			DEBUG_END();
+			return;
+		}
+		self->sample_rate = sample_rate;
+	}
+
+	self->parameters_configured = TRUE;
 
 	DEBUG_END();
 }
@@ -320,6 +356,10 @@ static void beat_detector_analyze(
 	
 	
 	DEBUG_BEGIN();
+	if(!self->parameters_configured)
+	{
+		beat_detector_configure(self);
+	}
 	beat_detector_invoke_callbacks(self, heart_rate);
 
 	DEBUG_END();
@@ -38,6 +38,7 @@
 
 /* Other modules */
 #include "ecg_data.h"
+#include "osea/osea.h"
 
 /*****************************************************************************
  * Definitions                                                               *
@@ -103,6 +104,9 @@ struct _BeatDetector
 	/** @brief Pointer to #EcgData */
 	EcgData *ecg_data;
 
+	/** @brief State of the OSEA beat detector and classifier */
+	OseaContext *osea;
+
 	/** @brief List of callbacks */
 	GSList *callbacks;
 
@@ -0,0 +1,356 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi, Sampo Savola
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* This module */
+#include "chunk_queue.h"
+
+/* System */
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>			/* for strerror() */
+#include <unistd.h>
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
+/* Other modules */
+#include "ec_error.h"
+
+#include "debug.h"
+
+/*****************************************************************************
+ * Data structures                                                           *
+ *****************************************************************************/
+
+/**
+ * @brief A file descriptor based wake-up mechanism
+ *
+ * With eventfd, both file descriptors are the same. Otherwise, a pipe
+ * is used.
+ */
+typedef struct _ChunkQueueNotifier {
+	gint read_fd;
+	gint write_fd;
+} ChunkQueueNotifier;
+
+struct _ChunkQueue {
+	guint chunk_count;
+	guint chunk_size;
+
+	/** @brief Storage for all the chunks */
+	guint8 *storage;
+
+	/** @brief Amount of valid data in each chunk */
+	guint *lengths;
+
+	/**
+	 * @brief Amount of chunks released by the consumer.
+	 *
+	 * Only the consumer modifies this. The counters are free-running;
+	 * the chunk index is the counter modulo chunk_count.
+	 */
+	volatile gint head;
+
+	/** @brief Amount of chunks committed by the producer */
+	volatile gint tail;
+
+	/** @brief Set when the producer waits for a free chunk */
+	volatile gint producer_waiting;
+
+	ChunkQueueNotifier data_notifier;
+	ChunkQueueNotifier space_notifier;
+};
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+static gboolean chunk_queue_notifier_open(
+		ChunkQueueNotifier *notifier,
+		GError **error);
+static void chunk_queue_notifier_close(ChunkQueueNotifier *notifier);
+static void chunk_queue_notifier_signal(ChunkQueueNotifier *notifier);
+static void chunk_queue_notifier_clear(ChunkQueueNotifier *notifier);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+/*===========================================================================*
+ * Public functions                                                          *
+ *===========================================================================*/
+
+ChunkQueue *chunk_queue_new(
+		guint chunk_count,
+		guint chunk_size,
+		GError **error)
+{
+	ChunkQueue *self = NULL;
+
+	g_return_val_if_fail(chunk_count > 0, NULL);
+	g_return_val_if_fail(chunk_size > 0, NULL);
+	g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+	DEBUG_BEGIN();
+
+	self = g_new0(ChunkQueue, 1);
+	self->chunk_count = chunk_count;
+	self->chunk_size = chunk_size;
+	self->data_notifier.read_fd = -1;
+	self->data_notifier.write_fd = -1;
+	self->space_notifier.read_fd = -1;
+	self->space_notifier.write_fd = -1;
+
+	if(!chunk_queue_notifier_open(&self->data_notifier, error) ||
+	   !chunk_queue_notifier_open(&self->space_notifier, error))
+	{
+		chunk_queue_free(self);
+		DEBUG_END();
+		return NULL;
+	}
+
+	self->storage = g_malloc(chunk_count * chunk_size);
+	self->lengths = g_new0(guint, chunk_count);
+
+	DEBUG_END();
+	return self;
+}
+
+void chunk_queue_free(ChunkQueue *self)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	chunk_queue_notifier_close(&self->data_notifier);
+	chunk_queue_notifier_close(&self->space_notifier);
+	g_free(self->storage);
+	g_free(self->lengths);
+	g_free(self);
+
+	DEBUG_END();
+}
+
+guint8 *chunk_queue_producer_acquire(ChunkQueue *self, guint *size)
+{
+	guint tail;
+
+	g_return_val_if_fail(self != NULL, NULL);
+
+	tail = (guint)self->tail;
+	if(tail - (guint)g_atomic_int_get(&self->head) >= self->chunk_count)
+	{
+		/* Full. Ask the consumer to notify when it releases a chunk,
+		 * and check again in case it did so in the meanwhile. */
+		g_atomic_int_compare_and_exchange(&self->producer_waiting,
+				0, 1);
+		if(tail - (guint)g_atomic_int_get(&self->head) >=
+				self->chunk_count)
+		{
+			return NULL;
+		}
+	}
+
+	if(size)
+	{
+		*size = self->chunk_size;
+	}
+	return self->storage + (tail % self->chunk_count) * self->chunk_size;
+}
+
+void chunk_queue_producer_commit(ChunkQueue *self, guint len)
+{
+	guint tail;
+
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(len <= self->chunk_size);
+
+	tail = (guint)self->tail;
+	self->lengths[tail % self->chunk_count] = len;
+
+	/* This is a full memory barrier, so the chunk contents are visible
+	 * to the consumer before the new tail is */
+	g_atomic_int_add(&self->tail, 1);
+
+	/* Wake up the consumer only if it has already processed everything
+	 * before this chunk. Otherwise it is still processing and will find
+	 * this chunk before going back to sleep. */
+	if((guint)g_atomic_int_get(&self->head) == tail)
+	{
+		chunk_queue_notifier_signal(&self->data_notifier);
+	}
+}
+
+gint chunk_queue_get_space_fd(ChunkQueue *self)
+{
+	g_return_val_if_fail(self != NULL, -1);
+	return self->space_notifier.read_fd;
+}
+
+void chunk_queue_producer_clear_notification(ChunkQueue *self)
+{
+	g_return_if_fail(self != NULL);
+	chunk_queue_notifier_clear(&self->space_notifier);
+}
+
+const guint8 *chunk_queue_consumer_peek(ChunkQueue *self, guint *len)
+{
+	guint head;
+	guint index;
+
+	g_return_val_if_fail(self != NULL, NULL);
+	g_return_val_if_fail(len != NULL, NULL);
+
+	head = (guint)self->head;
+	if(head == (guint)g_atomic_int_get(&self->tail))
+	{
+		return NULL;
+	}
+
+	index = head % self->chunk_count;
+	*len = self->lengths[index];
+	return self->storage + index * self->chunk_size;
+}
+
+void chunk_queue_consumer_release(ChunkQueue *self)
+{
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(self->head != g_atomic_int_get(&self->tail));
+
+	g_atomic_int_add(&self->head, 1);
+
+	if(g_atomic_int_compare_and_exchange(&self->producer_waiting, 1, 0))
+	{
+		chunk_queue_notifier_signal(&self->space_notifier);
+	}
+}
+
+gint chunk_queue_get_data_fd(ChunkQueue *self)
+{
+	g_return_val_if_fail(self != NULL, -1);
+	return self->data_notifier.read_fd;
+}
+
+void chunk_queue_consumer_clear_notification(ChunkQueue *self)
+{
+	g_return_if_fail(self != NULL);
+	chunk_queue_notifier_clear(&self->data_notifier);
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static gboolean chunk_queue_notifier_open(
+		ChunkQueueNotifier *notifier,
+		GError **error)
+{
+	gint fds[2];
+	gint i;
+
+	DEBUG_BEGIN();
+
+#ifdef HAVE_SYS_EVENTFD_H
+	fds[0] = eventfd(0, 0);
+	if(fds[0] == -1)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_PIPE,
+				"Unable to create eventfd: %s",
+				strerror(errno));
+		DEBUG_END();
+		return FALSE;
+	}
+	fds[1] = fds[0];
+#else
+	if(pipe(fds) == -1)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_PIPE,
+				"Unable to create pipe: %s",
+				strerror(errno));
+		DEBUG_END();
+		return FALSE;
+	}
+#endif
+
+	/* Neither signaling nor clearing must ever block */
+	for(i = 0; i < 2; i++)
+	{
+		fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+	}
+
+	notifier->read_fd = fds[0];
+	notifier->write_fd = fds[1];
+
+	DEBUG_END();
+	return TRUE;
+}
+
+static void chunk_queue_notifier_close(ChunkQueueNotifier *notifier)
+{
+	if(notifier->read_fd != -1)
+	{
+		close(notifier->read_fd);
+	}
+	if(notifier->write_fd != -1 && notifier->write_fd != notifier->read_fd)
+	{
+		close(notifier->write_fd);
+	}
+	notifier->read_fd = -1;
+	notifier->write_fd = -1;
+}
+
+static void chunk_queue_notifier_signal(ChunkQueueNotifier *notifier)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+	guint64 value = 1;
+	/* If the counter would overflow, the notification is pending
+	 * anyway */
+	if(write(notifier->write_fd, &value, sizeof(value)) < 0)
+#else
+	guint8 value = 1;
+	/* If the pipe is full, the notification is pending anyway */
+	if(write(notifier->write_fd, &value, sizeof(value)) < 0)
+#endif
+	{
+		DEBUG("Notification not written: %s", strerror(errno));
+	}
+}
+
+static void chunk_queue_notifier_clear(ChunkQueueNotifier *notifier)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+	guint64 value;
+	/* Reading resets the counter */
+	if(read(notifier->read_fd, &value, sizeof(value)) < 0)
+	{
+		DEBUG("Nothing to clear: %s", strerror(errno));
+	}
+#else
+	guint8 value[64];
+	while(read(notifier->read_fd, value, sizeof(value)) > 0)
+	{
+		/* Empty the pipe */
+	}
+#endif
+}
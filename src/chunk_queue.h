@@ -0,0 +1,154 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi, Sampo Savola
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+#ifndef _CHUNK_QUEUE_H
+#define _CHUNK_QUEUE_H
+
+/* Configuration */
+#include "config.h"
+
+/* GLib */
+#include <glib.h>
+
+/**
+ * @brief Single-producer, single-consumer queue of data chunks.
+ *
+ * The queue owns a fixed pool of chunk buffers. The producer thread reads
+ * data directly into a free chunk and commits it, and the consumer thread
+ * processes the committed chunks in place and releases them back to the
+ * pool. No locks are used, and no data is copied by the queue.
+ *
+ * The consumer is woken up through a file descriptor (an eventfd, if
+ * available) that becomes readable when chunks are committed, so it can
+ * be watched from the GLib main loop. Likewise, the producer can wait for
+ * a free chunk by watching another file descriptor.
+ */
+typedef struct _ChunkQueue ChunkQueue;
+
+/**
+ * @brief Create a new chunk queue
+ *
+ * @param chunk_count Amount of chunks in the pool
+ * @param chunk_size Size of one chunk in bytes
+ * @param error Return location for possible error
+ *
+ * @return Newly allocated queue, or NULL in case of an error
+ */
+ChunkQueue *chunk_queue_new(
+		guint chunk_count,
+		guint chunk_size,
+		GError **error);
+
+/**
+ * @brief Free a chunk queue and close its file descriptors
+ *
+ * @param self Pointer to #ChunkQueue
+ */
+void chunk_queue_free(ChunkQueue *self);
+
+/*===========================================================================*
+ * Producer side                                                             *
+ *===========================================================================*/
+
+/**
+ * @brief Get a free chunk to write data to
+ *
+ * The same chunk is returned until it is committed with
+ * #chunk_queue_producer_commit.
+ *
+ * @param self Pointer to #ChunkQueue
+ * @param size Return location for the size of the chunk
+ *
+ * @return Pointer to the chunk, or NULL if all the chunks are in the queue.
+ * In that case, wait until the file descriptor returned by
+ * #chunk_queue_get_space_fd becomes readable and try again.
+ */
+guint8 *chunk_queue_producer_acquire(ChunkQueue *self, guint *size);
+
+/**
+ * @brief Pass the acquired chunk to the consumer
+ *
+ * @param self Pointer to #ChunkQueue
+ * @param len Amount of valid data in the chunk
+ */
+void chunk_queue_producer_commit(ChunkQueue *self, guint len);
+
+/**
+ * @brief Get the file descriptor that becomes readable when a chunk is
+ * released while the producer was waiting for one
+ *
+ * @param self Pointer to #ChunkQueue
+ *
+ * @return The file descriptor. It is owned by the queue.
+ */
+gint chunk_queue_get_space_fd(ChunkQueue *self);
+
+/**
+ * @brief Clear the notification of the space file descriptor
+ *
+ * @param self Pointer to #ChunkQueue
+ */
+void chunk_queue_producer_clear_notification(ChunkQueue *self);
+
+/*===========================================================================*
+ * Consumer side                                                             *
+ *===========================================================================*/
+
+/**
+ * @brief Get the oldest committed chunk
+ *
+ * @param self Pointer to #ChunkQueue
+ * @param len Return location for the amount of data in the chunk
+ *
+ * @return Pointer to the chunk data, or NULL if the queue is empty
+ */
+const guint8 *chunk_queue_consumer_peek(ChunkQueue *self, guint *len);
+
+/**
+ * @brief Return the chunk returned by #chunk_queue_consumer_peek to the
+ * pool
+ *
+ * @param self Pointer to #ChunkQueue
+ */
+void chunk_queue_consumer_release(ChunkQueue *self);
+
+/**
+ * @brief Get the file descriptor that becomes readable when chunks are
+ * committed
+ *
+ * @param self Pointer to #ChunkQueue
+ *
+ * @return The file descriptor. It is owned by the queue.
+ */
+gint chunk_queue_get_data_fd(ChunkQueue *self);
+
+/**
+ * @brief Clear the notification of the data file descriptor
+ *
+ * Call this before processing the chunks, so that chunks committed while
+ * processing are not missed.
+ *
+ * @param self Pointer to #ChunkQueue
+ */
+void chunk_queue_consumer_clear_notification(ChunkQueue *self);
+
+#endif /* _CHUNK_QUEUE_H */
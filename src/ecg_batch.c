@@ -0,0 +1,673 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi, Sampo Savola
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/**
+ * @file ecg_batch.c
+ *
+ * @brief Run the OSEA beat detector and classifier over recorded ECG files.
+ *
+ * Usage: ecg_batch [-s RATE] [-j JOBS] [-a SUFFIX] [-l SECONDS] RECORD...
+ *
+ * Each record is a file of signed 16 bit little endian samples. The
+ * records are analyzed in parallel by a pool of worker threads, each
+ * with its own #OseaContext. For each record, two files are written:
+ *
+ * - RECORD.beats: one line per beat with the sample number of the
+ *   R-wave, the beat label (N, V or Q) and the matching template
+ * - RECORD.rr: one line per RR interval with the time of the beat in
+ *   seconds and the interval in milliseconds
+ *
+ * If a reference annotation suffix is given, the beats are scored against
+ * RECORD.SUFFIX with the beat-by-beat comparison of bxbep. The reference
+ * file has one annotation per line, either as "SAMPLE LABEL" or in the
+ * output format of the WFDB rdann program. LABEL is an MIT annotation
+ * mnemonic, such as N, V or A; non-beat annotations are ignored.
+ *
+ * The analysis speed is reported both as a total and per core, so that
+ * changes to the detector can be compared independently of the amount
+ * of workers.
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* System */
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* GLib */
+#include <glib.h>
+
+/* Other modules */
+#include "ec_error.h"
+#include "osea/osea.h"
+#include "osea/ecgcodes.h"
+#include "osea/bxb.h"
+
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+/** @brief Amount of samples read and analyzed at a time */
+#define ECG_BATCH_READ_LENGTH		4096
+
+/** @brief Beat match window, as in the AAMI standards */
+#define ECG_BATCH_MATCH_WINDOW		0.15	/* seconds */
+
+/** @brief Default learning period, as in the AAMI standards */
+#define ECG_BATCH_LEARNING_TIME		300	/* seconds */
+
+typedef struct _BatchOptions {
+	gint sample_rate;
+	gint jobs;
+	gchar *reference_suffix;
+	gdouble learning_time;
+} BatchOptions;
+
+typedef struct _BatchRecord {
+	gchar *path;
+	guint64 samples;
+	gint beats;
+
+	/** @brief Time the worker spent on this record, in seconds */
+	gdouble elapsed;
+
+	/** @brief Whether the record was scored against a reference */
+	gboolean scored;
+	BxbResult bxb;
+
+	GError *error;
+} BatchRecord;
+
+typedef struct _BatchMnemonic {
+	const gchar *mnemonic;
+	gint code;
+} BatchMnemonic;
+
+/** @brief MIT annotation mnemonics of the beat annotations */
+static const BatchMnemonic batch_mnemonics[] = {
+	{ "N", NORMAL },
+	{ "L", LBBB },
+	{ "R", RBBB },
+	{ "B", BBB },
+	{ "a", ABERR },
+	{ "V", PVC },
+	{ "F", FUSION },
+	{ "J", NPC },
+	{ "A", APC },
+	{ "S", SVPB },
+	{ "E", VESC },
+	{ "j", NESC },
+	{ "/", PACE },
+	{ "Q", UNKNOWN },
+	{ "e", AESC },
+	{ "n", SVESC },
+	{ "f", PFUS },
+	{ "r", RONT },
+	{ NULL, 0 }
+};
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+static void ecg_batch_worker(gpointer data, gpointer user_data);
+
+static gboolean ecg_batch_analyze(
+		BatchRecord *record,
+		const BatchOptions *options,
+		GArray *beats,
+		GError **error);
+
+static gboolean ecg_batch_read_reference(
+		const gchar *path,
+		GArray *annotations,
+		GError **error);
+
+static gchar ecg_batch_beat_label(gint beat_type);
+
+static gint ecg_batch_get_processors(void);
+
+static void ecg_batch_print_scores(const BxbResult *result);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+gint main(gint argc, gchar **argv)
+{
+	BatchOptions options;
+	BatchRecord *records = NULL;
+	GOptionContext *context = NULL;
+	GThreadPool *pool = NULL;
+	GError *error = NULL;
+	GTimer *timer = NULL;
+	BxbResult total_bxb;
+	guint64 total_samples = 0;
+	gdouble busy_time = 0;
+	gdouble elapsed = 0;
+	gint record_count = 0;
+	gint failures = 0;
+	gint scored = 0;
+	gint i, j;
+
+	GOptionEntry entries[] = {
+		{ "sample-rate", 's', 0, G_OPTION_ARG_INT,
+			&options.sample_rate,
+			"Sample rate of the records in Hz", "RATE" },
+		{ "jobs", 'j', 0, G_OPTION_ARG_INT, &options.jobs,
+			"Amount of worker threads, default is one per "
+				"processor", "JOBS" },
+		{ "annotations", 'a', 0, G_OPTION_ARG_STRING,
+			&options.reference_suffix,
+			"Score against reference annotations in "
+				"RECORD.SUFFIX", "SUFFIX" },
+		{ "learning-time", 'l', 0, G_OPTION_ARG_DOUBLE,
+			&options.learning_time,
+			"Length of the learning period that is not scored",
+			"SECONDS" },
+		{ NULL }
+	};
+
+	options.sample_rate = DEFAULT_SAMPLE_RATE;
+	options.jobs = 0;
+	options.reference_suffix = NULL;
+	options.learning_time = ECG_BATCH_LEARNING_TIME;
+
+	g_thread_init(NULL);
+
+	context = g_option_context_new("RECORD...");
+	g_option_context_add_main_entries(context, entries, NULL);
+	if(!g_option_context_parse(context, &argc, &argv, &error))
+	{
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free(context);
+
+	if(argc < 2 || options.jobs < 0 || options.learning_time < 0)
+	{
+		g_printerr("Usage: %s [-s RATE] [-j JOBS] [-a SUFFIX] "
+				"[-l SECONDS] RECORD...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if(options.sample_rate < MIN_SAMPLE_RATE ||
+	   options.sample_rate > MAX_SAMPLE_RATE)
+	{
+		g_printerr("Sample rate must be from %d to %d Hz\n",
+				MIN_SAMPLE_RATE, MAX_SAMPLE_RATE);
+		return EXIT_FAILURE;
+	}
+
+	if(options.jobs == 0)
+	{
+		options.jobs = ecg_batch_get_processors();
+	}
+
+	record_count = argc - 1;
+	records = g_new0(BatchRecord, record_count);
+
+	timer = g_timer_new();
+
+	pool = g_thread_pool_new(ecg_batch_worker, &options, options.jobs,
+			TRUE, &error);
+	if(!pool)
+	{
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+
+	for(i = 0; i < record_count; i++)
+	{
+		records[i].path = argv[i + 1];
+		g_thread_pool_push(pool, &records[i], NULL);
+	}
+
+	/* Wait for all the records to be analyzed */
+	g_thread_pool_free(pool, FALSE, TRUE);
+
+	g_timer_stop(timer);
+	elapsed = g_timer_elapsed(timer, NULL);
+
+	BxbReset(&total_bxb);
+
+	for(i = 0; i < record_count; i++)
+	{
+		if(records[i].error)
+		{
+			g_printerr("%s\n", records[i].error->message);
+			g_error_free(records[i].error);
+			failures++;
+			continue;
+		}
+
+		g_print("%s: %" G_GUINT64_FORMAT " samples, %d beats",
+				records[i].path,
+				records[i].samples,
+				records[i].beats);
+		if(records[i].elapsed > 0)
+		{
+			g_print(", %.0f samples/s",
+					records[i].samples / records[i].elapsed);
+		}
+		g_print("\n");
+
+		if(records[i].scored)
+		{
+			ecg_batch_print_scores(&records[i].bxb);
+			for(j = 0; j < BXB_LABEL_COUNT * BXB_LABEL_COUNT; j++)
+			{
+				total_bxb.counts[j / BXB_LABEL_COUNT]
+					[j % BXB_LABEL_COUNT] +=
+					records[i].bxb.counts
+					[j / BXB_LABEL_COUNT]
+					[j % BXB_LABEL_COUNT];
+			}
+			total_bxb.rrCount += records[i].bxb.rrCount;
+			total_bxb.rrSumSquares += records[i].bxb.rrSumSquares;
+			scored++;
+		}
+
+		total_samples += records[i].samples;
+		busy_time += records[i].elapsed;
+	}
+
+	g_print("\n");
+	g_print("Records:        %d (%d failed)\n", record_count, failures);
+	g_print("Workers:        %d\n", options.jobs);
+	g_print("Samples:        %" G_GUINT64_FORMAT "\n", total_samples);
+	g_print("Elapsed:        %.6f s\n", elapsed);
+	if(elapsed > 0)
+	{
+		g_print("Samples/s:      %.0f\n", total_samples / elapsed);
+	}
+	if(busy_time > 0)
+	{
+		g_print("Samples/s/core: %.0f\n", total_samples / busy_time);
+	}
+	if(scored > 1)
+	{
+		g_print("Gross scores of %d records:\n", scored);
+		ecg_batch_print_scores(&total_bxb);
+	}
+
+	g_timer_destroy(timer);
+	g_free(records);
+	g_free(options.reference_suffix);
+
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*****************************************************************************
+ * Private functions                                                         *
+ *****************************************************************************/
+
+/**
+ * @brief Analyze a record, and score it if a reference is given
+ *
+ * This is run in the threads of the pool.
+ *
+ * @param data Pointer to #BatchRecord
+ * @param user_data Pointer to #BatchOptions
+ */
+static void ecg_batch_worker(gpointer data, gpointer user_data)
+{
+	BatchRecord *record = (BatchRecord *)data;
+	const BatchOptions *options = (const BatchOptions *)user_data;
+	GArray *beats = NULL;
+	GArray *reference = NULL;
+	gchar *reference_path = NULL;
+	GTimer *timer = NULL;
+
+	DEBUG_BEGIN();
+
+	beats = g_array_new(FALSE, FALSE, sizeof(BxbAnnotation));
+
+	timer = g_timer_new();
+	if(!ecg_batch_analyze(record, options, beats, &record->error))
+	{
+		goto worker_done;
+	}
+	g_timer_stop(timer);
+	record->elapsed = g_timer_elapsed(timer, NULL);
+
+	if(options->reference_suffix)
+	{
+		reference = g_array_new(FALSE, FALSE, sizeof(BxbAnnotation));
+		reference_path = g_strconcat(record->path,
+				options->reference_suffix, NULL);
+		if(!ecg_batch_read_reference(reference_path, reference,
+					&record->error))
+		{
+			goto worker_done;
+		}
+
+		BxbReset(&record->bxb);
+		BxbCompare(&record->bxb,
+				(BxbAnnotation *)reference->data,
+				reference->len,
+				(BxbAnnotation *)beats->data,
+				beats->len,
+				options->learning_time * options->sample_rate,
+				ECG_BATCH_MATCH_WINDOW * options->sample_rate);
+		record->scored = TRUE;
+	}
+
+worker_done:
+	g_timer_destroy(timer);
+	g_array_free(beats, TRUE);
+	if(reference)
+	{
+		g_array_free(reference, TRUE);
+	}
+	g_free(reference_path);
+
+	DEBUG_END();
+}
+
+/**
+ * @brief Stream a record through the beat detector and classifier
+ *
+ * @param record Record to analyze. The amount of samples and beats
+ * are stored here.
+ * @param options Analysis options
+ * @param beats Array of #BxbAnnotation where the beats are appended
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean ecg_batch_analyze(
+		BatchRecord *record,
+		const BatchOptions *options,
+		GArray *beats,
+		GError **error)
+{
+	OseaContext *osea = NULL;
+	FILE *input = NULL;
+	FILE *beat_output = NULL;
+	FILE *rr_output = NULL;
+	gchar *path = NULL;
+	gint16 buffer[ECG_BATCH_READ_LENGTH];
+	gint samples[ECG_BATCH_READ_LENGTH];
+	OseaBeat found[ECG_BATCH_READ_LENGTH];
+	BxbAnnotation annotation;
+	gint64 previous_beat = -1;
+	gint64 beat_sample = 0;
+	gboolean success = FALSE;
+	size_t len = 0;
+	gint count = 0;
+	gint i;
+
+	DEBUG_BEGIN();
+
+	input = fopen(record->path, "rb");
+	if(!input)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to open record %s: %s",
+				record->path, strerror(errno));
+		goto analyze_done;
+	}
+
+	path = g_strconcat(record->path, ".beats", NULL);
+	beat_output = fopen(path, "w");
+	if(!beat_output)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to create %s: %s",
+				path, strerror(errno));
+		goto analyze_done;
+	}
+	g_free(path);
+
+	path = g_strconcat(record->path, ".rr", NULL);
+	rr_output = fopen(path, "w");
+	if(!rr_output)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to create %s: %s",
+				path, strerror(errno));
+		goto analyze_done;
+	}
+
+	osea = OseaCreate(options->sample_rate);
+
+	while((len = fread(buffer, sizeof(gint16), ECG_BATCH_READ_LENGTH,
+					input)) > 0)
+	{
+		for(i = 0; i < len; i++)
+		{
+			samples[i] = GINT16_FROM_LE(buffer[i]);
+		}
+
+		count = BeatDetectAndClassifyBlock(osea, samples, len, found);
+		for(i = 0; i < count; i++)
+		{
+			beat_sample = record->samples + found[i].sample -
+				found[i].delay;
+			fprintf(beat_output, "%" G_GINT64_FORMAT "\t%c\t%d\n",
+					beat_sample,
+					ecg_batch_beat_label(found[i].type),
+					found[i].match);
+
+			if(previous_beat >= 0)
+			{
+				fprintf(rr_output, "%.3f\t%.1f\n",
+						(gdouble)beat_sample /
+						options->sample_rate,
+						(beat_sample - previous_beat) *
+						1000.0 / options->sample_rate);
+			}
+			previous_beat = beat_sample;
+
+			annotation.time = beat_sample;
+			annotation.label = BxbLabel(found[i].type);
+			g_array_append_val(beats, annotation);
+		}
+
+		record->samples += len;
+		record->beats += count;
+	}
+
+	if(ferror(input))
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to read record %s: %s",
+				record->path, strerror(errno));
+		goto analyze_done;
+	}
+
+	if(ferror(beat_output) || ferror(rr_output))
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to write the results of %s",
+				record->path);
+		goto analyze_done;
+	}
+
+	success = TRUE;
+
+analyze_done:
+	if(osea)
+	{
+		OseaDestroy(osea);
+	}
+	if(input)
+	{
+		fclose(input);
+	}
+	if(beat_output)
+	{
+		fclose(beat_output);
+	}
+	if(rr_output)
+	{
+		fclose(rr_output);
+	}
+	g_free(path);
+
+	DEBUG_END();
+	return success;
+}
+
+/**
+ * @brief Read reference beat annotations
+ *
+ * @param path Path of the annotation file
+ * @param annotations Array of #BxbAnnotation where the beats are appended
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean ecg_batch_read_reference(
+		const gchar *path,
+		GArray *annotations,
+		GError **error)
+{
+	gchar *contents = NULL;
+	gchar **lines = NULL;
+	gchar **fields = NULL;
+	BxbAnnotation annotation;
+	gint field = 0;
+	gint line = 0;
+	gint i;
+
+	DEBUG_BEGIN();
+
+	if(!g_file_get_contents(path, &contents, NULL, error))
+	{
+		DEBUG_END();
+		return FALSE;
+	}
+
+	lines = g_strsplit(contents, "\n", -1);
+	g_free(contents);
+
+	for(line = 0; lines[line]; line++)
+	{
+		fields = g_strsplit_set(g_strstrip(lines[line]), " \t", -1);
+
+		/* Skip empty fields caused by repeated white space, and the
+		 * time column of rdann output */
+		field = 0;
+		while(fields[field] && (*fields[field] == '\0' ||
+				strchr(fields[field], ':')))
+		{
+			field++;
+		}
+
+		if(fields[field] && g_ascii_isdigit(*fields[field]))
+		{
+			annotation.time = strtol(fields[field], NULL, 10);
+			do
+			{
+				field++;
+			} while(fields[field] && *fields[field] == '\0');
+
+			for(i = 0; fields[field] && batch_mnemonics[i].mnemonic;
+					i++)
+			{
+				if(strcmp(fields[field],
+					  batch_mnemonics[i].mnemonic) == 0)
+				{
+					annotation.label = BxbLabel(
+						batch_mnemonics[i].code);
+					g_array_append_val(annotations,
+							annotation);
+					break;
+				}
+			}
+		}
+		g_strfreev(fields);
+	}
+
+	g_strfreev(lines);
+
+	DEBUG_END();
+	return TRUE;
+}
+
+static gchar ecg_batch_beat_label(gint beat_type)
+{
+	switch(beat_type)
+	{
+		case NORMAL:
+			return 'N';
+		case PVC:
+			return 'V';
+		default:
+			return 'Q';
+	}
+}
+
+static gint ecg_batch_get_processors(void)
+{
+	glong count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (gint)count : 1;
+}
+
+static void ecg_batch_print_scores(const BxbResult *result)
+{
+	BxbStats stats;
+
+	BxbGetStats(result, &stats);
+
+	g_print("  QRS TP %ld FN %ld FP %ld", stats.qrsTP, stats.qrsFN,
+			stats.qrsFP);
+	if(stats.qrsTP > 0)
+	{
+		g_print("  Se %.2f%% +P %.2f%%",
+				100.0 * stats.qrsTP /
+				(stats.qrsTP + stats.qrsFN),
+				100.0 * stats.qrsTP /
+				(stats.qrsTP + stats.qrsFP));
+	}
+	g_print("\n");
+
+	g_print("  VEB TP %ld FN %ld FP %ld", stats.vebTP, stats.vebFN,
+			stats.vebFP);
+	if(stats.vebTP > 0)
+	{
+		g_print("  Se %.2f%% +P %.2f%%",
+				100.0 * stats.vebTP /
+				(stats.vebTP + stats.vebFN),
+				100.0 * stats.vebTP /
+				(stats.vebTP + stats.vebFP));
+	}
+	g_print("\n");
+
+	if(result->rrCount > 0)
+	{
+		g_print("  RR error RMS %.2f samples\n",
+				sqrt(result->rrSumSquares / result->rrCount));
+	}
+}
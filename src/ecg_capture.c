@@ -0,0 +1,341 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi, Sampo Savola
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* This module */
+#include "ecg_capture.h"
+
+/* System */
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+/* Other modules */
+#include "ec_error.h"
+
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+#define ECG_CAPTURE_MAGIC		"ECHRMCAP"
+#define ECG_CAPTURE_MAGIC_LEN		8
+#define ECG_CAPTURE_HEADER_LEN		24
+#define ECG_CAPTURE_RECORD_HEADER_LEN	12
+
+struct _EcgCaptureReader {
+	FILE *file;
+	gchar *path;
+	HRMName hrm_name;
+
+	/** @brief Time stamp of the record being read */
+	guint64 timestamp;
+
+	/** @brief Amount of unread data in the current record */
+	guint remaining;
+};
+
+struct _EcgCaptureWriter {
+	FILE *file;
+	gchar *path;
+
+	/** @brief Capture start time, microseconds since the epoch */
+	guint64 start_time;
+};
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+static guint64 ecg_capture_get_time(void);
+static guint64 ecg_capture_get_uint(const guint8 *data, guint len);
+static void ecg_capture_put_uint(guint8 *data, guint len, guint64 value);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+/*===========================================================================*
+ * Public functions                                                          *
+ *===========================================================================*/
+
+EcgCaptureReader *ecg_capture_reader_open(const gchar *path, GError **error)
+{
+	EcgCaptureReader *self = NULL;
+	guint8 header[ECG_CAPTURE_HEADER_LEN];
+	guint version = 0;
+	guint hrm_name = 0;
+
+	g_return_val_if_fail(path != NULL, NULL);
+	g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+	DEBUG_BEGIN();
+
+	self = g_new0(EcgCaptureReader, 1);
+	self->path = g_strdup(path);
+	self->file = fopen(path, "rb");
+	if(!self->file)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to open capture file %s: %s",
+				path, strerror(errno));
+		goto open_failure;
+	}
+
+	if(fread(header, 1, sizeof(header), self->file) != sizeof(header) ||
+	   memcmp(header, ECG_CAPTURE_MAGIC, ECG_CAPTURE_MAGIC_LEN) != 0)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+				"%s is not a heart rate monitor capture file",
+				path);
+		goto open_failure;
+	}
+
+	version = ecg_capture_get_uint(header + 8, 2);
+	if(version != ECG_CAPTURE_VERSION)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+				"Unsupported capture file version %d in %s",
+				version, path);
+		goto open_failure;
+	}
+
+	hrm_name = ecg_capture_get_uint(header + 10, 2);
+	if(hrm_name != FRWD && hrm_name != ZEPHYR)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+				"Unknown heart rate monitor type %d in %s",
+				hrm_name, path);
+		goto open_failure;
+	}
+	self->hrm_name = (HRMName)hrm_name;
+
+	DEBUG_END();
+	return self;
+
+open_failure:
+	ecg_capture_reader_close(self);
+	DEBUG_END();
+	return NULL;
+}
+
+HRMName ecg_capture_reader_get_hrm_name(EcgCaptureReader *self)
+{
+	g_return_val_if_fail(self != NULL, FRWD);
+	return self->hrm_name;
+}
+
+gint ecg_capture_reader_read(
+		EcgCaptureReader *self,
+		guint64 *timestamp,
+		guint8 *buf,
+		guint buf_size,
+		GError **error)
+{
+	guint8 header[ECG_CAPTURE_RECORD_HEADER_LEN];
+	size_t header_read = 0;
+	guint len = 0;
+
+	g_return_val_if_fail(self != NULL, -1);
+	g_return_val_if_fail(buf != NULL, -1);
+	g_return_val_if_fail(buf_size > 0, -1);
+	g_return_val_if_fail(error == NULL || *error == NULL, -1);
+
+	/* Skip empty records */
+	while(self->remaining == 0)
+	{
+		header_read = fread(header, 1, sizeof(header), self->file);
+		if(header_read == 0 && feof(self->file))
+		{
+			return 0;
+		}
+		if(header_read != sizeof(header))
+		{
+			g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+					"Truncated record in %s", self->path);
+			return -1;
+		}
+		self->timestamp = ecg_capture_get_uint(header, 8);
+		self->remaining = ecg_capture_get_uint(header + 8, 4);
+	}
+
+	len = MIN(buf_size, self->remaining);
+	if(fread(buf, 1, len, self->file) != len)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+				"Truncated record in %s", self->path);
+		return -1;
+	}
+	self->remaining -= len;
+
+	if(timestamp)
+	{
+		*timestamp = self->timestamp;
+	}
+	return (gint)len;
+}
+
+void ecg_capture_reader_close(EcgCaptureReader *self)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	if(self->file)
+	{
+		fclose(self->file);
+	}
+	g_free(self->path);
+	g_free(self);
+
+	DEBUG_END();
+}
+
+EcgCaptureWriter *ecg_capture_writer_open(
+		const gchar *path,
+		HRMName hrm_name,
+		GError **error)
+{
+	EcgCaptureWriter *self = NULL;
+	guint8 header[ECG_CAPTURE_HEADER_LEN];
+
+	g_return_val_if_fail(path != NULL, NULL);
+	g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+	DEBUG_BEGIN();
+
+	self = g_new0(EcgCaptureWriter, 1);
+	self->path = g_strdup(path);
+	self->start_time = ecg_capture_get_time();
+	self->file = fopen(path, "wb");
+	if(!self->file)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to create capture file %s: %s",
+				path, strerror(errno));
+		ecg_capture_writer_close(self);
+		DEBUG_END();
+		return NULL;
+	}
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, ECG_CAPTURE_MAGIC, ECG_CAPTURE_MAGIC_LEN);
+	ecg_capture_put_uint(header + 8, 2, ECG_CAPTURE_VERSION);
+	ecg_capture_put_uint(header + 10, 2, hrm_name);
+	ecg_capture_put_uint(header + 16, 8, self->start_time);
+
+	if(fwrite(header, 1, sizeof(header), self->file) != sizeof(header))
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to write capture file %s: %s",
+				path, strerror(errno));
+		ecg_capture_writer_close(self);
+		DEBUG_END();
+		return NULL;
+	}
+
+	DEBUG_END();
+	return self;
+}
+
+gboolean ecg_capture_writer_write(
+		EcgCaptureWriter *self,
+		const guint8 *data,
+		guint len,
+		GError **error)
+{
+	guint8 header[ECG_CAPTURE_RECORD_HEADER_LEN];
+
+	g_return_val_if_fail(self != NULL, FALSE);
+	g_return_val_if_fail(data != NULL || len == 0, FALSE);
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+	ecg_capture_put_uint(header, 8,
+			ecg_capture_get_time() - self->start_time);
+	ecg_capture_put_uint(header + 8, 4, len);
+
+	if(fwrite(header, 1, sizeof(header), self->file) != sizeof(header) ||
+	   fwrite(data, 1, len, self->file) != len)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to write capture file %s: %s",
+				self->path, strerror(errno));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void ecg_capture_writer_close(EcgCaptureWriter *self)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	if(self->file)
+	{
+		if(fclose(self->file) != 0)
+		{
+			g_warning("Unable to close capture file %s: %s",
+					self->path, strerror(errno));
+		}
+	}
+	g_free(self->path);
+	g_free(self);
+
+	DEBUG_END();
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static guint64 ecg_capture_get_time(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (guint64)tv.tv_sec * G_USEC_PER_SEC + tv.tv_usec;
+}
+
+static guint64 ecg_capture_get_uint(const guint8 *data, guint len)
+{
+	guint64 value = 0;
+	gint i;
+
+	for(i = len - 1; i >= 0; i--)
+	{
+		value = (value << 8) | data[i];
+	}
+	return value;
+}
+
+static void ecg_capture_put_uint(guint8 *data, guint len, guint64 value)
+{
+	guint i;
+
+	for(i = 0; i < len; i++)
+	{
+		data[i] = value & 0xFF;
+		value = value >> 8;
+	}
+}
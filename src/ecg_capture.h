@@ -0,0 +1,155 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi, Sampo Savola
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/**
+ * @file ecg_capture.h
+ *
+ * @brief Capture files of the raw data received from a heart rate monitor.
+ *
+ * A capture file stores the raw byte chunks in the order they were read
+ * from the device, together with the time they were received, so that a
+ * session can be replayed later. All integers are little endian.
+ *
+ * <pre>
+ * Header (24 bytes):
+ *   0  8  Magic "ECHRMCAP"
+ *   8  2  Format version (1)
+ *  10  2  Heart rate monitor type (#HRMName)
+ *  12  4  Reserved (0)
+ *  16  8  Capture start time, microseconds since the epoch
+ *
+ * Record (12 + length bytes):
+ *   0  8  Time of reception, microseconds since the capture start
+ *   8  4  Length of the data
+ *  12     Data
+ * </pre>
+ *
+ * Captures are read and written sequentially, so the file can also be
+ * a FIFO.
+ */
+
+#ifndef _ECG_CAPTURE_H
+#define _ECG_CAPTURE_H
+
+/* Configuration */
+#include "config.h"
+
+/* GLib */
+#include <glib.h>
+
+/* Other modules */
+#include "hrm_framer.h"
+
+#define ECG_CAPTURE_VERSION		1
+
+typedef struct _EcgCaptureReader EcgCaptureReader;
+typedef struct _EcgCaptureWriter EcgCaptureWriter;
+
+/**
+ * @brief Open a capture file for reading
+ *
+ * @param path Path of the file
+ * @param error Return location for possible error
+ *
+ * @return Newly allocated reader, or NULL in case of an error
+ */
+EcgCaptureReader *ecg_capture_reader_open(const gchar *path, GError **error);
+
+/**
+ * @brief Get the type of the heart rate monitor that was captured
+ *
+ * @param self Pointer to #EcgCaptureReader
+ *
+ * @return Heart rate monitor type
+ */
+HRMName ecg_capture_reader_get_hrm_name(EcgCaptureReader *self);
+
+/**
+ * @brief Read the next chunk of data
+ *
+ * If the recorded chunk is bigger than the buffer, the rest of it is
+ * returned by the following calls, with the same time stamp.
+ *
+ * @param self Pointer to #EcgCaptureReader
+ * @param timestamp Return location for the time of reception, in
+ * microseconds since the start of the capture
+ * @param buf Buffer where to read the data
+ * @param buf_size Size of the buffer
+ * @param error Return location for possible error
+ *
+ * @return Amount of bytes read, 0 at the end of the capture, or -1 in case
+ * of an error
+ */
+gint ecg_capture_reader_read(
+		EcgCaptureReader *self,
+		guint64 *timestamp,
+		guint8 *buf,
+		guint buf_size,
+		GError **error);
+
+/**
+ * @brief Close a capture file and free the reader
+ *
+ * @param self Pointer to #EcgCaptureReader
+ */
+void ecg_capture_reader_close(EcgCaptureReader *self);
+
+/**
+ * @brief Create a capture file
+ *
+ * The capture start time is the time when this function is called.
+ *
+ * @param path Path of the file
+ * @param hrm_name Type of the heart rate monitor
+ * @param error Return location for possible error
+ *
+ * @return Newly allocated writer, or NULL in case of an error
+ */
+EcgCaptureWriter *ecg_capture_writer_open(
+		const gchar *path,
+		HRMName hrm_name,
+		GError **error);
+
+/**
+ * @brief Append a chunk of data that was received just now
+ *
+ * @param self Pointer to #EcgCaptureWriter
+ * @param data The received data
+ * @param len Length of the data
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean ecg_capture_writer_write(
+		EcgCaptureWriter *self,
+		const guint8 *data,
+		guint len,
+		GError **error);
+
+/**
+ * @brief Close a capture file and free the writer
+ *
+ * @param self Pointer to #EcgCaptureWriter
+ */
+void ecg_capture_writer_close(EcgCaptureWriter *self);
+
+#endif /* _ECG_CAPTURE_H */
@@ -58,9 +58,11 @@
 #define ECG_PACKET_ID_ACC_2			'\x55'
 #define ECG_PACKET_ID_ACC_3			'\x56'
 #define ECG_DATA_POLLING_STOP_CHECK_INTERVAL	15
+#define ECG_DATA_REPLAY_STOP_CHECK_INTERVAL	100000	/* microseconds */
 #define ECG_DATA_READ_BUFFER_SIZE		1024
-#define FRWD_PACKET_SIZE			93
-#define ZEPHYR_PACKET_SIZE			60
+#define ECG_DATA_CHUNK_COUNT			64
+#define ECG_DATA_BUFFER_SIZE			65536
+#define ECG_DATA_VOLTAGE_BUFFER_SIZE		16384
 /****************************************************************************
  * Private function prototypes                                              *
  ****************************************************************************/
@@ -74,12 +76,38 @@ static gint ecg_data_process_acc_data_block(EcgData *self, gint axis_count);
 static gboolean ecg_data_synchronize(EcgData *self, gboolean force);
 static void ecg_data_pop(EcgData *self, guint len, guint8 *checksum);
 
+static gboolean ecg_data_connect(EcgData *self, GError **error);
 static gboolean ecg_data_connect_bluetooth(EcgData *self, GError **error);
+static gboolean ecg_data_connect_replay(EcgData *self, GError **error);
 static void ecg_data_disconnect_bluetooth(EcgData *self);
 static void ecg_data_wait_for_disconnect(EcgData *self);
-static gboolean ecg_data_setup_serial_pipe(EcgData *self, GError **error);
-static gboolean frwd_parse_heartrate(EcgData *self,gchar* frwd);
-static gboolean zephyr_parse_heartrate(EcgData *self,gchar* zephyr);
+
+/**
+ * @brief Create the queue for the data and start the data poller thread
+ *
+ * @param self Pointer to #EcgData
+ * @param poller Thread function that produces the data
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean ecg_data_setup_chunk_queue(
+		EcgData *self,
+		GThreadFunc poller,
+		GError **error);
+
+/**
+ * @brief Callback for frames decoded by the #HrmFramer
+ *
+ * @param framer Pointer to #HrmFramer
+ * @param heart_rate Heart rate from the frame
+ * @param user_data Pointer to #EcgData
+ */
+static void ecg_data_heart_rate_decoded(
+		HrmFramer *framer,
+		gint heart_rate,
+		gpointer user_data);
+
 /**
  * @brief Remove unnecessary voltage data from the array.
  *
@@ -93,26 +121,58 @@ static void ecg_data_dispose_voltage_data(EcgData *self, guint len);
 
 
 /**
- * @brief Read data from rfcomm socket and push it into a pipe.
+ * @brief Read data from rfcomm socket directly into a chunk of the queue
+ * and pass it to the main loop.
  *
  * @param self Pointer to #EcgData
+ * @param chunk Chunk acquired from the queue
+ * @param size Size of the chunk
  *
  * @returns FALSE on critical error, TRUE otherwise.
  */
-static gboolean ecg_data_read_and_push_bluetooth_data(EcgData *self);
+static gboolean ecg_data_read_and_push_bluetooth_data(
+		EcgData *self,
+		guint8 *chunk,
+		guint size);
 
 static gpointer ecg_data_bluetooth_poller(gpointer user_data);
 
-static void ecg_data_receive_data(
-		GIOChannel *channel,
-		guchar *buffer,
-		gsize count);
+/**
+ * @brief Thread function that feeds the data from a capture file to the
+ * main loop
+ *
+ * @param user_data Pointer to #EcgData
+ */
+static gpointer ecg_data_replay_poller(gpointer user_data);
+
+/**
+ * @brief Wait for a free chunk in the queue
+ *
+ * This is used only from the data poller threads.
+ *
+ * @param self Pointer to #EcgData
+ * @param size Return location for the size of the chunk
+ *
+ * @return The chunk, or NULL if polling should be stopped
+ */
+static guint8 *ecg_data_poller_acquire_chunk(EcgData *self, guint *size);
+
+/**
+ * @brief Check whether the data poller thread should stop
+ *
+ * @param self Pointer to #EcgData
+ *
+ * @return TRUE if disconnection has been requested
+ */
+static gboolean ecg_data_poller_should_stop(EcgData *self);
 
-static void ecg_data_send_data(
-		GIOChannel *channel,
-		guchar *buf,
-		gssize count,
-		gboolean flush);
+/**
+ * @brief Release the resources of a connection. Called from the data
+ * poller thread when it stops.
+ *
+ * @param self Pointer to #EcgData
+ */
+static void ecg_data_poller_finish(EcgData *self);
 
 /**
  * @brief Callback for setting the bluetooth address of the ECG device
@@ -125,6 +185,28 @@ static void ecg_data_set_bluetooth_address(
 		gpointer user_data,
 		gpointer user_data_2);
 
+/**
+ * @brief Callback for setting the capture file
+ *
+ * @param entry GConfEntry that contains the data
+ * @param user_data Pointer to #EcgData
+ */
+static void ecg_data_gconf_capture_file_changed(
+		const GConfEntry *entry,
+		gpointer user_data,
+		gpointer user_data_2);
+
+/**
+ * @brief Callback for setting the file to replay
+ *
+ * @param entry GConfEntry that contains the data
+ * @param user_data Pointer to #EcgData
+ */
+static void ecg_data_gconf_replay_file_changed(
+		const GConfEntry *entry,
+		gpointer user_data,
+		gpointer user_data_2);
+
 /**
  * @brief Push new raw data to the buffer.
  *
@@ -147,8 +229,6 @@ static void ecg_data_push(EcgData *self, const guint8 *data, guint len);
 
 EcgData *ecg_data_new(GConfHelperData *gconf_helper)
 {
-	g_return_val_if_fail(gconf_helper != NULL, NULL);
-
 	DEBUG_BEGIN();
 
 	EcgData *self = g_new0(EcgData, 1);
@@ -161,14 +241,22 @@ EcgData *ecg_data_new(GConfHelperData *gconf_helper)
 
 	self->gconf_helper = gconf_helper;
 
-	self->buffer = g_byte_array_new();
-	self->voltage_array = g_byte_array_new();
+	self->buffer = ring_buffer_new(ECG_DATA_BUFFER_SIZE);
+	self->voltage_array = ring_buffer_new(ECG_DATA_VOLTAGE_BUFFER_SIZE);
 	self->connection_status_mutex = g_mutex_new();
 	self->connection_status = ECG_DATA_DISCONNECTED;
 
 	self->current_sequence_number = -1;
 	self->bluetooth_serial_fd = -1;
 
+	hrm_framer_init(&self->framer, FRWD);
+
+	if(!gconf_helper)
+	{
+		DEBUG_END();
+		return self;
+	}
+
 	gconf_helper_add_key_string(
 		gconf_helper,
 		ECGC_BLUETOOTH_ADDRESS,
@@ -177,6 +265,22 @@ EcgData *ecg_data_new(GConfHelperData *gconf_helper)
 		self,
 		NULL);
 
+	gconf_helper_add_key_string(
+		gconf_helper,
+		ECGC_HRM_CAPTURE_FILE,
+		"",
+		ecg_data_gconf_capture_file_changed,
+		self,
+		NULL);
+
+	gconf_helper_add_key_string(
+		gconf_helper,
+		ECGC_HRM_REPLAY_FILE,
+		"",
+		ecg_data_gconf_replay_file_changed,
+		self,
+		NULL);
+
 	DEBUG_END();
 	return self;
 }
@@ -190,9 +294,12 @@ void ecg_data_destroy(EcgData *self)
 	ecg_data_wait_for_disconnect(self);
 
 	g_mutex_free(self->connection_status_mutex);
-	g_byte_array_free(self->buffer, TRUE);
-	g_byte_array_free(self->voltage_array, TRUE);
+	ring_buffer_free(self->buffer);
+	ring_buffer_free(self->voltage_array);
 
+	g_free(self->bluetooth_name);
+	g_free(self->replay_file);
+	g_free(self->capture_file);
 	g_free(self);
 	DEBUG_END();
 }
@@ -217,7 +324,17 @@ gboolean ecg_data_add_callback_ecg(
 	{
 		DEBUG_LONG("First callback added. Connecting to ECG monitor");
 		first = TRUE;
-		self->bluetooth_name = gconf_helper_get_value_string_with_default(self->gconf_helper,ECGC_BLUETOOTH_NAME,"");
+		g_free(self->bluetooth_name);
+		if(self->gconf_helper)
+		{
+			self->bluetooth_name =
+				gconf_helper_get_value_string_with_default(
+						self->gconf_helper,
+						ECGC_BLUETOOTH_NAME,
+						"");
+		} else {
+			self->bluetooth_name = g_strdup("");
+		}
 		if(g_strrstr(self->bluetooth_name,"HXM") != NULL)
 		{
 		 self->hrm_name = ZEPHYR; 
@@ -229,6 +346,8 @@ gboolean ecg_data_add_callback_ecg(
 		 self->hrm_name = FRWD;
 		  DEBUG_LONG("FRWD HRM attached");
 		}
+
+		hrm_framer_init(&self->framer, self->hrm_name);
 	}
 
 	if(first)
@@ -241,8 +360,7 @@ gboolean ecg_data_add_callback_ecg(
 		{
 			case ECG_DATA_DISCONNECTED:
 				bluetooth_connection_ok =
-					ecg_data_connect_bluetooth(self,
-							error);
+					ecg_data_connect(self, error);
 				break;
 			case ECG_DATA_CONNECTED:
 			case ECG_DATA_CONNECTING:
@@ -258,8 +376,7 @@ gboolean ecg_data_add_callback_ecg(
 				 * and then connect again */
 				ecg_data_wait_for_disconnect(self);
 				bluetooth_connection_ok =
-					ecg_data_connect_bluetooth(self,
-							error);
+					ecg_data_connect(self, error);
 				break;
 		}
 	}
@@ -376,6 +493,58 @@ gint ecg_data_get_zero_level(EcgData *self)
 	return 128;
 }
 
+const HrmFramerStats *ecg_data_get_framing_stats(EcgData *self)
+{
+	g_return_val_if_fail(self != NULL, NULL);
+	return hrm_framer_get_stats(&self->framer);
+}
+
+guint64 ecg_data_get_received_bytes(EcgData *self)
+{
+	g_return_val_if_fail(self != NULL, 0);
+	return self->received_bytes;
+}
+
+void ecg_data_set_replay_file(
+		EcgData *self,
+		const gchar *path,
+		gboolean real_time)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	g_free(self->replay_file);
+	self->replay_file = NULL;
+	if(path && *path)
+	{
+		self->replay_file = g_strdup(path);
+	}
+	self->replay_real_time = real_time;
+
+	DEBUG_END();
+}
+
+void ecg_data_set_capture_file(EcgData *self, const gchar *path)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	g_free(self->capture_file);
+	self->capture_file = NULL;
+	if(path && *path)
+	{
+		self->capture_file = g_strdup(path);
+	}
+
+	DEBUG_END();
+}
+
+gboolean ecg_data_is_end_of_stream(EcgData *self)
+{
+	g_return_val_if_fail(self != NULL, FALSE);
+	return self->end_of_stream;
+}
+
 /*===========================================================================*
  * Private function declarations                                             *
  *===========================================================================*/
@@ -402,15 +571,34 @@ static void ecg_data_invoke_callbacks(EcgData *self, gint heart_rate)
 
 static void ecg_data_push(EcgData *self, const guint8 *data, guint len)
 {
+	guint written = 0;
+
 	g_return_if_fail(self != NULL);
 	g_return_if_fail(data != NULL);
 
 	DEBUG_BEGIN();
 
 	DEBUG("Pushing %d bytes of data to buffer", len);
-	self->buffer = g_byte_array_append(self->buffer, data, len);
+	while(len > 0)
+	{
+		written = ring_buffer_write(self->buffer, data, len);
+		if(written == 0)
+		{
+			/* The buffer is full of data that could not be
+			 * processed. Drop the oldest data to make room. */
+			g_warning("ECG data buffer overflow. Discarding %d bytes",
+					MIN(len, ring_buffer_get_length(
+							self->buffer)));
+			ring_buffer_skip(self->buffer,
+					MIN(len, ring_buffer_get_length(
+							self->buffer)));
+			continue;
+		}
+		data += written;
+		len -= written;
 
-	ecg_data_process(self);
+		ecg_data_process(self);
+	}
 
 	DEBUG_END();
 }
@@ -428,76 +616,9 @@ static void ecg_data_process(EcgData *self)
 	g_return_if_fail(self != NULL);
 
 	DEBUG_BEGIN();
-	gint offset = 0;
-
-	if(self->hrm_name == FRWD)
-	{
-	while(self->buffer->len > 0)
-	{
-		gchar *pointer = g_strstr_len((const gchar *)self->buffer->data,
-					       self->buffer->len,
-	    "FRWD");
-		if(!pointer)
-		{
-			/* No FRWD data. Clear buffer and wait for more data. */
-			ecg_data_pop(self, self->buffer->len, NULL);
-			break;
-		}
-
-		/* Remove non-FRWD data from the beginning of the buffer */
-		offset = pointer - (gchar *)self->buffer->data;
-		if(offset > 0)
-		ecg_data_pop(self, offset, NULL);
-
-		if(frwd_parse_heartrate(self, pointer))
-		{
-			/* Remove parsed data */
-			ecg_data_pop(self, FRWD_PACKET_SIZE,NULL);
-		}
-		else {
-			/*Wait for more data */
-			break;
-		}
-		/* Continue until the buffer is empty */
-	}
-	}
-	if(self->hrm_name == ZEPHYR){
-	  
-	  while(self->buffer->len > 0)
-	{
-		gchar begin_char[] = {0x02, '\0'};
-		gchar *pointer = g_strstr_len((const gchar *)self->buffer->data,
-					       self->buffer->len,&begin_char);
-		if(!pointer)
-		{
-			/* No ZEPHYR data. Clear buffer and wait for more data. */
-			ecg_data_pop(self, self->buffer->len, NULL);
-			break;
-		}
 
-		/* Remove non-ZEPHYR data from the beginning of the buffer */
-		offset = pointer - (gchar *)self->buffer->data;
-		if(offset > 0)
-		ecg_data_pop(self, offset, NULL);
-
-		if(zephyr_parse_heartrate(self, pointer))
-		{
-			/* Remove parsed data */
-			ecg_data_pop(self, ZEPHYR_PACKET_SIZE,NULL);
-		}
-		else {
-			/*Wait for more data */
-			break;
-		}
-		/* Continue until the buffer is empty */
-	}
-	  
-	  
-	  
-	}
-	 
-	  
-	
+	hrm_framer_process(&self->framer, self->buffer,
+			ecg_data_heart_rate_decoded, self);
 
 	DEBUG_END();
 }
@@ -536,7 +657,7 @@ static gboolean ecg_data_process_data_chunk(EcgData *self)
 
 		/* Check that we have the full packet header. If not, we'll get
 		 * back here later. */
-		if(self->buffer->len < ECG_PACKET_HEADER_LEN)
+		if(ring_buffer_get_length(self->buffer) < ECG_PACKET_HEADER_LEN)
 		{
 			DEBUG_LONG("Packet header incomplete. Waiting for more "
 					"data");
@@ -546,8 +667,8 @@ static gboolean ecg_data_process_data_chunk(EcgData *self)
 
 		/* Just a check to be sure */
 		if(!(
-					(self->buffer->data[0] == 0x00) &&
-					(self->buffer->data[1] == 0xFE)
+					(ring_buffer_peek(self->buffer, 0) == 0x00) &&
+					(ring_buffer_peek(self->buffer, 1) == 0xFE)
 		    ))
 		{
 			g_critical("Sync mark is not where it is supposed "
@@ -556,16 +677,17 @@ static gboolean ecg_data_process_data_chunk(EcgData *self)
 			return ecg_data_synchronize(self, FALSE);
 		}
 
-		self->battery_level = ((guint8)self->buffer->data[2]) / 2;
+		self->battery_level = ring_buffer_peek(self->buffer, 2) / 2;
 		/* Get the most significant byte and shift it */
-		sequence_number = ((guint16)(self->buffer->data[3])) & 0x0F;
+		sequence_number = ((guint16)ring_buffer_peek(self->buffer, 3))
+			& 0x0F;
 		sequence_number = sequence_number << 8;
 
 		/* Get the four first butes from the end part, and shift it */
-		sequence_number += (guint16)(self->buffer->data[4]);
+		sequence_number += (guint16)ring_buffer_peek(self->buffer, 4);
 		sequence_number += (guint16)seq_number_temp;
 
-		if(self->buffer->data[3] && (1 << 4))
+		if(ring_buffer_peek(self->buffer, 3) && (1 << 4))
 		{
 			/**
 			 * @todo: How is the exact position of the event
@@ -595,7 +717,7 @@ static gboolean ecg_data_process_data_chunk(EcgData *self)
 		self->current_sequence_number = (gint)sequence_number;
 
 		/* How many data blocks are there? */
-		data_block_count = (gint)((guint8)(self->buffer->data[5]));
+		data_block_count = (gint)ring_buffer_peek(self->buffer, 5);
 		DEBUG_LONG("%d data blocks", data_block_count);
 
 		/* We have now read the whole header and stored the extracted
@@ -665,10 +787,17 @@ static gboolean ecg_data_process_data_chunk(EcgData *self)
 	}
 
 	/* Verify the checksum and remove it */
-	if(checksum != (guint8)self->buffer->data[0])
+	if(ring_buffer_get_length(self->buffer) < 1)
+	{
+		DEBUG_LONG("Checksum not yet received. Waiting for more data");
+		current_data_block = data_block_count;
+		DEBUG_END();
+		return FALSE;
+	}
+	if(checksum != ring_buffer_peek(self->buffer, 0))
 	{
 		g_warning("Checksum does not match (%d ; %d)",
-				checksum, (guint8)self->buffer->data[0]);
+				checksum, ring_buffer_peek(self->buffer, 0));
 		goto resync_required;
 	} else {
 		DEBUG_LONG("Checksum OK");
@@ -716,7 +845,7 @@ static gint ecg_data_process_data_block(EcgData *self)
 	g_return_val_if_fail(self != NULL, -2);
 	DEBUG_BEGIN();
 
-	if(self->buffer->len < ECG_PACKET_HEADER_LEN)
+	if(ring_buffer_get_length(self->buffer) < ECG_PACKET_HEADER_LEN)
 	{
 		DEBUG("Not enough data yet.");
 		return -1;
@@ -724,7 +853,7 @@ static gint ecg_data_process_data_block(EcgData *self)
 
 	/* Determine the packet type: ECG, 2 Axis accelerometer or
 	 * 3 axis accelerometer */
-	switch(self->buffer->data[0])
+	switch((gchar)ring_buffer_peek(self->buffer, 0))
 	{
 		case ECG_PACKET_ID_ECG:
 			retval = ecg_data_process_ecg_data_block(self);
@@ -737,7 +866,7 @@ static gint ecg_data_process_data_block(EcgData *self)
 			break;
 		default:
 			g_warning("Unknown data packet ID: 0x%X",
-					self->buffer->data[0]);
+					ring_buffer_peek(self->buffer, 0));
 			DEBUG_END();
 			return -2;
 	}
@@ -759,22 +888,23 @@ static gint ecg_data_process_ecg_data_block(EcgData *self)
 {
 	guint data_block_length = 0;
 	guint ecg_data_offset = 0;
+	guint len = 0;
 
 	g_return_val_if_fail(self != NULL, -2);
 	DEBUG_BEGIN();
 
-	data_block_length = self->buffer->data[1];
+	data_block_length = ring_buffer_peek(self->buffer, 1);
 	data_block_length = data_block_length << 8;
-	data_block_length += self->buffer->data[2];
+	data_block_length += ring_buffer_peek(self->buffer, 2);
 	DEBUG("Data block length: %d", data_block_length);
 
-	if(self->buffer->len < data_block_length)
+	if(ring_buffer_get_length(self->buffer) < data_block_length)
 	{
 		DEBUG("Not enough data yet.");
 		return -1;
 	}
 
-	switch(self->buffer->data[3])
+	switch(ring_buffer_peek(self->buffer, 3))
 	{
 		case '\x01':
 			DEBUG("150 samples per second");
@@ -786,24 +916,42 @@ static gint ecg_data_process_ecg_data_block(EcgData *self)
 			break;
 		default:
 			g_warning("Unknown ECG data format ID: 0x%X",
-					self->buffer->data[3]);
+					ring_buffer_peek(self->buffer, 3));
 			return -2;
 	}
 
-	ecg_data_offset = self->voltage_array->len;
+	if(data_block_length < ECG_PACKET_HEADER_LEN)
+	{
+		g_warning("Invalid ECG data block length: %d",
+				data_block_length);
+		return -2;
+	}
 
-	self->voltage_array = g_byte_array_append(
+	/* Make room for the new samples by discarding the oldest ones */
+	len = data_block_length - ECG_PACKET_HEADER_LEN;
+	if(ring_buffer_get_free_space(self->voltage_array) < len)
+	{
+		ecg_data_dispose_voltage_data(self, MIN(
+				ring_buffer_get_length(self->voltage_array),
+				len - ring_buffer_get_free_space(
+					self->voltage_array)));
+	}
+
+	ecg_data_offset = ring_buffer_get_length(self->voltage_array);
+
+	ring_buffer_write_from(
 			self->voltage_array,
-			self->buffer->data + ECG_PACKET_HEADER_LEN,
-			data_block_length - ECG_PACKET_HEADER_LEN);
+			self->buffer,
+			ECG_PACKET_HEADER_LEN,
+			len);
 
 	/*
 	ecg_data_invoke_callbacks(self, ecg_data_offset,
 			data_block_length - ECG_PACKET_HEADER_LEN);
 */
 	/** @todo: Is the voltage buffer even needed anymore? */
-	ecg_data_dispose_voltage_data(self, data_block_length -
-			ECG_PACKET_HEADER_LEN);
+	ecg_data_dispose_voltage_data(self,
+			ring_buffer_get_length(self->voltage_array));
 
 	DEBUG_END();
 	return data_block_length;
@@ -829,26 +977,26 @@ static gint ecg_data_process_acc_data_block(EcgData *self, gint axis_count)
 
 	DEBUG_BEGIN();
 
-	data_block_length = self->buffer->data[1];
+	data_block_length = ring_buffer_peek(self->buffer, 1);
 	data_block_length = data_block_length << 8;
-	data_block_length += self->buffer->data[2];
+	data_block_length += ring_buffer_peek(self->buffer, 2);
 	DEBUG("Data block length: %d (0x%X)", data_block_length,
 			data_block_length);
 
-	if(self->buffer->len < data_block_length)
+	if(ring_buffer_get_length(self->buffer) < data_block_length)
 	{
 		DEBUG("Not enough data yet.");
 		return -1;
 	}
 
-	if(self->buffer->data[3] != '\x00')
+	if(ring_buffer_peek(self->buffer, 3) != '\x00')
 	{
 		g_warning("Invalid accelerometer data format: 0x%X",
-				self->buffer->data[3]);
+				ring_buffer_peek(self->buffer, 3));
 		return -2;
 	}
 
-	ecg_data_offset = self->voltage_array->len;
+	ecg_data_offset = ring_buffer_get_length(self->voltage_array);
 
 #if 0
 	/** @todo Extract the acc data */
@@ -903,6 +1051,7 @@ static gboolean ecg_data_synchronize(EcgData *self, gboolean force)
 	 * match later (i.e., invalid chunk/packet headers etc.)
 	 */
 
+	static const guint8 sync_mark[] = { 0x00, 0xFE };
 	gint i = 0;
 
 	g_return_val_if_fail(self != NULL, FALSE);
@@ -911,7 +1060,7 @@ static gboolean ecg_data_synchronize(EcgData *self, gboolean force)
 	if(force)
 	{
 		/* Check that there is room even for the initial sync mark */
-		if(self->buffer->len < 2)
+		if(ring_buffer_get_length(self->buffer) < 2)
 		{
 			DEBUG_END();
 			return FALSE;
@@ -921,38 +1070,27 @@ static gboolean ecg_data_synchronize(EcgData *self, gboolean force)
 		ecg_data_pop(self, 2, NULL);
 	}
 
-	/* Loop only to buffer->len - 1, because the sync mark is
-	 * two bytes */
-	for(i = 0; i < self->buffer->len - 1; i++)
+	i = ring_buffer_find(self->buffer, 0, sync_mark, sizeof(sync_mark));
+	if(i >= 0)
 	{
-		if(self->buffer->data[i] ==  0x00)
+		/* Throw away anything before sync mark, because it might be
+		 * anything. We don't have a header for it. */
+		DEBUG("Found sync mark at %d (%X)", i, i);
+		if(i + 5 < ring_buffer_get_length(self->buffer))
 		{
-			if(self->buffer->data[i+1] == 0xFE)
-			{
-				/* Throw away anything before sync mark,
-				 * because it might be anything. We don't
-				 * have a header for it. */
-				DEBUG("Found sync mark at %d (%X)", i, i);
-				if(i < self->buffer->len - 5)
-				{
-					DEBUG("Battery level seems now to be %d (%X)",
-							(guint8)self->buffer->data[i+2],
-							(guint8)self->buffer->data[i+2]);
-				}
+			DEBUG("Battery level seems now to be %d (%X)",
+					ring_buffer_peek(self->buffer, i + 2),
+					ring_buffer_peek(self->buffer, i + 2));
+		}
 
-				if(i > 0)
-				{
-					DEBUG("Removing %d unnecessary bytes",
-							i);
-					// self->last_processed_location = i;
-					ecg_data_pop(self, i, NULL);
-				}
-				// self->last_processed_location = 0;
-				self->in_sync = TRUE;
-				DEBUG_END();
-				return TRUE;
-			}
+		if(i > 0)
+		{
+			DEBUG("Removing %d unnecessary bytes", i);
+			ecg_data_pop(self, i, NULL);
 		}
+		self->in_sync = TRUE;
+		DEBUG_END();
+		return TRUE;
 	}
 
 	/* The sync mark was not found. Set the in_sync to FALSE,
@@ -974,10 +1112,8 @@ static gboolean ecg_data_synchronize(EcgData *self, gboolean force)
  */
 static void ecg_data_pop(EcgData *self, guint len, guint8 *checksum)
 {
-	guint8 *data_ptr;
-
 	g_return_if_fail(self != NULL);
-	g_return_if_fail(len <= self->buffer->len);
+	g_return_if_fail(len <= ring_buffer_get_length(self->buffer));
 	g_return_if_fail(len > 0);
 
 	DEBUG_BEGIN();
@@ -995,20 +1131,11 @@ static void ecg_data_pop(EcgData *self, guint len, guint8 *checksum)
 	if(checksum)
 	{
 		/* Add to the checksum of the removed data */
-		data_ptr = self->buffer->data;
-		for(data_ptr = self->buffer->data;
-				data_ptr < self->buffer->data + len;
-				data_ptr++)
-		{
-			*checksum += *((guint8 *)data_ptr);
-		}
+		*checksum += ring_buffer_sum(self->buffer, 0, len);
 	}
 
-	// self->last_processed_location = self->last_processed_location + 1 - len;
 	DEBUG("Removing %d bytes", len);
-	self->buffer = g_byte_array_remove_range(
-			self->buffer,
-			0, len);
+	ring_buffer_skip(self->buffer, len);
 
 	DEBUG_END();
 }
@@ -1016,9 +1143,7 @@ static void ecg_data_pop(EcgData *self, guint len, guint8 *checksum)
 static void ecg_data_dispose_voltage_data(EcgData *self, guint len)
 {
 	DEBUG_BEGIN();
-	self->voltage_array = g_byte_array_remove_range(
-			self->voltage_array,
-			0, len);
+	ring_buffer_skip(self->voltage_array, len);
 	DEBUG_END();
 }
 
@@ -1053,43 +1178,128 @@ static void ecg_data_set_bluetooth_address(
 	DEBUG_END();
 }
 
+static void ecg_data_gconf_capture_file_changed(
+		const GConfEntry *entry,
+		gpointer user_data,
+		gpointer user_data_2)
+{
+	EcgData *self = (EcgData *)user_data;
+
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(entry != NULL);
+
+	ecg_data_set_capture_file(self, gconf_value_get_string(
+				gconf_entry_get_value(entry)));
+}
+
+static void ecg_data_gconf_replay_file_changed(
+		const GConfEntry *entry,
+		gpointer user_data,
+		gpointer user_data_2)
+{
+	EcgData *self = (EcgData *)user_data;
+
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(entry != NULL);
+
+	ecg_data_set_replay_file(self, gconf_value_get_string(
+				gconf_entry_get_value(entry)), TRUE);
+}
+
 static gboolean ecg_data_bluetooth_data_arrived(
 		GIOChannel *source,
 		GIOCondition condition,
 		gpointer user_data)
 {
-	gchar str_ret[ECG_DATA_READ_BUFFER_SIZE];
+	const guint8 *chunk = NULL;
+	guint len = 0;
 
 	EcgData *self = (EcgData *)user_data;
 
 	g_return_val_if_fail(user_data != NULL, FALSE);
 	DEBUG_BEGIN();
 
-	guchar data_size_c[2];
-	guint data_size;
+	/* Clear the notification first, so that chunks that are committed
+	 * while we are processing will cause a new notification */
+	chunk_queue_consumer_clear_notification(self->chunk_queue);
+
+	while((chunk = chunk_queue_consumer_peek(self->chunk_queue, &len)))
+	{
+		if(len == 0)
+		{
+			/* An empty chunk marks the end of a replay */
+			DEBUG_LONG("End of stream");
+			self->end_of_stream = TRUE;
+		} else {
+			self->received_bytes += len;
+			ecg_data_push(self, chunk, len);
+		}
+
+		/* If the last callback was removed by a callback, the
+		 * queue is about to be freed by the data poller */
+		if(self->chunk_queue_watch_id == 0)
+		{
+			DEBUG_END();
+			return FALSE;
+		}
+		chunk_queue_consumer_release(self->chunk_queue);
+	}
+
+	DEBUG_END();
+	return TRUE;
+}
+
+static gboolean ecg_data_connect(EcgData *self, GError **error)
+{
+	if(self->replay_file)
+	{
+		return ecg_data_connect_replay(self, error);
+	}
+	return ecg_data_connect_bluetooth(self, error);
+}
+
+static gboolean ecg_data_connect_replay(EcgData *self, GError **error)
+{
+	g_return_val_if_fail(self != NULL, FALSE);
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+	DEBUG_BEGIN();
+
+	self->replay_reader = ecg_capture_reader_open(self->replay_file, error);
+	if(!self->replay_reader)
+	{
+		DEBUG_END();
+		return FALSE;
+	}
+
+	/* The capture knows which kind of device it came from */
+	self->hrm_name = ecg_capture_reader_get_hrm_name(self->replay_reader);
+	hrm_framer_init(&self->framer, self->hrm_name);
 
-	/* Read 2 characters to data_size_c */
-	ecg_data_receive_data(
-			self->bluetooth_serial_channel_read,
-			data_size_c,
-			2);
+	g_mutex_lock(self->connection_status_mutex);
+	self->connection_status = ECG_DATA_CONNECTING;
+	g_mutex_unlock(self->connection_status_mutex);
 
-	data_size = (gint)data_size_c[1] + ((gint) data_size_c[0] << 8);
+	if(!ecg_data_setup_chunk_queue(self, ecg_data_replay_poller, error))
+	{
+		ecg_capture_reader_close(self->replay_reader);
+		self->replay_reader = NULL;
 
-	/* Read <data_size> characters to str_ret */
-	ecg_data_receive_data(
-			self->bluetooth_serial_channel_read,
-			str_ret,
-			data_size);
+		g_mutex_lock(self->connection_status_mutex);
+		self->connection_status = ECG_DATA_DISCONNECTED;
+		g_mutex_unlock(self->connection_status_mutex);
+
+		DEBUG_END();
+		return FALSE;
+	}
 
-	ecg_data_push(self, (gint8 *)str_ret, (guint)data_size);
-	
 	DEBUG_END();
 	return TRUE;
 }
 
 static gboolean ecg_data_connect_bluetooth(EcgData *self, GError **error)
 {
+	GError *capture_error = NULL;
+
 	struct sockaddr_rc addr = { 0 };
 	gint status = 0;
 	gint i = 0;
@@ -1158,8 +1368,27 @@ static gboolean ecg_data_connect_bluetooth(EcgData *self, GError **error)
 		goto connection_failure;
 	}
 
-	if(!ecg_data_setup_serial_pipe(self, error))
+	if(self->capture_file)
+	{
+		self->capture_writer = ecg_capture_writer_open(
+				self->capture_file,
+				self->hrm_name,
+				&capture_error);
+		if(!self->capture_writer)
+		{
+			/* Capturing is not essential; go on without it */
+			g_warning("%s", capture_error->message);
+			g_error_free(capture_error);
+		}
+	}
+
+	if(!ecg_data_setup_chunk_queue(self, ecg_data_bluetooth_poller, error))
 	{
+		if(self->capture_writer)
+		{
+			ecg_capture_writer_close(self->capture_writer);
+			self->capture_writer = NULL;
+		}
 		DEBUG_END();
 		return FALSE;
 	}
@@ -1187,6 +1416,23 @@ static void ecg_data_disconnect_bluetooth(EcgData *self)
 	g_return_if_fail(self != NULL);
 	DEBUG_BEGIN();
 
+	/* Firstly, we remove the watch for the queue so that we can
+	 * immediately stop sending data to the listeners (that should happen
+	 * automatically anyhow, though, because the callbacks have already
+	 * been removed). This must be done before the data poller is asked
+	 * to stop, because the poller frees the queue.
+	 */
+	if(self->chunk_queue_watch_id)
+	{
+		g_source_remove(self->chunk_queue_watch_id);
+		self->chunk_queue_watch_id = 0;
+	}
+	if(self->chunk_queue_channel)
+	{
+		g_io_channel_unref(self->chunk_queue_channel);
+		self->chunk_queue_channel = NULL;
+	}
+
 	/* Set the connection status to REQEUST_DISCONNECT so that
 	 * the data poller knows to stop polling
 	 */
@@ -1194,13 +1440,10 @@ static void ecg_data_disconnect_bluetooth(EcgData *self)
 	self->connection_status = ECG_DATA_REQUEST_DISCONNECT;
 	g_mutex_unlock(self->connection_status_mutex);
 
-	/* Firstly, we remove the watch for the readable end of the serial
-	 * channel so that we can immediately stop sending data to the
-	 * listeners (that should happen automatically anyhow, though, because
-	 * the callbacks have already been removed)
-	 */
-	g_source_remove(self->bluetooth_serial_channel_read_watch_id);
-	self->bluetooth_serial_channel_read_watch_id = 0;
+	DEBUG_LONG("Frames: %u, framing errors: %u, resyncs: %u",
+			self->framer.stats.frames,
+			self->framer.stats.framing_errors,
+			self->framer.stats.resyncs);
 
 	DEBUG_END();
 }
@@ -1236,43 +1479,40 @@ static void ecg_data_wait_for_disconnect(EcgData *self)
 	DEBUG_END();
 }
 
-static gboolean ecg_data_setup_serial_pipe(EcgData *self, GError **error)
+static gboolean ecg_data_setup_chunk_queue(
+		EcgData *self,
+		GThreadFunc poller,
+		GError **error)
 {
-	gchar *err_msg = NULL;
 	g_return_val_if_fail(self != NULL, FALSE);
 	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 	DEBUG_BEGIN();
 
-	if(pipe(self->bluetooth_serial_pipe) == -1)
+	self->chunk_queue = chunk_queue_new(
+			ECG_DATA_CHUNK_COUNT,
+			ECG_DATA_READ_BUFFER_SIZE,
+			error);
+	if(!self->chunk_queue)
 	{
-		err_msg = strerror(errno);
-		g_set_error(error, EC_ERROR, EC_ERROR_PIPE,
-				err_msg);
 		/** @todo Disconnect bluetooth */
+		DEBUG_END();
 		return FALSE;
 	}
 
-	/* Create the writable channel for the pipe */
-	self->bluetooth_serial_channel_write = g_io_channel_unix_new(
-			self->bluetooth_serial_pipe[1]);
-
-	/* Binary data, set NULL encoding */
-	g_io_channel_set_encoding(self->bluetooth_serial_channel_write,
-			NULL, NULL);
+	/* Data from the previous connection is of no use */
+	ring_buffer_clear(self->buffer);
+	ring_buffer_clear(self->voltage_array);
+	hrm_framer_reset(&self->framer);
+	self->end_of_stream = FALSE;
+	self->received_bytes = 0;
 
-	/* Create the readable channel for the pipe */
-	self->bluetooth_serial_channel_read = g_io_channel_unix_new(
-			self->bluetooth_serial_pipe[0]);
+	/* The channel is only used for watching the notifications; the
+	 * queue owns the file descriptor */
+	self->chunk_queue_channel = g_io_channel_unix_new(
+			chunk_queue_get_data_fd(self->chunk_queue));
 
-	/* Binary data, set NULL encoding */
-	g_io_channel_set_encoding(self->bluetooth_serial_channel_read,
-			NULL, NULL);
-
-	g_io_channel_set_buffered(self->bluetooth_serial_channel_read,
-			FALSE);
-
-	self->bluetooth_serial_channel_read_watch_id =
-		g_io_add_watch(self->bluetooth_serial_channel_read,
+	self->chunk_queue_watch_id =
+		g_io_add_watch(self->chunk_queue_channel,
 				G_IO_IN,
 				ecg_data_bluetooth_data_arrived,
 				self);
@@ -1282,9 +1522,9 @@ static gboolean ecg_data_setup_serial_pipe(EcgData *self, GError **error)
 	g_mutex_unlock(self->connection_status_mutex);
 
 	/* Finally, create the thread for polling data from the actual
-	 * rfcomm socket */
+	 * rfcomm socket or the capture file */
 	self->bluetooth_poll_thread = g_thread_create(
-			ecg_data_bluetooth_poller,
+			poller,
 			self,
 			FALSE,
 			NULL);
@@ -1300,28 +1540,46 @@ static gpointer ecg_data_bluetooth_poller(gpointer user_data)
 	EcgData *self = (EcgData *)user_data;
 	struct timeval tv;
 	fd_set readfs;
-	GError *error = NULL;
+	gint fd = -1;
+	guint8 *chunk = NULL;
+	guint chunk_size = 0;
 
 	gboolean stop_thread = FALSE;
 
 	g_return_val_if_fail(self != NULL, NULL);
 	DEBUG_BEGIN();
 
-	FD_ZERO(&readfs);
-	FD_SET(self->bluetooth_serial_fd, &readfs);
-
 	do {
 		/* Check every N seconds if the polling should be stopped */
 		tv.tv_sec = ECG_DATA_POLLING_STOP_CHECK_INTERVAL;
 		tv.tv_usec = 0;
 
-		switch(select(self->bluetooth_serial_fd + 1,
+		/* If all the chunks are waiting to be processed by the main
+		 * loop, wait until one is released instead of reading */
+		chunk = chunk_queue_producer_acquire(self->chunk_queue,
+				&chunk_size);
+		if(chunk)
+		{
+			fd = self->bluetooth_serial_fd;
+		} else {
+			DEBUG("Chunk queue is full");
+			fd = chunk_queue_get_space_fd(self->chunk_queue);
+		}
+
+		FD_ZERO(&readfs);
+		FD_SET(fd, &readfs);
+
+		switch(select(fd + 1,
 					&readfs,
 					NULL, /* Ignore writefds */
 					NULL, /* Ignore exceptfds */
 					&tv))
 		{
 			case -1:
+				if(errno == EINTR)
+				{
+					break;
+				}
 				g_critical("Select() call failed");
 				stop_thread = TRUE;
 				break;
@@ -1330,227 +1588,245 @@ static gpointer ecg_data_bluetooth_poller(gpointer user_data)
 				/* There was no data. This is normal */
 				break;
 			default:
-				/* There is data available. Read it, and
-				 * then push to the read pipe. */
-				ecg_data_read_and_push_bluetooth_data(self);
+				if(chunk)
+				{
+					/* There is data available. Read it
+					 * and pass it to the main loop. */
+					ecg_data_read_and_push_bluetooth_data(
+							self,
+							chunk,
+							chunk_size);
+				} else {
+					chunk_queue_producer_clear_notification(
+							self->chunk_queue);
+				}
 		}
 		if(!stop_thread)
 		{
-			g_mutex_lock(self->connection_status_mutex);
-			stop_thread = (self->connection_status ==
-				ECG_DATA_REQUEST_DISCONNECT);
-			g_mutex_unlock(self->connection_status_mutex);
+			stop_thread = ecg_data_poller_should_stop(self);
 		}
 	} while(!stop_thread);
 
 	DEBUG_LONG("Disconnecting ECG Bluetooth");
 
-	g_mutex_lock(self->connection_status_mutex);
-	self->connection_status = ECG_DATA_DISCONNECTING;
-	g_mutex_unlock(self->connection_status_mutex);
+	ecg_data_poller_finish(self);
 
-	/* Close all the IO channels */
-	DEBUG("Shutting down bluetooth_serial_channel_write");
-	g_io_channel_shutdown(self->bluetooth_serial_channel_write,
-			FALSE, &error);
-	if(error)
-	{
-		g_warning("Error shutting down GIOChannel: %s",
-				error->message);
-		g_error_free(error);
-		error = NULL;
-	}
-	g_io_channel_unref(self->bluetooth_serial_channel_write);
-	self->bluetooth_serial_channel_write = NULL;
+	DEBUG_END();
+	return NULL;
+}
 
-	DEBUG("Shutting down bluetooth_serial_channel_read");
-	g_io_channel_shutdown(self->bluetooth_serial_channel_read,
-			FALSE, &error);
-	if(error)
-	{
-		g_warning("Error shutting down GIOChannel: %s",
-				error->message);
-		g_error_free(error);
-		error = NULL;
-	}
-	g_io_channel_unref(self->bluetooth_serial_channel_read);
-	self->bluetooth_serial_channel_read = NULL;
+static gpointer ecg_data_replay_poller(gpointer user_data)
+{
+	EcgData *self = (EcgData *)user_data;
+	GError *error = NULL;
+	GTimeVal start;
+	GTimeVal now;
+	guint64 timestamp = 0;
+	gint64 delay = 0;
+	guint8 *chunk = NULL;
+	guint chunk_size = 0;
+	gint len = 0;
 
-	shutdown(self->bluetooth_serial_fd, SHUT_RDWR);
-	self->bluetooth_serial_fd = -1;
+	g_return_val_if_fail(self != NULL, NULL);
+	DEBUG_BEGIN();
 
-	close(self->bluetooth_serial_pipe[0]);
-	close(self->bluetooth_serial_pipe[1]);
-	self->bluetooth_serial_pipe[0] = -1;
-	self->bluetooth_serial_pipe[1] = -1;
+	g_get_current_time(&start);
 
-	/* Empty the byte arrays */
-	DEBUG("Clearing arrays");
-	if(self->buffer->len > 0)
+	while((chunk = ecg_data_poller_acquire_chunk(self, &chunk_size)))
 	{
-		g_byte_array_remove_range(self->buffer, 0,
-				self->buffer->len);
+		len = ecg_capture_reader_read(self->replay_reader,
+				&timestamp, chunk, chunk_size, &error);
+		if(len < 0)
+		{
+			g_warning("%s", error->message);
+			g_error_free(error);
+			error = NULL;
+			len = 0;
+		}
+
+		/* Wait until the time the chunk was originally received */
+		while(self->replay_real_time && len > 0)
+		{
+			g_get_current_time(&now);
+			delay = (gint64)timestamp -
+				((gint64)(now.tv_sec - start.tv_sec) *
+				 G_USEC_PER_SEC +
+				 (now.tv_usec - start.tv_usec));
+			if(delay <= 0 || ecg_data_poller_should_stop(self))
+			{
+				break;
+			}
+			g_usleep(MIN(delay,
+					ECG_DATA_REPLAY_STOP_CHECK_INTERVAL));
+		}
+
+		/* An empty chunk tells the main loop that the replay has
+		 * ended */
+		chunk_queue_producer_commit(self->chunk_queue, len);
+		if(len == 0)
+		{
+			break;
+		}
 	}
-	if(self->voltage_array->len > 0)
+
+	/* The queue must exist until the main loop stops watching it */
+	while(!ecg_data_poller_should_stop(self))
 	{
-		g_byte_array_remove_range(self->voltage_array, 0,
-				self->voltage_array->len);
+		g_usleep(ECG_DATA_REPLAY_STOP_CHECK_INTERVAL);
 	}
-	DEBUG("Cleared arrays");
 
-	g_mutex_lock(self->connection_status_mutex);
-	self->connection_status = ECG_DATA_DISCONNECTED;
-	g_mutex_unlock(self->connection_status_mutex);
+	DEBUG_LONG("Stopping replay");
+
+	ecg_data_poller_finish(self);
 
 	DEBUG_END();
 	return NULL;
 }
 
-static gboolean ecg_data_read_and_push_bluetooth_data(EcgData *self)
+static guint8 *ecg_data_poller_acquire_chunk(EcgData *self, guint *size)
 {
-	size_t bufsize = ECG_DATA_READ_BUFFER_SIZE;
-	ssize_t read_size = 0;
+	guint8 *chunk = NULL;
+	struct timeval tv;
+	fd_set readfs;
+	gint fd = chunk_queue_get_space_fd(self->chunk_queue);
 
-	guchar data_len[2];
-	guchar buf[ECG_DATA_READ_BUFFER_SIZE];
+	while(!(chunk = chunk_queue_producer_acquire(self->chunk_queue, size)))
+	{
+		if(ecg_data_poller_should_stop(self))
+		{
+			return NULL;
+		}
 
-	g_return_val_if_fail(self != NULL, FALSE);
-	DEBUG_BEGIN();
+		tv.tv_sec = 0;
+		tv.tv_usec = ECG_DATA_REPLAY_STOP_CHECK_INTERVAL;
 
-	read_size = read(self->bluetooth_serial_fd, buf, bufsize);
-	DEBUG("Received %d bytes", read_size);
+		FD_ZERO(&readfs);
+		FD_SET(fd, &readfs);
+		if(select(fd + 1, &readfs, NULL, NULL, &tv) > 0)
+		{
+			chunk_queue_producer_clear_notification(
+					self->chunk_queue);
+		}
+	}
 
-	if(read_size < 1)
+	if(ecg_data_poller_should_stop(self))
 	{
-		DEBUG_END();
-		return TRUE;
+		return NULL;
 	}
+	return chunk;
+}
 
-	data_len[1] = read_size & 0xFF;
-	data_len[0] = read_size >> 8;
+static gboolean ecg_data_poller_should_stop(EcgData *self)
+{
+	gboolean stop = FALSE;
 
-	ecg_data_send_data(self->bluetooth_serial_channel_write,
-			data_len, 2, FALSE);
-	ecg_data_send_data(self->bluetooth_serial_channel_write,
-			buf, read_size, TRUE);
+	g_mutex_lock(self->connection_status_mutex);
+	stop = (self->connection_status == ECG_DATA_REQUEST_DISCONNECT);
+	g_mutex_unlock(self->connection_status_mutex);
 
-	DEBUG_END();
-	return TRUE;
+	return stop;
 }
 
-static void ecg_data_receive_data(
-		GIOChannel *channel,
-		guchar *buffer,
-		gsize count)
+static void ecg_data_poller_finish(EcgData *self)
 {
-	gint read_bytes;
-	gint pos = 0;
+	DEBUG_BEGIN();
 
-	struct timespec tv;
-	struct timespec rem;
+	g_mutex_lock(self->connection_status_mutex);
+	self->connection_status = ECG_DATA_DISCONNECTING;
+	g_mutex_unlock(self->connection_status_mutex);
 
-	DEBUG_BEGIN();
+	if(self->bluetooth_serial_fd != -1)
+	{
+		shutdown(self->bluetooth_serial_fd, SHUT_RDWR);
+		self->bluetooth_serial_fd = -1;
+	}
 
-	do {
-		tv.tv_sec = 1;
-		tv.tv_nsec = 0;
+	if(self->capture_writer)
+	{
+		ecg_capture_writer_close(self->capture_writer);
+		self->capture_writer = NULL;
+	}
 
-		g_io_channel_read_chars(channel,
-				buffer + pos,
-				count - pos,
-				&read_bytes,
-				NULL);
-		pos = pos + read_bytes;
+	if(self->replay_reader)
+	{
+		ecg_capture_reader_close(self->replay_reader);
+		self->replay_reader = NULL;
+	}
 
-		if(pos < count)
-		{
-			nanosleep(&tv, &rem);
-		}
-	} while(pos < count);
+	/* The main loop has already stopped watching the queue */
+	chunk_queue_free(self->chunk_queue);
+	self->chunk_queue = NULL;
+
+	g_mutex_lock(self->connection_status_mutex);
+	self->connection_status = ECG_DATA_DISCONNECTED;
+	g_mutex_unlock(self->connection_status_mutex);
 
-	/** @todo error checking */
 	DEBUG_END();
 }
 
-static void ecg_data_send_data(
-		GIOChannel *channel,
-		guchar *buf,
-		gssize count,
-		gboolean flush)
+static gboolean ecg_data_read_and_push_bluetooth_data(
+		EcgData *self,
+		guint8 *chunk,
+		guint size)
 {
-	struct timespec tv;
-	struct timespec rem;
-	gint position = 0;
-	gsize wrote_size = 0;
+	ssize_t read_size = 0;
+	GError *error = NULL;
 
+	g_return_val_if_fail(self != NULL, FALSE);
 	DEBUG_BEGIN();
 
-	do {
-		tv.tv_sec = 1;
-		tv.tv_nsec = 0;
+	read_size = read(self->bluetooth_serial_fd, chunk, size);
+	DEBUG("Received %d bytes", read_size);
 
-		g_io_channel_write_chars(
-				channel,
-				buf + position,
-				count - position,
-				&wrote_size,
-				NULL);
+	if(read_size < 1)
+	{
+		DEBUG_END();
+		return TRUE;
+	}
 
-		position += wrote_size;
-		if(position != wrote_size)
+	/* Capture before committing, as the chunk belongs to the main loop
+	 * after that */
+	if(self->capture_writer)
+	{
+		if(!ecg_capture_writer_write(self->capture_writer,
+					chunk, (guint)read_size, &error))
 		{
-			nanosleep(&tv, &rem);
+			g_warning("%s", error->message);
+			g_error_free(error);
+			ecg_capture_writer_close(self->capture_writer);
+			self->capture_writer = NULL;
 		}
-	} while(position != count);
-
-	if(flush)
-	{
-		g_io_channel_flush(channel, NULL);
 	}
 
-	/** @todo error checking */
+	chunk_queue_producer_commit(self->chunk_queue, (guint)read_size);
+
 	DEBUG_END();
+	return TRUE;
 }
 
-static gboolean frwd_parse_heartrate(EcgData *self,gchar* frwd){
-	
-	int i;
-	gint value = 0;
+static void ecg_data_heart_rate_decoded(
+		HrmFramer *framer,
+		gint heart_rate,
+		gpointer user_data)
+{
+	EcgData *self = (EcgData *)user_data;
+
+	g_return_if_fail(self != NULL);
 	DEBUG_BEGIN();
 
-	if(self->buffer->len < FRWD_PACKET_SIZE)
-	{
-		DEBUG_END();
-		return FALSE;
-	}
-	gchar *decrypt = g_strndup(frwd + 12, 3);
-	for(i = 0; i < 3; i++)
+	if(self->hrm_name == FRWD)
 	{
-		decrypt[i] /= 2;
+		/* FRWD sends garbage values every now and then. Keep the
+		 * previous value in that case. */
+		if(heart_rate < 235 && heart_rate > 20)
+		{
+			self->hr = heart_rate;
+		}
+	} else {
+		self->hr = heart_rate;
 	}
-	value = strtol(decrypt, NULL, 10);
-	
-	if(value < 235 && value > 20)
-	self->hr = value;
-	ecg_data_invoke_callbacks(self,self->hr);
-	g_free(decrypt);
-	DEBUG_END();
-	return TRUE;
 
-}
-static gboolean zephyr_parse_heartrate(EcgData *self,gchar* zephyr){
-  
-	int i;
-	gint value = 0;
-	DEBUG_BEGIN();
-	if(self->buffer->len < ZEPHYR_PACKET_SIZE)
-	{
-		DEBUG_END();
-		return FALSE;
-	}
-	self->hr = zephyr[12];
-	ecg_data_invoke_callbacks(self,self->hr);
+	ecg_data_invoke_callbacks(self, self->hr);
+
 	DEBUG_END();
-	return TRUE;
-  
 }
@@ -32,6 +32,10 @@
 
 /* Other modules */
 #include "gconf_helper.h"
+#include "ring_buffer.h"
+#include "hrm_framer.h"
+#include "chunk_queue.h"
+#include "ecg_capture.h"
 
 #define EC_MAX_NUM_EVENTS   20
 
@@ -60,10 +64,6 @@ typedef enum _EcgDataConnectionStatus {
 	ECG_DATA_DISCONNECTING
 } EcgDataConnectionStatus;
 
-typedef enum _HRMName{
-	FRWD,
-	ZEPHYR,
-} HRMName;
 /**
  * @brief Struct to hold data for a callback
  */
@@ -94,8 +94,10 @@ struct _EcgData {
 	 *
 	 * If this is needed, connecting to a callback is the right way
 	 * to do it.
+	 *
+	 * When the buffer is full, the oldest samples are discarded.
 	 */
-	GByteArray *voltage_array;
+	RingBuffer *voltage_array;
 
 	/**
 	 * @brief Time stamps of the events.
@@ -125,11 +127,11 @@ struct _EcgData {
 	guint battery_level;
 
 	/**
-	 * @brief FIFO-like buffer for the ECG data
+	 * @brief FIFO buffer for the raw data received from the device
 	 *
 	 * Consider this field private.
 	 */
-	GByteArray *buffer;
+	RingBuffer *buffer;
 
 	/**
 	 * @brief The sequence number of current data packet.
@@ -163,17 +165,17 @@ struct _EcgData {
 
 	gint bluetooth_serial_fd;
 
-	/** @brief The file descriptors for the Bluetooth serial data pipes */
-	gint bluetooth_serial_pipe[2];
-
-	/** @brief The writable end of the pipe */
-	GIOChannel *bluetooth_serial_channel_write;
+	/**
+	 * @brief Queue for passing the data from the polling thread to the
+	 * main loop
+	 */
+	ChunkQueue *chunk_queue;
 
-	/** @brief The readable end of the pipe */
-	GIOChannel *bluetooth_serial_channel_read;
+	/** @brief Channel for watching the data notifications of the queue */
+	GIOChannel *chunk_queue_channel;
 
-	/** @brief The watch id for the readable end of the pipe */
-	guint bluetooth_serial_channel_read_watch_id;
+	/** @brief The watch id for chunk_queue_channel */
+	guint chunk_queue_watch_id;
 
 	/** @brief Thread for reading data from the rfcomm device */
 	GThread *bluetooth_poll_thread;
@@ -185,18 +187,57 @@ struct _EcgData {
 	gint hr;
 	
 	gchar *bluetooth_name;
-	HRMName *hrm_name;
+	HRMName hrm_name;
+
+	/** @brief Frame decoder for the data from the heart rate monitor */
+	HrmFramer framer;
+
+	/**
+	 * @brief Capture file to replay instead of connecting to the heart
+	 * rate monitor, or NULL
+	 */
+	gchar *replay_file;
+
+	/** @brief Whether to replay at the original pace */
+	gboolean replay_real_time;
+
+	/** @brief Reader for replay_file while replaying */
+	EcgCaptureReader *replay_reader;
+
+	/**
+	 * @brief File where to capture the data received from the heart
+	 * rate monitor, or NULL
+	 */
+	gchar *capture_file;
+
+	/** @brief Writer for capture_file while connected */
+	EcgCaptureWriter *capture_writer;
+
+	/** @brief Set when the whole replayed capture has been processed */
+	gboolean end_of_stream;
+
+	/** @brief Bytes received from the device since it was connected */
+	guint64 received_bytes;
+
 	gint hr1,hr2,hr3,count;
 };
 
 /**
  * @brief Create a new EcgData object.
  *
- * @param gconf_helper Pointer to #GConfHelperData
+ * @param gconf_helper Pointer to #GConfHelperData, or NULL if settings are
+ * not to be used (for example, when only replaying captures)
  * @return Newly allocated EcgData object, or NULL in case of an error
  */
 EcgData *ecg_data_new(GConfHelperData *gconf_helper);
 
+/**
+ * @brief Disconnect from the ECG device and free an EcgData object.
+ *
+ * @param self Pointer to #EcgData
+ */
+void ecg_data_destroy(EcgData *self);
+
 /**
  * @brief Add a callback that is invoked when new ECG data arrives.
  *
@@ -275,4 +316,69 @@ gint ecg_data_get_units_per_mv(EcgData *self);
  */
 gint ecg_data_get_zero_level(EcgData *self);
 
+/**
+ * @brief Retrieve framing statistics of the data received from the heart
+ * rate monitor
+ *
+ * The statistics tell how many frames have been decoded, how many frames
+ * were rejected and how many times the stream had to be synchronized
+ * again since the heart rate monitor was connected.
+ *
+ * @param self Pointer to #EcgData
+ *
+ * @return Pointer to the statistics. This is owned by #EcgData.
+ */
+const HrmFramerStats *ecg_data_get_framing_stats(EcgData *self);
+
+/**
+ * @brief Get the amount of bytes received from the heart rate monitor
+ *
+ * The bytes are counted as they are processed, so when replaying a
+ * capture this tells how much of it has been replayed so far.
+ *
+ * @param self Pointer to #EcgData
+ *
+ * @return Bytes received since the heart rate monitor was connected
+ */
+guint64 ecg_data_get_received_bytes(EcgData *self);
+
+/**
+ * @brief Replay a capture file instead of connecting to the heart rate
+ * monitor
+ *
+ * The file is opened when the first callback is added. The heart rate
+ * monitor type is read from the capture.
+ *
+ * @param self Pointer to #EcgData
+ * @param path Path of the capture file (may be a FIFO), or NULL to connect
+ * to the heart rate monitor again
+ * @param real_time If TRUE, the data is replayed at the pace it was
+ * captured. Otherwise it is replayed as fast as it can be processed.
+ */
+void ecg_data_set_replay_file(
+		EcgData *self,
+		const gchar *path,
+		gboolean real_time);
+
+/**
+ * @brief Capture the raw data received from the heart rate monitor
+ *
+ * The file is created when the connection to the heart rate monitor is
+ * established, and the capture lasts until the connection is closed.
+ *
+ * @param self Pointer to #EcgData
+ * @param path Path of the capture file, or NULL to stop capturing
+ */
+void ecg_data_set_capture_file(EcgData *self, const gchar *path);
+
+/**
+ * @brief Tell whether the whole replayed capture has been processed
+ *
+ * @param self Pointer to #EcgData
+ *
+ * @return TRUE if all the data of the capture has been processed and the
+ * callbacks invoked, FALSE otherwise
+ */
+gboolean ecg_data_is_end_of_stream(EcgData *self);
+
 #endif /* _ECG_DATA_H */
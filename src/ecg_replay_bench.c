@@ -0,0 +1,191 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi, Sampo Savola
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/**
+ * @file ecg_replay_bench.c
+ *
+ * @brief Replay a heart rate monitor capture through #EcgData and report
+ * the decoding throughput.
+ *
+ * Usage: ecg_replay_bench [-c CALLBACKS] [-r] CAPTURE_FILE
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* System */
+#include <stdlib.h>
+
+/* GLib */
+#include <glib.h>
+
+/* Other modules */
+#include "ecg_data.h"
+
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+#define ECG_REPLAY_BENCH_CHECK_INTERVAL		10	/* milliseconds */
+
+typedef struct _BenchData {
+	EcgData *ecg_data;
+	GMainLoop *main_loop;
+
+	/** @brief Total amount of callback invocations */
+	guint64 callbacks;
+} BenchData;
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+static void ecg_replay_bench_heart_rate(
+		EcgData *ecg_data,
+		gint heart_rate,
+		gpointer *user_data);
+
+static gboolean ecg_replay_bench_check_end(gpointer user_data);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+gint main(gint argc, gchar **argv)
+{
+	BenchData bench;
+	GOptionContext *context = NULL;
+	GError *error = NULL;
+	GTimer *timer = NULL;
+	const HrmFramerStats *stats = NULL;
+	guint64 bytes = 0;
+	gdouble elapsed = 0;
+	gint callback_count = 1;
+	gboolean real_time = FALSE;
+	gint i;
+
+	GOptionEntry entries[] = {
+		{ "callbacks", 'c', 0, G_OPTION_ARG_INT, &callback_count,
+			"Amount of callbacks to register", "N" },
+		{ "real-time", 'r', 0, G_OPTION_ARG_NONE, &real_time,
+			"Replay at the pace the data was captured", NULL },
+		{ NULL }
+	};
+
+	g_thread_init(NULL);
+
+	context = g_option_context_new("CAPTURE_FILE");
+	g_option_context_add_main_entries(context, entries, NULL);
+	if(!g_option_context_parse(context, &argc, &argv, &error))
+	{
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free(context);
+
+	if(argc != 2 || callback_count < 1)
+	{
+		g_printerr("Usage: %s [-c CALLBACKS] [-r] CAPTURE_FILE\n",
+				argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	bench.callbacks = 0;
+	bench.main_loop = g_main_loop_new(NULL, FALSE);
+	bench.ecg_data = ecg_data_new(NULL);
+	ecg_data_set_replay_file(bench.ecg_data, argv[1], real_time);
+
+	timer = g_timer_new();
+
+	/* The replay starts when the first callback is added */
+	for(i = 0; i < callback_count; i++)
+	{
+		if(!ecg_data_add_callback_ecg(bench.ecg_data,
+					ecg_replay_bench_heart_rate,
+					(gpointer)&bench,
+					&error))
+		{
+			g_printerr("%s\n", error->message);
+			g_error_free(error);
+			return EXIT_FAILURE;
+		}
+	}
+
+	g_timeout_add(ECG_REPLAY_BENCH_CHECK_INTERVAL,
+			ecg_replay_bench_check_end,
+			&bench);
+	g_main_loop_run(bench.main_loop);
+
+	g_timer_stop(timer);
+	elapsed = g_timer_elapsed(timer, NULL);
+
+	stats = ecg_data_get_framing_stats(bench.ecg_data);
+	bytes = ecg_data_get_received_bytes(bench.ecg_data);
+
+	g_print("Bytes:          %" G_GUINT64_FORMAT "\n", bytes);
+	g_print("Packets:        %u\n", stats->frames);
+	g_print("Framing errors: %u\n", stats->framing_errors);
+	g_print("Resyncs:        %u\n", stats->resyncs);
+	g_print("Callbacks:      %" G_GUINT64_FORMAT "\n", bench.callbacks);
+	g_print("Elapsed:        %.6f s\n", elapsed);
+	if(elapsed > 0)
+	{
+		g_print("Bytes/s:        %.0f\n", bytes / elapsed);
+		g_print("Packets/s:      %.0f\n", stats->frames / elapsed);
+		g_print("Callbacks/s:    %.0f\n", bench.callbacks / elapsed);
+	}
+
+	ecg_data_destroy(bench.ecg_data);
+	g_main_loop_unref(bench.main_loop);
+	g_timer_destroy(timer);
+
+	return EXIT_SUCCESS;
+}
+
+/*****************************************************************************
+ * Private functions                                                         *
+ *****************************************************************************/
+
+static void ecg_replay_bench_heart_rate(
+		EcgData *ecg_data,
+		gint heart_rate,
+		gpointer *user_data)
+{
+	BenchData *bench = (BenchData *)user_data;
+	bench->callbacks++;
+}
+
+static gboolean ecg_replay_bench_check_end(gpointer user_data)
+{
+	BenchData *bench = (BenchData *)user_data;
+
+	if(ecg_data_is_end_of_stream(bench->ecg_data))
+	{
+		g_main_loop_quit(bench->main_loop);
+		return FALSE;
+	}
+	return TRUE;
+}
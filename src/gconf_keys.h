@@ -28,6 +28,9 @@
 #define ECGC_BLUETOOTH_ADDRESS	ECGC_BASE_DIR "/bluetooth_address"
 #define ECGC_BLUETOOTH_NAME	ECGC_BASE_DIR "/bluetooth_name"
 
+#define ECGC_HRM_CAPTURE_FILE	ECGC_BASE_DIR "/hrm_capture_file"
+#define ECGC_HRM_REPLAY_FILE	ECGC_BASE_DIR "/hrm_replay_file"
+
 #define ECGC_HRM_DIALOG_SHOWN	ECGC_BASE_DIR "/hrm_dialog_shown"
 
 #define ECGC_HRM_RANGES_DIALOG_SHOWN		ECGC_BASE_DIR \
@@ -59,6 +62,21 @@
 
 #define ECGC_IGNORE_TIME_ZONES	ECGC_BASE_DIR "/ignore_time_zones"
 
+/* Which GPS points are recorded, see track_filter.h. The distances are in
+ * meters and the interval in seconds. */
+#define ECGC_TRACK_FILTER_MODE		ECGC_BASE_DIR "/track_filter_mode"
+#define ECGC_TRACK_FILTER_DISTANCE	ECGC_BASE_DIR "/track_filter_distance"
+#define ECGC_TRACK_FILTER_ALTITUDE	ECGC_BASE_DIR "/track_filter_altitude"
+#define ECGC_TRACK_FILTER_INTERVAL	ECGC_BASE_DIR "/track_filter_interval"
+#define ECGC_TRACK_FILTER_MAX_ERROR	ECGC_BASE_DIR "/track_filter_max_error"
+
+/* How the heart rates are recorded, see heart_rate_aggregator.h. The
+ * resolution is in seconds. */
+#define ECGC_HEART_RATE_RECORDING_MODE		ECGC_BASE_DIR \
+	"/heart_rate_recording_mode"
+#define ECGC_HEART_RATE_RECORDING_RESOLUTION	ECGC_BASE_DIR \
+	"/heart_rate_recording_resolution"
+
 #define USE_METRIC		ECGC_BASE_DIR "/metric_units"
 
 #define DISPLAY_ON		ECGC_BASE_DIR "/display_on"
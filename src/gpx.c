@@ -27,13 +27,20 @@
 /* This module */
 #include "gpx.h"
 #include "gpx_defs.h"
+#include "gpx_journal.h"
+#include "gpx_recording.h"
 
 /* System */
 #include <errno.h>
+#include <fcntl.h>
 #include <string.h>
+#include <unistd.h>
+
+/* GLib */
+#include <glib/gstdio.h>
 
 /* LibXML2 */
-#include <libxml/xpath.h>
+#include <libxml/xmlIO.h>
 
 /* Other modules */
 #include "ec_error.h"
@@ -46,6 +53,53 @@
 
 #include "debug.h"
 
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+#define GPX_STORAGE_TEMP_SUFFIX		".tmp"
+
+/**
+ * @brief An asynchronous write
+ */
+typedef struct _GpxStorageWriteJob {
+	/**
+	 * @brief The storage that requested the write, or NULL if it has
+	 * been freed. Only used in the main loop.
+	 */
+	GpxStorage *storage;
+
+	/** @brief Copy of the document, owned by the job */
+	xmlDocPtr document;
+
+	/** @brief Copy of the recording, used instead of the document */
+	GpxRecording *recording;
+
+	/** @brief Path to write the document to */
+	gchar *path;
+
+	/** @brief Revision of the storage that the document has */
+	guint revision;
+
+	/**
+	 * @brief Journal of a storage that was freed before the write
+	 * completed, or NULL
+	 */
+	GpxJournal *journal;
+
+	GpxStorageWriteCallback callback;
+	gpointer user_data;
+
+	/** @brief Error set by the writer thread */
+	GError *error;
+} GpxStorageWriteJob;
+
+/**
+ * @brief The writer thread. There is only one, so that the writes are
+ * done in the order they are requested.
+ */
+static GThreadPool *gpx_storage_writer = NULL;
+
 /*****************************************************************************
  * Private function prototypes                                               *
  *****************************************************************************/
@@ -65,6 +119,24 @@ xmlNodePtr gpx_storage_find_route_track(
 		gboolean is_track,
 		guint route_track_id);
 
+/**
+ * @brief Allocates a new track ID
+ *
+ * @param self Pointer to #GpxStorage
+ *
+ * @return The allocated ID
+ */
+static guint gpx_storage_track_id_new(GpxStorage *self);
+
+/**
+ * @brief Allocates a new route ID
+ *
+ * @param self Pointer to #GpxStorage
+ *
+ * @return The allocated ID
+ */
+static guint gpx_storage_route_id_new(GpxStorage *self);
+
 /**
  * @brief Allocates a new track ID and creates an XML node for it
  *
@@ -107,6 +179,118 @@ static xmlNodePtr gpx_storage_route_new(GpxStorage *self, guint *id);
 static xmlNodePtr gpx_storage_get_last_track_segment(GpxStorage *self,
 		xmlNodePtr parent_node);
 
+/**
+ * @brief Add a waypoint to the recording
+ *
+ * @param self Pointer to #GpxStorage
+ * @param waypoint The waypoint. The ID of a new track or route is stored
+ * in it.
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean gpx_storage_record_waypoint(
+		GpxStorage *self,
+		GpxStorageWaypoint *waypoint);
+
+/**
+ * @brief Add heart rates to the recording
+ *
+ * @param self Pointer to #GpxStorage
+ * @param point_type Type of the first heart rate
+ * @param track_id ID of the track. The ID of a new track is stored here.
+ * @param heart_rates The heart rates
+ * @param count Amount of heart rates
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean gpx_storage_record_heart_rates(
+		GpxStorage *self,
+		GpxStoragePointType point_type,
+		guint *track_id,
+		const GpxStorageHeartRate *heart_rates,
+		guint count);
+
+/**
+ * @brief Journal a waypoint that was added
+ */
+static void gpx_storage_waypoint_added(
+		GpxStorage *self,
+		const GpxStorageWaypoint *waypoint);
+
+/**
+ * @brief Journal a heart rate that was added
+ */
+static void gpx_storage_heart_rate_added(
+		GpxStorage *self,
+		GpxStoragePointType point_type,
+		guint track_id,
+		const struct timeval *time,
+		gint heart_rate);
+
+/**
+ * @brief Journal the details that were set to a track or a route
+ */
+static void gpx_storage_details_set(
+		GpxStorage *self,
+		gboolean is_track,
+		guint route_track_id,
+		const gchar *name,
+		const gchar *comment);
+
+/**
+ * @brief Write a document or a recording to a temporary file and rename
+ * it over the file
+ *
+ * @param document The document to write, or NULL
+ * @param recording The recording to write if document is NULL
+ * @param path Path of the file
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean gpx_storage_save(
+		xmlDocPtr document,
+		const GpxRecording *recording,
+		const gchar *path,
+		GError **error);
+
+/**
+ * @brief Write the document of a job. Runs in the writer thread.
+ *
+ * @param data Pointer to #GpxStorageWriteJob
+ * @param user_data Not used
+ */
+static void gpx_storage_writer_func(gpointer data, gpointer user_data);
+
+/**
+ * @brief Complete an asynchronous write in the main loop
+ *
+ * @param user_data Pointer to #GpxStorageWriteJob
+ *
+ * @return Always FALSE
+ */
+static gboolean gpx_storage_write_done(gpointer user_data);
+
+/**
+ * @brief Get the journal, creating it if needed
+ *
+ * @param self Pointer to #GpxStorage
+ *
+ * @return The journal, or NULL if changes are not journaled
+ */
+static GpxJournal *gpx_storage_get_journal(GpxStorage *self);
+
+/**
+ * @brief Stop journaling after a journal could not be written
+ *
+ * The journal is removed, because recovering the file from an incomplete
+ * journal would overwrite the complete file when it is saved later.
+ *
+ * @param self Pointer to #GpxStorage
+ * @param error The error that occurred; it will be freed
+ */
+static void gpx_storage_journal_failed(GpxStorage *self, GError *error);
+
 /*****************************************************************************
  * Function declarations                                                     *
  *****************************************************************************/
@@ -156,19 +340,68 @@ GpxStorage *gpx_storage_new()
 
 	xmlDocSetRootElement(self->xml_document, self->root_node);
 
+	self->tracks = g_hash_table_new(g_direct_hash, g_direct_equal);
+	self->routes = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	DEBUG_END();
+	return self;
+}
+
+GpxStorage *gpx_storage_new_recording()
+{
+	GpxStorage *self = NULL;
+
+	DEBUG_BEGIN();
+
+	self = g_new0(GpxStorage, 1);
+	self->recording = gpx_recording_new();
+	self->tracks = g_hash_table_new(g_direct_hash, g_direct_equal);
+	self->routes = g_hash_table_new(g_direct_hash, g_direct_equal);
+
 	DEBUG_END();
 	return self;
 }
 
 void gpx_storage_free(GpxStorage *self)
 {
+	GSList *temp = NULL;
+	GpxStorageWriteJob *job = NULL;
+
 	g_return_if_fail(self != NULL);
 	DEBUG_BEGIN();
 
-	xmlFreeDoc(self->xml_document);
+	/* Writes in progress still complete and call their callbacks, but
+	 * do not update the storage */
+	for(temp = self->pending_writes; temp; temp = g_slist_next(temp))
+	{
+		job = (GpxStorageWriteJob *)temp->data;
+		job->storage = NULL;
+	}
+
+	if(self->journal && job && job->revision == self->revision)
+	{
+		/* The last write has all the changes. Keep the journal until
+		 * it has completed. */
+		job->journal = self->journal;
+	} else if(self->journal) {
+		/* Keep the journal for recovery if there are changes that
+		 * have not been written */
+		gpx_journal_close(self->journal,
+				self->pending_writes == NULL);
+	}
+	g_slist_free(self->pending_writes);
+
+	if(self->recording)
+	{
+		gpx_recording_free(self->recording);
+	} else {
+		xmlFreeDoc(self->xml_document);
+	}
 	g_free(self->file_path);
 	g_slist_free(self->track_ids);
 	g_slist_free(self->route_ids);
+	g_hash_table_destroy(self->tracks);
+	g_hash_table_destroy(self->routes);
 	g_free(self);
 
 	DEBUG_END();
@@ -178,9 +411,32 @@ void gpx_storage_set_path(
 		GpxStorage *self,
 		const gchar *path)
 {
+	GError *error = NULL;
+	gchar *journal_path = NULL;
+
 	g_return_if_fail(self != NULL);
 	DEBUG_BEGIN();
 
+	if(self->journal && (!path || !self->file_path ||
+				strcmp(self->file_path, path) != 0))
+	{
+		/* The journal always lives next to the file */
+		if(path)
+		{
+			journal_path = g_strconcat(path, GPX_JOURNAL_SUFFIX,
+					NULL);
+			if(!gpx_journal_rename(self->journal, journal_path,
+						&error))
+			{
+				gpx_storage_journal_failed(self, error);
+			}
+			g_free(journal_path);
+		} else {
+			gpx_journal_close(self->journal, TRUE);
+			self->journal = NULL;
+		}
+	}
+
 	if(self->file_path)
 	{
 		g_free(self->file_path);
@@ -190,10 +446,29 @@ void gpx_storage_set_path(
 	DEBUG_END();
 }
 
+void gpx_storage_set_journal_enabled(
+		GpxStorage *self,
+		gboolean enabled)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	self->journal_enabled = enabled;
+	if(!enabled && self->journal)
+	{
+		gpx_journal_close(self->journal, TRUE);
+		self->journal = NULL;
+	}
+
+	DEBUG_END();
+}
+
 gboolean gpx_storage_write(
 		GpxStorage *self,
 		GError **error)
 {
+	GError *journal_error = NULL;
+
 	/** @todo Do autosave every now and then */
 	g_return_val_if_fail(error != NULL || *error == NULL, FALSE);
 	g_return_val_if_fail(self != NULL, FALSE);
@@ -206,24 +481,108 @@ gboolean gpx_storage_write(
 		return FALSE;
 	}
 
-	xmlIndentTreeOutput = 1;
-
-	/**
-	 * @todo Make configurable whether or not to use indentation
-	 */
-	if(xmlSaveFormatFile(self->file_path,
-				self->xml_document,
-				1) < 0)
+	if(!gpx_storage_save(self->xml_document, self->recording,
+				self->file_path, error))
 	{
-		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
-				"File saving failed");
+		DEBUG_END();
 		return FALSE;
 	}
 
+	/* Nothing needs to be recovered from the journal unless more
+	 * changes are made */
+	if(self->journal && !gpx_journal_commit(self->journal,
+				&journal_error))
+	{
+		gpx_storage_journal_failed(self, journal_error);
+	}
+
 	DEBUG_END();
 	return TRUE;
 }
 
+void gpx_storage_write_async(
+		GpxStorage *self,
+		GpxStorageWriteCallback callback,
+		gpointer user_data)
+{
+	GpxStorageWriteJob *job = NULL;
+	GError *error = NULL;
+
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	job = g_new0(GpxStorageWriteJob, 1);
+	job->callback = callback;
+	job->user_data = user_data;
+
+	if(self->file_path == NULL)
+	{
+		g_set_error(&job->error, EC_ERROR, EC_ERROR_FILE,
+				"File name was not specified");
+		g_idle_add(gpx_storage_write_done, job);
+		DEBUG_END();
+		return;
+	}
+
+	if(!gpx_storage_writer)
+	{
+		gpx_storage_writer = g_thread_pool_new(
+				gpx_storage_writer_func,
+				NULL,
+				1,
+				FALSE,
+				&error);
+		if(!gpx_storage_writer)
+		{
+			job->error = error;
+			g_idle_add(gpx_storage_write_done, job);
+			DEBUG_END();
+			return;
+		}
+	}
+
+	/* Copying is a lot faster than formatting and writing, and after
+	 * this the document can be changed freely */
+	job->storage = self;
+	if(self->recording)
+	{
+		job->recording = gpx_recording_copy(self->recording);
+	} else {
+		job->document = xmlCopyDoc(self->xml_document, 1);
+	}
+	job->path = g_strdup(self->file_path);
+	job->revision = self->revision;
+	self->pending_writes = g_slist_append(self->pending_writes, job);
+
+	g_thread_pool_push(gpx_storage_writer, job, NULL);
+
+	DEBUG_END();
+}
+
+gboolean gpx_storage_sync(
+		GpxStorage *self,
+		GError **error)
+{
+	GError *journal_error = NULL;
+
+	g_return_val_if_fail(self != NULL, FALSE);
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+	DEBUG_BEGIN();
+
+	if(self->journal)
+	{
+		if(gpx_journal_sync(self->journal, &journal_error))
+		{
+			DEBUG_END();
+			return TRUE;
+		}
+		gpx_storage_journal_failed(self, journal_error);
+	}
+
+	DEBUG_END();
+	return gpx_storage_write(self, error);
+}
+
 void gpx_storage_add_waypoint(
 		GpxStorage *self,
 		GpxStorageWaypoint *waypoint)
@@ -231,13 +590,25 @@ void gpx_storage_add_waypoint(
 	xmlNodePtr parent_node = NULL;
 	xmlNodePtr waypoint_node = NULL;
 	gboolean is_track = FALSE;
-	gchar *buf = NULL;
+	gchar buf[UTIL_XML_DATE_TIME_BUF_SIZE];
 	gchar dbuf[G_ASCII_DTOSTR_BUF_SIZE];
 
 	g_return_if_fail(self != NULL);
 	g_return_if_fail(waypoint != NULL);
 	DEBUG_BEGIN();
 
+	if(self->recording)
+	{
+		if(gpx_storage_record_waypoint(self, waypoint))
+		{
+			gpx_storage_waypoint_added(self, waypoint);
+		} else {
+			g_warning("Unable to add point to track or route");
+		}
+		DEBUG_END();
+		return;
+	}
+
 	switch(waypoint->point_type)
 	{
 		case GPX_STORAGE_POINT_TYPE_TRACK_START:
@@ -323,12 +694,13 @@ void gpx_storage_add_waypoint(
 				dbuf);
 	}
 
-	buf = util_xml_date_time_string_from_timeval(&waypoint->timestamp);
+	util_xml_date_time_format(&waypoint->timestamp, buf);
 	xmlNewChild(waypoint_node,
 			NULL,
 			EC_GPX_NODE_WAYPOINT_TIME,
 			buf);
-	g_free(buf);
+
+	gpx_storage_waypoint_added(self, waypoint);
 
 	DEBUG_END();
 }
@@ -345,9 +717,8 @@ void gpx_storage_add_heart_rate(
 	xmlNodePtr node_extensions = NULL;
 	xmlNodePtr node_hr_list = NULL;
 	xmlNodePtr node_hr = NULL;
-	gchar *buf = NULL;
-
-	/** @todo Add caching for the xml node */
+	gchar buf[UTIL_XML_DATE_TIME_BUF_SIZE];
+	GpxStorageHeartRate rate;
 
 	g_return_if_fail(self != NULL);
 	g_return_if_fail(time != NULL);
@@ -362,6 +733,16 @@ void gpx_storage_add_heart_rate(
 		return;
 	}
 
+	if(self->recording)
+	{
+		rate.time = *time;
+		rate.heart_rate = heart_rate;
+		gpx_storage_add_heart_rates(self, point_type, track_id,
+				&rate, 1);
+		DEBUG_END();
+		return;
+	}
+
 	if(point_type == GPX_STORAGE_POINT_TYPE_TRACK_START)
 	{
 		node_track = gpx_storage_track_new(self, track_id);
@@ -396,31 +777,45 @@ void gpx_storage_add_heart_rate(
 		return;
 	}
 
-	node_extensions = xml_util_find_or_create_child_ordered(
-			node_trkseg,
-			EC_GPX_NODE_EXTENSIONS,
-			NULL,
-			EC_GPX_NODE_TRACK_SEGMENT,
-			NULL);
-
-	if(!node_extensions)
+	/* Searching the extensions node goes through all the track points
+	 * of the segment, so do it only once per segment */
+	if(node_trkseg == self->current_track_segment &&
+			self->current_heart_rate_list)
 	{
-		g_warning("Unable to find or create extension node");
-		DEBUG_END();
-		return;
-	}
+		node_hr_list = self->current_heart_rate_list;
+	} else {
+		node_extensions = xml_util_find_or_create_child_ordered(
+				node_trkseg,
+				EC_GPX_NODE_EXTENSIONS,
+				NULL,
+				EC_GPX_NODE_TRACK_SEGMENT,
+				NULL);
 
-	node_hr_list = xml_util_find_or_create_child(
-			node_extensions,
-			EC_GPX_EXT_NODE_HEART_RATE_LIST,
-			self->xmlns_gpx_extensions,
-			TRUE);
+		if(!node_extensions)
+		{
+			g_warning("Unable to find or create extension node");
+			DEBUG_END();
+			return;
+		}
 
-	if(!node_hr_list)
-	{
-		g_warning("Unable to find or create hear rate list node");
-		DEBUG_END();
-		return;
+		node_hr_list = xml_util_find_or_create_child(
+				node_extensions,
+				EC_GPX_EXT_NODE_HEART_RATE_LIST,
+				self->xmlns_gpx_extensions,
+				TRUE);
+
+		if(!node_hr_list)
+		{
+			g_warning("Unable to find or create hear rate list "
+					"node");
+			DEBUG_END();
+			return;
+		}
+
+		if(node_trkseg == self->current_track_segment)
+		{
+			self->current_heart_rate_list = node_hr_list;
+		}
 	}
 
 	node_hr = xmlNewChild(node_hr_list,
@@ -434,57 +829,145 @@ void gpx_storage_add_heart_rate(
 		return;
 	}
 
-	buf = util_xml_date_time_string_from_timeval(time);
+	util_xml_date_time_format(time, buf);
 
 	xmlNewProp(node_hr,
 			EC_GPX_EXT_ATTR_HEART_RATE_TIME,
 			buf);
-	g_free(buf);
 
-	buf = g_strdup_printf("%d", heart_rate);
+	g_snprintf(buf, sizeof(buf), "%d", heart_rate);
 	xmlNewProp(node_hr,
 			EC_GPX_EXT_ATTR_HEART_RATE_VALUE,
 			buf);
-	g_free(buf);
+
+	gpx_storage_heart_rate_added(self, point_type, *track_id, time,
+			heart_rate);
 
 	DEBUG_END();
 }
 
-void gpx_storage_set_route_or_track_details(
+void gpx_storage_add_heart_rates(
 		GpxStorage *self,
-		gboolean is_track,
-		guint route_track_id,
-		const gchar *name,
-		const gchar *comment)
+		GpxStoragePointType point_type,
+		guint *track_id,
+		const GpxStorageHeartRate *heart_rates,
+		guint count)
 {
-	xmlNodePtr route_track = NULL;
-	xmlNodePtr node_name = NULL;
-	xmlNodePtr node_comment = NULL;
+	struct timeval time;
+	guint i;
 
 	g_return_if_fail(self != NULL);
+	g_return_if_fail(track_id != NULL);
+	g_return_if_fail(heart_rates != NULL || count == 0);
 	DEBUG_BEGIN();
 
-	route_track = gpx_storage_find_route_track(
-			self,
-			is_track,
-			route_track_id);
-
-	if(!route_track)
+	if(count == 0)
 	{
-		DEBUG("Unable to find route or track with ID %d",
-				route_track_id);
 		DEBUG_END();
 		return;
 	}
 
-	if(name)
+	if(!self->recording)
 	{
-		node_name = xml_util_find_or_create_child(route_track,
-				EC_GPX_NODE_TRACK_NAME,
-				NULL,
-				FALSE);
-
-		if(!node_name)
+		/* The document caches the heart rate list of the current
+		 * segment, so adding them one by one is cheap enough */
+		for(i = 0; i < count; i++)
+		{
+			time = heart_rates[i].time;
+			gpx_storage_add_heart_rate(self,
+					i == 0 ? point_type :
+					GPX_STORAGE_POINT_TYPE_TRACK,
+					track_id,
+					&time,
+					heart_rates[i].heart_rate);
+		}
+		DEBUG_END();
+		return;
+	}
+
+	if((point_type != GPX_STORAGE_POINT_TYPE_TRACK_START) &&
+	   (point_type != GPX_STORAGE_POINT_TYPE_TRACK_SEGMENT_START) &&
+	   (point_type != GPX_STORAGE_POINT_TYPE_TRACK))
+	{
+		g_warning("Invalid point type for heart rate");
+		DEBUG_END();
+		return;
+	}
+
+	if(!gpx_storage_record_heart_rates(self, point_type, track_id,
+				heart_rates, count))
+	{
+		DEBUG_END();
+		return;
+	}
+
+	for(i = 0; i < count; i++)
+	{
+		gpx_storage_heart_rate_added(self,
+				i == 0 ? point_type :
+				GPX_STORAGE_POINT_TYPE_TRACK,
+				*track_id,
+				&heart_rates[i].time,
+				heart_rates[i].heart_rate);
+	}
+
+	DEBUG_END();
+}
+
+void gpx_storage_set_route_or_track_details(
+		GpxStorage *self,
+		gboolean is_track,
+		guint route_track_id,
+		const gchar *name,
+		const gchar *comment)
+{
+	xmlNodePtr route_track = NULL;
+	xmlNodePtr node_name = NULL;
+	xmlNodePtr node_comment = NULL;
+	GpxRecordingTrack *recorded = NULL;
+
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	if(self->recording)
+	{
+		recorded = gpx_recording_find_track(self->recording,
+				is_track, route_track_id);
+		if(!recorded)
+		{
+			DEBUG("Unable to find route or track with ID %d",
+					route_track_id);
+			DEBUG_END();
+			return;
+		}
+		gpx_recording_track_set_details(recorded, name, comment);
+		gpx_storage_details_set(self, is_track, route_track_id,
+				name, comment);
+		DEBUG_END();
+		return;
+	}
+
+	route_track = gpx_storage_find_route_track(
+			self,
+			is_track,
+			route_track_id);
+
+	if(!route_track)
+	{
+		DEBUG("Unable to find route or track with ID %d",
+				route_track_id);
+		DEBUG_END();
+		return;
+	}
+
+	if(name)
+	{
+		node_name = xml_util_find_or_create_child(route_track,
+				EC_GPX_NODE_TRACK_NAME,
+				NULL,
+				FALSE);
+
+		if(!node_name)
 		{
 			/* Create a new node; the name is always the first
 			 * child node of a track */
@@ -539,6 +1022,8 @@ void gpx_storage_set_route_or_track_details(
 		xmlNodeAddContent(node_comment, comment);
 	}
 
+	gpx_storage_details_set(self, is_track, route_track_id, name, comment);
+
 	DEBUG_END();
 }
 
@@ -551,67 +1036,12 @@ xmlNodePtr gpx_storage_find_route_track(
 		gboolean is_track,
 		guint route_track_id)
 {
-	xmlXPathContextPtr xpathCtx;
-	xmlXPathObjectPtr xpathObj;
 	xmlNodePtr retval = NULL;
-	xmlNodeSetPtr nodes = NULL;
-
-	gint i = 0;
-	guint found_id;
-
-	/**
-	 * @todo It is inefficient to find the right track every time.
-	 * A simple cache of the previous result would be easy to implement,
-	 * also it is possible to implement a list of trackid-node -pairs
-	 */
 
 	g_return_val_if_fail(self != NULL, NULL);
-	DEBUG_BEGIN();
-
-	xpathCtx = xmlXPathNewContext(self->xml_document);
-	if(xpathCtx == NULL)
-	{
-		g_warning("Unable to create XPath context");
-		DEBUG_END();
-		return NULL;
-	}
 
-	if(is_track)
-	{
-		xpathObj = xmlXPathEvalExpression(
-				EC_GPX_XPATH_TRACK_NUMBER,
-				xpathCtx);
-	} else {
-		xpathObj = xmlXPathEvalExpression(
-				EC_GPX_XPATH_ROUTE_NUMBER,
-				xpathCtx);
-	}
-
-	if(xpathObj == NULL)
-	{
-		xmlXPathFreeContext(xpathCtx);
-		g_warning("Unable to evaluate XPath expression");
-		DEBUG_END();
-		return NULL;
-	}
-
-	nodes = xpathObj->nodesetval;
-	for(i = 0; i < nodes->nodeNr; i++)
-	{
-		g_assert(nodes->nodeTab[i]);
-		if(nodes->nodeTab[i]->type == XML_ELEMENT_NODE)
-		{
-			/* Check if the route id matches */
-			errno = 0;
-			found_id = strtoul(nodes->nodeTab[i]->children->content,
-						NULL, 10);
-			if(errno == 0 && found_id == route_track_id)
-			{
-				retval = nodes->nodeTab[i]->parent;
-				break;
-			}
-		}
-	}
+	retval = g_hash_table_lookup(is_track ? self->tracks : self->routes,
+			GUINT_TO_POINTER(route_track_id));
 
 	if(!retval)
 	{
@@ -620,25 +1050,19 @@ xmlNodePtr gpx_storage_find_route_track(
 				route_track_id);
 	}
 
-	xmlXPathFreeObject(xpathObj);
-	xmlXPathFreeContext(xpathCtx);
-
-	DEBUG_END();
 	return retval;
 }
 
-static xmlNodePtr gpx_storage_track_new(GpxStorage *self, guint *id)
+static guint gpx_storage_track_id_new(GpxStorage *self)
 {
 	GSList *temp = NULL;
 	guint curr = 0;
 	guint prev = 0;
-	xmlNodePtr retval = NULL;
-	gchar *buf = NULL;
+	guint id = 0;
 	gboolean found_gap = FALSE;
 	gint counter = 1;
 
-	g_return_val_if_fail(self != NULL, NULL);
-	g_return_val_if_fail(id != NULL, NULL);
+	g_return_val_if_fail(self != NULL, 0);
 	DEBUG_BEGIN();
 
 	/* Search for an available number */
@@ -660,19 +1084,34 @@ static xmlNodePtr gpx_storage_track_new(GpxStorage *self, guint *id)
 	if(!found_gap)
 	{
 		/* There were no gaps. Add a new ID */
-		*id = counter;
+		id = counter;
 		self->track_ids = g_slist_append(self->track_ids,
 				GUINT_TO_POINTER(prev));
 
 	} else {
 		/* There was a gap. Use it. */
-		*id = prev;
+		id = prev;
 		self->track_ids = g_slist_insert(
 				self->track_ids,
 				GUINT_TO_POINTER(prev),
 				counter - 1);
 	}
 
+	DEBUG_END();
+	return id;
+}
+
+static xmlNodePtr gpx_storage_track_new(GpxStorage *self, guint *id)
+{
+	xmlNodePtr retval = NULL;
+	gchar *buf = NULL;
+
+	g_return_val_if_fail(self != NULL, NULL);
+	g_return_val_if_fail(id != NULL, NULL);
+	DEBUG_BEGIN();
+
+	*id = gpx_storage_track_id_new(self);
+
 	DEBUG("Adding track with id %d", *id);
 
 	/* Create the XML node */
@@ -689,6 +1128,8 @@ static xmlNodePtr gpx_storage_track_new(GpxStorage *self, guint *id)
 			buf);
 	g_free(buf);
 
+	g_hash_table_insert(self->tracks, GUINT_TO_POINTER(*id), retval);
+
 	DEBUG_END();
 	return retval;
 }
@@ -707,20 +1148,20 @@ static xmlNodePtr gpx_storage_track_segment_new(GpxStorage *self,
 			EC_GPX_NODE_TRACK_SEGMENT,
 			NULL);
 
+	self->current_track_segment = retval;
+	self->current_heart_rate_list = NULL;
+
 	DEBUG_END();
 	return retval;
 }
 
-static xmlNodePtr gpx_storage_route_new(GpxStorage *self, guint *id)
+static guint gpx_storage_route_id_new(GpxStorage *self)
 {
 	GSList *temp = NULL;
 	guint curr = 0;
 	guint prev = 0;
-	xmlNodePtr retval = NULL;
-	gchar *buf = NULL;
 
-	g_return_val_if_fail(self != NULL, NULL);
-	g_return_val_if_fail(id != NULL, NULL);
+	g_return_val_if_fail(self != NULL, 0);
 	DEBUG_BEGIN();
 
 	/* Search for an available number */
@@ -746,7 +1187,20 @@ static xmlNodePtr gpx_storage_route_new(GpxStorage *self, guint *id)
 	self->route_ids = g_slist_append(self->route_ids,
 			GUINT_TO_POINTER(prev));
 
-	*id = prev;
+	DEBUG_END();
+	return prev;
+}
+
+static xmlNodePtr gpx_storage_route_new(GpxStorage *self, guint *id)
+{
+	xmlNodePtr retval = NULL;
+	gchar *buf = NULL;
+
+	g_return_val_if_fail(self != NULL, NULL);
+	g_return_val_if_fail(id != NULL, NULL);
+	DEBUG_BEGIN();
+
+	*id = gpx_storage_route_id_new(self);
 
 	/* Create the XML node */
 	retval = xmlNewChild(self->root_node,
@@ -762,6 +1216,8 @@ static xmlNodePtr gpx_storage_route_new(GpxStorage *self, guint *id)
 			buf);
 	g_free(buf);
 
+	g_hash_table_insert(self->routes, GUINT_TO_POINTER(*id), retval);
+
 	DEBUG_END();
 	return retval;
 }
@@ -775,6 +1231,15 @@ static xmlNodePtr gpx_storage_get_last_track_segment(GpxStorage *self,
 
 	g_return_val_if_fail(self != NULL, NULL);
 	g_return_val_if_fail(parent_node != NULL, NULL);
+
+	/* New segments are always added to the end of a track, so the
+	 * current segment is the last one of its track */
+	if(self->current_track_segment &&
+			self->current_track_segment->parent == parent_node)
+	{
+		return self->current_track_segment;
+	}
+
 	DEBUG_BEGIN();
 
 	for(temp = parent_node->children; temp; temp = temp->next)
@@ -791,8 +1256,374 @@ static xmlNodePtr gpx_storage_get_last_track_segment(GpxStorage *self,
 	if(!found)
 	{
 		g_warning("No route segments");
+	} else {
+		self->current_track_segment = found;
+		self->current_heart_rate_list = NULL;
 	}
 
 	DEBUG_END();
 	return found;
 }
+
+static gboolean gpx_storage_record_waypoint(
+		GpxStorage *self,
+		GpxStorageWaypoint *waypoint)
+{
+	GpxRecordingTrack *track = NULL;
+
+	g_return_val_if_fail(self != NULL, FALSE);
+	g_return_val_if_fail(waypoint != NULL, FALSE);
+
+	switch(waypoint->point_type)
+	{
+		case GPX_STORAGE_POINT_TYPE_TRACK_START:
+			waypoint->route_track_id =
+				gpx_storage_track_id_new(self);
+			track = gpx_recording_add_track(self->recording, TRUE,
+					waypoint->route_track_id);
+			gpx_recording_track_add_segment(track);
+			break;
+		case GPX_STORAGE_POINT_TYPE_TRACK_SEGMENT_START:
+			track = gpx_recording_find_track(self->recording, TRUE,
+					waypoint->route_track_id);
+			if(track)
+			{
+				gpx_recording_track_add_segment(track);
+			}
+			break;
+		case GPX_STORAGE_POINT_TYPE_TRACK:
+			track = gpx_recording_find_track(self->recording, TRUE,
+					waypoint->route_track_id);
+			break;
+		case GPX_STORAGE_POINT_TYPE_ROUTE_START:
+			waypoint->route_track_id =
+				gpx_storage_route_id_new(self);
+			track = gpx_recording_add_track(self->recording, FALSE,
+					waypoint->route_track_id);
+			break;
+		case GPX_STORAGE_POINT_TYPE_ROUTE:
+			track = gpx_recording_find_track(self->recording,
+					FALSE,
+					waypoint->route_track_id);
+			break;
+	}
+
+	if(!track)
+	{
+		return FALSE;
+	}
+	return gpx_recording_track_add_point(track, waypoint);
+}
+
+static gboolean gpx_storage_record_heart_rates(
+		GpxStorage *self,
+		GpxStoragePointType point_type,
+		guint *track_id,
+		const GpxStorageHeartRate *heart_rates,
+		guint count)
+{
+	GpxRecordingTrack *track = NULL;
+
+	g_return_val_if_fail(self != NULL, FALSE);
+	g_return_val_if_fail(track_id != NULL, FALSE);
+
+	if(point_type == GPX_STORAGE_POINT_TYPE_TRACK_START)
+	{
+		*track_id = gpx_storage_track_id_new(self);
+		track = gpx_recording_add_track(self->recording, TRUE,
+				*track_id);
+	} else {
+		track = gpx_recording_find_track(self->recording, TRUE,
+				*track_id);
+	}
+
+	if(!track)
+	{
+		g_warning("Unable to find or create track with id %d",
+				*track_id);
+		return FALSE;
+	}
+
+	if(point_type != GPX_STORAGE_POINT_TYPE_TRACK)
+	{
+		gpx_recording_track_add_segment(track);
+	}
+
+	if(!gpx_recording_track_add_heart_rates(track, heart_rates, count))
+	{
+		g_warning("Unable to find or create a track segment");
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static void gpx_storage_waypoint_added(
+		GpxStorage *self,
+		const GpxStorageWaypoint *waypoint)
+{
+	GpxJournal *journal = NULL;
+	GError *error = NULL;
+
+	self->revision++;
+	journal = gpx_storage_get_journal(self);
+	if(journal && !gpx_journal_append_waypoint(journal, waypoint, &error))
+	{
+		gpx_storage_journal_failed(self, error);
+	}
+}
+
+static void gpx_storage_heart_rate_added(
+		GpxStorage *self,
+		GpxStoragePointType point_type,
+		guint track_id,
+		const struct timeval *time,
+		gint heart_rate)
+{
+	GpxJournal *journal = NULL;
+	GError *error = NULL;
+
+	self->revision++;
+	journal = gpx_storage_get_journal(self);
+	if(journal && !gpx_journal_append_heart_rate(journal, point_type,
+				track_id, time, heart_rate, &error))
+	{
+		gpx_storage_journal_failed(self, error);
+	}
+}
+
+static void gpx_storage_details_set(
+		GpxStorage *self,
+		gboolean is_track,
+		guint route_track_id,
+		const gchar *name,
+		const gchar *comment)
+{
+	GpxJournal *journal = NULL;
+	GError *error = NULL;
+
+	self->revision++;
+	journal = gpx_storage_get_journal(self);
+	if(journal && !gpx_journal_append_details(journal, is_track,
+				route_track_id, name, comment, &error))
+	{
+		gpx_storage_journal_failed(self, error);
+	}
+}
+
+static gboolean gpx_storage_save(
+		xmlDocPtr document,
+		const GpxRecording *recording,
+		const gchar *path,
+		GError **error)
+{
+	xmlOutputBufferPtr output = NULL;
+	gchar *temp_path = NULL;
+	gboolean retval = FALSE;
+	gint fd = -1;
+
+	g_return_val_if_fail(document != NULL || recording != NULL, FALSE);
+	g_return_val_if_fail(path != NULL, FALSE);
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+	DEBUG_BEGIN();
+
+	temp_path = g_strconcat(path, GPX_STORAGE_TEMP_SUFFIX, NULL);
+	fd = g_open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to create %s: %s",
+				temp_path, g_strerror(errno));
+		goto save_done;
+	}
+
+	/* The output buffer does not close the file descriptor */
+	output = xmlOutputBufferCreateFd(fd, NULL);
+	if(!output)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"File saving failed");
+		goto save_done;
+	}
+
+	if(document)
+	{
+		/**
+		 * @todo Make configurable whether or not to use indentation
+		 */
+		xmlIndentTreeOutput = 1;
+		if(xmlSaveFormatFileTo(output, document, NULL, 1) < 0)
+		{
+			g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+					"File saving failed");
+			goto save_done;
+		}
+	} else {
+		if(!gpx_recording_write(recording, output, error))
+		{
+			xmlOutputBufferClose(output);
+			goto save_done;
+		}
+		if(xmlOutputBufferClose(output) < 0)
+		{
+			g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+					"File saving failed");
+			goto save_done;
+		}
+	}
+
+	/* The data must be on the disk before the rename, or a crash can
+	 * leave an empty file in place of the old one */
+	if(fsync(fd) < 0)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to write %s: %s",
+				temp_path, g_strerror(errno));
+		goto save_done;
+	}
+
+	if(close(fd) < 0 || g_rename(temp_path, path) < 0)
+	{
+		fd = -1;
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to write %s: %s",
+				path, g_strerror(errno));
+		goto save_done;
+	}
+	fd = -1;
+
+	retval = TRUE;
+
+save_done:
+	if(fd >= 0)
+	{
+		close(fd);
+	}
+	if(!retval)
+	{
+		g_unlink(temp_path);
+	}
+	g_free(temp_path);
+
+	DEBUG_END();
+	return retval;
+}
+
+static void gpx_storage_writer_func(gpointer data, gpointer user_data)
+{
+	GpxStorageWriteJob *job = (GpxStorageWriteJob *)data;
+
+	g_return_if_fail(job != NULL);
+	DEBUG_BEGIN();
+
+	gpx_storage_save(job->document, job->recording, job->path,
+			&job->error);
+
+	g_idle_add(gpx_storage_write_done, job);
+
+	DEBUG_END();
+}
+
+static gboolean gpx_storage_write_done(gpointer user_data)
+{
+	GpxStorageWriteJob *job = (GpxStorageWriteJob *)user_data;
+	GpxStorage *self = NULL;
+	GError *journal_error = NULL;
+
+	g_return_val_if_fail(job != NULL, FALSE);
+	DEBUG_BEGIN();
+
+	self = job->storage;
+	if(self)
+	{
+		self->pending_writes = g_slist_remove(self->pending_writes,
+				job);
+
+		/* The journal can only be marked as up to date if nothing
+		 * was added while writing */
+		if(!job->error && self->journal &&
+				job->revision == self->revision &&
+				!gpx_journal_commit(self->journal,
+					&journal_error))
+		{
+			gpx_storage_journal_failed(self, journal_error);
+		}
+	}
+
+	if(job->journal)
+	{
+		/* The storage was freed; the journal is needed only if
+		 * the write failed */
+		gpx_journal_close(job->journal, job->error == NULL);
+	}
+
+	if(job->callback)
+	{
+		job->callback(job->error, job->user_data);
+	}
+
+	if(job->error)
+	{
+		g_error_free(job->error);
+	}
+	if(job->document)
+	{
+		xmlFreeDoc(job->document);
+	}
+	if(job->recording)
+	{
+		gpx_recording_free(job->recording);
+	}
+	g_free(job->path);
+	g_free(job);
+
+	DEBUG_END();
+	return FALSE;
+}
+
+static GpxJournal *gpx_storage_get_journal(GpxStorage *self)
+{
+	GError *error = NULL;
+	gchar *journal_path = NULL;
+
+	g_return_val_if_fail(self != NULL, NULL);
+
+	if(self->journal || !self->journal_enabled || !self->file_path)
+	{
+		return self->journal;
+	}
+
+	DEBUG_BEGIN();
+
+	journal_path = g_strconcat(self->file_path, GPX_JOURNAL_SUFFIX, NULL);
+	self->journal = gpx_journal_open(journal_path, &error);
+	g_free(journal_path);
+	if(!self->journal)
+	{
+		gpx_storage_journal_failed(self, error);
+	}
+
+	DEBUG_END();
+	return self->journal;
+}
+
+static void gpx_storage_journal_failed(GpxStorage *self, GError *error)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	g_warning("Journaling disabled: %s",
+			error ? error->message : "Unknown error");
+	if(error)
+	{
+		g_error_free(error);
+	}
+
+	if(self->journal)
+	{
+		gpx_journal_close(self->journal, TRUE);
+		self->journal = NULL;
+	}
+	self->journal_enabled = FALSE;
+
+	DEBUG_END();
+}
@@ -37,6 +37,8 @@
 #include <libxml/tree.h>
 
 typedef struct _GpxStorage GpxStorage;
+typedef struct _GpxJournal GpxJournal;
+typedef struct _GpxRecording GpxRecording;
 
 typedef enum _GpxStoragePointType {
 	/**
@@ -83,10 +85,37 @@ typedef struct _GpxStorageWaypoint {
 	struct timeval timestamp;
 } GpxStorageWaypoint;
 
+/**
+ * @brief A heart rate, for adding several at once with
+ * gpx_storage_add_heart_rates()
+ */
+typedef struct _GpxStorageHeartRate {
+	/** @brief Time when the heart rate was detected */
+	struct timeval time;
+
+	/** @brief The heart rate in beats per minute */
+	gint heart_rate;
+} GpxStorageHeartRate;
+
+/**
+ * @brief Function to call when an asynchronous write has completed
+ *
+ * @param error The error that occurred, or NULL on success
+ * @param user_data User data that was given with the write
+ */
+typedef void (*GpxStorageWriteCallback)(const GError *error,
+		gpointer user_data);
+
 struct _GpxStorage {
-	/** @brief Pointer to the XML document */
+	/** @brief Pointer to the XML document, NULL in recording mode */
 	xmlDocPtr xml_document;
 
+	/**
+	 * @brief Tracks and routes in recording mode, or NULL if the XML
+	 * document is used
+	 */
+	GpxRecording *recording;
+
 	/** @brief Pointer to the root node of the XML document */
 	xmlNodePtr root_node;
 
@@ -99,6 +128,12 @@ struct _GpxStorage {
 	/** @brief Whether or not the data has chagned since last save */
 	gboolean has_changed;
 
+	/** @brief Number of changes made to the document */
+	guint revision;
+
+	/** @brief Asynchronous writes that have not completed yet */
+	GSList *pending_writes;
+
 	/** @brief The name of current file, or NULL if not any */
 	gchar *file_path;
 
@@ -107,6 +142,30 @@ struct _GpxStorage {
 
 	/** @brief List of route IDs that are in use */
 	GSList *route_ids;
+
+	/** @brief Track nodes by track ID */
+	GHashTable *tracks;
+
+	/** @brief Route nodes by route ID */
+	GHashTable *routes;
+
+	/** @brief The track segment that points were last added to */
+	xmlNodePtr current_track_segment;
+
+	/**
+	 * @brief Heart rate list node of current_track_segment, or NULL if
+	 * it has not been looked up yet
+	 */
+	xmlNodePtr current_heart_rate_list;
+
+	/** @brief Whether or not to journal the changes */
+	gboolean journal_enabled;
+
+	/**
+	 * @brief Journal of the changes, or NULL if journaling is not
+	 * enabled or nothing has been added yet
+	 */
+	GpxJournal *journal;
 };
 
 /*****************************************************************************
@@ -118,6 +177,17 @@ struct _GpxStorage {
  */
 GpxStorage *gpx_storage_new();
 
+/**
+ * @brief Create a new, empty #GpxStorage in recording mode
+ *
+ * In recording mode, no XML document is built. The points and heart rates
+ * are kept in compact arrays and the GPX file is generated directly from
+ * them (see gpx_recording.h). This takes tens of bytes per point instead
+ * of hundreds, and adding a point takes constant time. The written file
+ * is the same as in the normal mode.
+ */
+GpxStorage *gpx_storage_new_recording();
+
 /**
  * @brief Frees memory used by GpxStorage
  *
@@ -166,6 +236,28 @@ void gpx_storage_add_heart_rate(
 		struct timeval *time,
 		gint heart_rate);
 
+/**
+ * @brief Adds several heart rates to the given track
+ *
+ * This is like calling gpx_storage_add_heart_rate() for each heart rate,
+ * but the track is looked up only once.
+ *
+ * @param self pointer to #GpxStorage
+ * @param point_type Point type of the first heart rate, see
+ * gpx_storage_add_heart_rate(). The others are added to the same
+ * segment.
+ * @param track_id ID of the track to add the heart rates to, or return
+ * location for the ID of the created track
+ * @param heart_rates The heart rates, oldest first
+ * @param count Amount of heart rates
+ */
+void gpx_storage_add_heart_rates(
+		GpxStorage *self,
+		GpxStoragePointType point_type,
+		guint *track_id,
+		const GpxStorageHeartRate *heart_rates,
+		guint count);
+
 /**
  * @brief Setup some details to a route or a track
  *
@@ -191,6 +283,22 @@ void gpx_storage_set_path(
 		GpxStorage *self,
 		const gchar *path);
 
+/**
+ * @brief Enable or disable journaling of the changes
+ *
+ * When journaling is enabled, every change is also appended to a journal
+ * next to the file (see gpx_journal.h). The journal is created when
+ * something is added after the path has been set, and removed when the
+ * storage is freed. If the application crashes, the file can be rebuilt
+ * from the journal with gpx_journal_recover_folder().
+ *
+ * @param self Pointer to #GpxStorage
+ * @param enabled Whether or not to journal the changes
+ */
+void gpx_storage_set_journal_enabled(
+		GpxStorage *self,
+		gboolean enabled);
+
 /**
  * @brief Write data to a file.
  *
@@ -206,4 +314,39 @@ gboolean gpx_storage_write(
 		GpxStorage *self,
 		GError **error);
 
+/**
+ * @brief Write data to a file without blocking
+ *
+ * A copy of the document is taken, and it is written to the file in a
+ * separate writer thread. The document can be changed, and the storage
+ * even freed, while the write is in progress. The file is written to a
+ * temporary file first and then renamed, so a crash never leaves a
+ * partially written file behind.
+ *
+ * @param self Pointer to #GpxStorage
+ * @param callback Function to call in the main loop when the write has
+ * completed, or NULL. It is called also if the storage has been freed.
+ * @param user_data User data to pass to the callback
+ */
+void gpx_storage_write_async(
+		GpxStorage *self,
+		GpxStorageWriteCallback callback,
+		gpointer user_data);
+
+/**
+ * @brief Make sure that the changes so far are on the disk
+ *
+ * If journaling is enabled, only the journal is synced to the disk, which
+ * takes a short time regardless of the size of the document. Otherwise
+ * the whole file is written with gpx_storage_write().
+ *
+ * @param self Pointer to #GpxStorage
+ * @param error Storage location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean gpx_storage_sync(
+		GpxStorage *self,
+		GError **error);
+
 #endif /* _GPX_H */
@@ -0,0 +1,1389 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi, Sampo Savola
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* This module */
+#include "gpx_binary.h"
+
+/* System */
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+/* GLib */
+#include <glib/gstdio.h>
+
+/* Other modules */
+#include "ec_error.h"
+#include "util.h"
+#include "location-distance-utils-fix.h"
+
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+#define GPX_BINARY_MAGIC		"ECGPXB"
+#define GPX_BINARY_MAGIC_LENGTH		6
+
+/** @brief Length of a string that is NULL */
+#define GPX_BINARY_NULL_STRING		0xFFFFFFFF
+
+/** @brief Scale of the fixed point latitudes and longitudes */
+#define GPX_BINARY_DEGREE_SCALE		1e7
+
+/** @brief Scale of the fixed point altitudes */
+#define GPX_BINARY_ALTITUDE_SCALE	100.0
+
+/**
+ * @brief Amount of points and heart rates in a track segment
+ */
+typedef struct _GpxBinarySegment {
+	guint points;
+	guint heart_rates;
+} GpxBinarySegment;
+
+/**
+ * @brief A track, with the points and heart rates of all of its segments
+ */
+typedef struct _GpxBinaryTrack {
+	gchar *name;
+	gchar *comment;
+	guint number;
+
+	/** @brief Array of #GpxBinarySegment */
+	GArray *segments;
+
+	/** @brief Array of #GpxParserDataWaypoint */
+	GArray *waypoints;
+
+	/** @brief Array of #GpxParserDataHeartRate */
+	GArray *heart_rates;
+} GpxBinaryTrack;
+
+struct _GpxBinary {
+	/** @brief Array of #GpxBinaryTrack pointers */
+	GPtrArray *tracks;
+};
+
+/**
+ * @brief Summary of a track, as stored in the file
+ */
+typedef struct _GpxBinaryTrackSummary {
+	gint64 start_time;
+	gint64 end_time;
+	guint64 distance;
+	guint heart_rate_min;
+	guint heart_rate_max;
+	guint64 heart_rate_sum;
+} GpxBinaryTrackSummary;
+
+/**
+ * @brief Position in the file that is being read
+ */
+typedef struct _GpxBinaryReader {
+	const guint8 *ptr;
+	const guint8 *end;
+
+	/** @brief Whether or not there was an attempt to read past the end */
+	gboolean overrun;
+} GpxBinaryReader;
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+static void gpx_binary_track_free(GpxBinaryTrack *track);
+
+/**
+ * @brief Get the last track and its last segment
+ *
+ * @return The last segment, or NULL if there are none
+ */
+static GpxBinarySegment *gpx_binary_get_last_segment(
+		GpxBinary *self,
+		GpxBinaryTrack **track);
+
+/**
+ * @brief Read a binary file and check its header
+ *
+ * @param path Path of the binary file
+ * @param gpx_stat Status of the GPX file the binary file must be up to
+ * date with, or NULL to read the binary file regardless of it. If this is
+ * given, a missing or out of date binary file is not an error.
+ * @param contents Return location for the contents of the file
+ * @param reader Reader positioned after the header
+ * @param track_count Return location for the amount of tracks
+ * @param error Return location for possible error
+ *
+ * @return TRUE if the file can be read, FALSE otherwise
+ */
+static gboolean gpx_binary_open(
+		const gchar *path,
+		const struct stat *gpx_stat,
+		gchar **contents,
+		GpxBinaryReader *reader,
+		guint *track_count,
+		GError **error);
+
+/**
+ * @brief Read a binary file
+ *
+ * @param path Path of the binary file
+ * @param gpx_stat See gpx_binary_open()
+ * @param error Return location for possible error
+ *
+ * @return Newly allocated #GpxBinary or NULL
+ */
+static GpxBinary *gpx_binary_read_path(
+		const gchar *path,
+		const struct stat *gpx_stat,
+		GError **error);
+
+static void gpx_binary_write_track(
+		GByteArray *buf,
+		const GpxBinaryTrack *track);
+
+static void gpx_binary_get_track_summary(
+		const GpxBinaryTrack *track,
+		GpxBinaryTrackSummary *summary);
+
+/**
+ * @brief Read the header of a track
+ *
+ * @param reader The reader
+ * @param track The track to read the number, name, comment and segment
+ * table to
+ * @param summary Return location for the summary
+ * @param columns_size Return location for the size of the columns that
+ * follow
+ */
+static void gpx_binary_read_track_header(
+		GpxBinaryReader *reader,
+		GpxBinaryTrack *track,
+		GpxBinaryTrackSummary *summary,
+		guint *columns_size);
+
+static void gpx_binary_read_track_columns(
+		GpxBinaryReader *reader,
+		GpxBinaryTrack *track);
+
+static void gpx_binary_add_to_summary(
+		GpxBinarySummary *summary,
+		const GpxBinaryTrackSummary *track_summary,
+		guint points,
+		guint heart_rates);
+
+static void gpx_binary_put_uint(GByteArray *buf, guint64 value, gint bytes);
+static void gpx_binary_put_varint(GByteArray *buf, guint64 value);
+static void gpx_binary_put_delta(GByteArray *buf, gint64 value, gint64 *prev);
+static void gpx_binary_put_string(GByteArray *buf, const gchar *string);
+
+static guint64 gpx_binary_get_uint(GpxBinaryReader *reader, gint bytes);
+static guint64 gpx_binary_get_varint(GpxBinaryReader *reader);
+static gint64 gpx_binary_get_delta(GpxBinaryReader *reader, gint64 *prev);
+static gchar *gpx_binary_get_string(GpxBinaryReader *reader);
+
+static gint64 gpx_binary_fixed(gdouble value, gdouble scale);
+static gint64 gpx_binary_usecs(const struct timeval *time);
+
+/**
+ * @brief Get the nanoseconds of the modification time of a file
+ *
+ * @return The nanoseconds, or 0 if the system does not store them
+ */
+static guint32 gpx_binary_get_mtime_nsec(const struct stat *file_stat);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+/*===========================================================================*
+ * Public functions                                                          *
+ *===========================================================================*/
+
+GpxBinary *gpx_binary_new()
+{
+	GpxBinary *self = NULL;
+
+	DEBUG_BEGIN();
+
+	self = g_new0(GpxBinary, 1);
+	self->tracks = g_ptr_array_new();
+
+	DEBUG_END();
+	return self;
+}
+
+void gpx_binary_free(GpxBinary *self)
+{
+	guint i;
+
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	for(i = 0; i < self->tracks->len; i++)
+	{
+		gpx_binary_track_free(g_ptr_array_index(self->tracks, i));
+	}
+	g_ptr_array_free(self->tracks, TRUE);
+	g_free(self);
+
+	DEBUG_END();
+}
+
+void gpx_binary_add(
+		GpxParserDataType data_type,
+		const GpxParserData *data,
+		gpointer user_data)
+{
+	GpxBinary *self = (GpxBinary *)user_data;
+	GpxBinaryTrack *track = NULL;
+	GpxBinarySegment *segment = NULL;
+	GpxBinarySegment new_segment;
+
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(data != NULL);
+
+	if(data_type == GPX_PARSER_DATA_TYPE_TRACK)
+	{
+		track = g_new0(GpxBinaryTrack, 1);
+		track->name = g_strdup(data->track->name);
+		track->comment = g_strdup(data->track->comment);
+		track->number = data->track->number;
+		track->segments = g_array_new(FALSE, FALSE,
+				sizeof(GpxBinarySegment));
+		track->waypoints = g_array_new(FALSE, FALSE,
+				sizeof(GpxParserDataWaypoint));
+		track->heart_rates = g_array_new(FALSE, FALSE,
+				sizeof(GpxParserDataHeartRate));
+		g_ptr_array_add(self->tracks, track);
+		return;
+	}
+
+	if(data_type == GPX_PARSER_DATA_TYPE_TRACK_SEGMENT)
+	{
+		if(self->tracks->len == 0)
+		{
+			g_warning("Track segment without a track");
+			return;
+		}
+		track = g_ptr_array_index(self->tracks, self->tracks->len - 1);
+		new_segment.points = 0;
+		new_segment.heart_rates = 0;
+		g_array_append_val(track->segments, new_segment);
+		return;
+	}
+
+	segment = gpx_binary_get_last_segment(self, &track);
+	if(!segment)
+	{
+		/* Routes are not delivered by the parser, so everything
+		 * else belongs to a track segment */
+		return;
+	}
+
+	switch(data_type)
+	{
+		case GPX_PARSER_DATA_TYPE_WAYPOINT:
+			g_array_append_vals(track->waypoints,
+					data->waypoint, 1);
+			segment->points++;
+			break;
+		case GPX_PARSER_DATA_TYPE_WAYPOINT_BATCH:
+			g_array_append_vals(track->waypoints,
+					data->waypoint_batch->waypoints,
+					data->waypoint_batch->count);
+			segment->points += data->waypoint_batch->count;
+			break;
+		case GPX_PARSER_DATA_TYPE_HEART_RATE:
+			g_array_append_vals(track->heart_rates,
+					data->heart_rate, 1);
+			segment->heart_rates++;
+			break;
+		case GPX_PARSER_DATA_TYPE_HEART_RATE_BATCH:
+			g_array_append_vals(track->heart_rates,
+					data->heart_rate_batch->heart_rates,
+					data->heart_rate_batch->count);
+			segment->heart_rates +=
+				data->heart_rate_batch->count;
+			break;
+		default:
+			break;
+	}
+}
+
+GpxBinary *gpx_binary_read(const gchar *gpx_path, GError **error)
+{
+	GpxBinary *self = NULL;
+	struct stat gpx_stat;
+	gchar *path = NULL;
+
+	g_return_val_if_fail(gpx_path != NULL, NULL);
+	g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+	DEBUG_BEGIN();
+
+	if(g_stat(gpx_path, &gpx_stat) < 0)
+	{
+		DEBUG_END();
+		return NULL;
+	}
+
+	path = g_strconcat(gpx_path, GPX_BINARY_SUFFIX, NULL);
+	self = gpx_binary_read_path(path, &gpx_stat, error);
+	g_free(path);
+
+	DEBUG_END();
+	return self;
+}
+
+GpxBinary *gpx_binary_read_file(const gchar *path, GError **error)
+{
+	GpxBinary *self = NULL;
+
+	g_return_val_if_fail(path != NULL, NULL);
+	g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+	DEBUG_BEGIN();
+
+	self = gpx_binary_read_path(path, NULL, error);
+
+	DEBUG_END();
+	return self;
+}
+
+gboolean gpx_binary_write(
+		GpxBinary *self,
+		const gchar *gpx_path,
+		const struct stat *gpx_stat,
+		GError **error)
+{
+	GByteArray *buf = NULL;
+	gchar *path = NULL;
+	gboolean retval = FALSE;
+	guint i;
+
+	g_return_val_if_fail(self != NULL, FALSE);
+	g_return_val_if_fail(gpx_path != NULL, FALSE);
+	g_return_val_if_fail(gpx_stat != NULL, FALSE);
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+	DEBUG_BEGIN();
+
+	buf = g_byte_array_new();
+	g_byte_array_append(buf, (const guint8 *)GPX_BINARY_MAGIC,
+			GPX_BINARY_MAGIC_LENGTH);
+	gpx_binary_put_uint(buf, GPX_BINARY_VERSION, 2);
+	gpx_binary_put_uint(buf, gpx_stat->st_size, 8);
+	gpx_binary_put_uint(buf, gpx_stat->st_mtime, 8);
+	gpx_binary_put_uint(buf, gpx_binary_get_mtime_nsec(gpx_stat), 4);
+	gpx_binary_put_uint(buf, (guint32)timezone, 4);
+	gpx_binary_put_uint(buf, util_get_ignore_time_zones() ? 1 : 0, 1);
+	gpx_binary_put_uint(buf, self->tracks->len, 4);
+
+	for(i = 0; i < self->tracks->len; i++)
+	{
+		gpx_binary_write_track(buf,
+				g_ptr_array_index(self->tracks, i));
+	}
+
+	/* g_file_set_contents() replaces the file atomically */
+	path = g_strconcat(gpx_path, GPX_BINARY_SUFFIX, NULL);
+	retval = g_file_set_contents(path, (const gchar *)buf->data, buf->len,
+			error);
+
+	g_free(path);
+	g_byte_array_free(buf, TRUE);
+
+	DEBUG_END();
+	return retval;
+}
+
+void gpx_binary_replay(
+		GpxBinary *self,
+		gboolean batched,
+		GpxParserCallback callback,
+		gpointer user_data)
+{
+	GpxBinaryTrack *track = NULL;
+	GpxBinarySegment *segment = NULL;
+	GpxParserDataTrack parser_track;
+	GpxParserDataTrackSegment parser_segment;
+	GpxParserDataWaypointBatch waypoint_batch;
+	GpxParserDataHeartRateBatch heart_rate_batch;
+	GpxParserData data;
+	guint point_index;
+	guint heart_rate_index;
+	guint count;
+	guint i, j, k;
+
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(callback != NULL);
+	DEBUG_BEGIN();
+
+	for(i = 0; i < self->tracks->len; i++)
+	{
+		track = g_ptr_array_index(self->tracks, i);
+		parser_track.name = track->name;
+		parser_track.comment = track->comment;
+		parser_track.number = track->number;
+		data.track = &parser_track;
+		callback(GPX_PARSER_DATA_TYPE_TRACK, &data, user_data);
+
+		point_index = 0;
+		heart_rate_index = 0;
+		for(j = 0; j < track->segments->len; j++)
+		{
+			segment = &g_array_index(track->segments,
+					GpxBinarySegment, j);
+			data.track_segment = &parser_segment;
+			callback(GPX_PARSER_DATA_TYPE_TRACK_SEGMENT, &data,
+					user_data);
+
+			for(k = 0; k < segment->heart_rates; k += count)
+			{
+				count = batched ? MIN(GPX_PARSER_BATCH_SIZE,
+						segment->heart_rates - k) : 1;
+				heart_rate_batch.heart_rates =
+					&g_array_index(track->heart_rates,
+						GpxParserDataHeartRate,
+						heart_rate_index + k);
+				heart_rate_batch.count = count;
+				if(batched)
+				{
+					data.heart_rate_batch =
+						&heart_rate_batch;
+					callback(
+					GPX_PARSER_DATA_TYPE_HEART_RATE_BATCH,
+					&data, user_data);
+				} else {
+					data.heart_rate =
+						heart_rate_batch.heart_rates;
+					callback(
+					GPX_PARSER_DATA_TYPE_HEART_RATE,
+					&data, user_data);
+				}
+			}
+
+			for(k = 0; k < segment->points; k += count)
+			{
+				count = batched ? MIN(GPX_PARSER_BATCH_SIZE,
+						segment->points - k) : 1;
+				waypoint_batch.waypoints =
+					&g_array_index(track->waypoints,
+						GpxParserDataWaypoint,
+						point_index + k);
+				waypoint_batch.count = count;
+				if(batched)
+				{
+					data.waypoint_batch = &waypoint_batch;
+					callback(
+					GPX_PARSER_DATA_TYPE_WAYPOINT_BATCH,
+					&data, user_data);
+				} else {
+					data.waypoint =
+						waypoint_batch.waypoints;
+					callback(
+					GPX_PARSER_DATA_TYPE_WAYPOINT,
+					&data, user_data);
+				}
+			}
+
+			point_index += segment->points;
+			heart_rate_index += segment->heart_rates;
+		}
+	}
+
+	DEBUG_END();
+}
+
+void gpx_binary_get_summary(GpxBinary *self, GpxBinarySummary *summary)
+{
+	GpxBinaryTrack *track = NULL;
+	GpxBinaryTrackSummary track_summary;
+	guint i;
+
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(summary != NULL);
+	DEBUG_BEGIN();
+
+	memset(summary, 0, sizeof(GpxBinarySummary));
+	for(i = 0; i < self->tracks->len; i++)
+	{
+		track = g_ptr_array_index(self->tracks, i);
+		gpx_binary_get_track_summary(track, &track_summary);
+		gpx_binary_add_to_summary(summary, &track_summary,
+				track->waypoints->len,
+				track->heart_rates->len);
+	}
+
+	DEBUG_END();
+}
+
+gboolean gpx_binary_read_summary(
+		const gchar *gpx_path,
+		GpxBinarySummary *summary,
+		GError **error)
+{
+	GpxBinaryTrack track;
+	GpxBinaryTrackSummary track_summary;
+	GpxBinaryReader reader;
+	struct stat gpx_stat;
+	gchar *path = NULL;
+	gchar *contents = NULL;
+	guint track_count = 0;
+	guint columns_size = 0;
+	guint points;
+	guint heart_rates;
+	guint i, j;
+
+	g_return_val_if_fail(gpx_path != NULL, FALSE);
+	g_return_val_if_fail(summary != NULL, FALSE);
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+	DEBUG_BEGIN();
+
+	if(g_stat(gpx_path, &gpx_stat) < 0)
+	{
+		DEBUG_END();
+		return FALSE;
+	}
+
+	path = g_strconcat(gpx_path, GPX_BINARY_SUFFIX, NULL);
+	if(!gpx_binary_open(path, &gpx_stat, &contents, &reader,
+				&track_count, error))
+	{
+		g_free(path);
+		DEBUG_END();
+		return FALSE;
+	}
+
+	memset(summary, 0, sizeof(GpxBinarySummary));
+	for(i = 0; i < track_count && !reader.overrun; i++)
+	{
+		memset(&track, 0, sizeof(GpxBinaryTrack));
+		gpx_binary_read_track_header(&reader, &track, &track_summary,
+				&columns_size);
+		if(reader.overrun || columns_size > reader.end - reader.ptr)
+		{
+			reader.overrun = TRUE;
+		} else {
+			reader.ptr += columns_size;
+			points = 0;
+			heart_rates = 0;
+			for(j = 0; j < track.segments->len; j++)
+			{
+				points += g_array_index(track.segments,
+						GpxBinarySegment, j).points;
+				heart_rates += g_array_index(track.segments,
+						GpxBinarySegment,
+						j).heart_rates;
+			}
+			gpx_binary_add_to_summary(summary, &track_summary,
+					points, heart_rates);
+		}
+
+		g_free(track.name);
+		g_free(track.comment);
+		if(track.segments)
+		{
+			g_array_free(track.segments, TRUE);
+		}
+	}
+
+	g_free(contents);
+
+	if(reader.overrun)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+				"%s is corrupted", path);
+		g_free(path);
+		DEBUG_END();
+		return FALSE;
+	}
+
+	g_free(path);
+	DEBUG_END();
+	return TRUE;
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static void gpx_binary_track_free(GpxBinaryTrack *track)
+{
+	g_return_if_fail(track != NULL);
+
+	g_free(track->name);
+	g_free(track->comment);
+	if(track->segments)
+	{
+		g_array_free(track->segments, TRUE);
+	}
+	if(track->waypoints)
+	{
+		g_array_free(track->waypoints, TRUE);
+	}
+	if(track->heart_rates)
+	{
+		g_array_free(track->heart_rates, TRUE);
+	}
+	g_free(track);
+}
+
+static GpxBinarySegment *gpx_binary_get_last_segment(
+		GpxBinary *self,
+		GpxBinaryTrack **track)
+{
+	if(self->tracks->len == 0)
+	{
+		return NULL;
+	}
+
+	*track = g_ptr_array_index(self->tracks, self->tracks->len - 1);
+	if((*track)->segments->len == 0)
+	{
+		return NULL;
+	}
+
+	return &g_array_index((*track)->segments, GpxBinarySegment,
+			(*track)->segments->len - 1);
+}
+
+static gboolean gpx_binary_open(
+		const gchar *path,
+		const struct stat *gpx_stat,
+		gchar **contents,
+		GpxBinaryReader *reader,
+		guint *track_count,
+		GError **error)
+{
+	gsize length = 0;
+	gboolean up_to_date = TRUE;
+
+	if(gpx_stat)
+	{
+		if(!g_file_get_contents(path, contents, &length, NULL))
+		{
+			/* There is no binary copy yet */
+			return FALSE;
+		}
+	} else {
+		if(!g_file_get_contents(path, contents, &length, error))
+		{
+			return FALSE;
+		}
+	}
+
+	reader->ptr = (const guint8 *)*contents;
+	reader->end = reader->ptr + length;
+	reader->overrun = FALSE;
+
+	if(length < GPX_BINARY_MAGIC_LENGTH ||
+			memcmp(reader->ptr, GPX_BINARY_MAGIC,
+				GPX_BINARY_MAGIC_LENGTH) != 0)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+				"%s is not a binary GPX file", path);
+		g_free(*contents);
+		*contents = NULL;
+		return FALSE;
+	}
+	reader->ptr += GPX_BINARY_MAGIC_LENGTH;
+
+	if(gpx_binary_get_uint(reader, 2) != GPX_BINARY_VERSION)
+	{
+		if(!gpx_stat)
+		{
+			g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+					"%s has an unsupported version",
+					path);
+		}
+		g_free(*contents);
+		*contents = NULL;
+		return FALSE;
+	}
+
+	/* The file is out of date if the GPX file or the way its times are
+	 * interpreted have changed */
+	if(gpx_stat)
+	{
+		up_to_date &= gpx_binary_get_uint(reader, 8) ==
+			(guint64)gpx_stat->st_size;
+		up_to_date &= gpx_binary_get_uint(reader, 8) ==
+			(guint64)gpx_stat->st_mtime;
+		up_to_date &= gpx_binary_get_uint(reader, 4) ==
+			gpx_binary_get_mtime_nsec(gpx_stat);
+		up_to_date &= gpx_binary_get_uint(reader, 4) ==
+			(guint32)timezone;
+		up_to_date &= gpx_binary_get_uint(reader, 1) ==
+			(util_get_ignore_time_zones() ? 1 : 0);
+	} else {
+		gpx_binary_get_uint(reader, 8);
+		gpx_binary_get_uint(reader, 8);
+		gpx_binary_get_uint(reader, 4);
+		gpx_binary_get_uint(reader, 4);
+		gpx_binary_get_uint(reader, 1);
+	}
+	*track_count = gpx_binary_get_uint(reader, 4);
+
+	if(!up_to_date || reader->overrun)
+	{
+		if(reader->overrun)
+		{
+			g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+					"%s is corrupted", path);
+		}
+		g_free(*contents);
+		*contents = NULL;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static GpxBinary *gpx_binary_read_path(
+		const gchar *path,
+		const struct stat *gpx_stat,
+		GError **error)
+{
+	GpxBinary *self = NULL;
+	GpxBinaryTrack *track = NULL;
+	GpxBinaryTrackSummary summary;
+	GpxBinaryReader reader;
+	gchar *contents = NULL;
+	const guint8 *columns_end = NULL;
+	const guint8 *file_end = NULL;
+	guint track_count = 0;
+	guint columns_size = 0;
+	guint i;
+
+	if(!gpx_binary_open(path, gpx_stat, &contents, &reader,
+				&track_count, error))
+	{
+		return NULL;
+	}
+
+	self = gpx_binary_new();
+	file_end = reader.end;
+	for(i = 0; i < track_count && !reader.overrun; i++)
+	{
+		track = g_new0(GpxBinaryTrack, 1);
+		g_ptr_array_add(self->tracks, track);
+
+		gpx_binary_read_track_header(&reader, track, &summary,
+				&columns_size);
+		if(reader.overrun || columns_size > reader.end - reader.ptr)
+		{
+			reader.overrun = TRUE;
+			break;
+		}
+
+		columns_end = reader.ptr + columns_size;
+		reader.end = columns_end;
+		gpx_binary_read_track_columns(&reader, track);
+		if(reader.ptr != columns_end)
+		{
+			reader.overrun = TRUE;
+		}
+		reader.end = file_end;
+	}
+
+	g_free(contents);
+
+	if(reader.overrun)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+				"%s is corrupted", path);
+		gpx_binary_free(self);
+		return NULL;
+	}
+
+	return self;
+}
+
+static void gpx_binary_write_track(
+		GByteArray *buf,
+		const GpxBinaryTrack *track)
+{
+	const GpxBinarySegment *segment = NULL;
+	const GpxParserDataWaypoint *waypoint = NULL;
+	const GpxParserDataHeartRate *heart_rate = NULL;
+	GpxBinaryTrackSummary summary;
+	guint8 altitude_bits = 0;
+	gint64 prev;
+	guint columns_start;
+	guint size_position;
+	guint size;
+	guint i;
+
+	gpx_binary_put_uint(buf, track->number, 4);
+	gpx_binary_put_string(buf, track->name);
+	gpx_binary_put_string(buf, track->comment);
+
+	gpx_binary_put_uint(buf, track->segments->len, 4);
+	for(i = 0; i < track->segments->len; i++)
+	{
+		segment = &g_array_index(track->segments, GpxBinarySegment, i);
+		gpx_binary_put_uint(buf, segment->points, 4);
+		gpx_binary_put_uint(buf, segment->heart_rates, 4);
+	}
+
+	gpx_binary_get_track_summary(track, &summary);
+	gpx_binary_put_uint(buf, summary.start_time, 8);
+	gpx_binary_put_uint(buf, summary.end_time, 8);
+	gpx_binary_put_uint(buf, summary.distance, 8);
+	gpx_binary_put_uint(buf, summary.heart_rate_min, 2);
+	gpx_binary_put_uint(buf, summary.heart_rate_max, 2);
+	gpx_binary_put_uint(buf, summary.heart_rate_sum, 8);
+
+	/* Size of the columns, filled in when they have been written */
+	size_position = buf->len;
+	gpx_binary_put_uint(buf, 0, 4);
+	columns_start = buf->len;
+
+	prev = 0;
+	for(i = 0; i < track->waypoints->len; i++)
+	{
+		waypoint = &g_array_index(track->waypoints,
+				GpxParserDataWaypoint, i);
+		gpx_binary_put_delta(buf,
+				gpx_binary_usecs(&waypoint->timestamp), &prev);
+	}
+
+	prev = 0;
+	for(i = 0; i < track->waypoints->len; i++)
+	{
+		waypoint = &g_array_index(track->waypoints,
+				GpxParserDataWaypoint, i);
+		gpx_binary_put_delta(buf, gpx_binary_fixed(waypoint->latitude,
+					GPX_BINARY_DEGREE_SCALE), &prev);
+	}
+
+	prev = 0;
+	for(i = 0; i < track->waypoints->len; i++)
+	{
+		waypoint = &g_array_index(track->waypoints,
+				GpxParserDataWaypoint, i);
+		gpx_binary_put_delta(buf, gpx_binary_fixed(waypoint->longitude,
+					GPX_BINARY_DEGREE_SCALE), &prev);
+	}
+
+	for(i = 0; i < track->waypoints->len; i++)
+	{
+		waypoint = &g_array_index(track->waypoints,
+				GpxParserDataWaypoint, i);
+		if(waypoint->altitude_is_set)
+		{
+			altitude_bits |= 1 << (i % 8);
+		}
+		if(i % 8 == 7 || i == track->waypoints->len - 1)
+		{
+			g_byte_array_append(buf, &altitude_bits, 1);
+			altitude_bits = 0;
+		}
+	}
+
+	prev = 0;
+	for(i = 0; i < track->waypoints->len; i++)
+	{
+		waypoint = &g_array_index(track->waypoints,
+				GpxParserDataWaypoint, i);
+		if(waypoint->altitude_is_set)
+		{
+			gpx_binary_put_delta(buf,
+					gpx_binary_fixed(waypoint->altitude,
+						GPX_BINARY_ALTITUDE_SCALE),
+					&prev);
+		}
+	}
+
+	prev = 0;
+	for(i = 0; i < track->heart_rates->len; i++)
+	{
+		heart_rate = &g_array_index(track->heart_rates,
+				GpxParserDataHeartRate, i);
+		gpx_binary_put_delta(buf,
+				gpx_binary_usecs(&heart_rate->timestamp),
+				&prev);
+	}
+
+	prev = 0;
+	for(i = 0; i < track->heart_rates->len; i++)
+	{
+		heart_rate = &g_array_index(track->heart_rates,
+				GpxParserDataHeartRate, i);
+		gpx_binary_put_delta(buf, heart_rate->value, &prev);
+	}
+
+	size = buf->len - columns_start;
+	for(i = 0; i < 4; i++)
+	{
+		buf->data[size_position + i] = (size >> (8 * i)) & 0xFF;
+	}
+}
+
+static void gpx_binary_get_track_summary(
+		const GpxBinaryTrack *track,
+		GpxBinaryTrackSummary *summary)
+{
+	const GpxBinarySegment *segment = NULL;
+	const GpxParserDataWaypoint *waypoint = NULL;
+	const GpxParserDataWaypoint *prev = NULL;
+	const GpxParserDataHeartRate *heart_rate = NULL;
+	gdouble distance = 0;
+	gint64 time;
+	guint point_index = 0;
+	guint i, j;
+
+	memset(summary, 0, sizeof(GpxBinaryTrackSummary));
+	summary->start_time = G_MAXINT64;
+	summary->end_time = G_MININT64;
+
+	/* The distance is not counted between segments */
+	for(i = 0; i < track->segments->len; i++)
+	{
+		segment = &g_array_index(track->segments, GpxBinarySegment, i);
+		prev = NULL;
+		for(j = 0; j < segment->points; j++)
+		{
+			waypoint = &g_array_index(track->waypoints,
+					GpxParserDataWaypoint,
+					point_index + j);
+			if(prev)
+			{
+				distance += location_distance_between(
+						prev->latitude,
+						prev->longitude,
+						waypoint->latitude,
+						waypoint->longitude) * 1000.0;
+			}
+			time = gpx_binary_usecs(&waypoint->timestamp);
+			summary->start_time = MIN(summary->start_time, time);
+			summary->end_time = MAX(summary->end_time, time);
+			prev = waypoint;
+		}
+		point_index += segment->points;
+	}
+	summary->distance = distance * 1000.0;
+
+	for(i = 0; i < track->heart_rates->len; i++)
+	{
+		heart_rate = &g_array_index(track->heart_rates,
+				GpxParserDataHeartRate, i);
+		time = gpx_binary_usecs(&heart_rate->timestamp);
+		summary->start_time = MIN(summary->start_time, time);
+		summary->end_time = MAX(summary->end_time, time);
+		if(i == 0 || heart_rate->value < summary->heart_rate_min)
+		{
+			summary->heart_rate_min = heart_rate->value;
+		}
+		if(heart_rate->value > summary->heart_rate_max)
+		{
+			summary->heart_rate_max = heart_rate->value;
+		}
+		summary->heart_rate_sum += heart_rate->value;
+	}
+
+	if(summary->start_time > summary->end_time)
+	{
+		summary->start_time = 0;
+		summary->end_time = 0;
+	}
+}
+
+static void gpx_binary_read_track_header(
+		GpxBinaryReader *reader,
+		GpxBinaryTrack *track,
+		GpxBinaryTrackSummary *summary,
+		guint *columns_size)
+{
+	GpxBinarySegment segment;
+	guint segment_count;
+	guint i;
+
+	track->number = gpx_binary_get_uint(reader, 4);
+	track->name = gpx_binary_get_string(reader);
+	track->comment = gpx_binary_get_string(reader);
+
+	segment_count = gpx_binary_get_uint(reader, 4);
+	if(segment_count > (reader->end - reader->ptr) / 8)
+	{
+		reader->overrun = TRUE;
+		segment_count = 0;
+	}
+	track->segments = g_array_sized_new(FALSE, FALSE,
+			sizeof(GpxBinarySegment), segment_count);
+	for(i = 0; i < segment_count; i++)
+	{
+		segment.points = gpx_binary_get_uint(reader, 4);
+		segment.heart_rates = gpx_binary_get_uint(reader, 4);
+		g_array_append_val(track->segments, segment);
+	}
+
+	summary->start_time = gpx_binary_get_uint(reader, 8);
+	summary->end_time = gpx_binary_get_uint(reader, 8);
+	summary->distance = gpx_binary_get_uint(reader, 8);
+	summary->heart_rate_min = gpx_binary_get_uint(reader, 2);
+	summary->heart_rate_max = gpx_binary_get_uint(reader, 2);
+	summary->heart_rate_sum = gpx_binary_get_uint(reader, 8);
+
+	*columns_size = gpx_binary_get_uint(reader, 4);
+}
+
+static void gpx_binary_read_track_columns(
+		GpxBinaryReader *reader,
+		GpxBinaryTrack *track)
+{
+	GpxBinarySegment *segment = NULL;
+	GpxParserDataWaypoint *waypoint = NULL;
+	GpxParserDataHeartRate *heart_rate = NULL;
+	guint64 points = 0;
+	guint64 heart_rates = 0;
+	gint64 prev;
+	gint64 value;
+	guint i, j;
+
+	for(i = 0; i < track->segments->len; i++)
+	{
+		segment = &g_array_index(track->segments, GpxBinarySegment, i);
+		points += segment->points;
+		heart_rates += segment->heart_rates;
+	}
+
+	/* Every value takes at least one byte */
+	if(points > reader->end - reader->ptr ||
+			heart_rates > reader->end - reader->ptr)
+	{
+		reader->overrun = TRUE;
+		return;
+	}
+
+	track->waypoints = g_array_sized_new(FALSE, TRUE,
+			sizeof(GpxParserDataWaypoint), points);
+	g_array_set_size(track->waypoints, points);
+	track->heart_rates = g_array_sized_new(FALSE, TRUE,
+			sizeof(GpxParserDataHeartRate), heart_rates);
+	g_array_set_size(track->heart_rates, heart_rates);
+
+	/* The point types are not stored; they are set like the parser sets
+	 * them */
+	points = 0;
+	for(i = 0; i < track->segments->len; i++)
+	{
+		segment = &g_array_index(track->segments, GpxBinarySegment, i);
+		for(j = 0; j < segment->points; j++)
+		{
+			waypoint = &g_array_index(track->waypoints,
+					GpxParserDataWaypoint, points + j);
+			if(j > 0)
+			{
+				waypoint->point_type =
+					GPX_STORAGE_POINT_TYPE_TRACK;
+			} else if(points == 0) {
+				waypoint->point_type =
+					GPX_STORAGE_POINT_TYPE_TRACK_START;
+			} else {
+				waypoint->point_type =
+				GPX_STORAGE_POINT_TYPE_TRACK_SEGMENT_START;
+			}
+		}
+		points += segment->points;
+	}
+
+	prev = 0;
+	for(i = 0; i < points; i++)
+	{
+		waypoint = &g_array_index(track->waypoints,
+				GpxParserDataWaypoint, i);
+		value = gpx_binary_get_delta(reader, &prev);
+		waypoint->timestamp.tv_sec = value / G_USEC_PER_SEC;
+		waypoint->timestamp.tv_usec = value % G_USEC_PER_SEC;
+	}
+
+	prev = 0;
+	for(i = 0; i < points; i++)
+	{
+		waypoint = &g_array_index(track->waypoints,
+				GpxParserDataWaypoint, i);
+		waypoint->latitude = gpx_binary_get_delta(reader, &prev) /
+			GPX_BINARY_DEGREE_SCALE;
+	}
+
+	prev = 0;
+	for(i = 0; i < points; i++)
+	{
+		waypoint = &g_array_index(track->waypoints,
+				GpxParserDataWaypoint, i);
+		waypoint->longitude = gpx_binary_get_delta(reader, &prev) /
+			GPX_BINARY_DEGREE_SCALE;
+	}
+
+	for(i = 0; i < points; i += 8)
+	{
+		value = gpx_binary_get_uint(reader, 1);
+		for(j = i; j < i + 8 && j < points; j++)
+		{
+			waypoint = &g_array_index(track->waypoints,
+					GpxParserDataWaypoint, j);
+			waypoint->altitude_is_set = (value >> (j % 8)) & 1;
+		}
+	}
+
+	prev = 0;
+	for(i = 0; i < points; i++)
+	{
+		waypoint = &g_array_index(track->waypoints,
+				GpxParserDataWaypoint, i);
+		if(waypoint->altitude_is_set)
+		{
+			waypoint->altitude = gpx_binary_get_delta(reader,
+					&prev) / GPX_BINARY_ALTITUDE_SCALE;
+		}
+	}
+
+	prev = 0;
+	for(i = 0; i < heart_rates; i++)
+	{
+		heart_rate = &g_array_index(track->heart_rates,
+				GpxParserDataHeartRate, i);
+		value = gpx_binary_get_delta(reader, &prev);
+		heart_rate->timestamp.tv_sec = value / G_USEC_PER_SEC;
+		heart_rate->timestamp.tv_usec = value % G_USEC_PER_SEC;
+	}
+
+	prev = 0;
+	for(i = 0; i < heart_rates; i++)
+	{
+		heart_rate = &g_array_index(track->heart_rates,
+				GpxParserDataHeartRate, i);
+		heart_rate->value = gpx_binary_get_delta(reader, &prev);
+	}
+}
+
+static void gpx_binary_add_to_summary(
+		GpxBinarySummary *summary,
+		const GpxBinaryTrackSummary *track_summary,
+		guint points,
+		guint heart_rates)
+{
+	gdouble heart_rate_sum;
+
+	if(points + heart_rates > 0)
+	{
+		if(summary->points + summary->heart_rates == 0 ||
+				track_summary->start_time <
+				gpx_binary_usecs(&summary->start_time))
+		{
+			summary->start_time.tv_sec =
+				track_summary->start_time / G_USEC_PER_SEC;
+			summary->start_time.tv_usec =
+				track_summary->start_time % G_USEC_PER_SEC;
+		}
+		if(summary->points + summary->heart_rates == 0 ||
+				track_summary->end_time >
+				gpx_binary_usecs(&summary->end_time))
+		{
+			summary->end_time.tv_sec =
+				track_summary->end_time / G_USEC_PER_SEC;
+			summary->end_time.tv_usec =
+				track_summary->end_time % G_USEC_PER_SEC;
+		}
+	}
+
+	if(heart_rates > 0)
+	{
+		if(summary->heart_rates == 0 ||
+				track_summary->heart_rate_min <
+				summary->heart_rate_min)
+		{
+			summary->heart_rate_min =
+				track_summary->heart_rate_min;
+		}
+		if(track_summary->heart_rate_max > summary->heart_rate_max)
+		{
+			summary->heart_rate_max =
+				track_summary->heart_rate_max;
+		}
+		heart_rate_sum = summary->heart_rate_average *
+			summary->heart_rates + track_summary->heart_rate_sum;
+		summary->heart_rate_average = heart_rate_sum /
+			(summary->heart_rates + heart_rates);
+	}
+
+	summary->tracks++;
+	summary->points += points;
+	summary->heart_rates += heart_rates;
+	summary->distance += track_summary->distance / 1000.0;
+}
+
+/*---------------------------------------------------------------------------*
+ * Encoding                                                                  *
+ *---------------------------------------------------------------------------*/
+
+static void gpx_binary_put_uint(GByteArray *buf, guint64 value, gint bytes)
+{
+	guint8 data[8];
+	gint i;
+
+	for(i = 0; i < bytes; i++)
+	{
+		data[i] = (value >> (8 * i)) & 0xFF;
+	}
+	g_byte_array_append(buf, data, bytes);
+}
+
+static void gpx_binary_put_varint(GByteArray *buf, guint64 value)
+{
+	guint8 data[10];
+	gint length = 0;
+
+	while(value >= 0x80)
+	{
+		data[length++] = (value & 0x7F) | 0x80;
+		value >>= 7;
+	}
+	data[length++] = value;
+	g_byte_array_append(buf, data, length);
+}
+
+static void gpx_binary_put_delta(GByteArray *buf, gint64 value, gint64 *prev)
+{
+	gint64 delta = value - *prev;
+
+	*prev = value;
+
+	/* Zigzag encoding keeps small negative values small */
+	gpx_binary_put_varint(buf, ((guint64)delta << 1) ^ (delta >> 63));
+}
+
+static void gpx_binary_put_string(GByteArray *buf, const gchar *string)
+{
+	guint32 length;
+
+	if(!string)
+	{
+		gpx_binary_put_uint(buf, GPX_BINARY_NULL_STRING, 4);
+		return;
+	}
+
+	length = strlen(string);
+	gpx_binary_put_uint(buf, length, 4);
+	g_byte_array_append(buf, (const guint8 *)string, length);
+}
+
+static guint64 gpx_binary_get_uint(GpxBinaryReader *reader, gint bytes)
+{
+	guint64 value = 0;
+	gint i;
+
+	if(reader->end - reader->ptr < bytes)
+	{
+		reader->overrun = TRUE;
+		reader->ptr = reader->end;
+		return 0;
+	}
+
+	for(i = 0; i < bytes; i++)
+	{
+		value |= (guint64)reader->ptr[i] << (8 * i);
+	}
+	reader->ptr += bytes;
+
+	return value;
+}
+
+static guint64 gpx_binary_get_varint(GpxBinaryReader *reader)
+{
+	guint64 value = 0;
+	gint shift = 0;
+
+	while(reader->ptr < reader->end && shift < 64)
+	{
+		value |= (guint64)(*reader->ptr & 0x7F) << shift;
+		if((*reader->ptr++ & 0x80) == 0)
+		{
+			return value;
+		}
+		shift += 7;
+	}
+
+	reader->overrun = TRUE;
+	return 0;
+}
+
+static gint64 gpx_binary_get_delta(GpxBinaryReader *reader, gint64 *prev)
+{
+	guint64 value = gpx_binary_get_varint(reader);
+
+	*prev += (gint64)(value >> 1) ^ -(gint64)(value & 1);
+	return *prev;
+}
+
+static gchar *gpx_binary_get_string(GpxBinaryReader *reader)
+{
+	gchar *string = NULL;
+	guint32 length;
+
+	length = gpx_binary_get_uint(reader, 4);
+	if(length == GPX_BINARY_NULL_STRING || reader->overrun)
+	{
+		return NULL;
+	}
+
+	if(length > reader->end - reader->ptr)
+	{
+		reader->overrun = TRUE;
+		reader->ptr = reader->end;
+		return NULL;
+	}
+
+	string = g_strndup((const gchar *)reader->ptr, length);
+	reader->ptr += length;
+
+	return string;
+}
+
+static gint64 gpx_binary_fixed(gdouble value, gdouble scale)
+{
+	value *= scale;
+	return (gint64)(value < 0 ? value - 0.5 : value + 0.5);
+}
+
+static gint64 gpx_binary_usecs(const struct timeval *time)
+{
+	return (gint64)time->tv_sec * G_USEC_PER_SEC + time->tv_usec;
+}
+
+static guint32 gpx_binary_get_mtime_nsec(const struct stat *file_stat)
+{
+#if defined(HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC)
+	return file_stat->st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMENSEC)
+	return file_stat->st_mtimensec;
+#else
+	return 0;
+#endif
+}
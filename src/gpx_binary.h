@@ -0,0 +1,222 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi, Sampo Savola
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/**
+ * @file gpx_binary.h
+ *
+ * @brief Compact binary copy of a GPX file, stored next to it
+ *
+ * Parsing the XML text of a long exercise takes a while, so when a GPX
+ * file has been parsed once, the parsed data is stored in a binary file
+ * next to it (FILE.gpx.ecb). The next time the GPX file is opened, the
+ * data is read from the binary file instead, as long as the GPX file has
+ * not changed. GPX remains the format that is written and exchanged; the
+ * binary file is only a cache and can always be removed.
+ *
+ * The binary file contains the data in columns, which compress well
+ * with simple delta encoding:
+ *
+ * <pre>
+ * Header     "ECGPXB", version, size and modification time (seconds
+ *            and nanoseconds) of the GPX file when it was parsed, time
+ *            zone settings it was parsed with, track count
+ * Track      number, name, comment, segment table (point and heart
+ *            rate count of each segment), summary (start and end time,
+ *            distance, heart rate minimum, maximum and average)
+ * Columns    point times, latitudes, longitudes, altitude presence
+ *            bits, altitudes, heart rate times, heart rate values
+ * </pre>
+ *
+ * Integers are stored as little endian, and column values as
+ * differences to the previous value, zigzag encoded to unsigned LEB128
+ * variable length integers. Times are in microseconds, latitudes and
+ * longitudes in 1e-7 degrees and altitudes in centimeters.
+ *
+ * Within a track segment, the heart rates are delivered before the
+ * points, like in the GPX files written by #GpxStorage.
+ */
+
+#ifndef _GPX_BINARY_H
+#define _GPX_BINARY_H
+
+/* Configuration */
+#include "config.h"
+
+/* System */
+#include <sys/stat.h>
+#include <sys/time.h>
+
+/* GLib */
+#include <glib.h>
+
+/* Other modules */
+#include "gpx_parser.h"
+
+#define GPX_BINARY_SUFFIX		".ecb"
+#define GPX_BINARY_VERSION		2
+
+typedef struct _GpxBinary GpxBinary;
+
+/**
+ * @brief Summary of the tracks in a binary file
+ */
+typedef struct _GpxBinarySummary {
+	guint tracks;
+	guint points;
+	guint heart_rates;
+
+	/** @brief Time of the first point or heart rate */
+	struct timeval start_time;
+
+	/** @brief Time of the last point or heart rate */
+	struct timeval end_time;
+
+	/** @brief Distance in meters */
+	gdouble distance;
+
+	/** @brief Heart rate minimum, maximum and average, or 0 if there
+	 * are no heart rates */
+	gint heart_rate_min;
+	gint heart_rate_max;
+	gdouble heart_rate_average;
+} GpxBinarySummary;
+
+/*****************************************************************************
+ * Function prototypes                                                       *
+ *****************************************************************************/
+
+/**
+ * @brief Create a new, empty binary copy
+ *
+ * The data is added with gpx_binary_add().
+ *
+ * @return Newly allocated #GpxBinary
+ */
+GpxBinary *gpx_binary_new();
+
+/**
+ * @brief Free a binary copy
+ *
+ * @param self Pointer to #GpxBinary
+ */
+void gpx_binary_free(GpxBinary *self);
+
+/**
+ * @brief Add data that was delivered by #GpxParser
+ *
+ * This can be used as the callback of gpx_parser_parse_file() or
+ * gpx_parser_parse_file_batched(), or called from one.
+ *
+ * @param data_type The type of the data
+ * @param data The data
+ * @param user_data Pointer to #GpxBinary
+ */
+void gpx_binary_add(
+		GpxParserDataType data_type,
+		const GpxParserData *data,
+		gpointer user_data);
+
+/**
+ * @brief Read the binary copy of a GPX file
+ *
+ * @param gpx_path Path of the GPX file
+ * @param error Return location for possible error. This is not set if
+ * the binary copy does not exist or if the GPX file has changed after it
+ * was written.
+ *
+ * @return Newly allocated #GpxBinary, or NULL if the binary copy does not
+ * exist, is out of date or could not be read
+ */
+GpxBinary *gpx_binary_read(const gchar *gpx_path, GError **error);
+
+/**
+ * @brief Read a binary file, whether or not it is up to date
+ *
+ * @param path Path of the binary file
+ * @param error Return location for possible error
+ *
+ * @return Newly allocated #GpxBinary, or NULL on error
+ */
+GpxBinary *gpx_binary_read_file(const gchar *path, GError **error);
+
+/**
+ * @brief Write the binary copy of a GPX file
+ *
+ * @param self Pointer to #GpxBinary
+ * @param gpx_path Path of the GPX file the data was parsed from. The
+ * binary copy is written to the same path with #GPX_BINARY_SUFFIX.
+ * @param gpx_stat Status of the GPX file that was parsed, taken from the
+ * same open file. The binary copy is up to date as long as the GPX file
+ * still has the same size and modification time.
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean gpx_binary_write(
+		GpxBinary *self,
+		const gchar *gpx_path,
+		const struct stat *gpx_stat,
+		GError **error);
+
+/**
+ * @brief Deliver the data like #GpxParser would
+ *
+ * @param self Pointer to #GpxBinary
+ * @param batched Whether to deliver the points and heart rates in
+ * batches, like gpx_parser_parse_file_batched()
+ * @param callback Callback to deliver the data to
+ * @param user_data User data to pass to the callback
+ */
+void gpx_binary_replay(
+		GpxBinary *self,
+		gboolean batched,
+		GpxParserCallback callback,
+		gpointer user_data);
+
+/**
+ * @brief Get the summary of all tracks
+ *
+ * @param self Pointer to #GpxBinary
+ * @param summary Return location for the summary
+ */
+void gpx_binary_get_summary(GpxBinary *self, GpxBinarySummary *summary);
+
+/**
+ * @brief Read only the summary from the binary copy of a GPX file
+ *
+ * The summary is stored in the track headers, so the points and heart
+ * rates are not read.
+ *
+ * @param gpx_path Path of the GPX file
+ * @param summary Return location for the summary
+ * @param error Return location for possible error. This is not set if
+ * the binary copy does not exist or if the GPX file has changed after it
+ * was written.
+ *
+ * @return TRUE on success, FALSE if the summary could not be read
+ */
+gboolean gpx_binary_read_summary(
+		const gchar *gpx_path,
+		GpxBinarySummary *summary,
+		GError **error);
+
+#endif /* _GPX_BINARY_H */
@@ -0,0 +1,490 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi, Sampo Savola
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/**
+ * @file gpx_convert.c
+ *
+ * @brief Convert between GPX files and their binary copies, and compare
+ * the load times and file sizes of the two.
+ *
+ * Usage:
+ * <pre>
+ * gpx_convert FILE.gpx                      Write FILE.gpx.ecb
+ * gpx_convert -g FILE.gpx.ecb OUTPUT.gpx    Write a GPX file from a binary
+ * gpx_convert -b [-n ROUNDS] FILE.gpx       Benchmark loading FILE.gpx
+ * </pre>
+ *
+ * Routes are not stored in the binary copy, and empty tracks and track
+ * segments are left out when writing a GPX file from one.
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* System */
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/* GLib */
+#include <glib.h>
+#include <glib-object.h>
+#include <glib/gstdio.h>
+
+/* Other modules */
+#include "ec_error.h"
+#include "gconf_helper.h"
+#include "gconf_keys.h"
+#include "gpx.h"
+#include "gpx_binary.h"
+#include "gpx_parser.h"
+#include "settings.h"
+#include "util.h"
+
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+#define GPX_CONVERT_DEFAULT_ROUNDS	10
+
+typedef struct _ConvertCounts {
+	guint tracks;
+	guint points;
+	guint heart_rates;
+} ConvertCounts;
+
+/**
+ * @brief State of writing parsed data to a #GpxStorage
+ */
+typedef struct _ConvertStorage {
+	GpxStorage *storage;
+
+	/** @brief Point type to add the next point or heart rate with */
+	GpxStoragePointType point_type;
+	guint track_id;
+
+	/**
+	 * @brief Details of the current track. The track is only created
+	 * when the first point or heart rate is added to it, so the details
+	 * are set then.
+	 */
+	gboolean details_pending;
+	gchar *name;
+	gchar *comment;
+} ConvertStorage;
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+static gboolean gpx_convert_to_binary(const gchar *gpx_path, GError **error);
+
+static gboolean gpx_convert_to_gpx(
+		const gchar *binary_path,
+		const gchar *gpx_path,
+		GError **error);
+
+static gboolean gpx_convert_bench(
+		const gchar *gpx_path,
+		gint rounds,
+		GError **error);
+
+static void gpx_convert_count(
+		GpxParserDataType data_type,
+		const GpxParserData *data,
+		gpointer user_data);
+
+static void gpx_convert_store(
+		GpxParserDataType data_type,
+		const GpxParserData *data,
+		gpointer user_data);
+
+/**
+ * @brief Update the state after a point or heart rate has been added
+ *
+ * @param convert Pointer to #ConvertStorage
+ */
+static void gpx_convert_store_added(ConvertStorage *convert);
+
+static guint64 gpx_convert_get_file_size(const gchar *path);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+gint main(gint argc, gchar **argv)
+{
+	GOptionContext *context = NULL;
+	GConfHelperData *gconf_helper = NULL;
+	Settings *settings = NULL;
+	GError *error = NULL;
+	gboolean to_gpx = FALSE;
+	gboolean bench = FALSE;
+	gint rounds = GPX_CONVERT_DEFAULT_ROUNDS;
+	gboolean success = FALSE;
+
+	GOptionEntry entries[] = {
+		{ "to-gpx", 'g', 0, G_OPTION_ARG_NONE, &to_gpx,
+			"Write a GPX file from a binary file", NULL },
+		{ "bench", 'b', 0, G_OPTION_ARG_NONE, &bench,
+			"Compare loading the GPX and the binary file",
+			NULL },
+		{ "rounds", 'n', 0, G_OPTION_ARG_INT, &rounds,
+			"Amount of times to load the files", "ROUNDS" },
+		{ NULL }
+	};
+
+	g_thread_init(NULL);
+	g_type_init();
+
+	context = g_option_context_new("FILE [OUTPUT]");
+	g_option_context_add_main_entries(context, entries, NULL);
+	if(!g_option_context_parse(context, &argc, &argv, &error))
+	{
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free(context);
+
+	if(argc != (to_gpx ? 3 : 2) || (to_gpx && bench) || rounds < 1)
+	{
+		g_printerr("Usage: %s FILE.gpx\n"
+				"       %s -g FILE.gpx" GPX_BINARY_SUFFIX
+				" OUTPUT.gpx\n"
+				"       %s -b [-n ROUNDS] FILE.gpx\n",
+				argv[0], argv[0], argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	/* The times are interpreted with the same settings as in eCoach */
+	gconf_helper = gconf_helper_new(ECGC_BASE_DIR);
+	settings = settings_initialize(gconf_helper);
+	util_initialize(settings);
+
+	if(to_gpx)
+	{
+		success = gpx_convert_to_gpx(argv[1], argv[2], &error);
+	} else if(bench) {
+		success = gpx_convert_bench(argv[1], rounds, &error);
+	} else {
+		success = gpx_convert_to_binary(argv[1], &error);
+	}
+
+	if(!success)
+	{
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/*****************************************************************************
+ * Private functions                                                         *
+ *****************************************************************************/
+
+static gboolean gpx_convert_to_binary(const gchar *gpx_path, GError **error)
+{
+	GpxBinary *binary = NULL;
+	GpxParserStatus status;
+	struct stat gpx_stat;
+	gchar *binary_path = NULL;
+	gboolean success = FALSE;
+
+	binary_path = g_strconcat(gpx_path, GPX_BINARY_SUFFIX, NULL);
+
+	/* Parse the XML without the parser writing the binary copy, so that
+	 * it is written only once, below */
+	binary = gpx_binary_new();
+	status = gpx_parser_parse_xml_batched(gpx_path, gpx_binary_add,
+			binary, &gpx_stat, error);
+	if(status != GPX_PARSER_STATUS_OK)
+	{
+		if(error && !*error)
+		{
+			g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+					"%s could not be parsed completely",
+					gpx_path);
+		}
+	} else {
+		success = gpx_binary_write(binary, gpx_path, &gpx_stat,
+				error);
+	}
+
+	if(success)
+	{
+		g_print("%s: %" G_GUINT64_FORMAT " bytes\n", gpx_path,
+				gpx_convert_get_file_size(gpx_path));
+		g_print("%s: %" G_GUINT64_FORMAT " bytes\n", binary_path,
+				gpx_convert_get_file_size(binary_path));
+	}
+
+	gpx_binary_free(binary);
+	g_free(binary_path);
+	return success;
+}
+
+static gboolean gpx_convert_to_gpx(
+		const gchar *binary_path,
+		const gchar *gpx_path,
+		GError **error)
+{
+	GpxBinary *binary = NULL;
+	ConvertStorage convert;
+	gboolean success = FALSE;
+
+	binary = gpx_binary_read_file(binary_path, error);
+	if(!binary)
+	{
+		return FALSE;
+	}
+
+	memset(&convert, 0, sizeof(ConvertStorage));
+	convert.storage = gpx_storage_new_recording();
+	convert.point_type = GPX_STORAGE_POINT_TYPE_TRACK_START;
+
+	gpx_binary_replay(binary, TRUE, gpx_convert_store, &convert);
+	g_free(convert.name);
+	g_free(convert.comment);
+
+	gpx_storage_set_path(convert.storage, gpx_path);
+	success = gpx_storage_write(convert.storage, error);
+
+	gpx_storage_free(convert.storage);
+	gpx_binary_free(binary);
+	return success;
+}
+
+static gboolean gpx_convert_bench(
+		const gchar *gpx_path,
+		gint rounds,
+		GError **error)
+{
+	ConvertCounts counts;
+	GpxBinarySummary summary;
+	GTimer *timer = NULL;
+	gchar *binary_path = NULL;
+	gdouble xml_elapsed = 0;
+	gdouble binary_elapsed = 0;
+	gdouble summary_elapsed = 0;
+	guint64 xml_size = 0;
+	guint64 binary_size = 0;
+	gint i;
+
+	binary_path = g_strconcat(gpx_path, GPX_BINARY_SUFFIX, NULL);
+	timer = g_timer_new();
+
+	/* Only parse the XML here; writing the binary copy is not part of
+	 * loading the file */
+	for(i = 0; i < rounds; i++)
+	{
+		memset(&counts, 0, sizeof(ConvertCounts));
+		g_timer_start(timer);
+		if(gpx_parser_parse_xml_batched(gpx_path, gpx_convert_count,
+					&counts, NULL, error)
+				== GPX_PARSER_STATUS_FAILED)
+		{
+			g_timer_destroy(timer);
+			g_free(binary_path);
+			return FALSE;
+		}
+		g_timer_stop(timer);
+		xml_elapsed += g_timer_elapsed(timer, NULL);
+	}
+
+	/* Write an up to date binary copy */
+	g_unlink(binary_path);
+	memset(&counts, 0, sizeof(ConvertCounts));
+	gpx_parser_parse_file_batched(gpx_path, gpx_convert_count, &counts,
+			NULL);
+	if(!g_file_test(binary_path, G_FILE_TEST_EXISTS))
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"%s was not written", binary_path);
+		g_timer_destroy(timer);
+		g_free(binary_path);
+		return FALSE;
+	}
+
+	/* The next loads read the binary copy */
+	for(i = 0; i < rounds; i++)
+	{
+		memset(&counts, 0, sizeof(ConvertCounts));
+		g_timer_start(timer);
+		gpx_parser_parse_file_batched(gpx_path, gpx_convert_count,
+				&counts, NULL);
+		g_timer_stop(timer);
+		binary_elapsed += g_timer_elapsed(timer, NULL);
+	}
+
+	for(i = 0; i < rounds; i++)
+	{
+		g_timer_start(timer);
+		gpx_binary_read_summary(gpx_path, &summary, NULL);
+		g_timer_stop(timer);
+		summary_elapsed += g_timer_elapsed(timer, NULL);
+	}
+
+	xml_size = gpx_convert_get_file_size(gpx_path);
+	binary_size = gpx_convert_get_file_size(binary_path);
+
+	g_print("Tracks:              %u\n", counts.tracks);
+	g_print("Points:              %u\n", counts.points);
+	g_print("Heart rates:         %u\n", counts.heart_rates);
+	g_print("GPX size:            %" G_GUINT64_FORMAT " bytes\n",
+			xml_size);
+	g_print("Binary size:         %" G_GUINT64_FORMAT " bytes\n",
+			binary_size);
+	if(binary_size > 0)
+	{
+		g_print("Size ratio:          %.1f\n",
+				(gdouble)xml_size / binary_size);
+	}
+	g_print("GPX load:            %.6f s\n", xml_elapsed / rounds);
+	g_print("Binary load:         %.6f s\n", binary_elapsed / rounds);
+	g_print("Summary load:        %.6f s\n", summary_elapsed / rounds);
+	if(binary_elapsed > 0)
+	{
+		g_print("Load time ratio:     %.1f\n",
+				xml_elapsed / binary_elapsed);
+	}
+
+	g_timer_destroy(timer);
+	g_free(binary_path);
+	return TRUE;
+}
+
+static void gpx_convert_count(
+		GpxParserDataType data_type,
+		const GpxParserData *data,
+		gpointer user_data)
+{
+	ConvertCounts *counts = (ConvertCounts *)user_data;
+
+	switch(data_type)
+	{
+		case GPX_PARSER_DATA_TYPE_TRACK:
+			counts->tracks++;
+			break;
+		case GPX_PARSER_DATA_TYPE_WAYPOINT:
+			counts->points++;
+			break;
+		case GPX_PARSER_DATA_TYPE_HEART_RATE:
+			counts->heart_rates++;
+			break;
+		case GPX_PARSER_DATA_TYPE_WAYPOINT_BATCH:
+			counts->points += data->waypoint_batch->count;
+			break;
+		case GPX_PARSER_DATA_TYPE_HEART_RATE_BATCH:
+			counts->heart_rates += data->heart_rate_batch->count;
+			break;
+		default:
+			break;
+	}
+}
+
+static void gpx_convert_store(
+		GpxParserDataType data_type,
+		const GpxParserData *data,
+		gpointer user_data)
+{
+	ConvertStorage *convert = (ConvertStorage *)user_data;
+	GpxParserDataHeartRate *heart_rate = NULL;
+	GpxStorageWaypoint waypoint;
+	guint i;
+
+	switch(data_type)
+	{
+		case GPX_PARSER_DATA_TYPE_TRACK:
+			g_free(convert->name);
+			g_free(convert->comment);
+			convert->name = g_strdup(data->track->name);
+			convert->comment = g_strdup(data->track->comment);
+			convert->details_pending = TRUE;
+			convert->point_type =
+				GPX_STORAGE_POINT_TYPE_TRACK_START;
+			break;
+		case GPX_PARSER_DATA_TYPE_TRACK_SEGMENT:
+			if(convert->point_type !=
+					GPX_STORAGE_POINT_TYPE_TRACK_START)
+			{
+				convert->point_type =
+				GPX_STORAGE_POINT_TYPE_TRACK_SEGMENT_START;
+			}
+			break;
+		case GPX_PARSER_DATA_TYPE_WAYPOINT_BATCH:
+			for(i = 0; i < data->waypoint_batch->count; i++)
+			{
+				waypoint = data->waypoint_batch->waypoints[i];
+				waypoint.point_type = convert->point_type;
+				waypoint.route_track_id = convert->track_id;
+				gpx_storage_add_waypoint(convert->storage,
+						&waypoint);
+				convert->track_id = waypoint.route_track_id;
+				gpx_convert_store_added(convert);
+			}
+			break;
+		case GPX_PARSER_DATA_TYPE_HEART_RATE_BATCH:
+			for(i = 0; i < data->heart_rate_batch->count; i++)
+			{
+				heart_rate =
+					&data->heart_rate_batch->heart_rates[i];
+				gpx_storage_add_heart_rate(convert->storage,
+						convert->point_type,
+						&convert->track_id,
+						&heart_rate->timestamp,
+						heart_rate->value);
+				gpx_convert_store_added(convert);
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+static void gpx_convert_store_added(ConvertStorage *convert)
+{
+	if(convert->details_pending)
+	{
+		gpx_storage_set_route_or_track_details(convert->storage,
+				TRUE, convert->track_id,
+				convert->name, convert->comment);
+		convert->details_pending = FALSE;
+	}
+	convert->point_type = GPX_STORAGE_POINT_TYPE_TRACK;
+}
+
+static guint64 gpx_convert_get_file_size(const gchar *path)
+{
+	struct stat file_stat;
+
+	if(g_stat(path, &file_stat) < 0)
+	{
+		return 0;
+	}
+	return file_stat.st_size;
+}
@@ -0,0 +1,861 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi, Sampo Savola
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* This module */
+#include "gpx_journal.h"
+
+/* System */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+/* GLib */
+#include <glib/gstdio.h>
+
+/* Other modules */
+#include "ec_error.h"
+
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+#define GPX_JOURNAL_MAGIC		"ECGPXJ"
+
+#define GPX_JOURNAL_RECORD_WAYPOINT	'W'
+#define GPX_JOURNAL_RECORD_HEART_RATE	'H'
+#define GPX_JOURNAL_RECORD_DETAILS	'D'
+#define GPX_JOURNAL_RECORD_COMMIT	'C'
+
+struct _GpxJournal {
+	/** @brief Path of the journal file */
+	gchar *path;
+
+	/** @brief Buffered stream of the journal file */
+	FILE *file;
+};
+
+/**
+ * @brief State of replaying a journal
+ */
+typedef struct _GpxJournalReplay {
+	GpxStorage *storage;
+
+	/** @brief Track IDs of the storage by track IDs in the journal */
+	GHashTable *track_ids;
+
+	/** @brief Route IDs of the storage by route IDs in the journal */
+	GHashTable *route_ids;
+
+	/** @brief Whether or not the GPX file was up to date */
+	gboolean committed;
+} GpxJournalReplay;
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Write a record to the journal
+ *
+ * @param self Pointer to #GpxJournal
+ * @param error Return location for possible error
+ * @param format printf-like format of the record, without the line feed
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean gpx_journal_printf(
+		GpxJournal *self,
+		GError **error,
+		const gchar *format,
+		...) G_GNUC_PRINTF(3, 4);
+
+/**
+ * @brief Read the journal and add its contents to a storage
+ *
+ * @param path Path of the journal
+ * @param storage The storage to add the contents to
+ * @param committed Return location for whether or not the GPX file
+ * was up to date
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean gpx_journal_replay(
+		const gchar *path,
+		GpxStorage *storage,
+		gboolean *committed,
+		GError **error);
+
+/**
+ * @brief Replay a single record
+ *
+ * @param replay Replay state
+ * @param fields Tab separated fields of the record
+ *
+ * @return TRUE if the record was valid, FALSE otherwise
+ */
+static gboolean gpx_journal_replay_record(
+		GpxJournalReplay *replay,
+		gchar **fields);
+
+/**
+ * @brief Map a track or route ID of the journal to an ID of the storage
+ *
+ * @param replay Replay state
+ * @param point_type Type of the point that was added
+ * @param journal_id The ID in the journal
+ * @param id The ID in the storage
+ * @param store Whether to look up the ID before adding the point (FALSE),
+ * or to store the ID that the storage allocated for a new track or route
+ * after adding the point (TRUE)
+ *
+ * @return TRUE on success, FALSE if the ID is not known
+ */
+static gboolean gpx_journal_replay_map_id(
+		GpxJournalReplay *replay,
+		GpxStoragePointType point_type,
+		guint journal_id,
+		guint *id,
+		gboolean store);
+
+/**
+ * @brief Escape a name or comment for the journal
+ *
+ * @param text Text to escape, or NULL
+ *
+ * @return Newly allocated field
+ */
+static gchar *gpx_journal_escape(const gchar *text);
+
+/**
+ * @brief Convert a field that was escaped with gpx_journal_escape back
+ *
+ * @param field The field
+ *
+ * @return Newly allocated text, or NULL if text was NULL
+ */
+static gchar *gpx_journal_unescape(const gchar *field);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+/*===========================================================================*
+ * Public functions                                                          *
+ *===========================================================================*/
+
+GpxJournal *gpx_journal_open(const gchar *path, GError **error)
+{
+	GpxJournal *self = NULL;
+	gint fd = -1;
+
+	g_return_val_if_fail(path != NULL, NULL);
+	g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+	DEBUG_BEGIN();
+
+	/* The file is truncated only after it has been locked, so that a
+	 * journal that is in use is never emptied */
+	fd = g_open(path, O_WRONLY | O_CREAT, 0644);
+	if(fd < 0)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to create journal %s: %s",
+				path, g_strerror(errno));
+		DEBUG_END();
+		return NULL;
+	}
+
+	/* The lock is released when the file is closed, also when the
+	 * application crashes */
+	if(flock(fd, LOCK_EX | LOCK_NB) < 0)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to lock journal %s: %s",
+				path, g_strerror(errno));
+		close(fd);
+		DEBUG_END();
+		return NULL;
+	}
+
+	if(ftruncate(fd, 0) < 0)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to truncate journal %s: %s",
+				path, g_strerror(errno));
+		close(fd);
+		DEBUG_END();
+		return NULL;
+	}
+
+	self = g_new0(GpxJournal, 1);
+	self->path = g_strdup(path);
+	self->file = fdopen(fd, "w");
+	if(!self->file)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to open journal %s: %s",
+				path, g_strerror(errno));
+		close(fd);
+		gpx_journal_close(self, TRUE);
+		DEBUG_END();
+		return NULL;
+	}
+
+	if(!gpx_journal_printf(self, error, "%s\t%d",
+				GPX_JOURNAL_MAGIC, GPX_JOURNAL_VERSION))
+	{
+		gpx_journal_close(self, TRUE);
+		DEBUG_END();
+		return NULL;
+	}
+
+	DEBUG_END();
+	return self;
+}
+
+void gpx_journal_close(GpxJournal *self, gboolean remove)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	/* Remove the file before closing it so that the recovery never
+	 * sees a journal that is not locked and is not in use either */
+	if(remove)
+	{
+		g_unlink(self->path);
+	}
+	if(self->file)
+	{
+		fclose(self->file);
+	}
+	g_free(self->path);
+	g_free(self);
+
+	DEBUG_END();
+}
+
+gboolean gpx_journal_rename(
+		GpxJournal *self,
+		const gchar *path,
+		GError **error)
+{
+	g_return_val_if_fail(self != NULL, FALSE);
+	g_return_val_if_fail(path != NULL, FALSE);
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+	DEBUG_BEGIN();
+
+	if(g_rename(self->path, path) < 0)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to move journal %s to %s: %s",
+				self->path, path, g_strerror(errno));
+		DEBUG_END();
+		return FALSE;
+	}
+
+	g_free(self->path);
+	self->path = g_strdup(path);
+
+	DEBUG_END();
+	return TRUE;
+}
+
+gboolean gpx_journal_append_waypoint(
+		GpxJournal *self,
+		const GpxStorageWaypoint *waypoint,
+		GError **error)
+{
+	gchar lat[G_ASCII_DTOSTR_BUF_SIZE];
+	gchar lon[G_ASCII_DTOSTR_BUF_SIZE];
+	gchar alt[G_ASCII_DTOSTR_BUF_SIZE];
+
+	g_return_val_if_fail(self != NULL, FALSE);
+	g_return_val_if_fail(waypoint != NULL, FALSE);
+
+	g_ascii_dtostr(lat, G_ASCII_DTOSTR_BUF_SIZE, waypoint->latitude);
+	g_ascii_dtostr(lon, G_ASCII_DTOSTR_BUF_SIZE, waypoint->longitude);
+	if(waypoint->altitude_is_set)
+	{
+		g_ascii_dtostr(alt, G_ASCII_DTOSTR_BUF_SIZE,
+				waypoint->altitude);
+	} else {
+		alt[0] = '\0';
+	}
+
+	return gpx_journal_printf(self, error, "%c\t%d\t%u\t%s\t%s\t%s\t%ld\t%ld",
+			GPX_JOURNAL_RECORD_WAYPOINT,
+			waypoint->point_type,
+			waypoint->route_track_id,
+			lat, lon, alt,
+			(glong)waypoint->timestamp.tv_sec,
+			(glong)waypoint->timestamp.tv_usec);
+}
+
+gboolean gpx_journal_append_heart_rate(
+		GpxJournal *self,
+		GpxStoragePointType point_type,
+		guint track_id,
+		const struct timeval *time,
+		gint heart_rate,
+		GError **error)
+{
+	g_return_val_if_fail(self != NULL, FALSE);
+	g_return_val_if_fail(time != NULL, FALSE);
+
+	return gpx_journal_printf(self, error, "%c\t%d\t%u\t%ld\t%ld\t%d",
+			GPX_JOURNAL_RECORD_HEART_RATE,
+			point_type,
+			track_id,
+			(glong)time->tv_sec,
+			(glong)time->tv_usec,
+			heart_rate);
+}
+
+gboolean gpx_journal_append_details(
+		GpxJournal *self,
+		gboolean is_track,
+		guint route_track_id,
+		const gchar *name,
+		const gchar *comment,
+		GError **error)
+{
+	gchar *name_field = NULL;
+	gchar *comment_field = NULL;
+	gboolean retval = FALSE;
+
+	g_return_val_if_fail(self != NULL, FALSE);
+
+	name_field = gpx_journal_escape(name);
+	comment_field = gpx_journal_escape(comment);
+
+	retval = gpx_journal_printf(self, error, "%c\t%d\t%u\t%s\t%s",
+			GPX_JOURNAL_RECORD_DETAILS,
+			is_track ? 1 : 0,
+			route_track_id,
+			name_field,
+			comment_field);
+
+	g_free(name_field);
+	g_free(comment_field);
+
+	return retval;
+}
+
+gboolean gpx_journal_commit(GpxJournal *self, GError **error)
+{
+	g_return_val_if_fail(self != NULL, FALSE);
+
+	if(!gpx_journal_printf(self, error, "%c", GPX_JOURNAL_RECORD_COMMIT))
+	{
+		return FALSE;
+	}
+	return gpx_journal_sync(self, error);
+}
+
+gboolean gpx_journal_sync(GpxJournal *self, GError **error)
+{
+	g_return_val_if_fail(self != NULL, FALSE);
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+	DEBUG_BEGIN();
+
+	if(fflush(self->file) != 0 || fsync(fileno(self->file)) < 0)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to write journal %s: %s",
+				self->path, g_strerror(errno));
+		DEBUG_END();
+		return FALSE;
+	}
+
+	DEBUG_END();
+	return TRUE;
+}
+
+gint gpx_journal_recover_folder(const gchar *folder, GError **error)
+{
+	GDir *dir = NULL;
+	const gchar *name = NULL;
+	gchar *path = NULL;
+	gchar *bad_path = NULL;
+	GError *recover_error = NULL;
+	gboolean recovered = FALSE;
+	gint count = 0;
+
+	g_return_val_if_fail(folder != NULL, -1);
+	g_return_val_if_fail(error == NULL || *error == NULL, -1);
+	DEBUG_BEGIN();
+
+	if(!g_file_test(folder, G_FILE_TEST_IS_DIR))
+	{
+		/* Nothing has been saved yet */
+		DEBUG_END();
+		return 0;
+	}
+
+	dir = g_dir_open(folder, 0, error);
+	if(!dir)
+	{
+		DEBUG_END();
+		return -1;
+	}
+
+	while((name = g_dir_read_name(dir)) != NULL)
+	{
+		if(!g_str_has_suffix(name, GPX_JOURNAL_SUFFIX))
+		{
+			continue;
+		}
+
+		path = g_build_filename(folder, name, NULL);
+		if(!gpx_journal_recover(path, &recovered, &recover_error))
+		{
+			/* Move the journal out of the way so that it does
+			 * not stop the recovery on every start */
+			g_warning("Unable to recover %s: %s", path,
+					recover_error->message);
+			g_error_free(recover_error);
+			recover_error = NULL;
+
+			bad_path = g_strconcat(path, GPX_JOURNAL_BAD_SUFFIX,
+					NULL);
+			if(g_rename(path, bad_path) < 0)
+			{
+				g_warning("Unable to rename %s: %s", path,
+						g_strerror(errno));
+			}
+			g_free(bad_path);
+		}
+		g_free(path);
+
+		if(recovered)
+		{
+			count++;
+		}
+	}
+	g_dir_close(dir);
+
+	DEBUG_END();
+	return count;
+}
+
+gboolean gpx_journal_recover(
+		const gchar *path,
+		gboolean *recovered,
+		GError **error)
+{
+	GpxStorage *storage = NULL;
+	gchar *gpx_path = NULL;
+	gboolean committed = FALSE;
+	gboolean retval = FALSE;
+	gint fd = -1;
+
+	g_return_val_if_fail(path != NULL, FALSE);
+	g_return_val_if_fail(recovered != NULL, FALSE);
+	g_return_val_if_fail(g_str_has_suffix(path, GPX_JOURNAL_SUFFIX),
+			FALSE);
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+	DEBUG_BEGIN();
+
+	*recovered = FALSE;
+
+	fd = g_open(path, O_RDONLY, 0);
+	if(fd < 0)
+	{
+		/* Removed after it was found; nothing to recover */
+		DEBUG_END();
+		return TRUE;
+	}
+
+	if(flock(fd, LOCK_EX | LOCK_NB) < 0)
+	{
+		DEBUG("Journal %s is in use", path);
+		close(fd);
+		DEBUG_END();
+		return TRUE;
+	}
+
+	storage = gpx_storage_new_recording();
+	if(!gpx_journal_replay(path, storage, &committed, error))
+	{
+		goto recover_done;
+	}
+
+	if(!committed)
+	{
+		gpx_path = g_strndup(path,
+				strlen(path) - strlen(GPX_JOURNAL_SUFFIX));
+		DEBUG("Recovering %s", gpx_path);
+		gpx_storage_set_path(storage, gpx_path);
+		if(!gpx_storage_write(storage, error))
+		{
+			goto recover_done;
+		}
+		*recovered = TRUE;
+	}
+
+	g_unlink(path);
+	retval = TRUE;
+
+recover_done:
+	gpx_storage_free(storage);
+	g_free(gpx_path);
+	close(fd);
+
+	DEBUG_END();
+	return retval;
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static gboolean gpx_journal_printf(
+		GpxJournal *self,
+		GError **error,
+		const gchar *format,
+		...)
+{
+	va_list args;
+	gint written = 0;
+
+	g_return_val_if_fail(self != NULL, FALSE);
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+	va_start(args, format);
+	written = vfprintf(self->file, format, args);
+	va_end(args);
+
+	if(written < 0 || fputc('\n', self->file) == EOF)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to write journal %s: %s",
+				self->path, g_strerror(errno));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean gpx_journal_replay(
+		const gchar *path,
+		GpxStorage *storage,
+		gboolean *committed,
+		GError **error)
+{
+	GpxJournalReplay replay;
+	gchar *contents = NULL;
+	gchar *line = NULL;
+	gchar *line_end = NULL;
+	gchar **fields = NULL;
+	gsize length = 0;
+	gint line_number = 1;
+	gboolean retval = FALSE;
+
+	g_return_val_if_fail(path != NULL, FALSE);
+	g_return_val_if_fail(storage != NULL, FALSE);
+	g_return_val_if_fail(committed != NULL, FALSE);
+	DEBUG_BEGIN();
+
+	if(!g_file_get_contents(path, &contents, &length, error))
+	{
+		DEBUG_END();
+		return FALSE;
+	}
+
+	memset(&replay, 0, sizeof(replay));
+	replay.storage = storage;
+	replay.track_ids = g_hash_table_new(g_direct_hash, g_direct_equal);
+	replay.route_ids = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	/* Check the header */
+	line_end = memchr(contents, '\n', length);
+	if(!line_end)
+	{
+		/* Crashed before the header was written; empty journal */
+		retval = TRUE;
+		goto replay_done;
+	}
+	*line_end = '\0';
+	fields = g_strsplit(contents, "\t", -1);
+	if(g_strv_length(fields) != 2 ||
+			strcmp(fields[0], GPX_JOURNAL_MAGIC) != 0 ||
+			atoi(fields[1]) != GPX_JOURNAL_VERSION)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+				"%s is not a supported journal", path);
+		goto replay_done;
+	}
+	g_strfreev(fields);
+	fields = NULL;
+
+	/* Only complete lines are replayed; the last one may have been
+	 * only partly written */
+	for(line = line_end + 1;
+			(line_end = memchr(line, '\n',
+					contents + length - line)) != NULL;
+			line = line_end + 1)
+	{
+		*line_end = '\0';
+		line_number++;
+
+		fields = g_strsplit(line, "\t", -1);
+		if(!gpx_journal_replay_record(&replay, fields))
+		{
+			g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+					"Invalid record on line %d of %s",
+					line_number, path);
+			goto replay_done;
+		}
+		g_strfreev(fields);
+		fields = NULL;
+	}
+
+	retval = TRUE;
+
+replay_done:
+	*committed = replay.committed;
+	g_strfreev(fields);
+	g_hash_table_destroy(replay.track_ids);
+	g_hash_table_destroy(replay.route_ids);
+	g_free(contents);
+
+	DEBUG_END();
+	return retval;
+}
+
+static gboolean gpx_journal_replay_record(
+		GpxJournalReplay *replay,
+		gchar **fields)
+{
+	GpxStorageWaypoint waypoint;
+	GpxStoragePointType point_type;
+	struct timeval time;
+	guint journal_id = 0;
+	guint id = 0;
+	gchar *name = NULL;
+	gchar *comment = NULL;
+	guint count = 0;
+
+	g_return_val_if_fail(replay != NULL, FALSE);
+	g_return_val_if_fail(fields != NULL, FALSE);
+
+	count = g_strv_length(fields);
+	if(count < 1 || strlen(fields[0]) != 1)
+	{
+		return FALSE;
+	}
+
+	switch(fields[0][0])
+	{
+		case GPX_JOURNAL_RECORD_WAYPOINT:
+			if(count != 8)
+			{
+				return FALSE;
+			}
+			memset(&waypoint, 0, sizeof(waypoint));
+			waypoint.point_type = atoi(fields[1]);
+			journal_id = strtoul(fields[2], NULL, 10);
+			waypoint.latitude = g_ascii_strtod(fields[3], NULL);
+			waypoint.longitude = g_ascii_strtod(fields[4], NULL);
+			if(fields[5][0] != '\0')
+			{
+				waypoint.altitude_is_set = TRUE;
+				waypoint.altitude = g_ascii_strtod(fields[5],
+						NULL);
+			}
+			waypoint.timestamp.tv_sec = strtol(fields[6], NULL, 10);
+			waypoint.timestamp.tv_usec = strtol(fields[7], NULL, 10);
+
+			if(!gpx_journal_replay_map_id(replay,
+						waypoint.point_type,
+						journal_id,
+						&waypoint.route_track_id,
+						FALSE))
+			{
+				return FALSE;
+			}
+			gpx_storage_add_waypoint(replay->storage, &waypoint);
+			gpx_journal_replay_map_id(replay,
+					waypoint.point_type,
+					journal_id,
+					&waypoint.route_track_id,
+					TRUE);
+			break;
+
+		case GPX_JOURNAL_RECORD_HEART_RATE:
+			if(count != 6)
+			{
+				return FALSE;
+			}
+			point_type = atoi(fields[1]);
+			journal_id = strtoul(fields[2], NULL, 10);
+			time.tv_sec = strtol(fields[3], NULL, 10);
+			time.tv_usec = strtol(fields[4], NULL, 10);
+
+			if(!gpx_journal_replay_map_id(replay, point_type,
+						journal_id, &id, FALSE))
+			{
+				return FALSE;
+			}
+			gpx_storage_add_heart_rate(replay->storage,
+					point_type,
+					&id,
+					&time,
+					atoi(fields[5]));
+			gpx_journal_replay_map_id(replay, point_type,
+					journal_id, &id, TRUE);
+			break;
+
+		case GPX_JOURNAL_RECORD_DETAILS:
+			if(count != 5)
+			{
+				return FALSE;
+			}
+			journal_id = strtoul(fields[2], NULL, 10);
+			point_type = atoi(fields[1]) ?
+				GPX_STORAGE_POINT_TYPE_TRACK :
+				GPX_STORAGE_POINT_TYPE_ROUTE;
+			if(!gpx_journal_replay_map_id(replay, point_type,
+						journal_id, &id, FALSE))
+			{
+				return FALSE;
+			}
+
+			name = gpx_journal_unescape(fields[3]);
+			comment = gpx_journal_unescape(fields[4]);
+			gpx_storage_set_route_or_track_details(
+					replay->storage,
+					atoi(fields[1]),
+					id,
+					name,
+					comment);
+			g_free(name);
+			g_free(comment);
+			break;
+
+		case GPX_JOURNAL_RECORD_COMMIT:
+			replay->committed = TRUE;
+			return TRUE;
+
+		default:
+			return FALSE;
+	}
+
+	/* There are changes that were not written to the GPX file */
+	replay->committed = FALSE;
+	return TRUE;
+}
+
+static gboolean gpx_journal_replay_map_id(
+		GpxJournalReplay *replay,
+		GpxStoragePointType point_type,
+		guint journal_id,
+		guint *id,
+		gboolean store)
+{
+	GHashTable *ids = NULL;
+	gpointer value = NULL;
+	gboolean is_start = FALSE;
+
+	switch(point_type)
+	{
+		case GPX_STORAGE_POINT_TYPE_TRACK_START:
+			is_start = TRUE;
+			/* Fall through */
+		case GPX_STORAGE_POINT_TYPE_TRACK_SEGMENT_START:
+		case GPX_STORAGE_POINT_TYPE_TRACK:
+			ids = replay->track_ids;
+			break;
+		case GPX_STORAGE_POINT_TYPE_ROUTE_START:
+			is_start = TRUE;
+			/* Fall through */
+		case GPX_STORAGE_POINT_TYPE_ROUTE:
+			ids = replay->route_ids;
+			break;
+		default:
+			return FALSE;
+	}
+
+	if(is_start)
+	{
+		/* The storage allocates the ID when the track or route
+		 * is started */
+		if(store)
+		{
+			g_hash_table_insert(ids,
+					GUINT_TO_POINTER(journal_id),
+					GUINT_TO_POINTER(*id));
+		}
+		return TRUE;
+	}
+
+	if(store)
+	{
+		return TRUE;
+	}
+
+	if(!g_hash_table_lookup_extended(ids, GUINT_TO_POINTER(journal_id),
+				NULL, &value))
+	{
+		return FALSE;
+	}
+	*id = GPOINTER_TO_UINT(value);
+	return TRUE;
+}
+
+static gchar *gpx_journal_escape(const gchar *text)
+{
+	gchar *escaped = NULL;
+	gchar *retval = NULL;
+
+	if(!text)
+	{
+		return g_strdup("");
+	}
+
+	/* Escapes also tabs and line feeds */
+	escaped = g_strescape(text, NULL);
+	retval = g_strconcat("=", escaped, NULL);
+	g_free(escaped);
+
+	return retval;
+}
+
+static gchar *gpx_journal_unescape(const gchar *field)
+{
+	if(field[0] != '=')
+	{
+		return NULL;
+	}
+	return g_strcompress(field + 1);
+}
@@ -0,0 +1,220 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi, Sampo Savola
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/**
+ * @file gpx_journal.h
+ *
+ * @brief Append-only journal of the changes made to a #GpxStorage
+ *
+ * Writing the whole GPX document takes longer the longer the exercise
+ * is, so while an exercise is going on, only the new points are appended
+ * to a journal next to the GPX file (FILE.gpx.journal). The complete GPX
+ * file is written when the exercise is stopped. If the application
+ * crashes before that, the GPX file can be rebuilt from the journal.
+ *
+ * The journal is a text file with one record per line, fields separated
+ * by tabs:
+ *
+ * <pre>
+ * ECGPXJ  1                                      Header and version
+ * W  TYPE  ID  LAT  LON  [ALT]  SEC  USEC        Waypoint
+ * H  TYPE  ID  SEC  USEC  HEART_RATE             Heart rate
+ * D  IS_TRACK  ID  [=NAME]  [=COMMENT]           Track or route details
+ * C                                              GPX file is up to date
+ * </pre>
+ *
+ * TYPE is a #GpxStoragePointType, and ID is the track or route ID that
+ * the point was added to. Names and comments are escaped with
+ * g_strescape(). An incomplete last line, left by a crash in the middle
+ * of a write, is ignored.
+ *
+ * An open journal is locked with flock(), so that a journal that is
+ * in use is never taken for one left by a crash.
+ */
+
+#ifndef _GPX_JOURNAL_H
+#define _GPX_JOURNAL_H
+
+/* Configuration */
+#include "config.h"
+
+/* System */
+#include <sys/time.h>
+
+/* GLib */
+#include <glib.h>
+
+/* Other modules */
+#include "gpx.h"
+
+#define GPX_JOURNAL_SUFFIX		".journal"
+#define GPX_JOURNAL_BAD_SUFFIX		".bad"
+#define GPX_JOURNAL_VERSION		1
+
+/*****************************************************************************
+ * Function prototypes                                                       *
+ *****************************************************************************/
+
+/**
+ * @brief Create a new journal, replacing a possibly existing one
+ *
+ * @param path Path of the journal file
+ * @param error Return location for possible error
+ *
+ * @return Newly allocated journal, or NULL in case of an error
+ */
+GpxJournal *gpx_journal_open(const gchar *path, GError **error);
+
+/**
+ * @brief Close a journal
+ *
+ * @param self Pointer to #GpxJournal
+ * @param remove Whether or not to also remove the journal file
+ */
+void gpx_journal_close(GpxJournal *self, gboolean remove);
+
+/**
+ * @brief Move the journal file
+ *
+ * @param self Pointer to #GpxJournal
+ * @param path New path of the journal file
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean gpx_journal_rename(
+		GpxJournal *self,
+		const gchar *path,
+		GError **error);
+
+/**
+ * @brief Append a waypoint that was added to a track or a route
+ *
+ * @param self Pointer to #GpxJournal
+ * @param waypoint The waypoint, with the ID of its track or route
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean gpx_journal_append_waypoint(
+		GpxJournal *self,
+		const GpxStorageWaypoint *waypoint,
+		GError **error);
+
+/**
+ * @brief Append a heart rate that was added to a track
+ *
+ * @param self Pointer to #GpxJournal
+ * @param point_type Point type the heart rate was added with
+ * @param track_id ID of the track
+ * @param time Time of the heart rate
+ * @param heart_rate The heart rate
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean gpx_journal_append_heart_rate(
+		GpxJournal *self,
+		GpxStoragePointType point_type,
+		guint track_id,
+		const struct timeval *time,
+		gint heart_rate,
+		GError **error);
+
+/**
+ * @brief Append the details of a track or a route
+ *
+ * @param self Pointer to #GpxJournal
+ * @param is_track Whether the details are for a track or a route
+ * @param route_track_id ID of the track or route
+ * @param name Name, or NULL if not changed
+ * @param comment Comment, or NULL if not changed
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean gpx_journal_append_details(
+		GpxJournal *self,
+		gboolean is_track,
+		guint route_track_id,
+		const gchar *name,
+		const gchar *comment,
+		GError **error);
+
+/**
+ * @brief Record that the GPX file has been written with all the changes
+ * so far, and sync the journal
+ *
+ * @param self Pointer to #GpxJournal
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean gpx_journal_commit(GpxJournal *self, GError **error);
+
+/**
+ * @brief Flush the appended records to the disk
+ *
+ * The records are buffered, and written to the disk in batches with
+ * this function.
+ *
+ * @param self Pointer to #GpxJournal
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean gpx_journal_sync(GpxJournal *self, GError **error);
+
+/**
+ * @brief Rebuild the GPX files of the journals left in a folder
+ *
+ * Each journal that is not in use is replayed, the GPX file is written if
+ * it was not up to date, and the journal is removed. A journal that cannot
+ * be recovered is renamed with #GPX_JOURNAL_BAD_SUFFIX so that it is not
+ * tried again, and the rest of the journals are still recovered.
+ *
+ * @param folder The folder to search for journals
+ * @param error Return location for possible error
+ *
+ * @return Amount of GPX files that were rebuilt, or -1 if the folder
+ * could not be read
+ */
+gint gpx_journal_recover_folder(const gchar *folder, GError **error);
+
+/**
+ * @brief Rebuild a GPX file from a journal, and remove the journal
+ *
+ * @param path Path of the journal. The GPX file is written to the same
+ * path without the #GPX_JOURNAL_SUFFIX.
+ * @param recovered Return location for whether or not the GPX file was
+ * rebuilt. It is not rebuilt if it was up to date, or if the journal is
+ * in use.
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean gpx_journal_recover(
+		const gchar *path,
+		gboolean *recovered,
+		GError **error);
+
+#endif /* _GPX_JOURNAL_H */
@@ -29,12 +29,21 @@
 
 /* System */
 #include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* GLib */
+#include <glib/gstdio.h>
 
 /* LibXML2 */
 #include <libxml/parser.h>
 
 /* Other modules */
+#include "gpx_binary.h"
 #include "gpx_defs.h"
 #include "ec_error.h"
 #include "util.h"
@@ -81,6 +90,22 @@ typedef struct _GpxParserPriv {
 	GString *buffer;
 	gboolean metadata_sent;
 	GpxStoragePointType next_point_type;
+
+	/* The point and heart rate that are being parsed. These are reused,
+	 * so that nothing is allocated per point. */
+	GpxParserDataWaypoint waypoint;
+	GpxParserDataHeartRate heart_rate;
+	GpxParserDataTrackSegment track_segment;
+
+	/* Batches, if the data is delivered in batches, otherwise NULL */
+	GArray *waypoints;
+	GArray *heart_rates;
+
+	/* The callback of the caller, when the data is also collected to
+	 * a binary copy */
+	GpxParserCallback client_callback;
+	gpointer client_data;
+	GpxBinary *binary;
 } GpxParserPriv;
 
 typedef struct _GpxParserSAX2Attribute {
@@ -97,6 +122,16 @@ typedef struct _GpxParserSAX2Attribute {
 
 static void gpx_parser_unknown_node(GpxParserPriv *self);
 
+/**
+ * @brief Deliver the batches that have not been delivered yet
+ *
+ * This must be called before delivering any other data, so that the
+ * data is delivered in the same order as it is in the file.
+ *
+ * @param self Pointer to #GpxParserPriv
+ */
+static void gpx_parser_flush_batches(GpxParserPriv *self);
+
 static xmlEntityPtr gpx_parser_sax_get_entity(void *ctx, const xmlChar *name)
 {
 	xmlEntityPtr entity;
@@ -145,6 +180,7 @@ static void gpx_parser_sax_end_document(void *ctx)
 	g_return_if_fail(self != NULL);
 	DEBUG_BEGIN();
 
+	gpx_parser_flush_batches(self);
 	g_string_free(self->buffer, TRUE);
 
 	DEBUG_END();
@@ -200,6 +236,96 @@ static void gpx_parser_parse_heart_rate(
 static void gpx_parser_free_data(GpxParserPriv *self,
 		GpxParserDataType data_type);
 
+/**
+ * @brief Parse a file, or read its binary copy if it is up to date
+ *
+ * @param file_name Name of the file to load from
+ * @param batched Whether or not to deliver the data in batches
+ * @param use_binary Whether or not to read and write the binary copy
+ * @param callback Callback to be called during parsing
+ * @param user_data Optional user data to be passed to the callback
+ * @param file_stat Return location for the status of the parsed file, or
+ * NULL
+ * @param error Storage location for possible error
+ *
+ * @return Status of the parsing
+ */
+static GpxParserStatus gpx_parser_parse(
+		const gchar *file_name,
+		gboolean batched,
+		gboolean use_binary,
+		GpxParserCallback callback,
+		gpointer user_data,
+		struct stat *file_stat,
+		GError **error);
+
+/**
+ * @brief Pass the data to the binary copy and to the callback of the
+ * caller
+ */
+static void gpx_parser_binary_callback(
+		GpxParserDataType data_type,
+		const GpxParserData *data,
+		gpointer user_data);
+
+/**
+ * @brief Parse a file that is mapped to memory
+ *
+ * @param file_name Name of the file to load from
+ * @param self Parser state, with the callback set
+ * @param file_stat Return location for the status of the file that was
+ * mapped. The file might be replaced while it is parsed, so this is the
+ * status of the data that was parsed, unlike that of the file name.
+ * @param error Storage location for possible error
+ *
+ * @return Status of the parsing
+ */
+static GpxParserStatus gpx_parser_parse_mapped_file(
+		const gchar *file_name,
+		GpxParserPriv *self,
+		struct stat *file_stat,
+		GError **error);
+
+/**
+ * @brief Deliver a parsed waypoint or heart rate, either directly or by
+ * adding it to a batch
+ *
+ * @param self Pointer to #GpxParserPriv
+ * @param data_type #GPX_PARSER_DATA_TYPE_WAYPOINT or
+ * #GPX_PARSER_DATA_TYPE_HEART_RATE
+ */
+static void gpx_parser_deliver(
+		GpxParserPriv *self,
+		GpxParserDataType data_type);
+
+/**
+ * @brief Parse a floating point number from an attribute value
+ *
+ * @param start Start of the value
+ * @param end End of the value
+ * @param value Return location for the number
+ *
+ * @return TRUE on success, FALSE if the value is not a number
+ */
+static gboolean gpx_parser_parse_double(
+		const xmlChar *start,
+		const xmlChar *end,
+		gdouble *value);
+
+/**
+ * @brief Parse a non-negative integer from an attribute value
+ *
+ * @param start Start of the value
+ * @param end End of the value
+ * @param value Return location for the number
+ *
+ * @return TRUE on success, FALSE if the value is not a number
+ */
+static gboolean gpx_parser_parse_int(
+		const xmlChar *start,
+		const xmlChar *end,
+		gint *value);
+
 /*****************************************************************************
  * Static variables                                                          *
  *****************************************************************************/
@@ -253,28 +379,29 @@ GpxParserStatus gpx_parser_parse_file(
 		gpointer user_data,
 		GError **error)
 {
-	GpxParserPriv self;
-
-	g_return_val_if_fail(error == NULL || *error == NULL,
-			GPX_PARSER_STATUS_FAILED);
-	g_return_val_if_fail(file_name != NULL, GPX_PARSER_STATUS_FAILED);
-	g_return_val_if_fail(callback  != NULL, GPX_PARSER_STATUS_FAILED);
-
-	DEBUG_BEGIN();
-
-	self.callback = callback;
-	self.user_data = user_data;
+	return gpx_parser_parse(file_name, FALSE, TRUE, callback, user_data,
+			NULL, error);
+}
 
-	if(xmlSAXUserParseFile(&gpx_parser_sax_handler, &self, file_name) < 0)
-	{
-		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
-				"Failed to open file");
-		DEBUG_END();
-		return GPX_PARSER_STATUS_FAILED;
-	}
+GpxParserStatus gpx_parser_parse_file_batched(
+		const gchar *file_name,
+		GpxParserCallback callback,
+		gpointer user_data,
+		GError **error)
+{
+	return gpx_parser_parse(file_name, TRUE, TRUE, callback, user_data,
+			NULL, error);
+}
 
-	DEBUG_END();
-	return self.retval;
+GpxParserStatus gpx_parser_parse_xml_batched(
+		const gchar *file_name,
+		GpxParserCallback callback,
+		gpointer user_data,
+		struct stat *file_stat,
+		GError **error)
+{
+	return gpx_parser_parse(file_name, TRUE, FALSE, callback, user_data,
+			file_stat, error);
 }
 
 /*===========================================================================*
@@ -376,6 +503,7 @@ static void gpx_parser_sax_start_element_ns(
 				 * requires that they are before the track
 				 * segments) */
 				self->metadata_sent = TRUE;
+				gpx_parser_flush_batches(self);
 				self->callback(
 						GPX_PARSER_DATA_TYPE_TRACK,
 						&self->data,
@@ -396,8 +524,8 @@ static void gpx_parser_sax_start_element_ns(
 
 			/* There is not any data in the track segment really,
 			 * but do this for completeness */
-			self->data.track_segment =
-				g_new0(GpxParserDataTrackSegment, 1);
+			gpx_parser_flush_batches(self);
+			self->data.track_segment = &self->track_segment;
 			self->callback(
 					GPX_PARSER_DATA_TYPE_TRACK_SEGMENT,
 					&self->data,
@@ -525,14 +653,7 @@ static void gpx_parser_sax_end_element_ns(
 		/* Send the waypoint */
 		self->data.waypoint->point_type = self->next_point_type;
 		self->next_point_type = GPX_STORAGE_POINT_TYPE_TRACK;
-		self->callback(
-				GPX_PARSER_DATA_TYPE_WAYPOINT,
-				&self->data,
-				self->user_data);
-		gpx_parser_free_data(
-				self,
-				GPX_PARSER_DATA_TYPE_WAYPOINT
-				);
+		gpx_parser_deliver(self, GPX_PARSER_DATA_TYPE_WAYPOINT);
 
 	} else if(self->state == GPX_PARSER_STATE_IN_TRACK_WAYPOINT_ALTITUDE) {
 		self->state = GPX_PARSER_STATE_IN_TRACK_WAYPOINT;
@@ -551,25 +672,17 @@ static void gpx_parser_sax_end_element_ns(
 
 	} else if(self->state == GPX_PARSER_STATE_IN_TRACK_WAYPOINT_TIME) {
 		self->state = GPX_PARSER_STATE_IN_TRACK_WAYPOINT;
-		tmp_buffer = g_string_free(self->buffer, FALSE);
-		self->buffer = g_string_new("");
-		util_timeval_from_xml_date_time_string(tmp_buffer,
+		util_timeval_from_xml_date_time(self->buffer->str,
+				self->buffer->len,
 				&self->data.waypoint->timestamp);
-		g_free(tmp_buffer);
+		g_string_set_size(self->buffer, 0);
 
 	} else if(self->state == GPX_PARSER_STATE_IN_HEART_RATE_LIST ) {
 		self->state = GPX_PARSER_STATE_IN_TRACK_SEGMENT_EXTENSIONS;
 
 	} else if(self->state == GPX_PARSER_STATE_IN_HEART_RATE) {
 		self->state = GPX_PARSER_STATE_IN_HEART_RATE_LIST;
-		self->callback(
-				GPX_PARSER_DATA_TYPE_HEART_RATE,
-				&self->data,
-				self->user_data);
-		gpx_parser_free_data(
-				self,
-				GPX_PARSER_DATA_TYPE_HEART_RATE
-				);
+		gpx_parser_deliver(self, GPX_PARSER_DATA_TYPE_HEART_RATE);
 
 	} else if(self->state == GPX_PARSER_STATE_IN_ROOT) {
 		if(strcmp(name, EC_GPX_NODE_ROOT) == 0)
@@ -633,14 +746,14 @@ static void gpx_parser_parse_track_point(
 		const xmlChar **attributes)
 {
 	GpxParserSAX2Attribute *attr = NULL;
-	gchar *value = NULL;
 	gint i = 0;
 
 	g_return_if_fail(self != NULL);
 	g_return_if_fail(attributes != NULL);
 	DEBUG_BEGIN();
 
-	self->data.waypoint = g_new0(GpxParserDataWaypoint, 1);
+	memset(&self->waypoint, 0, sizeof(GpxParserDataWaypoint));
+	self->data.waypoint = &self->waypoint;
 
 	for(i = 0; i < nb_attributes; i++)
 	{
@@ -648,33 +761,31 @@ static void gpx_parser_parse_track_point(
 		if(strcmp(attr->name,
 				EC_GPX_NODE_WAYPOINT_ATTR_LATITUDE_NAME) == 0)
 		{
-			value = g_strndup(attr->value_start,
-					attr->value_end - attr->value_start);
-			self->data.waypoint->latitude =
-				g_ascii_strtod(value, NULL);
-			if(errno)
+			if(!gpx_parser_parse_double(attr->value_start,
+						attr->value_end,
+						&self->waypoint.latitude))
 			{
-				g_warning("Unable to parse as a number: %s",
-						value);
+				g_warning("Unable to parse as a number: %.*s",
+					(gint)(attr->value_end -
+					       attr->value_start),
+					attr->value_start);
 			}
-			g_free(value);
 		} else if(strcmp(attr->name,
 				EC_GPX_NODE_WAYPOINT_ATTR_LONGITUDE_NAME) == 0)
 		{
-			value = g_strndup(attr->value_start,
-					attr->value_end - attr->value_start);
-			self->data.waypoint->longitude =
-				g_ascii_strtod(value, NULL);
-			if(errno)
+			if(!gpx_parser_parse_double(attr->value_start,
+						attr->value_end,
+						&self->waypoint.longitude))
 			{
-				g_warning("Unable to parse as a number: %s",
-						value);
+				g_warning("Unable to parse as a number: %.*s",
+					(gint)(attr->value_end -
+					       attr->value_start),
+					attr->value_start);
 			}
-			g_free(value);
 		}
 	}
-	DEBUG("Lat: %f, long: %f", self->data.waypoint->latitude,
-			self->data.waypoint->longitude);
+	DEBUG("Lat: %f, long: %f", self->waypoint.latitude,
+			self->waypoint.longitude);
 
 	DEBUG_END();
 }
@@ -685,43 +796,336 @@ static void gpx_parser_parse_heart_rate(
 		const xmlChar **attributes)
 {
 	GpxParserSAX2Attribute *attr = NULL;
-	gchar *value = NULL;
 	gint i = 0;
 
 	g_return_if_fail(self != NULL);
 	g_return_if_fail(attributes != NULL);
 	DEBUG_BEGIN();
 
-	self->data.heart_rate = g_new0(GpxParserDataHeartRate, 1);
+	memset(&self->heart_rate, 0, sizeof(GpxParserDataHeartRate));
+	self->data.heart_rate = &self->heart_rate;
 
 	for(i = 0; i < nb_attributes; i++)
 	{
 		attr = (GpxParserSAX2Attribute *)(attributes + 5 * i);
 		if(strcmp(attr->name, EC_GPX_EXT_ATTR_HEART_RATE_TIME) == 0)
 		{
-			value = g_strndup(attr->value_start,
-					attr->value_end - attr->value_start);
-			util_timeval_from_xml_date_time_string(
-					value,
-					&self->data.heart_rate->timestamp);
+			util_timeval_from_xml_date_time(
+					attr->value_start,
+					attr->value_end - attr->value_start,
+					&self->heart_rate.timestamp);
 		} else if(strcmp(attr->name,
 				EC_GPX_EXT_ATTR_HEART_RATE_VALUE) == 0)
 		{
-			value = g_strndup(attr->value_start,
-					attr->value_end - attr->value_start);
-			self->data.heart_rate->value =
-				strtoul(value, NULL, 10);
-			if(errno)
+			if(!gpx_parser_parse_int(attr->value_start,
+						attr->value_end,
+						&self->heart_rate.value))
 			{
-				g_warning("Unable to parse as a number: %s",
-						value);
+				g_warning("Unable to parse as a number: %.*s",
+					(gint)(attr->value_end -
+					       attr->value_start),
+					attr->value_start);
 			}
-			g_free(value);
 		}
 	}
 
 	DEBUG_END();
 }
+
+static void gpx_parser_deliver(
+		GpxParserPriv *self,
+		GpxParserDataType data_type)
+{
+	g_return_if_fail(self != NULL);
+
+	if(!self->waypoints)
+	{
+		self->callback(data_type, &self->data, self->user_data);
+		return;
+	}
+
+	if(data_type == GPX_PARSER_DATA_TYPE_WAYPOINT)
+	{
+		if(self->heart_rates->len)
+		{
+			gpx_parser_flush_batches(self);
+		}
+		g_array_append_val(self->waypoints, self->waypoint);
+		if(self->waypoints->len >= GPX_PARSER_BATCH_SIZE)
+		{
+			gpx_parser_flush_batches(self);
+		}
+	} else {
+		if(self->waypoints->len)
+		{
+			gpx_parser_flush_batches(self);
+		}
+		g_array_append_val(self->heart_rates, self->heart_rate);
+		if(self->heart_rates->len >= GPX_PARSER_BATCH_SIZE)
+		{
+			gpx_parser_flush_batches(self);
+		}
+	}
+}
+
+static void gpx_parser_flush_batches(GpxParserPriv *self)
+{
+	GpxParserDataWaypointBatch waypoint_batch;
+	GpxParserDataHeartRateBatch heart_rate_batch;
+	GpxParserData data;
+
+	g_return_if_fail(self != NULL);
+
+	/* Only one of the batches can have items, because adding to one
+	 * flushes the other */
+	if(self->waypoints && self->waypoints->len)
+	{
+		waypoint_batch.waypoints =
+			(GpxParserDataWaypoint *)self->waypoints->data;
+		waypoint_batch.count = self->waypoints->len;
+		data.waypoint_batch = &waypoint_batch;
+		self->callback(GPX_PARSER_DATA_TYPE_WAYPOINT_BATCH, &data,
+				self->user_data);
+		g_array_set_size(self->waypoints, 0);
+	}
+
+	if(self->heart_rates && self->heart_rates->len)
+	{
+		heart_rate_batch.heart_rates =
+			(GpxParserDataHeartRate *)self->heart_rates->data;
+		heart_rate_batch.count = self->heart_rates->len;
+		data.heart_rate_batch = &heart_rate_batch;
+		self->callback(GPX_PARSER_DATA_TYPE_HEART_RATE_BATCH, &data,
+				self->user_data);
+		g_array_set_size(self->heart_rates, 0);
+	}
+}
+
+static gboolean gpx_parser_parse_double(
+		const xmlChar *start,
+		const xmlChar *end,
+		gdouble *value)
+{
+	gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+	gchar *endptr = NULL;
+	gsize length = end - start;
+
+	/* The value is not null-terminated, so copy it to the stack for
+	 * g_ascii_strtod() */
+	if(length == 0 || length >= sizeof(buf))
+	{
+		return FALSE;
+	}
+	memcpy(buf, start, length);
+	buf[length] = '\0';
+
+	errno = 0;
+	*value = g_ascii_strtod(buf, &endptr);
+
+	return errno == 0 && endptr != buf;
+}
+
+static gboolean gpx_parser_parse_int(
+		const xmlChar *start,
+		const xmlChar *end,
+		gint *value)
+{
+	const xmlChar *ptr;
+
+	*value = 0;
+	for(ptr = start; ptr < end && g_ascii_isdigit(*ptr); ptr++)
+	{
+		if(*value > (G_MAXINT - 9) / 10)
+		{
+			return FALSE;
+		}
+		*value = *value * 10 + (*ptr - '0');
+	}
+
+	return ptr != start;
+}
+
+static GpxParserStatus gpx_parser_parse(
+		const gchar *file_name,
+		gboolean batched,
+		gboolean use_binary,
+		GpxParserCallback callback,
+		gpointer user_data,
+		struct stat *file_stat,
+		GError **error)
+{
+	GpxParserPriv self;
+	GpxParserStatus status;
+	GpxBinary *binary = NULL;
+	GError *binary_error = NULL;
+	struct stat parsed_stat;
+
+	g_return_val_if_fail(error == NULL || *error == NULL,
+			GPX_PARSER_STATUS_FAILED);
+	g_return_val_if_fail(file_name != NULL, GPX_PARSER_STATUS_FAILED);
+	g_return_val_if_fail(callback  != NULL, GPX_PARSER_STATUS_FAILED);
+
+	DEBUG_BEGIN();
+
+	if(use_binary)
+	{
+		binary = gpx_binary_read(file_name, &binary_error);
+		if(binary)
+		{
+			gpx_binary_replay(binary, batched, callback,
+					user_data);
+			gpx_binary_free(binary);
+			DEBUG_END();
+			return GPX_PARSER_STATUS_OK;
+		}
+		if(binary_error)
+		{
+			/* The binary copy is rewritten below */
+			g_warning("%s", binary_error->message);
+			g_clear_error(&binary_error);
+		}
+	}
+
+	memset(&self, 0, sizeof(GpxParserPriv));
+	if(use_binary)
+	{
+		self.callback = gpx_parser_binary_callback;
+		self.user_data = &self;
+		self.client_callback = callback;
+		self.client_data = user_data;
+		self.binary = gpx_binary_new();
+	} else {
+		self.callback = callback;
+		self.user_data = user_data;
+	}
+	if(batched)
+	{
+		self.waypoints = g_array_sized_new(FALSE, FALSE,
+				sizeof(GpxParserDataWaypoint),
+				GPX_PARSER_BATCH_SIZE);
+		self.heart_rates = g_array_sized_new(FALSE, FALSE,
+				sizeof(GpxParserDataHeartRate),
+				GPX_PARSER_BATCH_SIZE);
+	}
+
+	memset(&parsed_stat, 0, sizeof(struct stat));
+	status = gpx_parser_parse_mapped_file(file_name, &self,
+			&parsed_stat, error);
+	if(file_stat)
+	{
+		*file_stat = parsed_stat;
+	}
+
+	/* Only store data that was parsed completely. The binary copy
+	 * is only a cache, so failing to write it is not an error. */
+	if(use_binary && status == GPX_PARSER_STATUS_OK &&
+			!gpx_binary_write(self.binary, file_name,
+				&parsed_stat, &binary_error))
+	{
+		g_warning("Unable to write binary copy of %s: %s",
+				file_name, binary_error->message);
+		g_error_free(binary_error);
+	}
+
+	if(self.binary)
+	{
+		gpx_binary_free(self.binary);
+	}
+	if(batched)
+	{
+		g_array_free(self.waypoints, TRUE);
+		g_array_free(self.heart_rates, TRUE);
+	}
+
+	DEBUG_END();
+	return status;
+}
+
+static void gpx_parser_binary_callback(
+		GpxParserDataType data_type,
+		const GpxParserData *data,
+		gpointer user_data)
+{
+	GpxParserPriv *self = (GpxParserPriv *)user_data;
+
+	gpx_binary_add(data_type, data, self->binary);
+	self->client_callback(data_type, data, self->client_data);
+}
+
+static GpxParserStatus gpx_parser_parse_mapped_file(
+		const gchar *file_name,
+		GpxParserPriv *self,
+		struct stat *file_stat,
+		GError **error)
+{
+	GpxParserStatus status = GPX_PARSER_STATUS_FAILED;
+	gpointer contents = MAP_FAILED;
+	gint fd = -1;
+	gint result;
+
+	g_return_val_if_fail(file_name != NULL, GPX_PARSER_STATUS_FAILED);
+	g_return_val_if_fail(self != NULL, GPX_PARSER_STATUS_FAILED);
+
+	fd = g_open(file_name, O_RDONLY, 0);
+	if(fd < 0 || fstat(fd, file_stat) < 0)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Failed to open file: %s", g_strerror(errno));
+		goto parse_done;
+	}
+
+	if(file_stat->st_size == 0 || file_stat->st_size > G_MAXINT)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+				"Not a GPX file");
+		goto parse_done;
+	}
+
+	/* The pages are read in on demand, and the whole file is never
+	 * copied */
+	contents = mmap(NULL, file_stat->st_size, PROT_READ, MAP_PRIVATE,
+			fd, 0);
+	if(contents == MAP_FAILED)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Failed to read file: %s", g_strerror(errno));
+		goto parse_done;
+	}
+	posix_madvise(contents, file_stat->st_size, POSIX_MADV_SEQUENTIAL);
+
+	result = xmlSAXUserParseMemory(&gpx_parser_sax_handler, self,
+			contents, file_stat->st_size);
+	if(result < 0)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Failed to open file");
+		goto parse_done;
+	}
+
+	status = self->retval;
+
+	/* The data before the error, such as the points of a file that
+	 * was cut short, has been delivered */
+	if(result > 0 && status == GPX_PARSER_STATUS_OK)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+				"The file is not valid XML");
+		status = GPX_PARSER_STATUS_PARTIALLY_OK;
+	}
+
+parse_done:
+	if(contents != MAP_FAILED)
+	{
+		munmap(contents, file_stat->st_size);
+	}
+	if(fd >= 0)
+	{
+		close(fd);
+	}
+
+	return status;
+}
+
 static void gpx_parser_free_data(GpxParserPriv *self,
 		GpxParserDataType data_type)
 {
@@ -741,13 +1145,9 @@ static void gpx_parser_free_data(GpxParserPriv *self,
 			g_free(self->data.route);
 			break;
 		case GPX_PARSER_DATA_TYPE_TRACK_SEGMENT:
-			g_free(self->data.track_segment);
-			break;
 		case GPX_PARSER_DATA_TYPE_WAYPOINT:
-			g_free(self->data.waypoint);
-			break;
 		case GPX_PARSER_DATA_TYPE_HEART_RATE:
-			g_free(self->data.heart_rate);
+			/* These are reused, see GpxParserPriv */
 			break;
 		default:
 			g_warning("Unknown data type to be freed: %d",
@@ -30,6 +30,7 @@
 #include "config.h"
 
 /* System */
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <time.h>
 
@@ -39,6 +40,13 @@
 /* Other modules */
 #include "gpx.h"	/* Some datatypes are shared with GpxStorage */
 
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+/** @brief Maximum amount of items in a batch */
+#define GPX_PARSER_BATCH_SIZE		256
+
 /*****************************************************************************
  * Enumerations                                                              *
  *****************************************************************************/
@@ -48,7 +56,9 @@ enum _GpxParserDataType {
 	GPX_PARSER_DATA_TYPE_ROUTE,
 	GPX_PARSER_DATA_TYPE_HEART_RATE,
 	GPX_PARSER_DATA_TYPE_TRACK_SEGMENT,
-	GPX_PARSER_DATA_TYPE_WAYPOINT
+	GPX_PARSER_DATA_TYPE_WAYPOINT,
+	GPX_PARSER_DATA_TYPE_WAYPOINT_BATCH,
+	GPX_PARSER_DATA_TYPE_HEART_RATE_BATCH
 };
 
 enum _GpxParserStatus {
@@ -66,6 +76,8 @@ typedef struct _GpxParserDataRouteTrack GpxParserDataRoute;
 typedef struct _GpxStorageWaypoint GpxParserDataWaypoint;
 typedef struct _GpxParserDataTrackSegment GpxParserDataTrackSegment;
 typedef struct _GpxParserDataHeartRate GpxParserDataHeartRate;
+typedef struct _GpxParserDataWaypointBatch GpxParserDataWaypointBatch;
+typedef struct _GpxParserDataHeartRateBatch GpxParserDataHeartRateBatch;
 
 typedef union _GpxParserData GpxParserData;
 
@@ -80,7 +92,7 @@ typedef enum _GpxParserStatus GpxParserStatus;
  * @param user_data Optional user data
  *
  * @note The data parameter will be valid until the callback returns, after
- * that all memory used by it is freed.
+ * that all memory used by it is freed or reused.
  *
  * @note Some or even all of the fileds may be NULL, depending on whether
  * or not they were defined in the file that was parsed.
@@ -100,6 +112,8 @@ union _GpxParserData {
 	GpxParserDataTrackSegment *track_segment;
 	GpxParserDataWaypoint *waypoint;
 	GpxParserDataHeartRate *heart_rate;
+	GpxParserDataWaypointBatch *waypoint_batch;
+	GpxParserDataHeartRateBatch *heart_rate_batch;
 };
 
 /*****************************************************************************
@@ -121,6 +135,25 @@ struct _GpxParserDataHeartRate {
 	gint value;
 };
 
+/**
+ * @brief Consecutive waypoints of a track or a route
+ *
+ * The point type of the first waypoint may be a track, track segment or
+ * route start, like for a single waypoint.
+ */
+struct _GpxParserDataWaypointBatch {
+	GpxParserDataWaypoint *waypoints;
+	guint count;
+};
+
+/**
+ * @brief Consecutive heart rates of a track segment
+ */
+struct _GpxParserDataHeartRateBatch {
+	GpxParserDataHeartRate *heart_rates;
+	guint count;
+};
+
 /*****************************************************************************
  * Function prototypes                                                       *
  *****************************************************************************/
@@ -128,6 +161,11 @@ struct _GpxParserDataHeartRate {
 /**
  * @brief Parse a gpx file
  *
+ * The file is mapped to memory and parsed from there. After a successful
+ * parse, a binary copy of the data is written next to the file (see
+ * gpx_binary.h), and as long as the file does not change, the data is
+ * read from the binary copy instead.
+ *
  * @param file_name Name of the file to load from
  * @param callback Callback to be called during parsing
  * @param user_data Optional user data to be passed to the callback
@@ -141,4 +179,49 @@ GpxParserStatus gpx_parser_parse_file(
 		gpointer user_data,
 		GError **error);
 
+/**
+ * @brief Parse a gpx file, delivering waypoints and heart rates in batches
+ *
+ * This works like gpx_parser_parse_file(), except that instead of
+ * #GPX_PARSER_DATA_TYPE_WAYPOINT and #GPX_PARSER_DATA_TYPE_HEART_RATE,
+ * the callback gets #GPX_PARSER_DATA_TYPE_WAYPOINT_BATCH and
+ * #GPX_PARSER_DATA_TYPE_HEART_RATE_BATCH with up to
+ * #GPX_PARSER_BATCH_SIZE consecutive items at a time. The data is
+ * delivered in the same order as it is in the file.
+ *
+ * @param file_name Name of the file to load from
+ * @param callback Callback to be called during parsing
+ * @param user_data Optional user data to be passed to the callback
+ * @param error Storage location for possible error
+ *
+ * @return Status of the parsing
+ */
+GpxParserStatus gpx_parser_parse_file_batched(
+		const gchar *file_name,
+		GpxParserCallback callback,
+		gpointer user_data,
+		GError **error);
+
+/**
+ * @brief Parse the XML of a gpx file, delivering the data in batches
+ *
+ * This works like gpx_parser_parse_file_batched(), except that the binary
+ * copy is neither read nor written.
+ *
+ * @param file_name Name of the file to load from
+ * @param callback Callback to be called during parsing
+ * @param user_data Optional user data to be passed to the callback
+ * @param file_stat Return location for the status of the file that was
+ * parsed, for writing its binary copy with gpx_binary_write(), or NULL
+ * @param error Storage location for possible error
+ *
+ * @return Status of the parsing
+ */
+GpxParserStatus gpx_parser_parse_xml_batched(
+		const gchar *file_name,
+		GpxParserCallback callback,
+		gpointer user_data,
+		struct stat *file_stat,
+		GError **error);
+
 #endif /* _GPX_PARSER_H */
@@ -0,0 +1,721 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi, Sampo Savola
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* This module */
+#include "gpx_recording.h"
+#include "gpx_defs.h"
+
+/* System */
+#include <string.h>
+
+/* Other modules */
+#include "ec_error.h"
+#include "util.h"
+
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+/** @brief Amount of text to collect before passing it to the output */
+#define GPX_RECORDING_WRITE_CHUNK	4096
+
+/**
+ * @brief A track segment. Routes have a single segment.
+ */
+typedef struct _GpxRecordingSegment {
+	/** @brief Array of #GpxRecordingPoint */
+	GArray *points;
+
+	/**
+	 * @brief Array of #GpxRecordingHeartRate, or NULL if no heart
+	 * rates have been added
+	 */
+	GArray *heart_rates;
+} GpxRecordingSegment;
+
+struct _GpxRecordingTrack {
+	gboolean is_track;
+	guint id;
+	gchar *name;
+	gchar *comment;
+
+	/** @brief Array of #GpxRecordingSegment pointers */
+	GPtrArray *segments;
+};
+
+struct _GpxRecording {
+	/** @brief Tracks and routes in the order they were added */
+	GPtrArray *tracks;
+
+	/** @brief Tracks by track ID, NULL in copies */
+	GHashTable *track_ids;
+
+	/** @brief Routes by route ID, NULL in copies */
+	GHashTable *route_ids;
+};
+
+/**
+ * @brief State of writing a recording
+ */
+typedef struct _GpxRecordingWriter {
+	xmlOutputBufferPtr output;
+	GString *buffer;
+	gboolean failed;
+} GpxRecordingWriter;
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+static GpxRecordingSegment *gpx_recording_segment_new();
+
+static void gpx_recording_segment_free(GpxRecordingSegment *segment);
+
+static void gpx_recording_track_free(GpxRecordingTrack *track);
+
+/**
+ * @brief Write a track or a route
+ *
+ * @param writer Writer state
+ * @param track The track or route to write
+ */
+static void gpx_recording_write_track(
+		GpxRecordingWriter *writer,
+		const GpxRecordingTrack *track);
+
+/**
+ * @brief Write a track or route point
+ *
+ * @param writer Writer state
+ * @param point The point to write
+ * @param name Element name of the point
+ * @param indent Indentation of the point element
+ */
+static void gpx_recording_write_point(
+		GpxRecordingWriter *writer,
+		const GpxRecordingPoint *point,
+		const gchar *name,
+		const gchar *indent);
+
+/**
+ * @brief Write an element with text content
+ *
+ * @param writer Writer state
+ * @param indent Indentation of the element
+ * @param name Name of the element
+ * @param text Text content, which is escaped
+ */
+static void gpx_recording_write_text_element(
+		GpxRecordingWriter *writer,
+		const gchar *indent,
+		const gchar *name,
+		const gchar *text);
+
+/**
+ * @brief Pass the collected text to the output
+ *
+ * @param writer Writer state
+ * @param force Whether to pass the text even if there is only a little
+ */
+static void gpx_recording_flush(GpxRecordingWriter *writer, gboolean force);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+/*===========================================================================*
+ * Public functions                                                          *
+ *===========================================================================*/
+
+GpxRecording *gpx_recording_new()
+{
+	GpxRecording *self = NULL;
+
+	DEBUG_BEGIN();
+
+	self = g_new0(GpxRecording, 1);
+	self->tracks = g_ptr_array_new();
+	self->track_ids = g_hash_table_new(g_direct_hash, g_direct_equal);
+	self->route_ids = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	DEBUG_END();
+	return self;
+}
+
+GpxRecording *gpx_recording_copy(const GpxRecording *self)
+{
+	GpxRecording *copy = NULL;
+	GpxRecordingTrack *track = NULL;
+	GpxRecordingTrack *track_copy = NULL;
+	GpxRecordingSegment *segment = NULL;
+	GpxRecordingSegment *segment_copy = NULL;
+	guint i, j;
+
+	g_return_val_if_fail(self != NULL, NULL);
+	DEBUG_BEGIN();
+
+	copy = g_new0(GpxRecording, 1);
+	copy->tracks = g_ptr_array_sized_new(self->tracks->len);
+
+	for(i = 0; i < self->tracks->len; i++)
+	{
+		track = g_ptr_array_index(self->tracks, i);
+
+		track_copy = g_new0(GpxRecordingTrack, 1);
+		track_copy->is_track = track->is_track;
+		track_copy->id = track->id;
+		track_copy->name = g_strdup(track->name);
+		track_copy->comment = g_strdup(track->comment);
+		track_copy->segments = g_ptr_array_sized_new(
+				track->segments->len);
+
+		for(j = 0; j < track->segments->len; j++)
+		{
+			segment = g_ptr_array_index(track->segments, j);
+
+			segment_copy = g_new0(GpxRecordingSegment, 1);
+			segment_copy->points = g_array_sized_new(FALSE, FALSE,
+					sizeof(GpxRecordingPoint),
+					segment->points->len);
+			g_array_append_vals(segment_copy->points,
+					segment->points->data,
+					segment->points->len);
+			if(segment->heart_rates)
+			{
+				segment_copy->heart_rates = g_array_sized_new(
+						FALSE, FALSE,
+						sizeof(GpxRecordingHeartRate),
+						segment->heart_rates->len);
+				g_array_append_vals(segment_copy->heart_rates,
+						segment->heart_rates->data,
+						segment->heart_rates->len);
+			}
+			g_ptr_array_add(track_copy->segments, segment_copy);
+		}
+		g_ptr_array_add(copy->tracks, track_copy);
+	}
+
+	DEBUG_END();
+	return copy;
+}
+
+void gpx_recording_free(GpxRecording *self)
+{
+	guint i;
+
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	for(i = 0; i < self->tracks->len; i++)
+	{
+		gpx_recording_track_free(g_ptr_array_index(self->tracks, i));
+	}
+	g_ptr_array_free(self->tracks, TRUE);
+	if(self->track_ids)
+	{
+		g_hash_table_destroy(self->track_ids);
+	}
+	if(self->route_ids)
+	{
+		g_hash_table_destroy(self->route_ids);
+	}
+	g_free(self);
+
+	DEBUG_END();
+}
+
+GpxRecordingTrack *gpx_recording_add_track(
+		GpxRecording *self,
+		gboolean is_track,
+		guint id)
+{
+	GpxRecordingTrack *track = NULL;
+
+	g_return_val_if_fail(self != NULL, NULL);
+	g_return_val_if_fail(self->track_ids != NULL, NULL);
+	DEBUG_BEGIN();
+
+	track = g_new0(GpxRecordingTrack, 1);
+	track->is_track = is_track;
+	track->id = id;
+	track->segments = g_ptr_array_new();
+	if(!is_track)
+	{
+		/* Route points are stored like a track segment */
+		g_ptr_array_add(track->segments,
+				gpx_recording_segment_new());
+	}
+
+	g_ptr_array_add(self->tracks, track);
+	g_hash_table_insert(is_track ? self->track_ids : self->route_ids,
+			GUINT_TO_POINTER(id), track);
+
+	DEBUG_END();
+	return track;
+}
+
+GpxRecordingTrack *gpx_recording_find_track(
+		GpxRecording *self,
+		gboolean is_track,
+		guint id)
+{
+	g_return_val_if_fail(self != NULL, NULL);
+	g_return_val_if_fail(self->track_ids != NULL, NULL);
+
+	return g_hash_table_lookup(is_track ? self->track_ids : self->route_ids,
+			GUINT_TO_POINTER(id));
+}
+
+void gpx_recording_track_add_segment(GpxRecordingTrack *track)
+{
+	g_return_if_fail(track != NULL);
+	g_return_if_fail(track->is_track);
+
+	g_ptr_array_add(track->segments, gpx_recording_segment_new());
+}
+
+gboolean gpx_recording_track_add_point(
+		GpxRecordingTrack *track,
+		const GpxStorageWaypoint *waypoint)
+{
+	GpxRecordingSegment *segment = NULL;
+	GpxRecordingPoint point;
+
+	g_return_val_if_fail(track != NULL, FALSE);
+	g_return_val_if_fail(waypoint != NULL, FALSE);
+
+	if(track->segments->len == 0)
+	{
+		return FALSE;
+	}
+	segment = g_ptr_array_index(track->segments,
+			track->segments->len - 1);
+
+	point.latitude = waypoint->latitude;
+	point.longitude = waypoint->longitude;
+	point.altitude = waypoint->altitude;
+	point.altitude_is_set = waypoint->altitude_is_set;
+	point.timestamp = waypoint->timestamp;
+	g_array_append_val(segment->points, point);
+
+	return TRUE;
+}
+
+gboolean gpx_recording_track_add_heart_rate(
+		GpxRecordingTrack *track,
+		const struct timeval *time,
+		gint heart_rate)
+{
+	GpxRecordingHeartRate rate;
+
+	g_return_val_if_fail(time != NULL, FALSE);
+
+	rate.time = *time;
+	rate.heart_rate = heart_rate;
+
+	return gpx_recording_track_add_heart_rates(track, &rate, 1);
+}
+
+gboolean gpx_recording_track_add_heart_rates(
+		GpxRecordingTrack *track,
+		const GpxRecordingHeartRate *heart_rates,
+		guint count)
+{
+	GpxRecordingSegment *segment = NULL;
+
+	g_return_val_if_fail(track != NULL, FALSE);
+	g_return_val_if_fail(track->is_track, FALSE);
+	g_return_val_if_fail(heart_rates != NULL || count == 0, FALSE);
+
+	if(track->segments->len == 0)
+	{
+		return FALSE;
+	}
+	segment = g_ptr_array_index(track->segments,
+			track->segments->len - 1);
+
+	if(!segment->heart_rates)
+	{
+		segment->heart_rates = g_array_sized_new(FALSE, FALSE,
+				sizeof(GpxRecordingHeartRate), count);
+	}
+
+	g_array_append_vals(segment->heart_rates, heart_rates, count);
+
+	return TRUE;
+}
+
+void gpx_recording_track_set_details(
+		GpxRecordingTrack *track,
+		const gchar *name,
+		const gchar *comment)
+{
+	g_return_if_fail(track != NULL);
+
+	if(name)
+	{
+		g_free(track->name);
+		track->name = g_strdup(name);
+	}
+	if(comment)
+	{
+		g_free(track->comment);
+		track->comment = g_strdup(comment);
+	}
+}
+
+gboolean gpx_recording_write(
+		const GpxRecording *self,
+		xmlOutputBufferPtr output,
+		GError **error)
+{
+	GpxRecordingWriter writer;
+	guint i;
+
+	g_return_val_if_fail(self != NULL, FALSE);
+	g_return_val_if_fail(output != NULL, FALSE);
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+	DEBUG_BEGIN();
+
+	writer.output = output;
+	writer.buffer = g_string_sized_new(GPX_RECORDING_WRITE_CHUNK * 2);
+	writer.failed = FALSE;
+
+	/* The same declaration and root element that libxml2 writes for
+	 * the document of #GpxStorage */
+	g_string_append(writer.buffer,
+			"<?xml version=\"" EC_GPX_XML_VERSION "\"?>\n"
+			"<" EC_GPX_NODE_ROOT
+			" xmlns=\"" EC_GPX_XML_NAMESPACE "\""
+			" xmlns:" EC_GPX_SCHEMA_INSTANCE_PREFIX
+			"=\"" EC_XML_SCHEMA_INSTANCE "\""
+			" xmlns:" EC_GPX_EXTENSIONS_NAMESPACE_PREFIX
+			"=\"" EC_GPX_EXTENSIONS_NAMESPACE "\""
+			" " EC_GPX_ATTR_VERSION_NAME
+			"=\"" EC_GPX_ATTR_VERSION_CONTENT "\""
+			" " EC_GPX_ATTR_CREATOR_NAME
+			"=\"" EC_GPX_ATTR_CREATOR_CONTENT "\""
+			" " EC_GPX_SCHEMA_INSTANCE_PREFIX ":"
+			EC_XML_ATTR_SCHEMA_LOCATION_NAME
+			"=\"" EC_GPX_SCHEMA_LOCATIONS "\"");
+
+	if(self->tracks->len == 0)
+	{
+		g_string_append(writer.buffer, "/>\n");
+	} else {
+		g_string_append(writer.buffer, ">\n");
+		for(i = 0; i < self->tracks->len && !writer.failed; i++)
+		{
+			gpx_recording_write_track(&writer,
+					g_ptr_array_index(self->tracks, i));
+		}
+		g_string_append(writer.buffer, "</" EC_GPX_NODE_ROOT ">\n");
+	}
+
+	gpx_recording_flush(&writer, TRUE);
+	g_string_free(writer.buffer, TRUE);
+
+	if(writer.failed)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"File saving failed");
+		DEBUG_END();
+		return FALSE;
+	}
+
+	DEBUG_END();
+	return TRUE;
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static GpxRecordingSegment *gpx_recording_segment_new()
+{
+	GpxRecordingSegment *segment = NULL;
+
+	segment = g_new0(GpxRecordingSegment, 1);
+	segment->points = g_array_new(FALSE, FALSE, sizeof(GpxRecordingPoint));
+
+	return segment;
+}
+
+static void gpx_recording_segment_free(GpxRecordingSegment *segment)
+{
+	g_array_free(segment->points, TRUE);
+	if(segment->heart_rates)
+	{
+		g_array_free(segment->heart_rates, TRUE);
+	}
+	g_free(segment);
+}
+
+static void gpx_recording_track_free(GpxRecordingTrack *track)
+{
+	guint i;
+
+	for(i = 0; i < track->segments->len; i++)
+	{
+		gpx_recording_segment_free(
+				g_ptr_array_index(track->segments, i));
+	}
+	g_ptr_array_free(track->segments, TRUE);
+	g_free(track->name);
+	g_free(track->comment);
+	g_free(track);
+}
+
+static void gpx_recording_write_track(
+		GpxRecordingWriter *writer,
+		const GpxRecordingTrack *track)
+{
+	const GpxRecordingSegment *segment = NULL;
+	const GpxRecordingHeartRate *rate = NULL;
+	gchar time_buf[UTIL_XML_DATE_TIME_BUF_SIZE];
+	guint i, j;
+
+	g_string_append(writer->buffer, track->is_track ?
+			"  <" EC_GPX_NODE_TRACK ">\n" :
+			"  <" EC_GPX_NODE_ROUTE ">\n");
+
+	/* The name and the comment are placed before the number, as
+	 * gpx_storage_set_route_or_track_details() does */
+	if(track->name)
+	{
+		gpx_recording_write_text_element(writer, "    ",
+				EC_GPX_NODE_TRACK_NAME, track->name);
+	}
+	if(track->comment)
+	{
+		gpx_recording_write_text_element(writer, "    ",
+				EC_GPX_NODE_TRACK_COMMENT, track->comment);
+	}
+	g_string_append_printf(writer->buffer, "    <%s>%u</%s>\n",
+			EC_GPX_NODE_TRACK_NUMBER, track->id,
+			EC_GPX_NODE_TRACK_NUMBER);
+
+	if(!track->is_track)
+	{
+		segment = g_ptr_array_index(track->segments, 0);
+		for(i = 0; i < segment->points->len; i++)
+		{
+			gpx_recording_write_point(writer,
+					&g_array_index(segment->points,
+						GpxRecordingPoint, i),
+					EC_GPX_NODE_ROUTE_POINT,
+					"    ");
+		}
+		g_string_append(writer->buffer,
+				"  </" EC_GPX_NODE_ROUTE ">\n");
+		gpx_recording_flush(writer, FALSE);
+		return;
+	}
+
+	for(i = 0; i < track->segments->len && !writer->failed; i++)
+	{
+		segment = g_ptr_array_index(track->segments, i);
+		if(segment->points->len == 0 && !segment->heart_rates)
+		{
+			g_string_append(writer->buffer,
+					"    <" EC_GPX_NODE_TRACK_SEGMENT "/>\n");
+			continue;
+		}
+
+		g_string_append(writer->buffer,
+				"    <" EC_GPX_NODE_TRACK_SEGMENT ">\n");
+
+		/* The heart rates are the first child of the segment, where
+		 * xml_util_find_or_create_child_ordered() places them */
+		if(segment->heart_rates)
+		{
+			g_string_append(writer->buffer,
+					"      <" EC_GPX_NODE_EXTENSIONS ">\n"
+					"        <"
+					EC_GPX_EXTENSIONS_NAMESPACE_PREFIX ":"
+					EC_GPX_EXT_NODE_HEART_RATE_LIST ">\n");
+			for(j = 0; j < segment->heart_rates->len; j++)
+			{
+				rate = &g_array_index(segment->heart_rates,
+						GpxRecordingHeartRate, j);
+				util_xml_date_time_format(&rate->time,
+						time_buf);
+				g_string_append_printf(writer->buffer,
+						"          <%s:%s %s=\"%s\" "
+						"%s=\"%d\"/>\n",
+						EC_GPX_EXTENSIONS_NAMESPACE_PREFIX,
+						EC_GPX_EXT_NODE_HEART_RATE,
+						EC_GPX_EXT_ATTR_HEART_RATE_TIME,
+						time_buf,
+						EC_GPX_EXT_ATTR_HEART_RATE_VALUE,
+						rate->heart_rate);
+				gpx_recording_flush(writer, FALSE);
+			}
+			g_string_append(writer->buffer,
+					"        </"
+					EC_GPX_EXTENSIONS_NAMESPACE_PREFIX ":"
+					EC_GPX_EXT_NODE_HEART_RATE_LIST ">\n"
+					"      </" EC_GPX_NODE_EXTENSIONS ">\n");
+		}
+
+		for(j = 0; j < segment->points->len; j++)
+		{
+			gpx_recording_write_point(writer,
+					&g_array_index(segment->points,
+						GpxRecordingPoint, j),
+					EC_GPX_NODE_TRACK_POINT,
+					"      ");
+		}
+
+		g_string_append(writer->buffer,
+				"    </" EC_GPX_NODE_TRACK_SEGMENT ">\n");
+	}
+
+	g_string_append(writer->buffer, "  </" EC_GPX_NODE_TRACK ">\n");
+	gpx_recording_flush(writer, FALSE);
+}
+
+static void gpx_recording_write_point(
+		GpxRecordingWriter *writer,
+		const GpxRecordingPoint *point,
+		const gchar *name,
+		const gchar *indent)
+{
+	gchar lat[G_ASCII_DTOSTR_BUF_SIZE];
+	gchar lon[G_ASCII_DTOSTR_BUF_SIZE];
+	gchar alt[G_ASCII_DTOSTR_BUF_SIZE];
+	gchar time_buf[UTIL_XML_DATE_TIME_BUF_SIZE];
+
+	g_ascii_dtostr(lat, G_ASCII_DTOSTR_BUF_SIZE, point->latitude);
+	g_ascii_dtostr(lon, G_ASCII_DTOSTR_BUF_SIZE, point->longitude);
+	g_string_append_printf(writer->buffer, "%s<%s %s=\"%s\" %s=\"%s\">\n",
+			indent, name,
+			EC_GPX_NODE_WAYPOINT_ATTR_LATITUDE_NAME, lat,
+			EC_GPX_NODE_WAYPOINT_ATTR_LONGITUDE_NAME, lon);
+
+	if(point->altitude_is_set)
+	{
+		g_ascii_dtostr(alt, G_ASCII_DTOSTR_BUF_SIZE, point->altitude);
+		g_string_append_printf(writer->buffer, "%s  <%s>%s</%s>\n",
+				indent,
+				EC_GPX_NODE_WAYPOINT_ALTITUDE, alt,
+				EC_GPX_NODE_WAYPOINT_ALTITUDE);
+	}
+
+	util_xml_date_time_format(&point->timestamp, time_buf);
+	g_string_append_printf(writer->buffer, "%s  <%s>%s</%s>\n"
+			"%s</%s>\n",
+			indent,
+			EC_GPX_NODE_WAYPOINT_TIME, time_buf,
+			EC_GPX_NODE_WAYPOINT_TIME,
+			indent, name);
+
+	gpx_recording_flush(writer, FALSE);
+}
+
+static void gpx_recording_write_text_element(
+		GpxRecordingWriter *writer,
+		const gchar *indent,
+		const gchar *name,
+		const gchar *text)
+{
+	const gchar *c = NULL;
+	gunichar ch = 0;
+
+	if(text[0] == '\0')
+	{
+		g_string_append_printf(writer->buffer, "%s<%s/>\n",
+				indent, name);
+		return;
+	}
+
+	g_string_append_printf(writer->buffer, "%s<%s>", indent, name);
+
+	/* Escape the same characters as libxml2 does in text content. The
+	 * document has no encoding declaration, so libxml2 writes characters
+	 * outside ASCII as character references. */
+	for(c = text; *c; c++)
+	{
+		if((guchar)*c >= 0x80)
+		{
+			ch = g_utf8_get_char_validated(c, -1);
+			if(ch == (gunichar)-1 || ch == (gunichar)-2)
+			{
+				/* Not UTF-8; pass the byte through */
+				g_string_append_c(writer->buffer, *c);
+			} else {
+				g_string_append_printf(writer->buffer,
+						"&#x%X;", ch);
+				c = g_utf8_next_char(c) - 1;
+			}
+			continue;
+		}
+
+		switch(*c)
+		{
+			case '<':
+				g_string_append(writer->buffer, "&lt;");
+				break;
+			case '>':
+				g_string_append(writer->buffer, "&gt;");
+				break;
+			case '&':
+				g_string_append(writer->buffer, "&amp;");
+				break;
+			case '\r':
+				g_string_append(writer->buffer, "&#xD;");
+				break;
+			default:
+				g_string_append_c(writer->buffer, *c);
+		}
+	}
+
+	g_string_append_printf(writer->buffer, "</%s>\n", name);
+}
+
+static void gpx_recording_flush(GpxRecordingWriter *writer, gboolean force)
+{
+	if(writer->failed)
+	{
+		g_string_truncate(writer->buffer, 0);
+		return;
+	}
+
+	if(writer->buffer->len == 0 ||
+			(!force && writer->buffer->len < GPX_RECORDING_WRITE_CHUNK))
+	{
+		return;
+	}
+
+	if(xmlOutputBufferWrite(writer->output, writer->buffer->len,
+				writer->buffer->str) < 0)
+	{
+		writer->failed = TRUE;
+	}
+	g_string_truncate(writer->buffer, 0);
+}
@@ -0,0 +1,201 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi, Sampo Savola
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/**
+ * @file gpx_recording.h
+ *
+ * @brief Compact in-memory storage for tracks and routes that are being
+ * recorded, and a streaming writer for them
+ *
+ * A libxml2 tree takes hundreds of bytes for every track point. While
+ * recording, the points and heart rates are only appended, so they are
+ * kept in plain arrays instead, and the GPX text is generated directly
+ * from the arrays when the file is written. The output is the same as
+ * the one of the tree that #GpxStorage would otherwise build.
+ */
+
+#ifndef _GPX_RECORDING_H
+#define _GPX_RECORDING_H
+
+/* Configuration */
+#include "config.h"
+
+/* System */
+#include <sys/time.h>
+
+/* GLib */
+#include <glib.h>
+
+/* LibXML2 */
+#include <libxml/xmlIO.h>
+
+/* Other modules */
+#include "gpx.h"
+
+typedef struct _GpxRecordingTrack GpxRecordingTrack;
+
+/**
+ * @brief A recorded track or route point
+ */
+typedef struct _GpxRecordingPoint {
+	gdouble latitude;
+	gdouble longitude;
+	gdouble altitude;
+	struct timeval timestamp;
+	gboolean altitude_is_set;
+} GpxRecordingPoint;
+
+/**
+ * @brief A recorded heart rate
+ */
+typedef GpxStorageHeartRate GpxRecordingHeartRate;
+
+/*****************************************************************************
+ * Function prototypes                                                       *
+ *****************************************************************************/
+
+/**
+ * @brief Create a new, empty recording
+ */
+GpxRecording *gpx_recording_new();
+
+/**
+ * @brief Copy a recording, for example to write it in another thread
+ *
+ * Copying the arrays takes much less time than writing them.
+ *
+ * @param self Pointer to #GpxRecording
+ *
+ * @return Newly allocated copy. Tracks and routes cannot be looked up
+ * by ID in the copy.
+ */
+GpxRecording *gpx_recording_copy(const GpxRecording *self);
+
+/**
+ * @brief Free a recording
+ *
+ * @param self Pointer to #GpxRecording
+ */
+void gpx_recording_free(GpxRecording *self);
+
+/**
+ * @brief Add a new track or route to the end of the recording
+ *
+ * @param self Pointer to #GpxRecording
+ * @param is_track Whether to add a track or a route
+ * @param id ID of the track or route
+ *
+ * @return The added track or route
+ */
+GpxRecordingTrack *gpx_recording_add_track(
+		GpxRecording *self,
+		gboolean is_track,
+		guint id);
+
+/**
+ * @brief Find a track or a route
+ *
+ * @param self Pointer to #GpxRecording
+ * @param is_track Whether to search for a track or a route
+ * @param id ID of the track or route
+ *
+ * @return The track or route, or NULL if it was not found
+ */
+GpxRecordingTrack *gpx_recording_find_track(
+		GpxRecording *self,
+		gboolean is_track,
+		guint id);
+
+/**
+ * @brief Start a new segment in a track
+ *
+ * @param track Pointer to #GpxRecordingTrack
+ */
+void gpx_recording_track_add_segment(GpxRecordingTrack *track);
+
+/**
+ * @brief Add a point to the last segment of a track, or to a route
+ *
+ * @param track Pointer to #GpxRecordingTrack
+ * @param waypoint The point to add
+ *
+ * @return TRUE on success, FALSE if the track has no segments
+ */
+gboolean gpx_recording_track_add_point(
+		GpxRecordingTrack *track,
+		const GpxStorageWaypoint *waypoint);
+
+/**
+ * @brief Add a heart rate to the last segment of a track
+ *
+ * @param track Pointer to #GpxRecordingTrack
+ * @param time Time of the heart rate
+ * @param heart_rate The heart rate
+ *
+ * @return TRUE on success, FALSE if the track has no segments
+ */
+gboolean gpx_recording_track_add_heart_rate(
+		GpxRecordingTrack *track,
+		const struct timeval *time,
+		gint heart_rate);
+
+/**
+ * @brief Add several heart rates to the last segment of a track
+ *
+ * @param track Pointer to #GpxRecordingTrack
+ * @param heart_rates The heart rates, oldest first
+ * @param count Amount of heart rates
+ *
+ * @return TRUE on success, FALSE if the track has no segments
+ */
+gboolean gpx_recording_track_add_heart_rates(
+		GpxRecordingTrack *track,
+		const GpxRecordingHeartRate *heart_rates,
+		guint count);
+
+/**
+ * @brief Set the name and comment of a track or route
+ *
+ * @param track Pointer to #GpxRecordingTrack
+ * @param name New name, or NULL to keep the old one
+ * @param comment New comment, or NULL to keep the old one
+ */
+void gpx_recording_track_set_details(
+		GpxRecordingTrack *track,
+		const gchar *name,
+		const gchar *comment);
+
+/**
+ * @brief Write a recording as a GPX document
+ *
+ * @param self Pointer to #GpxRecording
+ * @param output The buffer to write to. It is not closed.
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean gpx_recording_write(
+		const GpxRecording *self,
+		xmlOutputBufferPtr output,
+		GError **error);
+
+#endif /* _GPX_RECORDING_H */
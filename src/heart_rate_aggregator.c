@@ -0,0 +1,342 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* This module */
+#include "heart_rate_aggregator.h"
+
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+struct _HeartRateAggregator {
+	HeartRateAggregatorMode mode;
+
+	HeartRateAggregatorCallback callback;
+	gpointer user_data;
+
+	/** @brief Length of the windows in microseconds */
+	gint64 resolution;
+
+	/* The window that is being collected */
+	gboolean has_window;
+	gint64 window_index;
+	guint window_count;
+	gdouble window_sum;
+	gint64 window_time_sum;
+	GpxStorageHeartRate window_min;
+	GpxStorageHeartRate window_max;
+
+	/** @brief Array of #GpxStorageHeartRate waiting to be delivered */
+	GArray *batch;
+};
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Add the result of the current window to the batch
+ *
+ * @param self Pointer to #HeartRateAggregator
+ */
+static void heart_rate_aggregator_close_window(HeartRateAggregator *self);
+
+/**
+ * @brief Deliver the batch and empty it
+ *
+ * @param self Pointer to #HeartRateAggregator
+ */
+static void heart_rate_aggregator_deliver(HeartRateAggregator *self);
+
+/**
+ * @brief Convert a time to microseconds
+ *
+ * @param time The time
+ *
+ * @return Microseconds since the Epoch
+ */
+static gint64 heart_rate_aggregator_time_to_usec(const struct timeval *time);
+
+/**
+ * @brief Convert microseconds to a time
+ *
+ * @param usec Microseconds since the Epoch
+ * @param time Return location for the time
+ */
+static void heart_rate_aggregator_usec_to_time(
+		gint64 usec,
+		struct timeval *time);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+/*===========================================================================*
+ * Public functions                                                          *
+ *===========================================================================*/
+
+HeartRateAggregator *heart_rate_aggregator_new(
+		HeartRateAggregatorCallback callback,
+		gpointer user_data)
+{
+	HeartRateAggregator *self = NULL;
+
+	g_return_val_if_fail(callback != NULL, NULL);
+	DEBUG_BEGIN();
+
+	self = g_new0(HeartRateAggregator, 1);
+	self->mode = HEART_RATE_AGGREGATOR_MODE_AVERAGE;
+	self->resolution = (gint64)HEART_RATE_AGGREGATOR_DEFAULT_RESOLUTION *
+		1000000;
+	self->callback = callback;
+	self->user_data = user_data;
+	self->batch = g_array_sized_new(FALSE, FALSE,
+			sizeof(GpxStorageHeartRate),
+			HEART_RATE_AGGREGATOR_BATCH_SIZE);
+
+	DEBUG_END();
+	return self;
+}
+
+void heart_rate_aggregator_free(HeartRateAggregator *self)
+{
+	if(!self)
+	{
+		return;
+	}
+
+	DEBUG_BEGIN();
+
+	g_array_free(self->batch, TRUE);
+	g_free(self);
+
+	DEBUG_END();
+}
+
+void heart_rate_aggregator_set_mode(
+		HeartRateAggregator *self,
+		HeartRateAggregatorMode mode,
+		gdouble resolution)
+{
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(mode >= 0 && mode < HEART_RATE_AGGREGATOR_MODE_COUNT);
+	DEBUG_BEGIN();
+
+	heart_rate_aggregator_flush(self);
+
+	self->mode = mode;
+	if(mode != HEART_RATE_AGGREGATOR_MODE_RAW)
+	{
+		if(resolution < 1)
+		{
+			g_warning("Heart rate resolution %f is too short, "
+					"using 1 second", resolution);
+			resolution = 1;
+		}
+		self->resolution = (gint64)(resolution * 1000000);
+	}
+
+	DEBUG_END();
+}
+
+void heart_rate_aggregator_add(
+		HeartRateAggregator *self,
+		const struct timeval *time,
+		gdouble heart_rate)
+{
+	GpxStorageHeartRate rate;
+	gint64 usec;
+	gint64 index;
+
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(time != NULL);
+	DEBUG_BEGIN();
+
+	rate.time = *time;
+	rate.heart_rate = (gint)heart_rate;
+
+	if(self->mode == HEART_RATE_AGGREGATOR_MODE_RAW)
+	{
+		g_array_append_val(self->batch, rate);
+	} else {
+		usec = heart_rate_aggregator_time_to_usec(time);
+		index = usec / self->resolution;
+
+		if(self->has_window && index != self->window_index)
+		{
+			heart_rate_aggregator_close_window(self);
+		}
+
+		if(!self->has_window)
+		{
+			self->has_window = TRUE;
+			self->window_index = index;
+			self->window_count = 0;
+			self->window_sum = 0;
+			self->window_time_sum = 0;
+			self->window_min = rate;
+			self->window_max = rate;
+		}
+
+		self->window_count++;
+		self->window_sum += heart_rate;
+		self->window_time_sum += usec -
+			self->window_index * self->resolution;
+
+		if(rate.heart_rate < self->window_min.heart_rate)
+		{
+			self->window_min = rate;
+		}
+		if(rate.heart_rate > self->window_max.heart_rate)
+		{
+			self->window_max = rate;
+		}
+	}
+
+	/* Deliver the batch when it is full or old enough. The time is
+	 * compared to the oldest heart rate in the batch. */
+	if(self->batch->len >= HEART_RATE_AGGREGATOR_BATCH_SIZE ||
+			(self->batch->len > 0 &&
+			 time->tv_sec - g_array_index(self->batch,
+				 GpxStorageHeartRate, 0).time.tv_sec >=
+			 HEART_RATE_AGGREGATOR_BATCH_INTERVAL))
+	{
+		heart_rate_aggregator_deliver(self);
+	}
+
+	DEBUG_END();
+}
+
+void heart_rate_aggregator_flush(HeartRateAggregator *self)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	if(self->has_window)
+	{
+		heart_rate_aggregator_close_window(self);
+	}
+	heart_rate_aggregator_deliver(self);
+
+	DEBUG_END();
+}
+
+void heart_rate_aggregator_reset(HeartRateAggregator *self)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	self->has_window = FALSE;
+	g_array_set_size(self->batch, 0);
+
+	DEBUG_END();
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static void heart_rate_aggregator_close_window(HeartRateAggregator *self)
+{
+	GpxStorageHeartRate rate;
+	gint64 usec;
+
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(self->has_window);
+	DEBUG_BEGIN();
+
+	self->has_window = FALSE;
+
+	switch(self->mode)
+	{
+		case HEART_RATE_AGGREGATOR_MODE_AVERAGE:
+			usec = self->window_index * self->resolution +
+				self->window_time_sum / self->window_count;
+			heart_rate_aggregator_usec_to_time(usec, &rate.time);
+			rate.heart_rate = (gint)(self->window_sum /
+					self->window_count + 0.5);
+			g_array_append_val(self->batch, rate);
+			break;
+		case HEART_RATE_AGGREGATOR_MODE_MIN_MAX:
+			/* Keep the order of the times */
+			if(timercmp(&self->window_max.time,
+						&self->window_min.time, <))
+			{
+				g_array_append_val(self->batch,
+						self->window_max);
+				g_array_append_val(self->batch,
+						self->window_min);
+			} else if(self->window_min.heart_rate ==
+					self->window_max.heart_rate) {
+				g_array_append_val(self->batch,
+						self->window_min);
+			} else {
+				g_array_append_val(self->batch,
+						self->window_min);
+				g_array_append_val(self->batch,
+						self->window_max);
+			}
+			break;
+		default:
+			g_warning("Unexpected heart rate aggregator mode: %d",
+					self->mode);
+			break;
+	}
+
+	DEBUG_END();
+}
+
+static void heart_rate_aggregator_deliver(HeartRateAggregator *self)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	if(self->batch->len > 0)
+	{
+		DEBUG("Delivering %d heart rates", self->batch->len);
+		self->callback((const GpxStorageHeartRate *)self->batch->data,
+				self->batch->len,
+				self->user_data);
+		g_array_set_size(self->batch, 0);
+	}
+
+	DEBUG_END();
+}
+
+static gint64 heart_rate_aggregator_time_to_usec(const struct timeval *time)
+{
+	return (gint64)time->tv_sec * 1000000 + time->tv_usec;
+}
+
+static void heart_rate_aggregator_usec_to_time(
+		gint64 usec,
+		struct timeval *time)
+{
+	time->tv_sec = usec / 1000000;
+	time->tv_usec = usec % 1000000;
+}
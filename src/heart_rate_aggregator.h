@@ -0,0 +1,161 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/**
+ * @file heart_rate_aggregator.h
+ *
+ * @brief Reduce and batch the heart rates before they are recorded
+ *
+ * The beat detector reports the heart rate on every beat, which is far
+ * more often than an exercise log needs. A #HeartRateAggregator combines
+ * the heart rates into windows of a chosen length and delivers the results
+ * in batches, so that they can be added to the track with one call:
+ *
+ * - #HEART_RATE_AGGREGATOR_MODE_RAW: Every heart rate is kept.
+ * - #HEART_RATE_AGGREGATOR_MODE_AVERAGE: The average of each window is
+ *   kept, at the average time of the heart rates in the window.
+ * - #HEART_RATE_AGGREGATOR_MODE_MIN_MAX: The lowest and the highest heart
+ *   rate of each window are kept at their own times, so that the peaks
+ *   are not averaged away.
+ */
+
+#ifndef _HEART_RATE_AGGREGATOR_H
+#define _HEART_RATE_AGGREGATOR_H
+
+/* Configuration */
+#include "config.h"
+
+/* System */
+#include <sys/time.h>
+
+/* GLib */
+#include <glib.h>
+
+/* Other modules */
+#include "gpx.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+/** @brief Default length of the windows, in seconds */
+#define HEART_RATE_AGGREGATOR_DEFAULT_RESOLUTION	10
+
+/**
+ * @brief Time in seconds after which the collected heart rates are
+ * delivered
+ */
+#define HEART_RATE_AGGREGATOR_BATCH_INTERVAL		30
+
+/** @brief Maximum amount of heart rates in a batch */
+#define HEART_RATE_AGGREGATOR_BATCH_SIZE		64
+
+typedef enum _HeartRateAggregatorMode {
+	HEART_RATE_AGGREGATOR_MODE_RAW = 0,
+	HEART_RATE_AGGREGATOR_MODE_AVERAGE,
+	HEART_RATE_AGGREGATOR_MODE_MIN_MAX,
+	HEART_RATE_AGGREGATOR_MODE_COUNT
+} HeartRateAggregatorMode;
+
+typedef struct _HeartRateAggregator HeartRateAggregator;
+
+/**
+ * @brief Function that records a batch of heart rates
+ *
+ * @param heart_rates The heart rates, oldest first
+ * @param count Amount of heart rates, at least one
+ * @param user_data User data that was given with the callback
+ */
+typedef void (*HeartRateAggregatorCallback)(
+		const GpxStorageHeartRate *heart_rates,
+		guint count,
+		gpointer user_data);
+
+/*****************************************************************************
+ * Function prototypes                                                       *
+ *****************************************************************************/
+
+/**
+ * @brief Create a new aggregator that averages the heart rates over
+ * #HEART_RATE_AGGREGATOR_DEFAULT_RESOLUTION seconds
+ *
+ * @param callback Function to call with the batches
+ * @param user_data User data to pass to the callback
+ *
+ * @return Newly allocated #HeartRateAggregator
+ */
+HeartRateAggregator *heart_rate_aggregator_new(
+		HeartRateAggregatorCallback callback,
+		gpointer user_data);
+
+/**
+ * @brief Free an aggregator. Heart rates that have not been delivered are
+ * dropped.
+ *
+ * @param self Pointer to #HeartRateAggregator
+ */
+void heart_rate_aggregator_free(HeartRateAggregator *self);
+
+/**
+ * @brief Set how the heart rates are combined
+ *
+ * The heart rates collected so far are delivered first.
+ *
+ * @param self Pointer to #HeartRateAggregator
+ * @param mode The mode
+ * @param resolution Length of the windows in seconds. Not used in
+ * #HEART_RATE_AGGREGATOR_MODE_RAW mode.
+ */
+void heart_rate_aggregator_set_mode(
+		HeartRateAggregator *self,
+		HeartRateAggregatorMode mode,
+		gdouble resolution);
+
+/**
+ * @brief Add a heart rate
+ *
+ * @param self Pointer to #HeartRateAggregator
+ * @param time Time when the heart rate was detected
+ * @param heart_rate The heart rate in beats per minute
+ */
+void heart_rate_aggregator_add(
+		HeartRateAggregator *self,
+		const struct timeval *time,
+		gdouble heart_rate);
+
+/**
+ * @brief Close the current window and deliver all collected heart rates
+ *
+ * This must be called before pausing or stopping the track.
+ *
+ * @param self Pointer to #HeartRateAggregator
+ */
+void heart_rate_aggregator_flush(HeartRateAggregator *self);
+
+/**
+ * @brief Drop the heart rates that have not been delivered
+ *
+ * @param self Pointer to #HeartRateAggregator
+ */
+void heart_rate_aggregator_reset(HeartRateAggregator *self);
+
+#endif /* _HEART_RATE_AGGREGATOR_H */
@@ -0,0 +1,408 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi, Sampo Savola
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* This module */
+#include "hrm_framer.h"
+
+/* System */
+#include <string.h>
+
+/* Other modules */
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+/** @brief The byte is part of the checksummed data */
+#define HRM_FIELD_FLAG_CHECKSUMMED	(1 << 0)
+
+/**
+ * @brief What to do with the bytes of a frame field
+ */
+typedef enum _HrmFieldType {
+	/** @brief Synchronization mark. Mismatch means no frame starts here */
+	HRM_FIELD_SYNC,
+	/** @brief Constant header bytes. Mismatch is a framing error */
+	HRM_FIELD_CONST,
+	/** @brief Bytes that are not interesting */
+	HRM_FIELD_SKIP,
+	/** @brief Heart rate as one unsigned byte */
+	HRM_FIELD_HEART_RATE_BYTE,
+	/** @brief Heart rate as ASCII digits, each multiplied by two (FRWD) */
+	HRM_FIELD_HEART_RATE_ASCII_X2,
+	/** @brief Checksum of the checksummed bytes */
+	HRM_FIELD_CHECKSUM
+} HrmFieldType;
+
+typedef enum _HrmChecksumType {
+	HRM_CHECKSUM_NONE,
+	/** @brief CRC-8, polynomial 0x8C (reflected), initial value 0 */
+	HRM_CHECKSUM_CRC8
+} HrmChecksumType;
+
+/**
+ * @brief One field of a frame: bytes [start, end) of the frame
+ */
+typedef struct _HrmFrameField {
+	guint start;
+	guint end;
+	HrmFieldType type;
+	guint flags;
+	/** @brief Expected bytes for HRM_FIELD_SYNC and HRM_FIELD_CONST */
+	const guint8 *value;
+} HrmFrameField;
+
+struct _HrmFrameFormat {
+	const gchar *name;
+	HrmChecksumType checksum_type;
+	/** @brief Fields in order. They must cover the whole frame. */
+	const HrmFrameField *fields;
+	guint field_count;
+	guint frame_len;
+};
+
+/*****************************************************************************
+ * Frame formats                                                             *
+ *****************************************************************************/
+
+/*
+ * FRWD frames are 93 bytes and start with "FRWD". The heart rate is at
+ * bytes 12-14 as ASCII digits, each byte multiplied by two.
+ */
+static const HrmFrameField hrm_framer_frwd_fields[] = {
+	{  0,  4, HRM_FIELD_SYNC, 0, (const guint8 *)"FRWD" },
+	{  4, 12, HRM_FIELD_SKIP, 0, NULL },
+	{ 12, 15, HRM_FIELD_HEART_RATE_ASCII_X2, 0, NULL },
+	{ 15, 93, HRM_FIELD_SKIP, 0, NULL }
+};
+
+/*
+ * Zephyr HxM general data frames are 60 bytes: STX (0x02), message ID
+ * (0x26), payload length (55), payload, CRC-8 of the payload and
+ * ETX (0x03). The heart rate is the tenth byte of the payload.
+ */
+static const guint8 hrm_framer_zephyr_stx[] = { 0x02 };
+static const guint8 hrm_framer_zephyr_header[] = { 0x26, 55 };
+static const guint8 hrm_framer_zephyr_etx[] = { 0x03 };
+
+static const HrmFrameField hrm_framer_zephyr_fields[] = {
+	{  0,  1, HRM_FIELD_SYNC, 0, hrm_framer_zephyr_stx },
+	{  1,  3, HRM_FIELD_CONST, 0, hrm_framer_zephyr_header },
+	{  3, 12, HRM_FIELD_SKIP, HRM_FIELD_FLAG_CHECKSUMMED, NULL },
+	{ 12, 13, HRM_FIELD_HEART_RATE_BYTE, HRM_FIELD_FLAG_CHECKSUMMED, NULL },
+	{ 13, 58, HRM_FIELD_SKIP, HRM_FIELD_FLAG_CHECKSUMMED, NULL },
+	{ 58, 59, HRM_FIELD_CHECKSUM, 0, NULL },
+	{ 59, 60, HRM_FIELD_CONST, 0, hrm_framer_zephyr_etx }
+};
+
+/** @brief Frame formats, indexed by #HRMName */
+static const HrmFrameFormat hrm_framer_formats[] = {
+	[FRWD] = {
+		"FRWD",
+		HRM_CHECKSUM_NONE,
+		hrm_framer_frwd_fields,
+		G_N_ELEMENTS(hrm_framer_frwd_fields),
+		93
+	},
+	[ZEPHYR] = {
+		"Zephyr",
+		HRM_CHECKSUM_CRC8,
+		hrm_framer_zephyr_fields,
+		G_N_ELEMENTS(hrm_framer_zephyr_fields),
+		60
+	}
+};
+
+static const guint8 hrm_framer_crc8_table[256] = {
+	0x00, 0x5E, 0xBC, 0xE2, 0x61, 0x3F, 0xDD, 0x83,
+	0xC2, 0x9C, 0x7E, 0x20, 0xA3, 0xFD, 0x1F, 0x41,
+	0x9D, 0xC3, 0x21, 0x7F, 0xFC, 0xA2, 0x40, 0x1E,
+	0x5F, 0x01, 0xE3, 0xBD, 0x3E, 0x60, 0x82, 0xDC,
+	0x23, 0x7D, 0x9F, 0xC1, 0x42, 0x1C, 0xFE, 0xA0,
+	0xE1, 0xBF, 0x5D, 0x03, 0x80, 0xDE, 0x3C, 0x62,
+	0xBE, 0xE0, 0x02, 0x5C, 0xDF, 0x81, 0x63, 0x3D,
+	0x7C, 0x22, 0xC0, 0x9E, 0x1D, 0x43, 0xA1, 0xFF,
+	0x46, 0x18, 0xFA, 0xA4, 0x27, 0x79, 0x9B, 0xC5,
+	0x84, 0xDA, 0x38, 0x66, 0xE5, 0xBB, 0x59, 0x07,
+	0xDB, 0x85, 0x67, 0x39, 0xBA, 0xE4, 0x06, 0x58,
+	0x19, 0x47, 0xA5, 0xFB, 0x78, 0x26, 0xC4, 0x9A,
+	0x65, 0x3B, 0xD9, 0x87, 0x04, 0x5A, 0xB8, 0xE6,
+	0xA7, 0xF9, 0x1B, 0x45, 0xC6, 0x98, 0x7A, 0x24,
+	0xF8, 0xA6, 0x44, 0x1A, 0x99, 0xC7, 0x25, 0x7B,
+	0x3A, 0x64, 0x86, 0xD8, 0x5B, 0x05, 0xE7, 0xB9,
+	0x8C, 0xD2, 0x30, 0x6E, 0xED, 0xB3, 0x51, 0x0F,
+	0x4E, 0x10, 0xF2, 0xAC, 0x2F, 0x71, 0x93, 0xCD,
+	0x11, 0x4F, 0xAD, 0xF3, 0x70, 0x2E, 0xCC, 0x92,
+	0xD3, 0x8D, 0x6F, 0x31, 0xB2, 0xEC, 0x0E, 0x50,
+	0xAF, 0xF1, 0x13, 0x4D, 0xCE, 0x90, 0x72, 0x2C,
+	0x6D, 0x33, 0xD1, 0x8F, 0x0C, 0x52, 0xB0, 0xEE,
+	0x32, 0x6C, 0x8E, 0xD0, 0x53, 0x0D, 0xEF, 0xB1,
+	0xF0, 0xAE, 0x4C, 0x12, 0x91, 0xCF, 0x2D, 0x73,
+	0xCA, 0x94, 0x76, 0x28, 0xAB, 0xF5, 0x17, 0x49,
+	0x08, 0x56, 0xB4, 0xEA, 0x69, 0x37, 0xD5, 0x8B,
+	0x57, 0x09, 0xEB, 0xB5, 0x36, 0x68, 0x8A, 0xD4,
+	0x95, 0xCB, 0x29, 0x77, 0xF4, 0xAA, 0x48, 0x16,
+	0xE9, 0xB7, 0x55, 0x0B, 0x88, 0xD6, 0x34, 0x6A,
+	0x2B, 0x75, 0x97, 0xC9, 0x4A, 0x14, 0xF6, 0xA8,
+	0x74, 0x2A, 0xC8, 0x96, 0x15, 0x4B, 0xA9, 0xF7,
+	0xB6, 0xE8, 0x0A, 0x54, 0xD7, 0x89, 0x6B, 0x35,
+};
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Start decoding a new frame at the read cursor
+ *
+ * @param self Pointer to #HrmFramer
+ */
+static void hrm_framer_begin_frame(HrmFramer *self);
+
+/**
+ * @brief Remove data that does not belong to any frame
+ *
+ * @param self Pointer to #HrmFramer
+ * @param buffer Buffer where to remove the data from
+ * @param len Amount of bytes to remove
+ */
+static void hrm_framer_discard(HrmFramer *self, RingBuffer *buffer, guint len);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+/*===========================================================================*
+ * Public functions                                                          *
+ *===========================================================================*/
+
+void hrm_framer_init(HrmFramer *self, HRMName hrm)
+{
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(hrm < G_N_ELEMENTS(hrm_framer_formats));
+	DEBUG_BEGIN();
+
+	memset(self, 0, sizeof(HrmFramer));
+	self->format = &hrm_framer_formats[hrm];
+	DEBUG("Using %s frame format", self->format->name);
+	hrm_framer_begin_frame(self);
+
+	DEBUG_END();
+}
+
+void hrm_framer_reset(HrmFramer *self)
+{
+	g_return_if_fail(self != NULL);
+
+	hrm_framer_begin_frame(self);
+	self->lost_sync = FALSE;
+}
+
+guint hrm_framer_process(
+		HrmFramer *self,
+		RingBuffer *buffer,
+		HrmFramerFunc callback,
+		gpointer user_data)
+{
+	const HrmFrameFormat *format = NULL;
+	const HrmFrameField *field = NULL;
+	guint len = 0;
+	guint frames = 0;
+	gint offset = 0;
+	guint8 byte = 0;
+	gchar digit = 0;
+	gboolean frame_ok = TRUE;
+
+	g_return_val_if_fail(self != NULL, 0);
+	g_return_val_if_fail(self->format != NULL, 0);
+	g_return_val_if_fail(buffer != NULL, 0);
+	DEBUG_BEGIN();
+
+	format = self->format;
+	len = ring_buffer_get_length(buffer);
+
+	while(self->pos < len)
+	{
+		if(self->pos == 0)
+		{
+			/* Hunt for the first byte of the sync mark */
+			offset = ring_buffer_find(buffer, 0,
+					format->fields[0].value, 1);
+			if(offset < 0)
+			{
+				hrm_framer_discard(self, buffer, len);
+				break;
+			}
+			if(offset > 0)
+			{
+				hrm_framer_discard(self, buffer, offset);
+				len -= offset;
+			}
+		}
+
+		field = &format->fields[self->field];
+		byte = ring_buffer_peek(buffer, self->pos);
+		frame_ok = TRUE;
+
+		switch(field->type)
+		{
+			case HRM_FIELD_SYNC:
+				if(byte != field->value[self->pos - field->start])
+				{
+					/* Not a frame after all */
+					hrm_framer_discard(self, buffer, 1);
+					hrm_framer_begin_frame(self);
+					len--;
+					continue;
+				}
+				break;
+			case HRM_FIELD_CONST:
+				frame_ok = (byte ==
+					field->value[self->pos - field->start]);
+				break;
+			case HRM_FIELD_SKIP:
+				break;
+			case HRM_FIELD_HEART_RATE_BYTE:
+				self->heart_rate = byte;
+				break;
+			case HRM_FIELD_HEART_RATE_ASCII_X2:
+				/* Parse like strtol() would: skip leading
+				 * white space and stop at first non-digit */
+				digit = (gchar)byte / 2;
+				if(self->heart_rate_done)
+				{
+					break;
+				}
+				if(g_ascii_isdigit(digit))
+				{
+					self->heart_rate = self->heart_rate * 10
+						+ (digit - '0');
+					self->heart_rate_digits++;
+				} else if(self->heart_rate_digits > 0 ||
+						!g_ascii_isspace(digit)) {
+					self->heart_rate_done = TRUE;
+				}
+				break;
+			case HRM_FIELD_CHECKSUM:
+				frame_ok = (byte == self->checksum);
+				if(!frame_ok)
+				{
+					DEBUG("%s checksum does not match "
+							"(%d ; %d)",
+							format->name,
+							self->checksum,
+							byte);
+				}
+				break;
+		}
+
+		if(!frame_ok)
+		{
+			/* Skip the start of this frame and look for the next
+			 * sync mark */
+			self->stats.framing_errors++;
+			hrm_framer_discard(self, buffer, 1);
+			hrm_framer_begin_frame(self);
+			len--;
+			continue;
+		}
+
+		if(field->flags & HRM_FIELD_FLAG_CHECKSUMMED)
+		{
+			switch(format->checksum_type)
+			{
+				case HRM_CHECKSUM_CRC8:
+					self->checksum = hrm_framer_crc8_table[
+						self->checksum ^ byte];
+					break;
+				case HRM_CHECKSUM_NONE:
+					break;
+			}
+		}
+
+		self->pos++;
+		if(self->pos < field->end)
+		{
+			continue;
+		}
+
+		self->field++;
+		if(self->field < format->field_count)
+		{
+			continue;
+		}
+
+		/* The whole frame has been decoded */
+		if(self->lost_sync)
+		{
+			self->stats.resyncs++;
+			self->lost_sync = FALSE;
+		}
+		self->stats.frames++;
+		frames++;
+
+		if(callback)
+		{
+			callback(self, self->heart_rate, user_data);
+		}
+
+		ring_buffer_skip(buffer, format->frame_len);
+		len -= format->frame_len;
+		hrm_framer_begin_frame(self);
+	}
+
+	DEBUG_END();
+	return frames;
+}
+
+const HrmFramerStats *hrm_framer_get_stats(HrmFramer *self)
+{
+	g_return_val_if_fail(self != NULL, NULL);
+	return &self->stats;
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static void hrm_framer_begin_frame(HrmFramer *self)
+{
+	self->pos = 0;
+	self->field = 0;
+	self->checksum = 0;
+	self->heart_rate = 0;
+	self->heart_rate_digits = 0;
+	self->heart_rate_done = FALSE;
+}
+
+static void hrm_framer_discard(HrmFramer *self, RingBuffer *buffer, guint len)
+{
+	DEBUG("Discarding %d bytes", len);
+	ring_buffer_skip(buffer, len);
+	self->stats.discarded_bytes += len;
+	self->lost_sync = TRUE;
+}
@@ -0,0 +1,167 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi, Sampo Savola
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+#ifndef _HRM_FRAMER_H
+#define _HRM_FRAMER_H
+
+/* Configuration */
+#include "config.h"
+
+/* GLib */
+#include <glib.h>
+
+/* Other modules */
+#include "ring_buffer.h"
+
+/**
+ * @brief Supported heart rate monitor types
+ */
+typedef enum _HRMName{
+	FRWD,
+	ZEPHYR,
+} HRMName;
+
+typedef struct _HrmFramer HrmFramer;
+typedef struct _HrmFrameFormat HrmFrameFormat;
+
+/**
+ * @brief Type definition for the function that is called for every
+ * complete and valid frame
+ *
+ * @param self Pointer to #HrmFramer
+ * @param heart_rate Heart rate decoded from the frame
+ * @param user_data User data that was passed to #hrm_framer_process
+ */
+typedef void (*HrmFramerFunc)(
+		HrmFramer *self,
+		gint heart_rate,
+		gpointer user_data);
+
+/**
+ * @brief Framing statistics
+ */
+typedef struct _HrmFramerStats {
+	/** @brief Amount of valid frames decoded */
+	guint frames;
+
+	/**
+	 * @brief Amount of frames that were rejected after the sync mark
+	 * was found (invalid header, checksum or end mark)
+	 */
+	guint framing_errors;
+
+	/**
+	 * @brief How many times synchronization was regained after
+	 * discarding data that did not belong to any frame
+	 */
+	guint resyncs;
+
+	/** @brief Amount of bytes that did not belong to any valid frame */
+	guint64 discarded_bytes;
+} HrmFramerStats;
+
+/**
+ * @brief State of a frame decoder.
+ *
+ * The decoder does not allocate any memory, so this can be embedded in
+ * other structs. Consider all the fields private.
+ */
+struct _HrmFramer {
+	/** @brief Frame format of the heart rate monitor */
+	const HrmFrameFormat *format;
+
+	/**
+	 * @brief Position in the current frame, which starts at the read
+	 * cursor of the buffer
+	 */
+	guint pos;
+
+	/** @brief Index of the field where pos is */
+	guint field;
+
+	/** @brief Running checksum of the current frame */
+	guint8 checksum;
+
+	/** @brief Heart rate decoded so far from the current frame */
+	gint heart_rate;
+
+	/** @brief Amount of heart rate digits decoded so far */
+	guint heart_rate_digits;
+
+	/** @brief Whether the end of the heart rate value was reached */
+	gboolean heart_rate_done;
+
+	/** @brief Whether data has been discarded since the last frame */
+	gboolean lost_sync;
+
+	HrmFramerStats stats;
+};
+
+/**
+ * @brief Initialize a frame decoder
+ *
+ * @param self Pointer to #HrmFramer
+ * @param hrm Type of the heart rate monitor whose frames to decode
+ */
+void hrm_framer_init(HrmFramer *self, HRMName hrm);
+
+/**
+ * @brief Reset the decoder state, for example after reconnecting.
+ *
+ * The statistics are not reset.
+ *
+ * @param self Pointer to #HrmFramer
+ */
+void hrm_framer_reset(HrmFramer *self);
+
+/**
+ * @brief Decode frames from a buffer
+ *
+ * In a valid stream every byte is examined only once, even if a frame
+ * arrives in several pieces. Complete frames and data that does not belong
+ * to any frame are removed from the buffer. An incomplete frame at the end of the buffer
+ * is left there, and decoding continues from where it left off when the
+ * function is called again.
+ *
+ * @param self Pointer to #HrmFramer
+ * @param buffer Buffer that contains the received data
+ * @param callback Function to call for every valid frame
+ * @param user_data User data to pass to the callback
+ *
+ * @return Amount of valid frames decoded
+ */
+guint hrm_framer_process(
+		HrmFramer *self,
+		RingBuffer *buffer,
+		HrmFramerFunc callback,
+		gpointer user_data);
+
+/**
+ * @brief Get the framing statistics
+ *
+ * @param self Pointer to #HrmFramer
+ *
+ * @return Pointer to the statistics. This is owned by the decoder.
+ */
+const HrmFramerStats *hrm_framer_get_stats(HrmFramer *self);
+
+#endif /* _HRM_FRAMER_H */
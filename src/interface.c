@@ -41,6 +41,7 @@
 #include "hrm_settings.h"
 #include "hrm_shared.h"
 #include "ec_error.h"
+#include "gpx_journal.h"
 #include "settings.h"
 #include "general_settings.h"
 #include "target_heart_rate.h"
@@ -535,6 +536,7 @@ static void interface_default_folder_changed(
 	GConfValue *value = NULL;
 	AppData *app_data = (AppData *)user_data;
 	const gchar *default_folder_name;
+	GError *error = NULL;
 
 	g_return_if_fail(app_data != NULL);
 	g_return_if_fail(entry != NULL);
@@ -543,6 +545,17 @@ static void interface_default_folder_changed(
 	value = gconf_entry_get_value(entry);
 	default_folder_name = gconf_value_get_string(value);
 
+	/* Rebuild the files of activities that were interrupted by a crash
+	 * before they are listed anywhere */
+	if(gpx_journal_recover_folder(default_folder_name, &error) < 0)
+	{
+		ec_error_show_message_error_printf(
+				_("Unable to recover activity data:\n%s"),
+				error->message);
+		g_error_free(error);
+		error = NULL;
+	}
+
 	activity_chooser_set_default_folder(
 			app_data->activity_chooser,
 			default_folder_name);
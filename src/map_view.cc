@@ -100,6 +100,13 @@ static void map_view_heart_rate_changed(
 
 static void map_view_hide_map_widget(MapView *self);
 
+/**
+ * @brief Set up the track filter and the heart rate aggregator from GConf
+ *
+ * @param self Pointer to #MapView
+ */
+static void map_view_configure_recording(MapView *self);
+
 static void map_view_location_changed(
 		LocationGPSDevice *device,
 		gpointer user_data);
@@ -108,6 +115,13 @@ static void map_view_check_and_add_route_point(
 		MapView *self,
 		MapPoint *point,
 		LocationGPSDeviceFix *fix);	
+static void map_view_record_route_point(
+		TrackHelperPoint *point,
+		gpointer user_data);
+static void map_view_record_heart_rates(
+		const GpxStorageHeartRate *heart_rates,
+		guint count,
+		gpointer user_data);
 static void map_view_btn_start_pause_clicked(GtkWidget *button,
 		gpointer user_data);
 static void map_view_btn_stop_clicked(GtkWidget *button, gpointer user_data);
@@ -176,6 +190,12 @@ MapView *map_view_new(
 	self->beat_detector = beat_detector;
 	self->osso = osso;
 	self->track_helper = track_helper_new();
+	self->track_filter = track_filter_new(map_view_record_route_point,
+			self);
+	self->heart_rate_aggregator = heart_rate_aggregator_new(
+			map_view_record_heart_rates,
+			self);
+	map_view_configure_recording(self);
 	self->first_location_point_added = FALSE;
 
 
@@ -678,6 +698,10 @@ void map_view_stop(MapView *self)
 		DEBUG_END();
 		return;
 	}
+
+	/* End the track where the user is */
+	track_filter_flush(self->track_filter);
+	heart_rate_aggregator_flush(self->heart_rate_aggregator);
 	//for calendar
 	
 	if(self->add_calendar){
@@ -755,6 +779,7 @@ void map_view_stop(MapView *self)
 	}
 	track_helper_stop(self->track_helper);
 	track_helper_clear(self->track_helper, FALSE);
+	track_filter_reset(self->track_filter);
 	self->activity_state = MAP_VIEW_ACTIVITY_STATE_STOPPED;
 	g_source_remove(self->activity_timer_id);
 	self->activity_timer_id = 0;
@@ -766,6 +791,8 @@ void map_view_clear_all(MapView *self)
 	g_return_if_fail(self != NULL);
 	DEBUG_BEGIN();
 	track_helper_clear(self->track_helper, TRUE);
+	track_filter_reset(self->track_filter);
+	heart_rate_aggregator_reset(self->heart_rate_aggregator);
 	map_view_update_stats(self);
 	DEBUG_END();
 }
@@ -951,15 +978,11 @@ static void map_view_heart_rate_changed(
 	}
 		if(self->activity_state == MAP_VIEW_ACTIVITY_STATE_STARTED && self->first_location_point_added)
 		{
-			self->heart_rate_count++;
-			if(self->heart_rate_count == 10)
-			{
-				self->heart_rate_count = 0;
-				track_helper_add_heart_rate(
-						self->track_helper,
-						time,
-						heart_rate);
-			}
+			/* The aggregator calls map_view_record_heart_rates()
+			 * with the heart rates to record */
+			heart_rate_aggregator_add(self->heart_rate_aggregator,
+					time,
+					heart_rate);
 		}
 	}
 
@@ -1047,11 +1070,8 @@ static void map_view_check_and_add_route_point(
 		MapPoint *point,
 		LocationGPSDeviceFix *fix)
 {
-	gdouble distance = 0;
-	gboolean add_point_to_track = FALSE;
-	MapPoint *point_copy = NULL;
 	TrackHelperPoint track_helper_point;
-	gboolean map_widget_ready = TRUE;
+	gdouble speed = -1;
 
 	g_return_if_fail(self != NULL);
 	g_return_if_fail(fix != NULL);
@@ -1063,71 +1083,120 @@ static void map_view_check_and_add_route_point(
 		DEBUG_END();
 		return;
 	}
-	if(!self->point_added)
+
+	track_helper_point.latitude = fix->latitude;
+	track_helper_point.longitude = fix->longitude;
+
+	if(fix->fields & LOCATION_GPS_DEVICE_ALTITUDE_SET)
 	{
-	//	DEBUG("First point. Adding to track.");
-		/* Always add the first point to the route */
-		add_point_to_track = TRUE;
-		self->point_added = TRUE;
+		track_helper_point.altitude_is_set = TRUE;
+		track_helper_point.altitude = fix->altitude;
 	} else {
-		distance = location_distance_between(
-				self->previous_added_point.latitude,
-				self->previous_added_point.longitude,
-				fix->latitude,
-				fix->longitude) * 1000.0;
-		DEBUG("Distance: %f meters", distance);
-
-		/* Only add additional points if distance is at
-		 * least 10 meters, or if elevation has changed at least
-		 * 2 meters */
-		/* @todo: Are the 10 m / 2 m values sane? */
-
-		if(self->previous_added_point.altitude_set &&
-				fix->fields & LOCATION_GPS_DEVICE_ALTITUDE_SET
-				&& fabs(self->previous_added_point.altitude -
-					fix->altitude) >= 2)
-		{
-			DEBUG("Altitude has changed at least 2 meters. "
-					"Adding point to track.");
-			add_point_to_track = TRUE;
-		} else if(distance >= 10) {
-			DEBUG("Distance has changed at least 10 meters. "
-					"Adding point to track");
-			add_point_to_track = TRUE;
-		}
+		track_helper_point.altitude_is_set = FALSE;
+		track_helper_point.altitude = 0;
 	}
-	if(add_point_to_track)
+
+	gettimeofday(&track_helper_point.timestamp, NULL);
+
+	/* The GPS device reports the speed in km/h */
+	if(fix->fields & LOCATION_GPS_DEVICE_SPEED_SET)
 	{
-		self->previous_added_point.latitude = fix->latitude;
-		self->previous_added_point.longitude = fix->longitude;
+		speed = fix->speed / 3.6;
+	}
 
-		track_helper_point.latitude = fix->latitude;
-		track_helper_point.longitude = fix->longitude;
+	/* The statistics are computed from every point, so that they are
+	 * not delayed or made less accurate by the filter */
+	track_helper_update_statistics(self->track_helper,
+			&track_helper_point);
 
-		if(fix->fields & LOCATION_GPS_DEVICE_ALTITUDE_SET)
-		{
-			self->previous_added_point.altitude_set = TRUE;
-			self->previous_added_point.altitude = fix->altitude;
-			track_helper_point.altitude_is_set = TRUE;
-			track_helper_point.altitude = fix->altitude;
-		} else {
-			self->previous_added_point.altitude_set = FALSE;
-			self->previous_added_point.altitude = 0;
-			track_helper_point.altitude_is_set = FALSE;
-		}
+	/* The filter decides whether the point is worth recording, and
+	 * calls map_view_record_route_point() if it is */
+	track_filter_add_point(self->track_filter, &track_helper_point, speed);
+
+	DEBUG_END();
+}
 
-		gettimeofday(&track_helper_point.timestamp, NULL);
-		track_helper_add_track_point(self->track_helper,
-				&track_helper_point);
+static void map_view_record_route_point(
+		TrackHelperPoint *point,
+		gpointer user_data)
+{
+	MapView *self = (MapView *)user_data;
 
-		/* Map widget wants to own the point that is added to the
-		 * route */
-		point_copy = g_new0(MapPoint, 1);
-		point_copy->latitude = point->latitude;
-		point_copy->longitude = point->longitude;
-		
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(point != NULL);
+	DEBUG_BEGIN();
+
+	track_helper_add_track_point(self->track_helper, point);
+
+	DEBUG_END();
+}
+
+static void map_view_record_heart_rates(
+		const GpxStorageHeartRate *heart_rates,
+		guint count,
+		gpointer user_data)
+{
+	MapView *self = (MapView *)user_data;
+
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	track_helper_add_heart_rates(self->track_helper, heart_rates, count);
+
+	DEBUG_END();
+}
+
+static void map_view_configure_recording(MapView *self)
+{
+	gint mode;
+
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	mode = gconf_helper_get_value_int_with_default(self->gconf_helper,
+			ECGC_TRACK_FILTER_MODE,
+			TRACK_FILTER_MODE_FIXED);
+	if(mode < 0 || mode >= TRACK_FILTER_MODE_COUNT)
+	{
+		g_warning("Unknown track filter mode: %d", mode);
+		mode = TRACK_FILTER_MODE_FIXED;
 	}
 
+	track_filter_set_mode(self->track_filter, (TrackFilterMode)mode);
+	track_filter_set_thresholds(self->track_filter,
+			MAX(0, gconf_helper_get_value_float_with_default(
+					self->gconf_helper,
+					ECGC_TRACK_FILTER_DISTANCE,
+					TRACK_FILTER_DEFAULT_DISTANCE)),
+			MAX(0, gconf_helper_get_value_float_with_default(
+					self->gconf_helper,
+					ECGC_TRACK_FILTER_ALTITUDE,
+					TRACK_FILTER_DEFAULT_ALTITUDE)),
+			MAX(0, gconf_helper_get_value_float_with_default(
+					self->gconf_helper,
+					ECGC_TRACK_FILTER_INTERVAL,
+					TRACK_FILTER_DEFAULT_INTERVAL)),
+			MAX(0, gconf_helper_get_value_float_with_default(
+					self->gconf_helper,
+					ECGC_TRACK_FILTER_MAX_ERROR,
+					TRACK_FILTER_DEFAULT_MAX_ERROR)));
+
+	mode = gconf_helper_get_value_int_with_default(self->gconf_helper,
+			ECGC_HEART_RATE_RECORDING_MODE,
+			HEART_RATE_AGGREGATOR_MODE_AVERAGE);
+	if(mode < 0 || mode >= HEART_RATE_AGGREGATOR_MODE_COUNT)
+	{
+		g_warning("Unknown heart rate recording mode: %d", mode);
+		mode = HEART_RATE_AGGREGATOR_MODE_AVERAGE;
+	}
+
+	heart_rate_aggregator_set_mode(self->heart_rate_aggregator,
+			(HeartRateAggregatorMode)mode,
+			gconf_helper_get_value_float_with_default(
+				self->gconf_helper,
+				ECGC_HEART_RATE_RECORDING_RESOLUTION,
+				HEART_RATE_AGGREGATOR_DEFAULT_RESOLUTION));
+
 	DEBUG_END();
 }
 
@@ -1225,6 +1294,9 @@ static void map_view_start_activity(MapView *self)
 
 	time(&self->start);
 
+	/* Always add the first point */
+	track_filter_reset(self->track_filter);
+
 	/* Clear the track helper */
 	if(self->activity_state == MAP_VIEW_ACTIVITY_STATE_STOPPED)
 	{
@@ -1278,7 +1350,7 @@ static void map_view_continue_activity(MapView *self)
 			self);
 
 	/* Force adding the current location */
-	self->point_added = FALSE;
+	track_filter_reset(self->track_filter);
 
 	self->activity_state = MAP_VIEW_ACTIVITY_STATE_STARTED;
 
@@ -1299,6 +1371,8 @@ static void map_view_pause_activity(MapView *self)
 
 	gettimeofday(&time_now, NULL);
 
+	track_filter_flush(self->track_filter);
+	heart_rate_aggregator_flush(self->heart_rate_aggregator);
 	track_helper_pause(self->track_helper);
 
 	/* Get the difference between now and previous start time */
@@ -57,11 +57,12 @@
 #include "beat_detect.h"
 #include "gconf_helper.h"
 #include "track.h"
+#include "track_filter.h"
+#include "heart_rate_aggregator.h"
 
 
 
 typedef struct _MapView MapView;
-typedef struct _MapViewGpsPoint MapViewGpsPoint;
 
 typedef enum _MapViewDirection {
 	MAP_VIEW_DIRECTION_NORTH,
@@ -91,13 +92,6 @@ typedef enum _MapViewHRMStatus {
 	MAP_VIEW_HRM_STATUS_COUNT
 } MapViewHRMStatus;
 
-struct _MapViewGpsPoint {
-	gdouble latitude;
-	gdouble longitude;
-	gboolean altitude_set;
-	gdouble altitude;
-};
-
 struct _MapView {
 	GtkWindow *parent_window;	/**< Parent window		*/
 	GtkWidget *win;			/**Stackable window		*/
@@ -188,7 +182,8 @@ struct _MapView {
 	gchar *activity_comment;
 	gchar *file_name;
 
-	gint heart_rate_count;		/**< Count of heart rate values	*/
+	HeartRateAggregator
+		*heart_rate_aggregator;	/**< Heart rates to record	*/
 	gint heart_rate_limit_low;	/**< Heart rate lower range	*/
 	gint heart_rate_limit_high;	/**< Heart rate upper range	*/
 
@@ -212,8 +207,7 @@ struct _MapView {
 	OsmGpsMapSource_t map_provider ;
 
 	
-	gboolean point_added;
-	MapViewGpsPoint previous_added_point;
+	TrackFilter *track_filter;	/**< Decides which points to record */
 	gdouble travelled_distance;
 	const char *friendly_name;
 	char *cachedir;
@@ -54,58 +54,139 @@ Functions in bdac.cpp require functions in the following files:
          and BEAT_SAMPLE_RATE in bcac.h.
 
 *******************************************************************************/
-#include "qrsdet.h"	// For base SAMPLE_RATE
+#include <stdlib.h>
+#include <string.h>
+#include "qrsdet.h"	// For MIN_SAMPLE_RATE and MAX_SAMPLE_RATE
 #include "bdac.h"
+#include "ecgcodes.h"
+#include "osea.h"
 
-#define ECG_BUFFER_LENGTH	1000	// Should be long enough for a beat
-											// plus extra space to accommodate
-											// the maximum detection delay.
-#define BEAT_QUE_LENGTH	10			// Length of que for beats awaiting
-											// classification.  Because of
-											// detection delays, Multiple beats
-											// can occur before there is enough data
-											// to classify the first beat in the que.
+// Converts a number of samples at BEAT_SAMPLE_RATE to the input sample rate.
+
+#define BEAT_TO_SAMPLES(ctx, n)	((n)*(ctx)->rate.sampleRate/BEAT_SAMPLE_RATE)
 
 // Internal function prototypes.
 
-void DownSampleBeat(int *beatOut, int *beatIn) ;
+void SetSampleRate(OseaRate *rate, int sampleRate) ;
+int ClassifySample(OseaContext *ctx, int ecgSample, int detectDelay,
+	int *beatType, int *beatMatch) ;
+void DownSampleBeat(int *beatOut, int *beatIn, int sampleRate) ;
 
 // External functions prototypes.
 
-int QRSDet( int datum, int init ) ;
-int NoiseCheck(int datum, int delay, int RR, int beatBegin, int beatEnd) ;
-int Classify(int *newBeat,int rr, int noiseLevel, int *beatMatch, int *fidAdj, int init) ;
-int GetDominantType(void) ;
-int GetBeatEnd(int type) ;
-int GetBeatBegin(int type) ;
+int QRSDet(OseaContext *ctx, int datum, int init ) ;
+int QRSDetFiltered(OseaContext *ctx, int fdatum, int derivDatum) ;
+void QRSFilterBlock(OseaContext *ctx, const int *datum, int *fdatum, int n) ;
+void Deriv1Block(OseaContext *ctx, const int *x, int *y, int n) ;
+int NoiseCheck(OseaContext *ctx, int datum, int delay, int RR, int beatBegin, int beatEnd) ;
+int Classify(OseaContext *ctx, int *newBeat,int rr, int noiseLevel, int *beatMatch, int *fidAdj, int init) ;
+int GetDominantType(OseaContext *ctx) ;
+int GetBeatEnd(OseaContext *ctx, int type) ;
+int GetBeatBegin(OseaContext *ctx, int type) ;
 int gcd(int x, int y) ;
 
-// Global Variables
+/******************************************************************************
+	OseaCreate() allocates and initializes a new beat detection and
+	classification context for ECG sampled at sampleRate Hz.  Returns NULL
+	if out of memory or if the sample rate is not supported.
+*******************************************************************************/
+
+OseaContext *OseaCreate(int sampleRate)
+	{
+	OseaContext *ctx ;
+
+	ctx = (OseaContext *) malloc(sizeof(OseaContext)) ;
+	if((ctx != NULL) && (OseaInit(ctx,sampleRate) != 0))
+		{
+		free(ctx) ;
+		ctx = NULL ;
+		}
+	return(ctx) ;
+	}
+
+/******************************************************************************
+	OseaDestroy() frees a context allocated with OseaCreate().
+*******************************************************************************/
+
+void OseaDestroy(OseaContext *ctx)
+	{
+	free(ctx) ;
+	}
 
-int ECGBuffer[ECG_BUFFER_LENGTH], ECGBufferIndex = 0 ;  // Circular data buffer.
-int BeatBuffer[BEATLGTH] ;
-int BeatQue[BEAT_QUE_LENGTH], BeatQueCount = 0 ;  // Buffer of detection delays.
-int RRCount = 0 ;
-int InitBeatFlag = 1 ;
+/******************************************************************************
+	OseaInit() sets all the variables of a context to the values that the
+	original global and static variables had at program start, sets up the
+	constants for sampleRate, and then resets the beat detector and
+	classifier.  Returns 0, or -1 if the sample rate is not supported.
+*******************************************************************************/
+
+int OseaInit(OseaContext *ctx, int sampleRate)
+	{
+	if((sampleRate < MIN_SAMPLE_RATE) || (sampleRate > MAX_SAMPLE_RATE))
+		return(-1) ;
+
+	memset(ctx, 0, sizeof(OseaContext)) ;
+	SetSampleRate(&ctx->rate, sampleRate) ;
+	ctx->bdac.InitBeatFlag = 1 ;
+	ctx->qrsdet.sbcount = ctx->rate.ms1500 ;
+	ctx->classify.lastRhythmClass = UNKNOWN ;
+	ResetBDAC(ctx) ;
+	return(0) ;
+	}
+
+/******************************************************************************
+	SetSampleRate() computes the time constants and filter lengths for
+	sampleRate.  These are the same expressions that qrsdet.h used with a
+	fixed SAMPLE_RATE, so at 300 Hz the detector behaves exactly as before.
+	The filter lengths for 150 and 300 Hz must agree with the constants in
+	qrsdet.h that the fast paths in qrsfilt.c use.
+*******************************************************************************/
+
+void SetSampleRate(OseaRate *rate, int sampleRate)
+	{
+	rate->sampleRate = sampleRate ;
+	rate->ms80 = MS_TO_SAMPLES(80,sampleRate) ;
+	rate->ms95 = MS_TO_SAMPLES(95,sampleRate) ;
+	rate->ms150 = MS_TO_SAMPLES(150,sampleRate) ;
+	rate->ms220 = MS_TO_SAMPLES(220,sampleRate) ;
+	rate->ms250 = MS_TO_SAMPLES(250,sampleRate) ;
+	rate->ms300 = MS_TO_SAMPLES(300,sampleRate) ;
+	rate->ms360 = MS_TO_SAMPLES(360,sampleRate) ;
+	rate->ms1000 = sampleRate ;
+	rate->ms1500 = (int) (1500/MS_PER_SAMPLE(sampleRate)) ;
+
+	rate->derivLength = MS_TO_SAMPLES(10,sampleRate) ;
+	rate->lpBufferLgth = 2*MS_TO_SAMPLES(25,sampleRate) ;
+	rate->hpBufferLgth = MS_TO_SAMPLES(125,sampleRate) ;
+	rate->windowWidth = MS_TO_SAMPLES(80,sampleRate) ;
+
+	rate->preBlank = MS_TO_SAMPLES(200,sampleRate) ;
+	rate->filterDelay = (int) (((double) rate->derivLength/2)
+		+ ((double) rate->lpBufferLgth/2 - 1)
+		+ (((double) rate->hpBufferLgth-1)/2) + rate->preBlank) ;
+	rate->derDelay = rate->windowWidth + rate->filterDelay
+		+ MS_TO_SAMPLES(100,sampleRate) ;
+	}
 
 /******************************************************************************
 	ResetBDAC() resets static variables required for beat detection and
 	classification.
 *******************************************************************************/
 
-void ResetBDAC(void)
+void ResetBDAC(OseaContext *ctx)
 	{
 	int dummy ;
-	QRSDet(0,1) ;	// Reset the qrs detector
-	RRCount = 0 ;
-	Classify(BeatBuffer,0,0,&dummy,&dummy,1) ;
-	InitBeatFlag = 1 ;
-   BeatQueCount = 0 ;	// Flush the beat que.
+	QRSDet(ctx, 0,1) ;	// Reset the qrs detector
+	ctx->bdac.RRCount = 0 ;
+	Classify(ctx, ctx->bdac.BeatBuffer,0,0,&dummy,&dummy,1) ;
+	ctx->bdac.InitBeatFlag = 1 ;
+   ctx->bdac.BeatQueCount = 0 ;	// Flush the beat que.
 	}
 
 /*****************************************************************************
 Syntax:
-	int BeatDetectAndClassify(int ecgSample, int *beatType, *beatMatch) ;
+	int BeatDetectAndClassify(OseaContext *ctx, int ecgSample, int *beatType,
+		int *beatMatch) ;
 Description:
 	BeatDetectAndClassify() implements a beat detector and classifier.
 	ECG samples are passed into BeatDetectAndClassify() one sample at a
@@ -119,96 +200,156 @@ Returns
 	classified.  If a beat has been classified, BeatDetectAndClassify returns
 	the number of samples since the approximate location of the R-wave.
 ****************************************************************************/
-int BeatDetectAndClassify(int ecgSample, int *beatType, int *beatMatch)
+int BeatDetectAndClassify(OseaContext *ctx, int ecgSample, int *beatType, int *beatMatch)
 	{
-	int detectDelay, rr, i, j ;
+	int detectDelay ;
+
+	// Run the sample through the QRS detector.
+
+	detectDelay = QRSDet(ctx, ecgSample,0) ;
+	return(ClassifySample(ctx, ecgSample, detectDelay, beatType, beatMatch)) ;
+	}
+
+/*****************************************************************************
+Syntax:
+	int BeatDetectAndClassifyBlock(OseaContext *ctx, const int *ecgSamples,
+		int n, OseaBeat *beats) ;
+Description:
+	BeatDetectAndClassifyBlock() passes n consecutive samples through the
+	beat detector and classifier.  The results are the same as from calling
+	BeatDetectAndClassify() for each sample, and the two can be mixed.  The
+	QRS filters are run a block at a time with QRSFilterBlock().
+
+	For every beat that BeatDetectAndClassify() would have returned, an
+	OseaBeat is stored in beats, which must have room for n beats.
+Returns
+	The number of beats stored in beats.
+****************************************************************************/
+int BeatDetectAndClassifyBlock(OseaContext *ctx, const int *ecgSamples, int n,
+	OseaBeat *beats)
+	{
+	int fdatum[OSEA_BLOCK_LENGTH], derivDatum[OSEA_BLOCK_LENGTH] ;
+	int i, m, start, delay, beatType, beatMatch ;
+	int beatCount = 0 ;
+
+	for(start = 0; start < n; start += m)
+		{
+		m = (n-start < OSEA_BLOCK_LENGTH) ? n-start : OSEA_BLOCK_LENGTH ;
+		QRSFilterBlock(ctx, &ecgSamples[start], fdatum, m) ;
+		Deriv1Block(ctx, &ecgSamples[start], derivDatum, m) ;
+
+		for(i = 0; i < m; ++i)
+			{
+			delay = QRSDetFiltered(ctx, fdatum[i], derivDatum[i]) ;
+			delay = ClassifySample(ctx, ecgSamples[start+i], delay,
+				&beatType, &beatMatch) ;
+			if(delay != 0)
+				{
+				beats[beatCount].sample = start+i ;
+				beats[beatCount].delay = delay ;
+				beats[beatCount].type = beatType ;
+				beats[beatCount].match = beatMatch ;
+				++beatCount ;
+				}
+			}
+		}
+	return(beatCount) ;
+	}
+
+/*****************************************************************************
+	ClassifySample() is the part of BeatDetectAndClassify() that follows the
+	QRS detector.  detectDelay is the return value of QRSDet() for
+	ecgSample.
+****************************************************************************/
+int ClassifySample(OseaContext *ctx, int ecgSample, int detectDelay,
+	int *beatType, int *beatMatch)
+	{
+	int rr, i, j ;
 	int noiseEst = 0, beatBegin, beatEnd ;
 	int domType ;
 	int fidAdj ;
-	int tempBeat[(SAMPLE_RATE/BEAT_SAMPLE_RATE)*BEATLGTH] ;
+	int tempBeat[(MAX_SAMPLE_RATE*BEATLGTH)/BEAT_SAMPLE_RATE] ;
 
 	// Store new sample in the circular buffer.
 
-	ECGBuffer[ECGBufferIndex] = ecgSample ;
-	if(++ECGBufferIndex == ECG_BUFFER_LENGTH)
-		ECGBufferIndex = 0 ;
+	ctx->bdac.ECGBuffer[ctx->bdac.ECGBufferIndex] = ecgSample ;
+	if(++ctx->bdac.ECGBufferIndex == ECG_BUFFER_LENGTH)
+		ctx->bdac.ECGBufferIndex = 0 ;
 
 	// Increment RRInterval count.
 
-	++RRCount ;
+	++ctx->bdac.RRCount ;
 
 	// Increment detection delays for any beats in the que.
 
-	for(i = 0; i < BeatQueCount; ++i)
-		++BeatQue[i] ;
+	for(i = 0; i < ctx->bdac.BeatQueCount; ++i)
+		++ctx->bdac.BeatQue[i] ;
 
-	// Run the sample through the QRS detector.
+	// Add a beat found by the QRS detector to the que.
 
-	detectDelay = QRSDet(ecgSample,0) ;
 	if(detectDelay != 0)
 		{
-		BeatQue[BeatQueCount] = detectDelay ;
-		++BeatQueCount ;
+		ctx->bdac.BeatQue[ctx->bdac.BeatQueCount] = detectDelay ;
+		++ctx->bdac.BeatQueCount ;
 		}
 
 	// Return if no beat is ready for classification.
 
-	if((BeatQue[0] < (BEATLGTH-FIDMARK)*(SAMPLE_RATE/BEAT_SAMPLE_RATE))
-		|| (BeatQueCount == 0))
+	if((ctx->bdac.BeatQue[0] < BEAT_TO_SAMPLES(ctx,BEATLGTH-FIDMARK))
+		|| (ctx->bdac.BeatQueCount == 0))
 		{
-		NoiseCheck(ecgSample,0,rr, beatBegin, beatEnd) ;	// Update noise check buffer
+		NoiseCheck(ctx, ecgSample,0,rr, beatBegin, beatEnd) ;	// Update noise check buffer
 		return 0 ;
 		}
 
 	// Otherwise classify the beat at the head of the que.
 
-	rr = RRCount - BeatQue[0] ;	// Calculate the R-to-R interval
-	detectDelay = RRCount = BeatQue[0] ;
+	rr = ctx->bdac.RRCount - ctx->bdac.BeatQue[0] ;	// Calculate the R-to-R interval
+	detectDelay = ctx->bdac.RRCount = ctx->bdac.BeatQue[0] ;
 
 	// Estimate low frequency noise in the beat.
 	// Might want to move this into classify().
 
-	domType = GetDominantType() ;
+	domType = GetDominantType(ctx) ;
 	if(domType == -1)
 		{
-		beatBegin = MS250 ;
-		beatEnd = MS300 ;
+		beatBegin = ctx->rate.ms250 ;
+		beatEnd = ctx->rate.ms300 ;
 		}
 	else
 		{
-		beatBegin = (SAMPLE_RATE/BEAT_SAMPLE_RATE)*(FIDMARK-GetBeatBegin(domType)) ;
-		beatEnd = (SAMPLE_RATE/BEAT_SAMPLE_RATE)*(GetBeatEnd(domType)-FIDMARK) ;
+		beatBegin = BEAT_TO_SAMPLES(ctx,FIDMARK-GetBeatBegin(ctx, domType)) ;
+		beatEnd = BEAT_TO_SAMPLES(ctx,GetBeatEnd(ctx, domType)-FIDMARK) ;
 		}
-	noiseEst = NoiseCheck(ecgSample,detectDelay,rr,beatBegin,beatEnd) ;
+	noiseEst = NoiseCheck(ctx, ecgSample,detectDelay,rr,beatBegin,beatEnd) ;
 
 	// Copy the beat from the circular buffer to the beat buffer
-	// and reduce the sample rate by averageing pairs of data
-	// points.
+	// and reduce the sample rate to BEAT_SAMPLE_RATE.
 
-	j = ECGBufferIndex - detectDelay - (SAMPLE_RATE/BEAT_SAMPLE_RATE)*FIDMARK ;
+	j = ctx->bdac.ECGBufferIndex - detectDelay - BEAT_TO_SAMPLES(ctx,FIDMARK) ;
 	if(j < 0) j += ECG_BUFFER_LENGTH ;
 
-	for(i = 0; i < (SAMPLE_RATE/BEAT_SAMPLE_RATE)*BEATLGTH; ++i)
+	for(i = 0; i < BEAT_TO_SAMPLES(ctx,BEATLGTH); ++i)
 		{
-		tempBeat[i] = ECGBuffer[j] ;
+		tempBeat[i] = ctx->bdac.ECGBuffer[j] ;
 		if(++j == ECG_BUFFER_LENGTH)
 			j = 0 ;
 		}
 
-	DownSampleBeat(BeatBuffer,tempBeat) ;
+	DownSampleBeat(ctx->bdac.BeatBuffer,tempBeat,ctx->rate.sampleRate) ;
 
 	// Update the QUE.
 
-	for(i = 0; i < BeatQueCount-1; ++i)
-		BeatQue[i] = BeatQue[i+1] ;
-	--BeatQueCount ;
+	for(i = 0; i < ctx->bdac.BeatQueCount-1; ++i)
+		ctx->bdac.BeatQue[i] = ctx->bdac.BeatQue[i+1] ;
+	--ctx->bdac.BeatQueCount ;
 
 
 	// Skip the first beat.
 
-	if(InitBeatFlag)
+	if(ctx->bdac.InitBeatFlag)
 		{
-		InitBeatFlag = 0 ;
+		ctx->bdac.InitBeatFlag = 0 ;
 		*beatType = 13 ;
 		*beatMatch = 0 ;
 		fidAdj = 0 ;
@@ -216,8 +357,8 @@ int BeatDetectAndClassify(int ecgSample, int *beatType, int *beatMatch)
 	// Classify all other beats.
 	else
 		{
-		*beatType = Classify(BeatBuffer,rr,noiseEst,beatMatch,&fidAdj,0) ;
-		fidAdj *= SAMPLE_RATE/BEAT_SAMPLE_RATE ;
+		*beatType = Classify(ctx, ctx->bdac.BeatBuffer,rr,noiseEst,beatMatch,&fidAdj,0) ;
+		fidAdj = BEAT_TO_SAMPLES(ctx,fidAdj) ;
       }
 
 	// Ignore detection if the classifier decides that this
@@ -225,25 +366,53 @@ int BeatDetectAndClassify(int ecgSample, int *beatType, int *beatMatch)
 
 	if(*beatType == 100)
 		{
-		RRCount += rr ;
+		ctx->bdac.RRCount += rr ;
 		return(0) ;
 		}
 
 	// Limit the fiducial mark adjustment in case of problems with
 	// beat onset and offset estimation.
 
-	if(fidAdj > MS80)
-		fidAdj = MS80 ;
-	else if(fidAdj < -MS80)
-		fidAdj = -MS80 ;
+	if(fidAdj > ctx->rate.ms80)
+		fidAdj = ctx->rate.ms80 ;
+	else if(fidAdj < -ctx->rate.ms80)
+		fidAdj = -ctx->rate.ms80 ;
 
 	return(detectDelay-fidAdj) ;
 	}
 
-void DownSampleBeat(int *beatOut, int *beatIn)
+/*****************************************************************************
+	DownSampleBeat() reduces one second of ECG sampled at sampleRate to
+	BEATLGTH samples at BEAT_SAMPLE_RATE.  Each output sample is the average
+	of the input samples in its sample period.  150 and 300 Hz have their
+	own fast paths.
+*****************************************************************************/
+
+void DownSampleBeat(int *beatOut, int *beatIn, int sampleRate)
 	{
-	int i ;
+	int i, j, begin, end ;
+	long sum ;
 
-	for(i = 0; i < BEATLGTH; ++i)
-		beatOut[i] = (beatIn[i<<1]+beatIn[(i<<1)+1])>>1 ;
+	switch(sampleRate)
+		{
+		case BEAT_SAMPLE_RATE :
+			memcpy(beatOut,beatIn,BEATLGTH*sizeof(int)) ;
+			break ;
+
+		case 2*BEAT_SAMPLE_RATE :
+			for(i = 0; i < BEATLGTH; ++i)
+				beatOut[i] = (beatIn[i<<1]+beatIn[(i<<1)+1])>>1 ;
+			break ;
+
+		default :
+			for(i = 0, end = 0; i < BEATLGTH; ++i)
+				{
+				begin = end ;
+				end = ((i+1)*sampleRate)/BEAT_SAMPLE_RATE ;
+				for(j = begin, sum = 0; j < end; ++j)
+					sum += beatIn[j] ;
+				beatOut[i] = sum/(end-begin) ;
+				}
+			break ;
+		}
 	}
@@ -57,7 +57,6 @@ MA 02143 USA).  For updates to this software, please visit our website
 #define MAXTYPES 8
 #define FIDMARK BEAT_MS400
 
-void ResetBDAC(void);
-int BeatDetectAndClassify(int ecgSample, int *beatType, int *beatMatch);
+// ResetBDAC() and BeatDetectAndClassify() are declared in osea.h.
 
 #endif /* BDAC_H */
@@ -0,0 +1,288 @@
+/*****************************************************************************
+FILE:  bxb.c
+REVISED:	2026
+  ___________________________________________________________________________
+
+bxb.c: Beat-by-beat annotation comparison, adapted from bxbep.c.
+Copyright (C) 2001 George B. Moody
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place - Suite 330, Boston, MA 02111-1307, USA.
+  __________________________________________________________________________
+
+This file contains the beat matching rules of bxbep.c, which implement the
+beat-by-beat comparison described in AAMI/ANSI EC38:1998 and AAMI EC57:1998.
+The annotation streams are arrays instead of WFDB annotation files, and the
+results are returned in a BxbResult instead of the global counters.
+
+	BxbLabel -- Maps an MIT annotation code to an AAMI label.
+	BxbReset -- Clears the counts of a BxbResult.
+	BxbCompare -- Compares test annotations to reference annotations.
+	BxbGetStats -- Calculates QRS and VEB detection statistics.
+
+*****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "ecgcodes.h"
+#include "bxb.h"
+
+#define BXB_HUGE_TIME	0x7FFFFFFFL	// Time used after the last annotation.
+
+// One annotation stream, with the current and the next annotation as in
+// getref() and gettest() of bxbep.c.
+
+typedef struct _BxbStream {
+	const BxbAnnotation *ann ;
+	int count, next ;
+	long time, nextTime ;
+	int label, nextLabel ;
+	long rr ;				// RR interval, if non-zero.
+	} BxbStream ;
+
+// Local prototypes.
+
+void BxbNext(BxbStream *stream) ;
+void BxbPair(BxbResult *result, int ref, int test, long refRR, long testRR) ;
+
+/***************************************************************************
+	BxbLabel() maps an MIT annotation code to an AAMI label.  As in the
+	standard report of bxbep.c, supraventricular ectopic beats are counted
+	as normal beats.  Non-beat annotations are mapped to 'O'.
+****************************************************************************/
+
+int BxbLabel(int anntyp)
+	{
+	switch(anntyp)
+		{
+		case NORMAL :
+		case LBBB :
+		case RBBB :
+		case BBB :
+		case NPC :
+		case APC :
+		case SVPB :
+		case ABERR :
+		case NESC :
+		case AESC :
+		case SVESC :
+			return('N') ;
+		case PVC :
+		case RONT :
+		case VESC :
+			return('V') ;
+		case FUSION :
+			return('F') ;
+		case UNKNOWN :
+		case PACE :
+		case PFUS :
+		case LEARN :
+			return('Q') ;
+		default :
+			return('O') ;
+		}
+	}
+
+void BxbReset(BxbResult *result)
+	{
+	memset(result, 0, sizeof(*result)) ;
+	}
+
+/***************************************************************************
+	BxbCompare() pairs the test annotations with the reference annotations
+	and adds the pairs to the counts in result.  Annotations before start
+	belong to the learning period and are not counted.  Annotations match
+	if they are no more than matchWindow samples apart (150 ms in the
+	standards).  Both arrays must be sorted by time.
+****************************************************************************/
+
+void BxbCompare(BxbResult *result, const BxbAnnotation *ref, int refCount,
+	const BxbAnnotation *test, int testCount, long start, long matchWindow)
+	{
+	BxbStream r, t ;
+
+	memset(&r, 0, sizeof(r)) ;
+	memset(&t, 0, sizeof(t)) ;
+	r.ann = ref ;
+	r.count = refCount ;
+	t.ann = test ;
+	t.count = testCount ;
+
+	// Set r to the first reference annotation after the end of the
+	// learning period, and t to the last test annotation in the
+	// learning period.
+
+	do
+		BxbNext(&r) ;
+	while(r.time < start) ;
+
+	do
+		BxbNext(&t) ;
+	while(t.nextTime < start) ;
+
+	// If t matches the first reference annotation, count it and get the
+	// next annotation from each stream.  Otherwise skip a test annotation
+	// at the very beginning of the test period that has no match.
+
+	if(r.time-t.time < labs(r.time-t.nextTime) && r.time-t.time <= matchWindow)
+		{
+		if(r.label != 0 || t.label != 0)	// False only if start = 0.
+			BxbPair(result, r.label, t.label, r.rr, t.rr) ;
+		BxbNext(&r) ;
+		BxbNext(&t) ;
+		}
+	else
+		{
+		BxbNext(&t) ;
+		if(t.time-start <= matchWindow &&
+			labs(r.time-t.nextTime) < labs(r.time-t.time))
+			BxbNext(&t) ;
+		}
+
+	// Each time through the loop, a beat label pair is counted, and the
+	// annotations that were paired are replaced by the next ones.
+
+	while(r.time != BXB_HUGE_TIME)
+		{
+		if(t.time < r.time)
+			{
+			// Test annotation is earliest.  Pair it with the reference
+			// annotation if that is the best match, or else with an O
+			// pseudo-beat.
+
+			if(r.time-t.time <= matchWindow &&
+				r.time-t.time < labs(r.time-t.nextTime))
+				{
+				BxbPair(result, r.label, t.label, r.rr, t.rr) ;
+				BxbNext(&r) ;
+				BxbNext(&t) ;
+				}
+			else
+				{
+				BxbPair(result, 'O', t.label, r.rr, t.rr) ;
+				BxbNext(&t) ;
+				}
+			}
+		else
+			{
+			// Reference annotation is earliest.
+
+			if(t.time-r.time <= matchWindow &&
+				t.time-r.time < labs(t.time-r.nextTime))
+				{
+				BxbPair(result, r.label, t.label, r.rr, t.rr) ;
+				BxbNext(&t) ;
+				BxbNext(&r) ;
+				}
+			else
+				{
+				BxbPair(result, r.label, 'O', r.rr, t.rr) ;
+				BxbNext(&r) ;
+				}
+			}
+		}
+	}
+
+/***************************************************************************
+	BxbGetStats() calculates the detection statistics that bxbep.c writes
+	to adtstat.txt.  Fusion and unknown beats detected as VEBs are not
+	counted as false positives.
+****************************************************************************/
+
+void BxbGetStats(const BxbResult *result, BxbStats *stats)
+	{
+	int i, j ;
+	const char *labels = BXB_LABELS ;
+
+	memset(stats, 0, sizeof(*stats)) ;
+	for(i = 0; i < BXB_LABEL_COUNT; ++i)
+		for(j = 0; j < BXB_LABEL_COUNT; ++j)
+			{
+			if(labels[i] == 'O' || labels[i] == 'X')
+				{
+				if(labels[j] != 'O' && labels[j] != 'X')
+					stats->qrsFP += result->counts[i][j] ;
+				}
+			else if(labels[j] == 'O' || labels[j] == 'X')
+				stats->qrsFN += result->counts[i][j] ;
+			else
+				stats->qrsTP += result->counts[i][j] ;
+
+			if(labels[i] == 'V')
+				{
+				if(labels[j] == 'V')
+					stats->vebTP += result->counts[i][j] ;
+				else
+					stats->vebFN += result->counts[i][j] ;
+				}
+			else if(labels[j] == 'V' && labels[i] != 'F' && labels[i] != 'Q')
+				stats->vebFP += result->counts[i][j] ;
+			}
+	}
+
+/***************************************************************************
+	BxbNext() moves a stream to its next annotation, as getref() and
+	gettest() in bxbep.c.
+****************************************************************************/
+
+void BxbNext(BxbStream *stream)
+	{
+	long prevTime = stream->time ;
+
+	stream->time = stream->nextTime ;
+	stream->label = stream->nextLabel ;
+
+	if(prevTime == 0 || stream->time == BXB_HUGE_TIME)
+		stream->rr = 0 ;
+	else
+		stream->rr = stream->time - prevTime ;
+
+	if(stream->next < stream->count)
+		{
+		stream->nextTime = stream->ann[stream->next].time ;
+		stream->nextLabel = stream->ann[stream->next].label ;
+		++stream->next ;
+		}
+	else
+		{
+		stream->nextTime = BXB_HUGE_TIME ;
+		stream->nextLabel = '*' ;
+		}
+	}
+
+/***************************************************************************
+	BxbPair() counts a beat label pair.  Labels that are not in BXB_LABELS
+	are not counted, and O or X pseudo-beats are never paired together.
+	The RR interval error is counted in any case, as in bxbep.c.
+****************************************************************************/
+
+void BxbPair(BxbResult *result, int ref, int test, long refRR, long testRR)
+	{
+	const char *r, *t ;
+	double rre ;
+
+	r = (ref != 0) ? strchr(BXB_LABELS, ref) : NULL ;
+	t = (test != 0) ? strchr(BXB_LABELS, test) : NULL ;
+	if(r != NULL && t != NULL &&
+		!((*r == 'O' || *r == 'X') && (*t == 'O' || *t == 'X')))
+		++result->counts[r-BXB_LABELS][t-BXB_LABELS] ;
+
+	// Compute the RR interval error and update the sum of squared errors.
+
+	if(refRR > 0 && testRR > 0)
+		{
+		rre = refRR - testRR ;
+		result->rrSumSquares += rre*rre ;
+		++result->rrCount ;
+		}
+	}
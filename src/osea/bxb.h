@@ -0,0 +1,66 @@
+/*****************************************************************************
+FILE:  bxb.h
+REVISED:	2026
+  ___________________________________________________________________________
+
+bxb.h: Beat-by-beat annotation comparison, adapted from bxbep.c.
+Copyright (C) 2001 George B. Moody
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place - Suite 330, Boston, MA 02111-1307, USA.
+  __________________________________________________________________________
+
+	bxbep.c compares annotation files read with the WFDB library.  The
+	same comparison is done here on annotations held in memory, so that
+	it can be used without WFDB, for example right after a record has
+	been analyzed.
+
+	Annotations are given as AAMI labels (N, S, V, F or Q), which can be
+	obtained from MIT annotation codes with BxbLabel().  Only beat
+	annotations are passed; periods of ventricular fibrillation and
+	shutdown are not handled.
+
+	The counts from several records can be accumulated into the same
+	BxbResult to get gross statistics.
+
+*****************************************************************************/
+
+#ifndef _BXB_H
+#define _BXB_H
+
+#define BXB_LABELS	"NSVFQOX"	// Row and column labels of BxbResult.counts.
+#define BXB_LABEL_COUNT	7
+
+typedef struct _BxbAnnotation {
+	long time ;		// Sample number.
+	int label ;		// AAMI label.
+	} BxbAnnotation ;
+
+typedef struct _BxbResult {
+	long counts[BXB_LABEL_COUNT][BXB_LABEL_COUNT] ;	// [reference][test]
+	long rrCount ;			// Number of RR intervals compared.
+	double rrSumSquares ;	// Sum of squared RR interval errors.
+	} BxbResult ;
+
+typedef struct _BxbStats {
+	long qrsTP, qrsFN, qrsFP ;
+	long vebTP, vebFN, vebFP ;
+	} BxbStats ;
+
+int BxbLabel(int anntyp) ;
+void BxbReset(BxbResult *result) ;
+void BxbCompare(BxbResult *result, const BxbAnnotation *ref, int refCount,
+	const BxbAnnotation *test, int testCount, long start, long matchWindow) ;
+void BxbGetStats(const BxbResult *result, BxbStats *stats) ;
+
+#endif /* _BXB_H */
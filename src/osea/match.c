@@ -39,6 +39,8 @@ is a list of functions that are available for calling by classify.
 							beats scaled to produce the best match.
 	CompareBeats2 -- Measures the difference between two beats without
 							beat scaling.
+	CompareBeatsScalar, CompareBeats2Scalar -- The original versions of
+							the above, used as a reference for testing.
 	NewBeatType -- Start a new beat type with the present beat.
 	BestMorphMatch -- Finds the beat template that best matches a new beat.
 	UpdateBeatType -- Updates existing beat template and associated features
@@ -76,9 +78,14 @@ some level of encapsulation:
 ******************************************************************************/
 #include <stdlib.h>
 #include <stdio.h>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "ecgcodes.h"
 
 #include "bdac.h"
+#include "osea.h"
 #define MATCH_LENGTH	BEAT_MS300	// Number of points used for beat matching.
 #define MATCH_LIMIT	1.2			// Match limit used testing whether two
 											// beat types might be combined.
@@ -92,56 +99,42 @@ some level of encapsulation:
 
 // Local prototypes.
 
-int NoiseCheck(int *beat) ;
 double CompareBeats(int *beat1, int *beat2, int *shiftAdj) ;
 double CompareBeats2(int *beat1, int *beat2, int *shiftAdj) ;
+void ScaledDiffs(int *beat1, double *scaled, long *beatDiff) ;
+int ScaledDiffsSSE2(int *beat1, double *scaled, long *beatDiff) ;
+double BestShift(long *beatDiff, int mag, int *shiftAdj) ;
+int BeatRange(int *beat) ;
 void UpdateBeat(int *aveBeat, int *newBeat, int shift) ;
-void BeatCopy(int srcBeat, int destBeat) ;
-int MinimumBeatVariation(int type) ;
+void BeatCopy(OseaContext *ctx, int srcBeat, int destBeat) ;
+int MinimumBeatVariation(OseaContext *ctx, int type) ;
 
 // External prototypes.
 
 void AnalyzeBeat(int *beat, int *onset, int *offset, int *isoLevel,
 	int *beatBegin, int *beatEnd, int *amp) ;
-void AdjustDomData(int oldType, int newType) ;
-void CombineDomData(int oldType, int newType) ;
+void AdjustDomData(OseaContext *ctx, int oldType, int newType) ;
+void CombineDomData(OseaContext *ctx, int oldType, int newType) ;
 
-// Global variables.
-
-int BeatTemplates[MAXTYPES][BEATLGTH] ;
-int BeatCounts[MAXTYPES] ;
-int BeatWidths[MAXTYPES] ;
-int BeatClassifications[MAXTYPES] ;
-int BeatBegins[MAXTYPES] ;
-int BeatEnds[MAXTYPES] ;
-int BeatsSinceLastMatch[MAXTYPES] ;
-int BeatAmps[MAXTYPES] ;
-int BeatCenters[MAXTYPES] ;
-double MIs[MAXTYPES][8] ;
-
-// Need access to these in postclas.cpp when beat types are combined
-// and moved.
-
-extern int PostClass[MAXTYPES][8] ;
-extern int PCRhythm[MAXTYPES][8] ;
-
-int TypeCount = 0 ;
+// The template matching state is in ctx->match.  The post
+// classifications in ctx->postclas are also moved when beat types
+// are combined.
 
 /***************************************************************************
 ResetMatch() resets static variables involved with template matching.
 ****************************************************************************/
 
-void ResetMatch(void)
+void ResetMatch(OseaContext *ctx)
 	{
 	int i, j ;
-	TypeCount = 0 ;
+	ctx->match.TypeCount = 0 ;
 	for(i = 0; i < MAXTYPES; ++i)
 		{
-		BeatCounts[i] = 0 ;
-		BeatClassifications[i] = UNKNOWN ;
+		ctx->match.BeatCounts[i] = 0 ;
+		ctx->match.BeatClassifications[i] = UNKNOWN ;
 		for(j = 0; j < 8; ++j)
 			{
-			MIs[i][j] = 0 ;
+			ctx->match.MIs[i][j] = 0 ;
 			}
 		}
 	}
@@ -152,12 +145,291 @@ void ResetMatch(void)
 	possible match.  The metric returned is the sum of the absolute
 	differences between beats divided by the amplitude of the beats.  The
 	shift used for the match is returned via the pointer *shiftAdj.
+
+	Beat2 is scaled once for all shifts, and the differences for all
+	shifts are accumulated together, one point at a time, so that the
+	shifts can be calculated in parallel vector lanes.  The result is
+	exactly the same as that of the point-by-point CompareBeatsScalar().
 ***************************************************************************/
 
 #define MATCH_START	(FIDMARK-(MATCH_LENGTH/2))
 #define MATCH_END	(FIDMARK+(MATCH_LENGTH/2))
+#define MATCH_POINTS	(MATCH_END-MATCH_START)		// One less than MATCH_LENGTH.
+#define SHIFT_COUNT	(2*MAX_SHIFT+1)
+#define SCALED_LENGTH	(MATCH_POINTS+2*MAX_SHIFT)
+#define LANE_LIMIT	(1 << 20)	// Largest sample magnitude for 32 bit lanes.
 
 double CompareBeats(int *beat1, int *beat2, int *shiftAdj)
+	{
+	int i, mag1, mag2 ;
+	long beatDiff[SHIFT_COUNT] ;
+	double scaled[SCALED_LENGTH+1], scaleFactor ;
+
+	// Calculate the magnitude of each beat.
+
+	mag1 = BeatRange(beat1) ;
+	mag2 = BeatRange(beat2) ;
+
+	scaleFactor = mag1 ;
+	scaleFactor /= mag2 ;
+
+	// Scale the points of beat2 that are used with any shift.  The
+	// extra point keeps the vector loads of the last shift in bounds.
+
+	for(i = 0; i < SCALED_LENGTH; ++i)
+		{
+		scaled[i] = beat2[MATCH_START-MAX_SHIFT+i] ;
+		scaled[i] *= scaleFactor ;
+		}
+	scaled[SCALED_LENGTH] = 0 ;
+
+	// Calculate the sum of the point-by-point
+	// absolute differences for all possible shifts.
+
+#ifdef __SSE2__
+	if(!ScaledDiffsSSE2(&beat1[MATCH_START], scaled, beatDiff))
+#endif
+		ScaledDiffs(&beat1[MATCH_START], scaled, beatDiff) ;
+
+	// Metric scales inversely with match length.
+	// algorithm was originally tuned with a match
+	// length of 30.
+
+	return(BestShift(beatDiff, 2*mag1, shiftAdj)) ;
+	}
+
+/***************************************************************************
+	ScaledDiffs() calculates the CompareBeats() differences for all shifts
+	in the same order of operations as CompareBeatsScalar().  The loop
+	over the shifts is independent for each shift, so the compiler can
+	vectorize it where the target supports 64 bit lanes.
+****************************************************************************/
+
+void ScaledDiffs(int *beat1, double *scaled, long *beatDiff)
+	{
+	int i, shift ;
+	long meanDiff[SHIFT_COUNT] ;
+	double *p ;
+
+	for(shift = 0; shift < SHIFT_COUNT; ++shift)
+		meanDiff[shift] = 0 ;
+
+	for(i = 0; i < MATCH_POINTS; ++i)
+		{
+		p = &scaled[i] ;
+		for(shift = 0; shift < SHIFT_COUNT; ++shift)
+			meanDiff[shift] += beat1[i] - p[shift] ;
+		}
+
+	for(shift = 0; shift < SHIFT_COUNT; ++shift)
+		{
+		meanDiff[shift] /= MATCH_LENGTH ;
+		beatDiff[shift] = 0 ;
+		}
+
+	for(i = 0; i < MATCH_POINTS; ++i)
+		{
+		p = &scaled[i] ;
+		for(shift = 0; shift < SHIFT_COUNT; ++shift)
+			beatDiff[shift] += abs(beat1[i] - meanDiff[shift] - p[shift]) ;
+		}
+	}
+
+#ifdef __SSE2__
+
+/***************************************************************************
+	ScaledDiffsSSE2() is ScaledDiffs() with two shifts per SSE2 register.
+	The running mean difference is truncated to an integer after every
+	point, as in the scalar code, and the absolute differences are summed
+	in 32 bit lanes.  This is exact as long as the samples are smaller
+	than LANE_LIMIT, which is always the case for real ECG data.  If they
+	are not, 0 is returned and nothing is calculated.
+****************************************************************************/
+
+int ScaledDiffsSSE2(int *beat1, double *scaled, long *beatDiff)
+	{
+	int i, shift, diffs[4] ;
+	double mean[SHIFT_COUNT+1] ;
+	__m128d meanDiff[(SHIFT_COUNT+1)/2], b ;
+	__m128i sum[(SHIFT_COUNT+1)/2], d, sign ;
+
+	for(i = 0; i < MATCH_POINTS; ++i)
+		if(abs(beat1[i]) > LANE_LIMIT)
+			return(0) ;
+	for(i = 0; i < SCALED_LENGTH; ++i)
+		if(!(fabs(scaled[i]) <= LANE_LIMIT))
+			return(0) ;
+
+	for(shift = 0; shift < (SHIFT_COUNT+1)/2; ++shift)
+		meanDiff[shift] = _mm_setzero_pd() ;
+
+	for(i = 0; i < MATCH_POINTS; ++i)
+		{
+		b = _mm_set1_pd(beat1[i]) ;
+		for(shift = 0; shift < (SHIFT_COUNT+1)/2; ++shift)
+			{
+			meanDiff[shift] = _mm_add_pd(meanDiff[shift],
+				_mm_sub_pd(b, _mm_loadu_pd(&scaled[i+2*shift]))) ;
+			meanDiff[shift] = _mm_cvtepi32_pd(_mm_cvttpd_epi32(meanDiff[shift])) ;
+			}
+		}
+
+	for(shift = 0; shift < (SHIFT_COUNT+1)/2; ++shift)
+		_mm_storeu_pd(&mean[2*shift], meanDiff[shift]) ;
+	for(shift = 0; shift < SHIFT_COUNT; ++shift)
+		mean[shift] = (long)mean[shift]/MATCH_LENGTH ;
+	for(shift = 0; shift < (SHIFT_COUNT+1)/2; ++shift)
+		{
+		meanDiff[shift] = _mm_loadu_pd(&mean[2*shift]) ;
+		sum[shift] = _mm_setzero_si128() ;
+		}
+
+	for(i = 0; i < MATCH_POINTS; ++i)
+		{
+		b = _mm_set1_pd(beat1[i]) ;
+		for(shift = 0; shift < (SHIFT_COUNT+1)/2; ++shift)
+			{
+			d = _mm_cvttpd_epi32(_mm_sub_pd(_mm_sub_pd(b, meanDiff[shift]),
+				_mm_loadu_pd(&scaled[i+2*shift]))) ;
+			sign = _mm_srai_epi32(d, 31) ;
+			d = _mm_sub_epi32(_mm_xor_si128(d, sign), sign) ;
+			sum[shift] = _mm_add_epi32(sum[shift], d) ;
+			}
+		}
+
+	for(shift = 0; shift < SHIFT_COUNT; shift += 2)
+		{
+		_mm_storeu_si128((__m128i *)diffs, sum[shift/2]) ;
+		beatDiff[shift] = diffs[0] ;
+		if(shift+1 < SHIFT_COUNT)
+			beatDiff[shift+1] = diffs[1] ;
+		}
+	return(1) ;
+	}
+
+#endif
+
+/***************************************************************************
+	CompareBeats2 is nearly the same as CompareBeats above, but beat2 is
+	not scaled before calculating the match metric.  The match metric is
+	then the sum of the absolute differences divided by the average amplitude
+	of the two beats.
+
+	The sums used for the mean differences are updated from one shift
+	to the next instead of being recalculated.  When the samples are
+	small enough, the absolute differences are summed with int, which
+	the compiler vectorizes with SSE2 or NEON.
+****************************************************************************/
+
+double CompareBeats2(int *beat1, int *beat2, int *shiftAdj)
+	{
+	int i, shift, mag1, mag2, mean, diff, small ;
+	int *p ;
+	long beatDiff[SHIFT_COUNT], meanDiff, sum1, sum2 ;
+
+	// Calculate the magnitude of each beat.
+
+	mag1 = BeatRange(beat1) ;
+	mag2 = BeatRange(beat2) ;
+
+	small = 1 ;
+	for(i = MATCH_START-MAX_SHIFT; i < MATCH_END+MAX_SHIFT; ++i)
+		if(abs(beat1[i]) > LANE_LIMIT || abs(beat2[i]) > LANE_LIMIT)
+			small = 0 ;
+
+	sum1 = sum2 = 0 ;
+	for(i = MATCH_START; i < MATCH_END; ++i)
+		{
+		sum1 += beat1[i] ;
+		sum2 += beat2[i-MAX_SHIFT] ;
+		}
+
+	// Calculate the sum of the point-by-point
+	// absolute differences for all possible shifts.
+
+	for(shift = 0; shift < SHIFT_COUNT; ++shift)
+		{
+		p = &beat2[MATCH_START-MAX_SHIFT+shift] ;
+		if(shift > 0)
+			sum2 += p[MATCH_POINTS-1] - p[-1] ;
+		meanDiff = (sum1 - sum2)/MATCH_LENGTH ;
+
+		if(small)
+			{
+			mean = meanDiff ;
+			diff = 0 ;
+			for(i = 0; i < MATCH_POINTS; ++i)
+				diff += abs(beat1[MATCH_START+i] - mean - p[i]) ;
+			beatDiff[shift] = diff ;
+			}
+		else
+			{
+			beatDiff[shift] = 0 ;
+			for(i = 0; i < MATCH_POINTS; ++i)
+				beatDiff[shift] += abs(beat1[MATCH_START+i] - meanDiff - p[i]) ;
+			}
+		}
+
+	// Metric scales inversely with match length.
+	// algorithm was originally tuned with a match
+	// length of 30.
+
+	return(BestShift(beatDiff, mag1+mag2, shiftAdj)) ;
+	}
+
+/***************************************************************************
+	BestShift() finds the shift with the smallest difference, and returns
+	the difference scaled to a match metric.
+****************************************************************************/
+
+double BestShift(long *beatDiff, int mag, int *shiftAdj)
+	{
+	int shift, minShift ;
+	double metric ;
+
+	minShift = 0 ;
+	for(shift = 1; shift < SHIFT_COUNT; ++shift)
+		if(beatDiff[shift] < beatDiff[minShift])
+			minShift = shift ;
+
+	metric = beatDiff[minShift] ;
+	*shiftAdj = minShift - MAX_SHIFT ;
+	metric /= mag ;
+	metric *= 30 ;
+	metric /= MATCH_LENGTH ;
+	return(metric) ;
+	}
+
+/***************************************************************************
+	BeatRange() returns the difference between the largest and the
+	smallest point of a beat in the matching region.
+****************************************************************************/
+
+int BeatRange(int *beat)
+	{
+	int i, max, min ;
+
+	max = min = beat[MATCH_START] ;
+	for(i = MATCH_START+1; i < MATCH_END; ++i)
+		if(beat[i] > max)
+			max = beat[i] ;
+		else if(beat[i] < min)
+			min = beat[i] ;
+	return(max - min) ;
+	}
+
+/**************************************************************************
+	CompareBeats() takes two beat buffers and compares how well they match
+	point-by-point.  Beat2 is shifted and scaled to produce the closest
+	possible match.  The metric returned is the sum of the absolute
+	differences between beats divided by the amplitude of the beats.  The
+	shift used for the match is returned via the pointer *shiftAdj.
+
+	This is the original point-by-point version of CompareBeats(), kept
+	as a reference for testing and benchmarking the vectorized one.
+***************************************************************************/
+
+double CompareBeatsScalar(int *beat1, int *beat2, int *shiftAdj)
 	{
 	int i, max, min, magSum, shift ;
 	long beatDiff, meanDiff, minDiff, minShift ;
@@ -236,13 +508,15 @@ double CompareBeats(int *beat1, int *beat2, int *shiftAdj)
 	}
 
 /***************************************************************************
-	CompareBeats2 is nearly the same as CompareBeats above, but beat2 is
+	CompareBeats2Scalar() is nearly the same as CompareBeatsScalar() above, but beat2 is
 	not scaled before calculating the match metric.  The match metric is
 	then the sum of the absolute differences divided by the average amplitude
 	of the two beats.
+
+	This is the original version of CompareBeats2(), kept as a reference.
 ****************************************************************************/
 
-double CompareBeats2(int *beat1, int *beat2, int *shiftAdj)
+double CompareBeats2Scalar(int *beat1, int *beat2, int *shiftAdj)
 	{
 	int i, max, min, shift ;
 	int mag1, mag2 ;
@@ -310,6 +584,7 @@ double CompareBeats2(int *beat1, int *beat2, int *shiftAdj)
 	return(metric) ;
 	}
 
+
 /************************************************************************
 UpdateBeat() averages a new beat into an average beat template by adding
 1/8th of the new beat to 7/8ths of the average beat.
@@ -338,9 +613,9 @@ void UpdateBeat(int *aveBeat, int *newBeat, int shift)
 	been detected.
 *******************************************************/
 
-int GetTypesCount(void)
+int GetTypesCount(OseaContext *ctx)
 	{
-	return(TypeCount) ;
+	return(ctx->match.TypeCount) ;
 	}
 
 /********************************************************
@@ -348,18 +623,18 @@ int GetTypesCount(void)
 	a particular type have been detected.
 ********************************************************/
 
-int GetBeatTypeCount(int type)
+int GetBeatTypeCount(OseaContext *ctx, int type)
 	{
-	return(BeatCounts[type]) ;
+	return(ctx->match.BeatCounts[type]) ;
 	}
 
 /*******************************************************
 	GetBeatWidth returns the QRS width estimate for
 	a given type of beat.
 *******************************************************/
-int GetBeatWidth(int type)
+int GetBeatWidth(OseaContext *ctx, int type)
 	{
-	return(BeatWidths[type]) ;
+	return(ctx->match.BeatWidths[type]) ;
 	}
 
 /*******************************************************
@@ -367,9 +642,9 @@ int GetBeatWidth(int type)
 	offset of a beat.
 ********************************************************/
 
-int GetBeatCenter(int type)
+int GetBeatCenter(OseaContext *ctx, int type)
 	{
-	return(BeatCenters[type]) ;
+	return(ctx->match.BeatCenters[type]) ;
 	}
 
 /*******************************************************
@@ -377,11 +652,11 @@ int GetBeatCenter(int type)
 	a given beat type (NORMAL, PVC, or UNKNOWN).
 ********************************************************/
 
-int GetBeatClass(int type)
+int GetBeatClass(OseaContext *ctx, int type)
 	{
 	if(type == MAXTYPES)
 		return(UNKNOWN) ;
-	return(BeatClassifications[type]) ;
+	return(ctx->match.BeatClassifications[type]) ;
 	}
 
 /******************************************************
@@ -389,9 +664,9 @@ int GetBeatClass(int type)
 	given type.
 ******************************************************/
 
-void SetBeatClass(int type, int beatClass)
+void SetBeatClass(OseaContext *ctx, int type, int beatClass)
 	{
-	BeatClassifications[type] = beatClass ;
+	ctx->match.BeatClassifications[type] = beatClass ;
 	}
 
 /******************************************************************************
@@ -399,35 +674,35 @@ void SetBeatClass(int type, int beatClass)
 	features as the next available beat type.
 ******************************************************************************/
 
-int NewBeatType(int *newBeat )
+int NewBeatType(OseaContext *ctx, int *newBeat )
 	{
 	int i, onset, offset, isoLevel, beatBegin, beatEnd ;
 	int mcType, amp ;
 
 	// Update count of beats since each template was matched.
 
-	for(i = 0; i < TypeCount; ++i)
-		++BeatsSinceLastMatch[i] ;
+	for(i = 0; i < ctx->match.TypeCount; ++i)
+		++ctx->match.BeatsSinceLastMatch[i] ;
 
-	if(TypeCount < MAXTYPES)
+	if(ctx->match.TypeCount < MAXTYPES)
 		{
 		for(i = 0; i < BEATLGTH; ++i)
-			BeatTemplates[TypeCount][i] = newBeat[i] ;
+			ctx->match.BeatTemplates[ctx->match.TypeCount][i] = newBeat[i] ;
 
-		BeatCounts[TypeCount] = 1 ;
-		BeatClassifications[TypeCount] = UNKNOWN ;
-		AnalyzeBeat(&BeatTemplates[TypeCount][0],&onset,&offset, &isoLevel,
+		ctx->match.BeatCounts[ctx->match.TypeCount] = 1 ;
+		ctx->match.BeatClassifications[ctx->match.TypeCount] = UNKNOWN ;
+		AnalyzeBeat(&ctx->match.BeatTemplates[ctx->match.TypeCount][0],&onset,&offset, &isoLevel,
 			&beatBegin, &beatEnd, &amp) ;
-		BeatWidths[TypeCount] = offset-onset ;
-		BeatCenters[TypeCount] = (offset+onset)/2 ;
-		BeatBegins[TypeCount] = beatBegin ;
-		BeatEnds[TypeCount] = beatEnd ;
-		BeatAmps[TypeCount] = amp ;
+		ctx->match.BeatWidths[ctx->match.TypeCount] = offset-onset ;
+		ctx->match.BeatCenters[ctx->match.TypeCount] = (offset+onset)/2 ;
+		ctx->match.BeatBegins[ctx->match.TypeCount] = beatBegin ;
+		ctx->match.BeatEnds[ctx->match.TypeCount] = beatEnd ;
+		ctx->match.BeatAmps[ctx->match.TypeCount] = amp ;
 
-		BeatsSinceLastMatch[TypeCount] = 0 ;
+		ctx->match.BeatsSinceLastMatch[ctx->match.TypeCount] = 0 ;
 
-		++TypeCount ;
-		return(TypeCount-1) ;
+		++ctx->match.TypeCount ;
+		return(ctx->match.TypeCount-1) ;
 		}
 
 	// If we have used all the template space, replace the beat
@@ -444,34 +719,34 @@ int NewBeatType(int *newBeat )
 			{
 			mcType = 0 ;
 			for(i = 1; i < MAXTYPES; ++i)
-				if(BeatCounts[i] < BeatCounts[mcType])
+				if(ctx->match.BeatCounts[i] < ctx->match.BeatCounts[mcType])
 					mcType = i ;
-				else if(BeatCounts[i] == BeatCounts[mcType])
+				else if(ctx->match.BeatCounts[i] == ctx->match.BeatCounts[mcType])
 					{
-					if(BeatsSinceLastMatch[i] > BeatsSinceLastMatch[mcType])
+					if(ctx->match.BeatsSinceLastMatch[i] > ctx->match.BeatsSinceLastMatch[mcType])
 						mcType = i ;
 					}
 			}
 
 		// Adjust dominant beat monitor data.
 
-		AdjustDomData(mcType,MAXTYPES) ;
+		AdjustDomData(ctx, mcType,MAXTYPES) ;
 
 		// Substitute this beat.
 
 		for(i = 0; i < BEATLGTH; ++i)
-			BeatTemplates[mcType][i] = newBeat[i] ;
+			ctx->match.BeatTemplates[mcType][i] = newBeat[i] ;
 
-		BeatCounts[mcType] = 1 ;
-		BeatClassifications[mcType] = UNKNOWN ;
-		AnalyzeBeat(&BeatTemplates[mcType][0],&onset,&offset, &isoLevel,
+		ctx->match.BeatCounts[mcType] = 1 ;
+		ctx->match.BeatClassifications[mcType] = UNKNOWN ;
+		AnalyzeBeat(&ctx->match.BeatTemplates[mcType][0],&onset,&offset, &isoLevel,
 			&beatBegin, &beatEnd, &amp) ;
-		BeatWidths[mcType] = offset-onset ;
-		BeatCenters[mcType] = (offset+onset)/2 ;
-		BeatBegins[mcType] = beatBegin ;
-		BeatEnds[mcType] = beatEnd ;
-		BeatsSinceLastMatch[mcType] = 0 ;
-      BeatAmps[mcType] = amp ;
+		ctx->match.BeatWidths[mcType] = offset-onset ;
+		ctx->match.BeatCenters[mcType] = (offset+onset)/2 ;
+		ctx->match.BeatBegins[mcType] = beatBegin ;
+		ctx->match.BeatEnds[mcType] = beatEnd ;
+		ctx->match.BeatsSinceLastMatch[mcType] = 0 ;
+      ctx->match.BeatAmps[mcType] = amp ;
 		return(mcType) ;
 		}
 	}
@@ -482,7 +757,7 @@ int NewBeatType(int *newBeat )
 	metric for that type, and the shift used for that match.
 ***************************************************************************/
 
-void BestMorphMatch(int *newBeat,int *matchType,double *matchIndex, double *mi2,
+void BestMorphMatch(OseaContext *ctx, int *newBeat,int *matchType,double *matchIndex, double *mi2,
 	int *shiftAdj)
 	{
 	int type, i, bestMatch, nextBest, minShift, shift, temp ;
@@ -490,7 +765,7 @@ void BestMorphMatch(int *newBeat,int *matchType,double *matchIndex, double *mi2,
 	double bestDiff2, nextDiff2;
 	double beatDiff, minDiff, nextDiff=10000 ;
 
-	if(TypeCount == 0)
+	if(ctx->match.TypeCount == 0)
 		{
 		*matchType = 0 ;
 		*matchIndex = 1000 ;		// Make sure there is no match so a new beat is
@@ -501,9 +776,9 @@ void BestMorphMatch(int *newBeat,int *matchType,double *matchIndex, double *mi2,
 	// Compare the new beat to all type beat
 	// types that have been saved.
 
-	for(type = 0; type < TypeCount; ++type)
+	for(type = 0; type < ctx->match.TypeCount; ++type)
 		{
-		beatDiff = CompareBeats(&BeatTemplates[type][0],newBeat,&shift) ;
+		beatDiff = CompareBeats(&ctx->match.BeatTemplates[type][0],newBeat,&shift) ;
 		if(type == 0)
 			{
 			bestMatch = 0 ;
@@ -518,7 +793,7 @@ void BestMorphMatch(int *newBeat,int *matchType,double *matchIndex, double *mi2,
 			minDiff = beatDiff ;
 			minShift = shift ;
 			}
-		else if((TypeCount > 1) && (type == 1))
+		else if((ctx->match.TypeCount > 1) && (type == 1))
 			{
 			nextBest = type ;
 			nextDiff = beatDiff ;
@@ -535,12 +810,12 @@ void BestMorphMatch(int *newBeat,int *matchType,double *matchIndex, double *mi2,
 	// is the best match when no scaling is used.
 	// Then check whether the two close types can be combined.
 
-	if((minDiff < MATCH_LIMIT) && (nextDiff < MATCH_LIMIT) && (TypeCount > 1))
+	if((minDiff < MATCH_LIMIT) && (nextDiff < MATCH_LIMIT) && (ctx->match.TypeCount > 1))
 		{
 		// Compare without scaling.
 
-		bestDiff2 = CompareBeats2(&BeatTemplates[bestMatch][0],newBeat,&bestShift2) ;
-		nextDiff2 = CompareBeats2(&BeatTemplates[nextBest][0],newBeat,&nextShift2) ;
+		bestDiff2 = CompareBeats2(&ctx->match.BeatTemplates[bestMatch][0],newBeat,&bestShift2) ;
+		nextDiff2 = CompareBeats2(&ctx->match.BeatTemplates[nextBest][0],newBeat,&nextShift2) ;
 		if(nextDiff2 < bestDiff2)
 			{
 			temp = bestMatch ;
@@ -554,10 +829,10 @@ void BestMorphMatch(int *newBeat,int *matchType,double *matchIndex, double *mi2,
 			}
 		else *mi2 = nextDiff2 ;
 
-		beatDiff = CompareBeats(&BeatTemplates[bestMatch][0],&BeatTemplates[nextBest][0],&shift) ;
+		beatDiff = CompareBeats(&ctx->match.BeatTemplates[bestMatch][0],&ctx->match.BeatTemplates[nextBest][0],&shift) ;
 
 		if((beatDiff < COMBINE_LIMIT) &&
-			((*mi2 < 1.0) || (!MinimumBeatVariation(nextBest))))
+			((*mi2 < 1.0) || (!MinimumBeatVariation(ctx, nextBest))))
 			{
 
 			// Combine beats into bestMatch
@@ -568,24 +843,24 @@ void BestMorphMatch(int *newBeat,int *matchType,double *matchIndex, double *mi2,
 					{
 					if((i+shift > 0) && (i + shift < BEATLGTH))
 						{
-						BeatTemplates[bestMatch][i] += BeatTemplates[nextBest][i+shift] ;
-						BeatTemplates[bestMatch][i] >>= 1 ;
+						ctx->match.BeatTemplates[bestMatch][i] += ctx->match.BeatTemplates[nextBest][i+shift] ;
+						ctx->match.BeatTemplates[bestMatch][i] >>= 1 ;
 						}
 					}
 
-				if((BeatClassifications[bestMatch] == NORMAL) || (BeatClassifications[nextBest] == NORMAL))
-					BeatClassifications[bestMatch] = NORMAL ;
-				else if((BeatClassifications[bestMatch] == PVC) || (BeatClassifications[nextBest] == PVC))
-					BeatClassifications[bestMatch] = PVC ;
+				if((ctx->match.BeatClassifications[bestMatch] == NORMAL) || (ctx->match.BeatClassifications[nextBest] == NORMAL))
+					ctx->match.BeatClassifications[bestMatch] = NORMAL ;
+				else if((ctx->match.BeatClassifications[bestMatch] == PVC) || (ctx->match.BeatClassifications[nextBest] == PVC))
+					ctx->match.BeatClassifications[bestMatch] = PVC ;
 
-				BeatCounts[bestMatch] += BeatCounts[nextBest] ;
+				ctx->match.BeatCounts[bestMatch] += ctx->match.BeatCounts[nextBest] ;
 
-				CombineDomData(nextBest,bestMatch) ;
+				CombineDomData(ctx, nextBest,bestMatch) ;
 
 				// Shift other templates over.
 
-				for(type = nextBest; type < TypeCount-1; ++type)
-					BeatCopy(type+1,type) ;
+				for(type = nextBest; type < ctx->match.TypeCount-1; ++type)
+					BeatCopy(ctx, type+1,type) ;
 
 				}
 
@@ -595,32 +870,32 @@ void BestMorphMatch(int *newBeat,int *matchType,double *matchIndex, double *mi2,
 				{
 				for(i = 0; i < BEATLGTH; ++i)
 					{
-					BeatTemplates[nextBest][i] += BeatTemplates[bestMatch][i] ;
-					BeatTemplates[nextBest][i] >>= 1 ;
+					ctx->match.BeatTemplates[nextBest][i] += ctx->match.BeatTemplates[bestMatch][i] ;
+					ctx->match.BeatTemplates[nextBest][i] >>= 1 ;
 					}
 
-				if((BeatClassifications[bestMatch] == NORMAL) || (BeatClassifications[nextBest] == NORMAL))
-					BeatClassifications[nextBest] = NORMAL ;
-				else if((BeatClassifications[bestMatch] == PVC) || (BeatClassifications[nextBest] == PVC))
-					BeatClassifications[nextBest] = PVC ;
+				if((ctx->match.BeatClassifications[bestMatch] == NORMAL) || (ctx->match.BeatClassifications[nextBest] == NORMAL))
+					ctx->match.BeatClassifications[nextBest] = NORMAL ;
+				else if((ctx->match.BeatClassifications[bestMatch] == PVC) || (ctx->match.BeatClassifications[nextBest] == PVC))
+					ctx->match.BeatClassifications[nextBest] = PVC ;
 
-				BeatCounts[nextBest] += BeatCounts[bestMatch] ;
+				ctx->match.BeatCounts[nextBest] += ctx->match.BeatCounts[bestMatch] ;
 
-				CombineDomData(bestMatch,nextBest) ;
+				CombineDomData(ctx, bestMatch,nextBest) ;
 
 				// Shift other templates over.
 
-				for(type = bestMatch; type < TypeCount-1; ++type)
-					BeatCopy(type+1,type) ;
+				for(type = bestMatch; type < ctx->match.TypeCount-1; ++type)
+					BeatCopy(ctx, type+1,type) ;
 
 
 				bestMatch = nextBest ;
 				}
-			--TypeCount ;
-			BeatClassifications[TypeCount] = UNKNOWN ;
+			--ctx->match.TypeCount ;
+			ctx->match.BeatClassifications[ctx->match.TypeCount] = UNKNOWN ;
 			}
 		}
-	*mi2 = CompareBeats2(&BeatTemplates[bestMatch][0],newBeat,&bestShift2) ;
+	*mi2 = CompareBeats2(&ctx->match.BeatTemplates[bestMatch][0],newBeat,&bestShift2) ;
 	*matchType = bestMatch ;
 	*matchIndex = minDiff ;
 	*shiftAdj = minShift ;
@@ -631,7 +906,7 @@ void BestMorphMatch(int *newBeat,int *matchType,double *matchIndex, double *mi2,
 	using a new beat.
 ***************************************************************************/
 
-void UpdateBeatType(int matchType,int *newBeat, double mi2,
+void UpdateBeatType(OseaContext *ctx, int matchType,int *newBeat, double mi2,
 	 int shiftAdj)
 	{
 	int i,onset,offset, isoLevel, beatBegin, beatEnd ;
@@ -639,44 +914,44 @@ void UpdateBeatType(int matchType,int *newBeat, double mi2,
 
 	// Update beats since templates were matched.
 
-	for(i = 0; i < TypeCount; ++i)
+	for(i = 0; i < ctx->match.TypeCount; ++i)
 		{
 		if(i != matchType)
-			++BeatsSinceLastMatch[i] ;
-		else BeatsSinceLastMatch[i] = 0 ;
+			++ctx->match.BeatsSinceLastMatch[i] ;
+		else ctx->match.BeatsSinceLastMatch[i] = 0 ;
 		}
 
 	// If this is only the second beat, average it with the existing
 	// template.
 
-	if(BeatCounts[matchType] == 1)
+	if(ctx->match.BeatCounts[matchType] == 1)
 		for(i = 0; i < BEATLGTH; ++i)
 			{
 			if((i+shiftAdj >= 0) && (i+shiftAdj < BEATLGTH))
-				BeatTemplates[matchType][i] = (BeatTemplates[matchType][i] + newBeat[i+shiftAdj])>>1 ;
+				ctx->match.BeatTemplates[matchType][i] = (ctx->match.BeatTemplates[matchType][i] + newBeat[i+shiftAdj])>>1 ;
 			}
 
 	// Otherwise do a normal update.
 
 	else
-		UpdateBeat(&BeatTemplates[matchType][0], newBeat, shiftAdj) ;
+		UpdateBeat(&ctx->match.BeatTemplates[matchType][0], newBeat, shiftAdj) ;
 
 	// Determine beat features for the new average beat.
 
-	AnalyzeBeat(&BeatTemplates[matchType][0],&onset,&offset,&isoLevel,
+	AnalyzeBeat(&ctx->match.BeatTemplates[matchType][0],&onset,&offset,&isoLevel,
 		&beatBegin, &beatEnd, &amp) ;
 
-	BeatWidths[matchType] = offset-onset ;
-	BeatCenters[matchType] = (offset+onset)/2 ;
-	BeatBegins[matchType] = beatBegin ;
-	BeatEnds[matchType] = beatEnd ;
-	BeatAmps[matchType] = amp ;
+	ctx->match.BeatWidths[matchType] = offset-onset ;
+	ctx->match.BeatCenters[matchType] = (offset+onset)/2 ;
+	ctx->match.BeatBegins[matchType] = beatBegin ;
+	ctx->match.BeatEnds[matchType] = beatEnd ;
+	ctx->match.BeatAmps[matchType] = amp ;
 
-	++BeatCounts[matchType] ;
+	++ctx->match.BeatCounts[matchType] ;
 
 	for(i = MAXPREV-1; i > 0; --i)
-		MIs[matchType][i] = MIs[matchType][i-1] ;
-	MIs[matchType][0] = mi2 ;
+		ctx->match.MIs[matchType][i] = ctx->match.MIs[matchType][i-1] ;
+	ctx->match.MIs[matchType][0] = mi2 ;
 
 	}
 
@@ -686,17 +961,17 @@ void UpdateBeatType(int matchType,int *newBeat, double mi2,
 	frequently.
 ****************************************************************************/
 
-int GetDominantType(void)
+int GetDominantType(OseaContext *ctx)
 	{
 	int maxCount = 0, maxType = -1 ;
 	int type, totalCount ;
 
 	for(type = 0; type < MAXTYPES; ++type)
 		{
-		if((BeatClassifications[type] == NORMAL) && (BeatCounts[type] > maxCount))
+		if((ctx->match.BeatClassifications[type] == NORMAL) && (ctx->match.BeatCounts[type] > maxCount))
 			{
 			maxType = type ;
-			maxCount = BeatCounts[type] ;
+			maxCount = ctx->match.BeatCounts[type] ;
 			}
 		}
 
@@ -705,14 +980,14 @@ int GetDominantType(void)
 
 	if(maxType == -1)
 		{
-		for(type = 0, totalCount = 0; type < TypeCount; ++type)
-			totalCount += BeatCounts[type] ;
+		for(type = 0, totalCount = 0; type < ctx->match.TypeCount; ++type)
+			totalCount += ctx->match.BeatCounts[type] ;
 		if(totalCount > 300)
-			for(type = 0; type < TypeCount; ++type)
-				if(BeatCounts[type] > maxCount)
+			for(type = 0; type < ctx->match.TypeCount; ++type)
+				if(ctx->match.BeatCounts[type] > maxCount)
 					{
 					maxType = type ;
-					maxCount = BeatCounts[type] ;
+					maxCount = ctx->match.BeatCounts[type] ;
 					}
 		}
 
@@ -724,10 +999,10 @@ int GetDominantType(void)
 	ClearLastNewType removes the last new type that was initiated
 ************************************************************************/
 
-void ClearLastNewType(void)
+void ClearLastNewType(OseaContext *ctx)
 	{
-	if(TypeCount != 0)
-		--TypeCount ;
+	if(ctx->match.TypeCount != 0)
+		--ctx->match.TypeCount ;
 	}
 
 /****************************************************************
@@ -735,9 +1010,9 @@ void ClearLastNewType(void)
 	beginning of the beat (P-wave onset if a P-wave is found).
 *****************************************************************/
 
-int GetBeatBegin(int type)
+int GetBeatBegin(OseaContext *ctx, int type)
 	{
-	return(BeatBegins[type]) ;
+	return(ctx->match.BeatBegins[type]) ;
 	}
 
 /****************************************************************
@@ -745,14 +1020,14 @@ int GetBeatBegin(int type)
 	a beat (T-wave offset).
 *****************************************************************/
 
-int GetBeatEnd(int type)
+int GetBeatEnd(OseaContext *ctx, int type)
 	{
-	return(BeatEnds[type]) ;
+	return(ctx->match.BeatEnds[type]) ;
 	}
 
-int GetBeatAmp(int type)
+int GetBeatAmp(OseaContext *ctx, int type)
 	{
-	return(BeatAmps[type]) ;
+	return(ctx->match.BeatAmps[type]) ;
 	}
 
 
@@ -762,16 +1037,16 @@ int GetBeatAmp(int type)
 	normal type.
 ************************************************************************/
 
-double DomCompare2(int *newBeat, int domType)
+double DomCompare2(OseaContext *ctx, int *newBeat, int domType)
 	{
 	int shift ;
-	return(CompareBeats2(&BeatTemplates[domType][0],newBeat,&shift)) ;
+	return(CompareBeats2(&ctx->match.BeatTemplates[domType][0],newBeat,&shift)) ;
 	}
 
-double DomCompare(int newType, int domType)
+double DomCompare(OseaContext *ctx, int newType, int domType)
 	{
 	int shift ;
-	return(CompareBeats2(&BeatTemplates[domType][0],&BeatTemplates[newType][0],
+	return(CompareBeats2(&ctx->match.BeatTemplates[domType][0],&ctx->match.BeatTemplates[newType][0],
 		&shift)) ;
 	}
 
@@ -779,35 +1054,35 @@ double DomCompare(int newType, int domType)
 BeatCopy copies beat data from a source beat to a destination beat.
 *************************************************************************/
 
-void BeatCopy(int srcBeat, int destBeat)
+void BeatCopy(OseaContext *ctx, int srcBeat, int destBeat)
 	{
 	int i ;
 
 	// Copy template.
 
 	for(i = 0; i < BEATLGTH; ++i)
-		BeatTemplates[destBeat][i] = BeatTemplates[srcBeat][i] ;
+		ctx->match.BeatTemplates[destBeat][i] = ctx->match.BeatTemplates[srcBeat][i] ;
 
 	// Move feature information.
 
-	BeatCounts[destBeat] = BeatCounts[srcBeat] ;
-	BeatWidths[destBeat] = BeatWidths[srcBeat] ;
-	BeatCenters[destBeat] = BeatCenters[srcBeat] ;
+	ctx->match.BeatCounts[destBeat] = ctx->match.BeatCounts[srcBeat] ;
+	ctx->match.BeatWidths[destBeat] = ctx->match.BeatWidths[srcBeat] ;
+	ctx->match.BeatCenters[destBeat] = ctx->match.BeatCenters[srcBeat] ;
 	for(i = 0; i < MAXPREV; ++i)
 		{
-		PostClass[destBeat][i] = PostClass[srcBeat][i] ;
-		PCRhythm[destBeat][i] = PCRhythm[srcBeat][i] ;
+		ctx->postclas.PostClass[destBeat][i] = ctx->postclas.PostClass[srcBeat][i] ;
+		ctx->postclas.PCRhythm[destBeat][i] = ctx->postclas.PCRhythm[srcBeat][i] ;
 		}
 
-	BeatClassifications[destBeat] = BeatClassifications[srcBeat] ;
-	BeatBegins[destBeat] = BeatBegins[srcBeat] ;
-	BeatEnds[destBeat] = BeatBegins[srcBeat] ;
-	BeatsSinceLastMatch[destBeat] = BeatsSinceLastMatch[srcBeat];
-	BeatAmps[destBeat] = BeatAmps[srcBeat] ;
+	ctx->match.BeatClassifications[destBeat] = ctx->match.BeatClassifications[srcBeat] ;
+	ctx->match.BeatBegins[destBeat] = ctx->match.BeatBegins[srcBeat] ;
+	ctx->match.BeatEnds[destBeat] = ctx->match.BeatBegins[srcBeat] ;
+	ctx->match.BeatsSinceLastMatch[destBeat] = ctx->match.BeatsSinceLastMatch[srcBeat];
+	ctx->match.BeatAmps[destBeat] = ctx->match.BeatAmps[srcBeat] ;
 
 	// Adjust data in dominant beat monitor.
 
-	AdjustDomData(srcBeat,destBeat) ;
+	AdjustDomData(ctx, srcBeat,destBeat) ;
 	}
 
 /********************************************************************
@@ -815,11 +1090,11 @@ void BeatCopy(int srcBeat, int destBeat)
 	have all had similarity indexes less than 0.5.
 *********************************************************************/
 
-int MinimumBeatVariation(int type)
+int MinimumBeatVariation(OseaContext *ctx, int type)
 	{
 	int i ;
 	for(i = 0; i < MAXTYPES; ++i)
-		if(MIs[type][i] > 0.5)
+		if(ctx->match.MIs[type][i] > 0.5)
 			i = MAXTYPES+2 ;
 	if(i == MAXTYPES)
 		return(1) ;
@@ -833,17 +1108,17 @@ int MinimumBeatVariation(int type)
 
 #define WIDE_VAR_LIMIT	0.50
 
-int WideBeatVariation(int type)
+int WideBeatVariation(OseaContext *ctx, int type)
 	{
 	int i, n ;
 	double aveMI ;
 
-	n = BeatCounts[type] ;
+	n = ctx->match.BeatCounts[type] ;
 	if(n > 8)
 		n = 8 ;
 
 	for(i = 0, aveMI = 0; i <n; ++i)
-		aveMI += MIs[type][i] ;
+		aveMI += ctx->match.MIs[type][i] ;
 
 	aveMI /= n ;
 	if(aveMI > WIDE_VAR_LIMIT)
@@ -34,21 +34,16 @@ This file contains functions for evaluating the noise content of a beat.
 
 #include <stdlib.h>
 #include "qrsdet.h"
-
-#define NB_LENGTH	MS1500
-#define NS_LENGTH	MS50
-
-int NoiseBuffer[NB_LENGTH], NBPtr = 0 ;
-int NoiseEstimate ;
+#include "osea.h"
 
 /************************************************************************
 	GetNoiseEstimate() allows external access the present noise estimate.
 	this function is only used for debugging.
 *************************************************************************/
 
-int GetNoiseEstimate()
+int GetNoiseEstimate(OseaContext *ctx)
 	{
-	return(NoiseEstimate) ;
+	return(ctx->noisechk.NoiseEstimate) ;
 	}
 
 /***********************************************************************
@@ -72,23 +67,23 @@ int GetNoiseEstimate()
 
 ***********************************************************************/
 
-int NoiseCheck(int datum, int delay, int RR, int beatBegin, int beatEnd)
+int NoiseCheck(OseaContext *ctx, int datum, int delay, int RR, int beatBegin, int beatEnd)
 	{
 	int ptr, i;
 	int ncStart, ncEnd, ncMax, ncMin ;
 	double noiseIndex ;
 
-	NoiseBuffer[NBPtr] = datum ;
-	if(++NBPtr == NB_LENGTH)
-		NBPtr = 0 ;
+	ctx->noisechk.NoiseBuffer[ctx->noisechk.NBPtr] = datum ;
+	if(++ctx->noisechk.NBPtr == ctx->rate.ms1500)
+		ctx->noisechk.NBPtr = 0 ;
 
 	// Check for noise in region that is 300 ms following
 	// last R-wave and 250 ms preceding present R-wave.
 
 	ncStart = delay+RR-beatEnd ;	// Calculate offset to end of previous beat.
 	ncEnd = delay+beatBegin ;		// Calculate offset to beginning of this beat.
-	if(ncStart > ncEnd + MS250)
-		ncStart = ncEnd + MS250 ;
+	if(ncStart > ncEnd + ctx->rate.ms250)
+		ncStart = ncEnd + ctx->rate.ms250 ;
 
 
 	// Estimate noise if delay indicates a beat has been detected,
@@ -96,24 +91,24 @@ int NoiseCheck(int datum, int delay, int RR, int beatBegin, int beatEnd)
 	// some space between the end of the last beat and the beginning
 	// of this beat.
 
-	if((delay != 0) && (ncStart < NB_LENGTH) && (ncStart > ncEnd))
+	if((delay != 0) && (ncStart < ctx->rate.ms1500) && (ncStart > ncEnd))
 		{
 
-		ptr = NBPtr - ncStart ;	// Find index to end of last beat in
+		ptr = ctx->noisechk.NBPtr - ncStart ;	// Find index to end of last beat in
 		if(ptr < 0)					// the circular buffer.
-			ptr += NB_LENGTH ;
+			ptr += ctx->rate.ms1500 ;
 
 		// Find the maximum and minimum values in the
 		// isoelectric region between beats.
 
-		ncMax = ncMin = NoiseBuffer[ptr] ;
+		ncMax = ncMin = ctx->noisechk.NoiseBuffer[ptr] ;
 		for(i = 0; i < ncStart-ncEnd; ++i)
 			{
-			if(NoiseBuffer[ptr] > ncMax)
-				ncMax = NoiseBuffer[ptr] ;
-			else if(NoiseBuffer[ptr] < ncMin)
-				ncMin = NoiseBuffer[ptr] ;
-			if(++ptr == NB_LENGTH)
+			if(ctx->noisechk.NoiseBuffer[ptr] > ncMax)
+				ncMax = ctx->noisechk.NoiseBuffer[ptr] ;
+			else if(ctx->noisechk.NoiseBuffer[ptr] < ncMin)
+				ncMin = ctx->noisechk.NoiseBuffer[ptr] ;
+			if(++ptr == ctx->rate.ms1500)
 				ptr = 0 ;
 			}
 
@@ -122,10 +117,10 @@ int NoiseCheck(int datum, int delay, int RR, int beatBegin, int beatEnd)
 
 		noiseIndex = (ncMax-ncMin) ;
 		noiseIndex /= (ncStart-ncEnd) ;
-		NoiseEstimate = noiseIndex * 10 ;
+		ctx->noisechk.NoiseEstimate = noiseIndex * 10 ;
 		}
 	else
-		NoiseEstimate = 0 ;
-	return(NoiseEstimate) ;
+		ctx->noisechk.NoiseEstimate = 0 ;
+	return(ctx->noisechk.NoiseEstimate) ;
 	}
 
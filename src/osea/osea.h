@@ -0,0 +1,235 @@
+/*****************************************************************************
+FILE:  osea.h
+REVISED:	2026
+  ___________________________________________________________________________
+
+osea.h: State of one beat detector and classifier instance.
+
+This file is free software; you can redistribute it and/or modify it under
+the terms of the GNU Library General Public License as published by the Free
+Software Foundation; either version 2 of the License, or (at your option) any
+later version.
+
+This software is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU Library General Public License for more
+details.
+
+You should have received a copy of the GNU Library General Public License along
+with this library; if not, write to the Free Software Foundation, Inc., 59
+Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  __________________________________________________________________________
+
+	The original OSEA functions kept their state in global and static
+	variables, which allowed only one ECG stream to be analyzed at a time.
+	All of that state is collected here into an OseaContext, which is
+	passed as the first parameter to every function that needs it.
+	Separate contexts are completely independent, so several streams can
+	be analyzed in parallel in separate threads.
+
+	The sample rate of the ECG is also kept in the context.  Any rate
+	from MIN_SAMPLE_RATE to MAX_SAMPLE_RATE (qrsdet.h) can be used; the
+	buffers are sized for the highest one.
+
+	Usage:
+
+		OseaContext *ctx = OseaCreate(300) ;
+		...
+		delay = BeatDetectAndClassify(ctx, sample, &beatType, &beatMatch) ;
+		...
+		beatCount = BeatDetectAndClassifyBlock(ctx, samples, n, beats) ;
+		...
+		OseaDestroy(ctx) ;
+
+	A context can also be embedded in another struct and initialized
+	with OseaInit(), which is also used to change the sample rate.
+
+*****************************************************************************/
+
+#ifndef _OSEA_H
+#define _OSEA_H
+
+#include "qrsdet.h"
+#include "bdac.h"
+
+#define OSEA_MS(ms)	(((ms)*MAX_SAMPLE_RATE + 999)/1000)
+
+#define ECG_BUFFER_LENGTH	OSEA_MS(3400)	// Should be long enough for a beat
+											// plus extra space to accommodate
+											// the maximum detection delay.
+#define BEAT_QUE_LENGTH	10			// Length of que for beats awaiting
+											// classification.  Because of
+											// detection delays, Multiple beats
+											// can occur before there is enough data
+											// to classify the first beat in the que.
+
+// The lengths of the filter and delay buffers depend on the sample rate.
+// These are upper bounds at MAX_SAMPLE_RATE, used as the buffer sizes;
+// the buffers still wrap at the exact lengths kept in OseaRate.
+
+#define DERIV_SIZE	OSEA_MS(10)
+#define LPBUFFER_SIZE	(2*OSEA_MS(25))
+#define HPBUFFER_SIZE	OSEA_MS(125)
+#define WINDOW_SIZE	OSEA_MS(80)
+#define DDBUFFER_SIZE	(WINDOW_SIZE + DERIV_SIZE + LPBUFFER_SIZE \
+								+ HPBUFFER_SIZE + OSEA_MS(200) + OSEA_MS(100))
+#define NBUFFER_SIZE	OSEA_MS(1500)
+#define OSEA_BLOCK_LENGTH	256	// Samples filtered at a time by QRSFilterBlock().
+#define DM_BUFFER_LENGTH	180		// Length of the dominant monitor buffers.
+#define RBB_LENGTH	8				// Length of the RR interval buffer.
+
+// Sample rate dependent constants, set by OseaInit().  MSxxx is the
+// number of samples in xxx ms.
+
+typedef struct _OseaRate {
+	int sampleRate ;
+	int ms80, ms95, ms150, ms220, ms250, ms300, ms360 ;
+	int ms1000, ms1500 ;
+	int derivLength, lpBufferLgth, hpBufferLgth, windowWidth ;
+	int preBlank ;		// MS200
+	int filterDelay ;	// Filter delays plus 200 ms blanking delay.
+	int derDelay ;		// windowWidth + filterDelay + MS100
+	} OseaRate ;
+
+// qrsfilt.c
+
+typedef struct _OseaLPFilt {
+	long y1, y2 ;
+	int data[LPBUFFER_SIZE], ptr ;
+	} OseaLPFilt ;
+
+typedef struct _OseaHPFilt {
+	long y ;
+	int data[HPBUFFER_SIZE], ptr ;
+	} OseaHPFilt ;
+
+typedef struct _OseaDeriv {
+	int derBuff[DERIV_SIZE], derI ;
+	} OseaDeriv ;
+
+typedef struct _OseaMvwInt {
+	long sum ;
+	int data[WINDOW_SIZE], ptr ;
+	} OseaMvwInt ;
+
+// qrsdet.c
+
+typedef struct _OseaPeak {
+	int max, timeSinceMax, lastDatum ;
+	} OseaPeak ;
+
+typedef struct _OseaQRSDet {
+	int det_thresh, qpkcnt ;
+	int qrsbuf[8], noise[8], rrbuf[8] ;
+	int rsetBuff[8], rsetCount ;
+	int nmedian, qmedian, rrmedian ;
+	int count, sbpeak, sbloc, sbcount ;
+	int maxder, lastmax ;
+	int initBlank, initMax ;
+	int preBlankCnt, tempPeak ;
+	int DDBuffer[DDBUFFER_SIZE], DDPtr ;	/* Buffer holding derivative data. */
+	int Dly ;
+	} OseaQRSDet ;
+
+// bdac.c
+
+typedef struct _OseaBDAC {
+	int ECGBuffer[ECG_BUFFER_LENGTH], ECGBufferIndex ;  // Circular data buffer.
+	int BeatBuffer[BEATLGTH] ;
+	int BeatQue[BEAT_QUE_LENGTH], BeatQueCount ;  // Buffer of detection delays.
+	int RRCount ;
+	int InitBeatFlag ;
+	} OseaBDAC ;
+
+// noisechk.c
+
+typedef struct _OseaNoiseChk {
+	int NoiseBuffer[NBUFFER_SIZE], NBPtr ;
+	int NoiseEstimate ;
+	} OseaNoiseChk ;
+
+// classify.c
+
+typedef struct _OseaClassify {
+	int DomType ;
+	int RecentRRs[8], RecentTypes[8] ;
+	int morphType, runCount ;
+	int lastIsoLevel, lastRhythmClass, lastBeatWasNew ;
+
+	// Dominant monitor.
+	int NewDom, DomRhythm ;
+	int DMBeatTypes[DM_BUFFER_LENGTH], DMBeatClasses[DM_BUFFER_LENGTH] ;
+	int DMBeatRhythms[DM_BUFFER_LENGTH] ;
+	int DMNormCounts[8], DMBeatCounts[8], DMIrregCount ;
+	int brIndex ;
+	} OseaClassify ;
+
+// match.c
+
+typedef struct _OseaMatch {
+	int BeatTemplates[MAXTYPES][BEATLGTH] ;
+	int BeatCounts[MAXTYPES] ;
+	int BeatWidths[MAXTYPES] ;
+	int BeatClassifications[MAXTYPES] ;
+	int BeatBegins[MAXTYPES] ;
+	int BeatEnds[MAXTYPES] ;
+	int BeatsSinceLastMatch[MAXTYPES] ;
+	int BeatAmps[MAXTYPES] ;
+	int BeatCenters[MAXTYPES] ;
+	double MIs[MAXTYPES][8] ;
+	int TypeCount ;
+	} OseaMatch ;
+
+// postclas.c
+
+typedef struct _OseaPostClas {
+	int PostClass[MAXTYPES][8], PCInitCount ;
+	int PCRhythm[MAXTYPES][8] ;
+	int lastRC, lastWidth ;
+	double lastMI2 ;
+	} OseaPostClas ;
+
+// rythmchk.c
+
+typedef struct _OseaRhythmChk {
+	int RRBuffer[RBB_LENGTH], RRTypes[RBB_LENGTH], BeatCount ;
+	int ClassifyState ;
+	int BigeminyFlag ;
+	} OseaRhythmChk ;
+
+typedef struct _OseaContext {
+	OseaRate rate ;
+	OseaLPFilt lp ;
+	OseaHPFilt hp ;
+	OseaDeriv d1, d2 ;
+	OseaMvwInt mvw ;
+	OseaPeak peak ;
+	OseaQRSDet qrsdet ;
+	OseaBDAC bdac ;
+	OseaNoiseChk noisechk ;
+	OseaClassify classify ;
+	OseaMatch match ;
+	OseaPostClas postclas ;
+	OseaRhythmChk rhythm ;
+	} OseaContext ;
+
+// A beat returned by BeatDetectAndClassifyBlock().
+
+typedef struct _OseaBeat {
+	int sample ;	// Index of the sample that completed the beat.
+	int delay ;		// Samples from the R-wave to that sample.
+	int type ;		// Beat classification.
+	int match ;		// Number of the matching template.
+	} OseaBeat ;
+
+OseaContext *OseaCreate(int sampleRate) ;
+void OseaDestroy(OseaContext *ctx) ;
+int OseaInit(OseaContext *ctx, int sampleRate) ;
+
+void ResetBDAC(OseaContext *ctx) ;
+int BeatDetectAndClassify(OseaContext *ctx, int ecgSample, int *beatType,
+	int *beatMatch) ;
+int BeatDetectAndClassifyBlock(OseaContext *ctx, const int *ecgSamples, int n,
+	OseaBeat *beats) ;
+
+#endif /* _OSEA_H */
@@ -1,5 +1,7 @@
-void ResetPostClassify() ;
-void PostClassify(int *recentTypes, int domType, int *recentRRs, int width, double mi2,
+#include "osea.h"
+
+void ResetPostClassify(OseaContext *ctx) ;
+void PostClassify(OseaContext *ctx, int *recentTypes, int domType, int *recentRRs, int width, double mi2,
 	int rhythmClass) ;
-int CheckPostClass(int type) ;
-int CheckPCRhythm(int type) ;
+int CheckPostClass(OseaContext *ctx, int type) ;
+int CheckPCRhythm(OseaContext *ctx, int type) ;
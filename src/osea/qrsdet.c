@@ -33,7 +33,7 @@ definitions in qrsdet.h.  QRSDet is the only function that needs to be
 visable outside of these files.
 
 Syntax:
-	int QRSDet(int ecgSample, int init) ;
+	int QRSDet(OseaContext *ctx, int ecgSample, int init) ;
 
 Description:
 	QRSDet() implements a modified version of the QRS detection
@@ -46,7 +46,8 @@ Description:
 	Consecutive ECG samples are passed to QRSDet.  QRSDet was
 	designed for a 200 Hz sample rate.  QRSDet contains a number
 	of static variables that it uses to adapt to different ECG
-	signals.  These variables can be reset by passing any value
+	signals.  These variables are kept in the OseaContext passed
+	in ctx, and they can be reset by passing any value
 	not equal to 0 in init.
 
 	Note: QRSDet() requires filters in QRSFilt.cpp
@@ -65,44 +66,34 @@ Returns:
 
 #include <math.h>
 #include "qrsdet.h"
-#define PRE_BLANK	MS200
+#include "osea.h"
 
 
 // External Prototypes.
 
-int QRSFilter(int datum, int init) ;
-int deriv1( int x0, int init ) ;
+int QRSFilter(OseaContext *ctx, int datum, int init) ;
+int deriv1(OseaContext *ctx, int x0, int init ) ;
 
 // Local Prototypes.
 
-int Peak( int datum, int init ) ;
+int QRSDetFiltered(OseaContext *ctx, int fdatum, int derivDatum) ;
+int Peak(OseaContext *ctx, int datum, int init ) ;
 int median(int *array, int datnum) ;
 int thresh(int qmedian, int nmedian) ;
-int BLSCheck(int *dBuf,int dbPtr,int *maxder) ;
+int BLSCheck(OseaContext *ctx, int *dBuf,int dbPtr,int *maxder) ;
 
 int earlyThresh(int qmedian, int nmedian) ;
 
 
 double TH = 0.475  ;
 
-int DDBuffer[DER_DELAY], DDPtr ;	/* Buffer holding derivative data. */
-int Dly  = 0 ;
 
 const int MEMMOVELEN = 7*sizeof(int);
 
-int QRSDet( int datum, int init )
+int QRSDet(OseaContext *ctx, int datum, int init )
 	{
-	static int det_thresh, qpkcnt = 0 ;
-	static int qrsbuf[8], noise[8], rrbuf[8] ;
-	static int rsetBuff[8], rsetCount = 0 ;
-	static int nmedian, qmedian, rrmedian ;
-	static int count, sbpeak = 0, sbloc, sbcount = MS1500 ;
-	static int maxder, lastmax ;
-	static int initBlank, initMax ;
-	static int preBlankCnt, tempPeak ;
-	
-	int fdatum, QrsDelay = 0 ;
-	int i, newPeak, aPeak ;
+	int fdatum, derivDatum ;
+	int i ;
 
 /*	Initialize all buffers to 0 on the first call.	*/
 
@@ -110,50 +101,64 @@ int QRSDet( int datum, int init )
 		{
 		for(i = 0; i < 8; ++i)
 			{
-			noise[i] = 0 ;	/* Initialize noise buffer */
-			rrbuf[i] = MS1000 ;/* and R-to-R interval buffer. */
+			ctx->qrsdet.noise[i] = 0 ;	/* Initialize noise buffer */
+			ctx->qrsdet.rrbuf[i] = ctx->rate.ms1000 ;/* and R-to-R interval buffer. */
 			}
 
-		qpkcnt = maxder = lastmax = count = sbpeak = 0 ;
-		initBlank = initMax = preBlankCnt = DDPtr = 0 ;
-		sbcount = MS1500 ;
-		QRSFilter(0,1) ;	/* initialize filters. */
-		Peak(0,1) ;
+		ctx->qrsdet.qpkcnt = ctx->qrsdet.maxder = ctx->qrsdet.lastmax = ctx->qrsdet.count = ctx->qrsdet.sbpeak = 0 ;
+		ctx->qrsdet.initBlank = ctx->qrsdet.initMax = ctx->qrsdet.preBlankCnt = ctx->qrsdet.DDPtr = 0 ;
+		ctx->qrsdet.sbcount = ctx->rate.ms1500 ;
+		QRSFilter(ctx, 0,1) ;	/* initialize filters. */
+		Peak(ctx, 0,1) ;
 		}
 
-	fdatum = QRSFilter(datum,0) ;	/* Filter data. */
+	fdatum = QRSFilter(ctx, datum,0) ;	/* Filter data. */
+	derivDatum = deriv1(ctx, datum, 0 ) ;
+	return(QRSDetFiltered(ctx, fdatum, derivDatum)) ;
+	}
 
+/****************************************************************************
+	QRSDetFiltered() is the part of QRSDet() that follows the filters.  It
+	takes the output of QRSFilter() and deriv1() for one sample, so that
+	the filtering can also be done a block at a time with QRSFilterBlock()
+	and Deriv1Block().
+****************************************************************************/
+
+int QRSDetFiltered(OseaContext *ctx, int fdatum, int derivDatum)
+	{
+	int QrsDelay = 0 ;
+	int i, newPeak, aPeak ;
 
 	/* Wait until normal detector is ready before calling early detections. */
 
-	aPeak = Peak(fdatum,0) ;
+	aPeak = Peak(ctx, fdatum,0) ;
 
 	// Hold any peak that is detected for 200 ms
 	// in case a bigger one comes along.  There
 	// can only be one QRS complex in any 200 ms window.
 
 	newPeak = 0 ;
-	if(aPeak && !preBlankCnt)			// If there has been no peak for 200 ms
+	if(aPeak && !ctx->qrsdet.preBlankCnt)			// If there has been no peak for 200 ms
 		{										// save this one and start counting.
-		tempPeak = aPeak ;
-		preBlankCnt = PRE_BLANK ;			// MS200
+		ctx->qrsdet.tempPeak = aPeak ;
+		ctx->qrsdet.preBlankCnt = ctx->rate.preBlank ;			// MS200
 		}
 
-	else if(!aPeak && preBlankCnt)	// If we have held onto a peak for
+	else if(!aPeak && ctx->qrsdet.preBlankCnt)	// If we have held onto a peak for
 		{										// 200 ms pass it on for evaluation.
-		if(--preBlankCnt == 0)
-			newPeak = tempPeak ;
+		if(--ctx->qrsdet.preBlankCnt == 0)
+			newPeak = ctx->qrsdet.tempPeak ;
 		}
 
 	else if(aPeak)							// If we were holding a peak, but
 		{										// this ones bigger, save it and
-		if(aPeak > tempPeak)				// start counting to 200 ms again.
+		if(aPeak > ctx->qrsdet.tempPeak)				// start counting to 200 ms again.
 			{
-			tempPeak = aPeak ;
-			preBlankCnt = PRE_BLANK ; // MS200
+			ctx->qrsdet.tempPeak = aPeak ;
+			ctx->qrsdet.preBlankCnt = ctx->rate.preBlank ; // MS200
 			}
-		else if(--preBlankCnt == 0)
-			newPeak = tempPeak ;
+		else if(--ctx->qrsdet.preBlankCnt == 0)
+			newPeak = ctx->qrsdet.tempPeak ;
 		}
 
 /*	newPeak = 0 ;
@@ -166,39 +171,39 @@ int QRSDet( int datum, int init )
 	/* Save derivative of raw signal for T-wave and baseline
 	   shift discrimination. */
 	
-	DDBuffer[DDPtr] = deriv1( datum, 0 ) ;
-	if(++DDPtr == DER_DELAY)
-		DDPtr = 0 ;
+	ctx->qrsdet.DDBuffer[ctx->qrsdet.DDPtr] = derivDatum ;
+	if(++ctx->qrsdet.DDPtr == ctx->rate.derDelay)
+		ctx->qrsdet.DDPtr = 0 ;
 
 	/* Initialize the qrs peak buffer with the first eight 	*/
 	/* local maximum peaks detected.						*/
 
-	if( qpkcnt < 8 )
+	if( ctx->qrsdet.qpkcnt < 8 )
 		{
-		++count ;
-		if(newPeak > 0) count = WINDOW_WIDTH ;
-		if(++initBlank == MS1000)
+		++ctx->qrsdet.count ;
+		if(newPeak > 0) ctx->qrsdet.count = ctx->rate.windowWidth ;
+		if(++ctx->qrsdet.initBlank == ctx->rate.ms1000)
 			{
-			initBlank = 0 ;
-			qrsbuf[qpkcnt] = initMax ;
-			initMax = 0 ;
-			++qpkcnt ;
-			if(qpkcnt == 8)
+			ctx->qrsdet.initBlank = 0 ;
+			ctx->qrsdet.qrsbuf[ctx->qrsdet.qpkcnt] = ctx->qrsdet.initMax ;
+			ctx->qrsdet.initMax = 0 ;
+			++ctx->qrsdet.qpkcnt ;
+			if(ctx->qrsdet.qpkcnt == 8)
 				{
-				qmedian = median( qrsbuf, 8 ) ;
-				nmedian = 0 ;
-				rrmedian = MS1000 ;
-				sbcount = MS1500+MS150 ;
-				det_thresh = thresh(qmedian,nmedian) ;
+				ctx->qrsdet.qmedian = median( ctx->qrsdet.qrsbuf, 8 ) ;
+				ctx->qrsdet.nmedian = 0 ;
+				ctx->qrsdet.rrmedian = ctx->rate.ms1000 ;
+				ctx->qrsdet.sbcount = ctx->rate.ms1500+ctx->rate.ms150 ;
+				ctx->qrsdet.det_thresh = thresh(ctx->qrsdet.qmedian,ctx->qrsdet.nmedian) ;
 				}
 			}
-		if( newPeak > initMax )
-			initMax = newPeak ;
+		if( newPeak > ctx->qrsdet.initMax )
+			ctx->qrsdet.initMax = newPeak ;
 		}
 
 	else	/* Else test for a qrs. */
 		{
-		++count ;
+		++ctx->qrsdet.count ;
 		if(newPeak > 0)
 			{
 			
@@ -207,31 +212,31 @@ int QRSDet( int datum, int init )
 			   for T-wave and baseline shift rejection.  Only consider this
 			   peak if it doesn't seem to be a base line shift. */
 			   
-			if(!BLSCheck(DDBuffer, DDPtr, &maxder))
+			if(!BLSCheck(ctx, ctx->qrsdet.DDBuffer, ctx->qrsdet.DDPtr, &ctx->qrsdet.maxder))
 				{
 
 
 				// Classify the beat as a QRS complex
 				// if the peak is larger than the detection threshold.
 
-				if(newPeak > det_thresh)
+				if(newPeak > ctx->qrsdet.det_thresh)
 					{
-					memmove(&qrsbuf[1], qrsbuf, MEMMOVELEN) ;
-					qrsbuf[0] = newPeak ;
-					qmedian = median(qrsbuf,8) ;
-					det_thresh = thresh(qmedian,nmedian) ;
-					memmove(&rrbuf[1], rrbuf, MEMMOVELEN) ;
-					rrbuf[0] = count - WINDOW_WIDTH ;
-					rrmedian = median(rrbuf,8) ;
-					sbcount = rrmedian + (rrmedian >> 1) + WINDOW_WIDTH ;
-					count = WINDOW_WIDTH ;
-
-					sbpeak = 0 ;
-
-					lastmax = maxder ;
-					maxder = 0 ;
-					QrsDelay =  WINDOW_WIDTH + FILTER_DELAY ;
-					initBlank = initMax = rsetCount = 0 ;
+					memmove(&ctx->qrsdet.qrsbuf[1], ctx->qrsdet.qrsbuf, MEMMOVELEN) ;
+					ctx->qrsdet.qrsbuf[0] = newPeak ;
+					ctx->qrsdet.qmedian = median(ctx->qrsdet.qrsbuf,8) ;
+					ctx->qrsdet.det_thresh = thresh(ctx->qrsdet.qmedian,ctx->qrsdet.nmedian) ;
+					memmove(&ctx->qrsdet.rrbuf[1], ctx->qrsdet.rrbuf, MEMMOVELEN) ;
+					ctx->qrsdet.rrbuf[0] = ctx->qrsdet.count - ctx->rate.windowWidth ;
+					ctx->qrsdet.rrmedian = median(ctx->qrsdet.rrbuf,8) ;
+					ctx->qrsdet.sbcount = ctx->qrsdet.rrmedian + (ctx->qrsdet.rrmedian >> 1) + ctx->rate.windowWidth ;
+					ctx->qrsdet.count = ctx->rate.windowWidth ;
+
+					ctx->qrsdet.sbpeak = 0 ;
+
+					ctx->qrsdet.lastmax = ctx->qrsdet.maxder ;
+					ctx->qrsdet.maxder = 0 ;
+					QrsDelay =  ctx->rate.windowWidth + ctx->rate.filterDelay ;
+					ctx->qrsdet.initBlank = ctx->qrsdet.initMax = ctx->qrsdet.rsetCount = 0 ;
 
 			//		preBlankCnt = PRE_BLANK ;
 					}
@@ -242,19 +247,19 @@ int QRSDet( int datum, int init )
 
 				else
 					{
-					memmove(&noise[1],noise,MEMMOVELEN) ;
-					noise[0] = newPeak ;
-					nmedian = median(noise,8) ;
-					det_thresh = thresh(qmedian,nmedian) ;
+					memmove(&ctx->qrsdet.noise[1],ctx->qrsdet.noise,MEMMOVELEN) ;
+					ctx->qrsdet.noise[0] = newPeak ;
+					ctx->qrsdet.nmedian = median(ctx->qrsdet.noise,8) ;
+					ctx->qrsdet.det_thresh = thresh(ctx->qrsdet.qmedian,ctx->qrsdet.nmedian) ;
 
 					// Don't include early peaks (which might be T-waves)
 					// in the search back process.  A T-wave can mask
 					// a small following QRS.
 
-					if((newPeak > sbpeak) && ((count-WINDOW_WIDTH) >= MS360))
+					if((newPeak > ctx->qrsdet.sbpeak) && ((ctx->qrsdet.count-ctx->rate.windowWidth) >= ctx->rate.ms360))
 						{
-						sbpeak = newPeak ;
-						sbloc = count  - WINDOW_WIDTH ;
+						ctx->qrsdet.sbpeak = newPeak ;
+						ctx->qrsdet.sbloc = ctx->qrsdet.count  - ctx->rate.windowWidth ;
 						}
 					}
 				}
@@ -263,58 +268,58 @@ int QRSDet( int datum, int init )
 		/* Test for search back condition.  If a QRS is found in  */
 		/* search back update the QRS buffer and det_thresh.      */
 
-		if((count > sbcount) && (sbpeak > (det_thresh >> 1)))
+		if((ctx->qrsdet.count > ctx->qrsdet.sbcount) && (ctx->qrsdet.sbpeak > (ctx->qrsdet.det_thresh >> 1)))
 			{
-			memmove(&qrsbuf[1],qrsbuf,MEMMOVELEN) ;
-			qrsbuf[0] = sbpeak ;
-			qmedian = median(qrsbuf,8) ;
-			det_thresh = thresh(qmedian,nmedian) ;
-			memmove(&rrbuf[1],rrbuf,MEMMOVELEN) ;
-			rrbuf[0] = sbloc ;
-			rrmedian = median(rrbuf,8) ;
-			sbcount = rrmedian + (rrmedian >> 1) + WINDOW_WIDTH ;
-			QrsDelay = count = count - sbloc ;
-			QrsDelay += FILTER_DELAY ;
-			sbpeak = 0 ;
-			lastmax = maxder ;
-			maxder = 0 ;
-			initBlank = initMax = rsetCount = 0 ;
+			memmove(&ctx->qrsdet.qrsbuf[1],ctx->qrsdet.qrsbuf,MEMMOVELEN) ;
+			ctx->qrsdet.qrsbuf[0] = ctx->qrsdet.sbpeak ;
+			ctx->qrsdet.qmedian = median(ctx->qrsdet.qrsbuf,8) ;
+			ctx->qrsdet.det_thresh = thresh(ctx->qrsdet.qmedian,ctx->qrsdet.nmedian) ;
+			memmove(&ctx->qrsdet.rrbuf[1],ctx->qrsdet.rrbuf,MEMMOVELEN) ;
+			ctx->qrsdet.rrbuf[0] = ctx->qrsdet.sbloc ;
+			ctx->qrsdet.rrmedian = median(ctx->qrsdet.rrbuf,8) ;
+			ctx->qrsdet.sbcount = ctx->qrsdet.rrmedian + (ctx->qrsdet.rrmedian >> 1) + ctx->rate.windowWidth ;
+			QrsDelay = ctx->qrsdet.count = ctx->qrsdet.count - ctx->qrsdet.sbloc ;
+			QrsDelay += ctx->rate.filterDelay ;
+			ctx->qrsdet.sbpeak = 0 ;
+			ctx->qrsdet.lastmax = ctx->qrsdet.maxder ;
+			ctx->qrsdet.maxder = 0 ;
+			ctx->qrsdet.initBlank = ctx->qrsdet.initMax = ctx->qrsdet.rsetCount = 0 ;
 			}
 		}
 
 	// In the background estimate threshold to replace adaptive threshold
 	// if eight seconds elapses without a QRS detection.
 
-	if( qpkcnt == 8 )
+	if( ctx->qrsdet.qpkcnt == 8 )
 		{
-		if(++initBlank == MS1000)
+		if(++ctx->qrsdet.initBlank == ctx->rate.ms1000)
 			{
-			initBlank = 0 ;
-			rsetBuff[rsetCount] = initMax ;
-			initMax = 0 ;
-			++rsetCount ;
+			ctx->qrsdet.initBlank = 0 ;
+			ctx->qrsdet.rsetBuff[ctx->qrsdet.rsetCount] = ctx->qrsdet.initMax ;
+			ctx->qrsdet.initMax = 0 ;
+			++ctx->qrsdet.rsetCount ;
 
 			// Reset threshold if it has been 8 seconds without
 			// a detection.
 
-			if(rsetCount == 8)
+			if(ctx->qrsdet.rsetCount == 8)
 				{
 				for(i = 0; i < 8; ++i)
 					{
-					qrsbuf[i] = rsetBuff[i] ;
-					noise[i] = 0 ;
+					ctx->qrsdet.qrsbuf[i] = ctx->qrsdet.rsetBuff[i] ;
+					ctx->qrsdet.noise[i] = 0 ;
 					}
-				qmedian = median( rsetBuff, 8 ) ;
-				nmedian = 0 ;
-				rrmedian = MS1000 ;
-				sbcount = MS1500+MS150 ;
-				det_thresh = thresh(qmedian,nmedian) ;
-				initBlank = initMax = rsetCount = 0 ;
-            sbpeak = 0 ;
+				ctx->qrsdet.qmedian = median( ctx->qrsdet.rsetBuff, 8 ) ;
+				ctx->qrsdet.nmedian = 0 ;
+				ctx->qrsdet.rrmedian = ctx->rate.ms1000 ;
+				ctx->qrsdet.sbcount = ctx->rate.ms1500+ctx->rate.ms150 ;
+				ctx->qrsdet.det_thresh = thresh(ctx->qrsdet.qmedian,ctx->qrsdet.nmedian) ;
+				ctx->qrsdet.initBlank = ctx->qrsdet.initMax = ctx->qrsdet.rsetCount = 0 ;
+            ctx->qrsdet.sbpeak = 0 ;
 				}
 			}
-		if( newPeak > initMax )
-			initMax = newPeak ;
+		if( newPeak > ctx->qrsdet.initMax )
+			ctx->qrsdet.initMax = newPeak ;
 		}
 
 	return(QrsDelay) ;
@@ -325,40 +330,39 @@ int QRSDet( int datum, int init )
 * when the signal returns to half its peak height, or 
 **************************************************************/
 
-int Peak( int datum, int init )
+int Peak(OseaContext *ctx, int datum, int init )
 	{
-	static int max = 0, timeSinceMax = 0, lastDatum ;
 	int pk = 0 ;
 
 	if(init)
-		max = timeSinceMax = 0 ;
+		ctx->peak.max = ctx->peak.timeSinceMax = 0 ;
 		
-	if(timeSinceMax > 0)
-		++timeSinceMax ;
+	if(ctx->peak.timeSinceMax > 0)
+		++ctx->peak.timeSinceMax ;
 
-	if((datum > lastDatum) && (datum > max))
+	if((datum > ctx->peak.lastDatum) && (datum > ctx->peak.max))
 		{
-		max = datum ;
-		if(max > 2)
-			timeSinceMax = 1 ;
+		ctx->peak.max = datum ;
+		if(ctx->peak.max > 2)
+			ctx->peak.timeSinceMax = 1 ;
 		}
 
-	else if(datum < (max >> 1))
+	else if(datum < (ctx->peak.max >> 1))
 		{
-		pk = max ;
-		max = 0 ;
-		timeSinceMax = 0 ;
-		Dly = 0 ;
+		pk = ctx->peak.max ;
+		ctx->peak.max = 0 ;
+		ctx->peak.timeSinceMax = 0 ;
+		ctx->qrsdet.Dly = 0 ;
 		}
 
-	else if(timeSinceMax > MS95)
+	else if(ctx->peak.timeSinceMax > ctx->rate.ms95)
 		{
-		pk = max ;
-		max = 0 ;
-		timeSinceMax = 0 ;
-		Dly = 3 ;
+		pk = ctx->peak.max ;
+		ctx->peak.max = 0 ;
+		ctx->peak.timeSinceMax = 0 ;
+		ctx->qrsdet.Dly = 3 ;
 		}
-	lastDatum = datum ;
+	ctx->peak.lastDatum = datum ;
 	return(pk) ;
 	}
 
@@ -418,14 +422,14 @@ int thresh(int qmedian, int nmedian)
 	roughly the same magnitude in a 220 ms window.
 ***********************************************************************/
 
-int BLSCheck(int *dBuf,int dbPtr,int *maxder)
+int BLSCheck(OseaContext *ctx, int *dBuf,int dbPtr,int *maxder)
 	{
 	int max, min, maxt, mint, t, x ;
 	max = min = 0 ;
 
 	return(0) ;
 	
-	for(t = 0; t < MS220; ++t)
+	for(t = 0; t < ctx->rate.ms220; ++t)
 		{
 		x = dBuf[dbPtr] ;
 		if(x > max)
@@ -438,7 +442,7 @@ int BLSCheck(int *dBuf,int dbPtr,int *maxder)
 			mint = t ;
 			min = x;
 			}
-		if(++dbPtr == DER_DELAY)
+		if(++dbPtr == ctx->rate.derDelay)
 			dbPtr = 0 ;
 		}
 
@@ -449,7 +453,7 @@ int BLSCheck(int *dBuf,int dbPtr,int *maxder)
 		where the interval between them is less than 150 ms. */
 	   
 	if((max > (min>>3)) && (min > (max>>3)) &&
-		(abs(maxt - mint) < MS150))
+		(abs(maxt - mint) < ctx->rate.ms150))
 		return(0) ;
 		
 	else
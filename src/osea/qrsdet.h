@@ -32,37 +32,28 @@ MA 02143 USA).  For updates to this software, please visit our website
 *****************************************************************************/
 
 
-#define SAMPLE_RATE	300	/* Sample rate in Hz. */
-#define MS_PER_SAMPLE	( (double) 1000/ (double) SAMPLE_RATE)
-#define MS10	((int) (10/ MS_PER_SAMPLE + 0.5))
-#define MS25	((int) (25/MS_PER_SAMPLE + 0.5))
-#define MS30	((int) (30/MS_PER_SAMPLE + 0.5))
-#define MS80	((int) (80/MS_PER_SAMPLE + 0.5))
-#define MS95	((int) (95/MS_PER_SAMPLE + 0.5))
-#define MS100	((int) (100/MS_PER_SAMPLE + 0.5))
-#define MS125	((int) (125/MS_PER_SAMPLE + 0.5))
-#define MS150	((int) (150/MS_PER_SAMPLE + 0.5))
-#define MS160	((int) (160/MS_PER_SAMPLE + 0.5))
-#define MS175	((int) (175/MS_PER_SAMPLE + 0.5))
-#define MS195	((int) (195/MS_PER_SAMPLE + 0.5))
-#define MS200	((int) (200/MS_PER_SAMPLE + 0.5))
-#define MS220	((int) (220/MS_PER_SAMPLE + 0.5))
-#define MS250	((int) (250/MS_PER_SAMPLE + 0.5))
-#define MS300	((int) (300/MS_PER_SAMPLE + 0.5))
-#define MS360	((int) (360/MS_PER_SAMPLE + 0.5))
-#define MS450	((int) (450/MS_PER_SAMPLE + 0.5))
-#define MS1000	SAMPLE_RATE
-#define MS1500	((int) (1500/MS_PER_SAMPLE))
-/*#define DERIV_LENGTH	MS10 */
-#define DERIV_LENGTH	3
-/*#define LPBUFFER_LGTH ((int) (2*MS25)) */
-#define LPBUFFER_LGTH	16
-/*#define HPBUFFER_LGTH MS125 */
-#define HPBUFFER_LGTH	38
-
-/*#define WINDOW_WIDTH	MS80 */			// Moving window integration width.
-#define WINDOW_WIDTH	24
-#define	FILTER_DELAY (int) (((double) DERIV_LENGTH/2) + ((double) LPBUFFER_LGTH/2 - 1) + (((double) HPBUFFER_LGTH-1)/2) + PRE_BLANK)  // filter delays plus 200 ms blanking delay
-#define DER_DELAY	WINDOW_WIDTH + FILTER_DELAY + MS100
-
-
+// The sample rate is chosen at run time with OseaInit().  The time
+// constants and filter lengths that used to be derived from a fixed
+// SAMPLE_RATE here are kept per context in OseaRate (osea.h).
+
+#define MIN_SAMPLE_RATE	150	/* Same as BEAT_SAMPLE_RATE. */
+#define MAX_SAMPLE_RATE	500
+#define DEFAULT_SAMPLE_RATE	300
+
+#define MS_PER_SAMPLE(rate)	( (double) 1000/ (double) (rate))
+#define MS_TO_SAMPLES(ms, rate)	((int) ((ms)/MS_PER_SAMPLE(rate) + 0.5))
+
+// Filter lengths are DERIV_LENGTH = MS10, LPBUFFER_LGTH = 2*MS25,
+// HPBUFFER_LGTH = MS125 and WINDOW_WIDTH = MS80 (moving window
+// integration width).  The values for the common sample rates are
+// fixed here so that qrsfilt.c can use them as constants.
+
+#define DERIV_LENGTH_150	2
+#define LPBUFFER_LGTH_150	8
+#define HPBUFFER_LGTH_150	19
+#define WINDOW_WIDTH_150	12
+
+#define DERIV_LENGTH_300	3
+#define LPBUFFER_LGTH_300	16
+#define HPBUFFER_LGTH_300	38
+#define WINDOW_WIDTH_300	24
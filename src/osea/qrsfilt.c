@@ -35,13 +35,35 @@ MA 02143 USA).  For updates to this software, please visit our website
 			modification for different sample rates.
 *******************************************************************************/
 #include <math.h>
+#include <string.h>
 #include "qrsdet.h"
+#include "osea.h"
+
+// The fast paths rely on FilterSample() and FilterBlock() being inlined
+// with constant filter lengths, which GCC does not always do by itself.
+
+#ifdef __GNUC__
+#define ALWAYS_INLINE	static inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE	static inline
+#endif
+
 // Local Prototypes.
-int lpfilt( int datum ,int init) ;
-int hpfilt( int datum, int init ) ;
-int deriv1( int x0, int init ) ;
-int deriv2( int x0, int init ) ;
-int mvwint(int datum, int init) ;
+int lpfilt(OseaContext *ctx, int datum ,int init) ;
+int hpfilt(OseaContext *ctx, int datum, int init ) ;
+int deriv1(OseaContext *ctx, int x0, int init ) ;
+int deriv2(OseaContext *ctx, int x0, int init ) ;
+int mvwint(OseaContext *ctx, int datum, int init) ;
+ALWAYS_INLINE int FilterSample(OseaContext *ctx, int datum, int derivLength,
+	int lpLgth, int hpLgth, int windowWidth) ;
+static inline int LPFiltStep(OseaLPFilt *lp, int datum, int lgth) ;
+static inline int HPFiltStep(OseaHPFilt *hp, int datum, int lgth) ;
+static inline int DerivStep(OseaDeriv *d, int x, int lgth) ;
+static inline int MvwIntStep(OseaMvwInt *mvw, int datum, int width) ;
+ALWAYS_INLINE void FilterBlock(OseaContext *ctx, const int *datum, int *fdatum,
+	int n, int derivLength, int lpLgth, int hpLgth, int windowWidth) ;
+static void LoadHistory(int *hist, const int *data, int ptr, int lgth) ;
+static void StoreHistory(int *data, int *ptr, const int *hist, int lgth) ;
 /******************************************************************************
 * Syntax:
 *	int QRSFilter(int datum, int init) ;
@@ -54,24 +76,53 @@ int mvwint(int datum, int init) ;
 *	frequencies from 150 to 250 samples per second.
 *
 *	The filter buffers and static variables are reset if a value other than
-*	0 is passed to QRSFilter through init.
+*	0 is passed to QRSFilter through init.  The filter lengths depend on
+*	the sample rate of the context.
 *******************************************************************************/
-int QRSFilter(int datum,int init)
+int QRSFilter(OseaContext *ctx, int datum,int init)
 	{
-	int fdatum ;
 	if(init)
 		{
-		hpfilt( 0, 1 ) ;		// Initialize filters.
-		lpfilt( 0, 1 ) ;
-		mvwint( 0, 1 ) ;
-		deriv1( 0, 1 ) ;
-		deriv2( 0, 1 ) ;
+		hpfilt(ctx, 0, 1 ) ;		// Initialize filters.
+		lpfilt(ctx, 0, 1 ) ;
+		mvwint(ctx, 0, 1 ) ;
+		deriv1(ctx, 0, 1 ) ;
+		deriv2(ctx, 0, 1 ) ;
 		}
-	fdatum = lpfilt( datum, 0 ) ;		// Low pass filter data.
-	fdatum = hpfilt( fdatum, 0 ) ;	// High pass filter data.
-	fdatum = deriv2( fdatum, 0 ) ;	// Take the derivative.
+
+	// The common sample rates have their own copies of the filters
+	// with the buffer lengths known at compile time, which turns the
+	// divisions into shifts and multiplications.
+
+	switch(ctx->rate.sampleRate)
+		{
+		case 150 :
+			return(FilterSample(ctx, datum, DERIV_LENGTH_150, LPBUFFER_LGTH_150,
+				HPBUFFER_LGTH_150, WINDOW_WIDTH_150)) ;
+		case 300 :
+			return(FilterSample(ctx, datum, DERIV_LENGTH_300, LPBUFFER_LGTH_300,
+				HPBUFFER_LGTH_300, WINDOW_WIDTH_300)) ;
+		default :
+			return(FilterSample(ctx, datum, ctx->rate.derivLength,
+				ctx->rate.lpBufferLgth, ctx->rate.hpBufferLgth,
+				ctx->rate.windowWidth)) ;
+		}
+	}
+
+/******************************************************************************
+*	FilterSample() runs one sample through the filters of QRSFilter() with
+*	the given filter lengths.  It is inlined into QRSFilter() once for each
+*	sample rate that has a fast path.
+*******************************************************************************/
+ALWAYS_INLINE int FilterSample(OseaContext *ctx, int datum, int derivLength,
+	int lpLgth, int hpLgth, int windowWidth)
+	{
+	int fdatum ;
+	fdatum = LPFiltStep(&ctx->lp, datum, lpLgth ) ;		// Low pass filter data.
+	fdatum = HPFiltStep(&ctx->hp, fdatum, hpLgth ) ;	// High pass filter data.
+	fdatum = DerivStep(&ctx->d2, fdatum, derivLength ) ;	// Take the derivative.
 	fdatum = abs(fdatum) ;				// Take the absolute value.
-	fdatum = mvwint( fdatum, 0 ) ;	// Average over an 80 ms window .
+	fdatum = MvwIntStep(&ctx->mvw, fdatum, windowWidth ) ;	// Average over an 80 ms window .
 	return(fdatum) ;
 	}
 
@@ -84,29 +135,32 @@ int QRSFilter(int datum,int init)
 *	Note that the filter delay is (LPBUFFER_LGTH/2)-1
 *
 **************************************************************************/
-int lpfilt( int datum ,int init)
+int lpfilt(OseaContext *ctx, int datum ,int init)
 	{
-	static long y1 = 0, y2 = 0 ;
-	static int data[LPBUFFER_LGTH], ptr = 0 ;
-	long y0 ;
-	int output, halfPtr ;
 	if(init)
 		{
-		for(ptr = 0; ptr < LPBUFFER_LGTH; ++ptr)
-			data[ptr] = 0 ;
-		y1 = y2 = 0 ;
-		ptr = 0 ;
+		for(ctx->lp.ptr = 0; ctx->lp.ptr < ctx->rate.lpBufferLgth; ++ctx->lp.ptr)
+			ctx->lp.data[ctx->lp.ptr] = 0 ;
+		ctx->lp.y1 = ctx->lp.y2 = 0 ;
+		ctx->lp.ptr = 0 ;
 		}
-	halfPtr = ptr-(LPBUFFER_LGTH/2) ;	// Use halfPtr to index
+	return(LPFiltStep(&ctx->lp, datum, ctx->rate.lpBufferLgth)) ;
+	}
+
+static inline int LPFiltStep(OseaLPFilt *lp, int datum, int lgth)
+	{
+	long y0 ;
+	int output, halfPtr ;
+	halfPtr = lp->ptr-(lgth/2) ;	// Use halfPtr to index
 	if(halfPtr < 0)							// to x[n-6].
-		halfPtr += LPBUFFER_LGTH ;
-	y0 = (y1 << 1) - y2 + datum - (data[halfPtr] << 1) + data[ptr] ;
-	y2 = y1;
-	y1 = y0;
-	output = y0 / ((LPBUFFER_LGTH*LPBUFFER_LGTH)/4);
-	data[ptr] = datum ;			// Stick most recent sample into
-	if(++ptr == LPBUFFER_LGTH)	// the circular buffer and update
-		ptr = 0 ;					// the buffer pointer.
+		halfPtr += lgth ;
+	y0 = (lp->y1 << 1) - lp->y2 + datum - (lp->data[halfPtr] << 1) + lp->data[lp->ptr] ;
+	lp->y2 = lp->y1;
+	lp->y1 = y0;
+	output = y0 / ((lgth*lgth)/4);
+	lp->data[lp->ptr] = datum ;			// Stick most recent sample into
+	if(++lp->ptr == lgth)	// the circular buffer and update
+		lp->ptr = 0 ;					// the buffer pointer.
 	return(output) ;
 	}
 
@@ -119,28 +173,32 @@ int lpfilt( int datum ,int init)
 *
 *  Filter delay is (HPBUFFER_LGTH-1)/2
 ******************************************************************************/
-int hpfilt( int datum, int init )
+int hpfilt(OseaContext *ctx, int datum, int init )
 	{
-	static long y=0 ;
-	static int data[HPBUFFER_LGTH], ptr = 0 ;
-	int z, halfPtr ;
 	if(init)
 		{
-		for(ptr = 0; ptr < HPBUFFER_LGTH; ++ptr)
-			data[ptr] = 0 ;
-		ptr = 0 ;
-		y = 0 ;
+		for(ctx->hp.ptr = 0; ctx->hp.ptr < ctx->rate.hpBufferLgth; ++ctx->hp.ptr)
+			ctx->hp.data[ctx->hp.ptr] = 0 ;
+		ctx->hp.ptr = 0 ;
+		ctx->hp.y = 0 ;
 		}
-	y += datum - data[ptr];
-	halfPtr = ptr-(HPBUFFER_LGTH/2) ;
+	return(HPFiltStep(&ctx->hp, datum, ctx->rate.hpBufferLgth)) ;
+	}
+
+static inline int HPFiltStep(OseaHPFilt *hp, int datum, int lgth)
+	{
+	int z, halfPtr ;
+	hp->y += datum - hp->data[hp->ptr];
+	halfPtr = hp->ptr-(lgth/2) ;
 	if(halfPtr < 0)
-		halfPtr += HPBUFFER_LGTH ;
-	z = data[halfPtr] - (y / HPBUFFER_LGTH);
-	data[ptr] = datum ;
-	if(++ptr == HPBUFFER_LGTH)
-		ptr = 0 ;
+		halfPtr += lgth ;
+	z = hp->data[halfPtr] - (hp->y / lgth);
+	hp->data[hp->ptr] = datum ;
+	if(++hp->ptr == lgth)
+		hp->ptr = 0 ;
 	return( z );
 	}
+
 /*****************************************************************************
 *  deriv1 and deriv2 implement derivative approximations represented by
 *  the difference equation:
@@ -149,38 +207,36 @@ int hpfilt( int datum, int init )
 *
 *  Filter delay is DERIV_LENGTH/2
 *****************************************************************************/
-int deriv1(int x, int init)
+int deriv1(OseaContext *ctx, int x, int init)
 	{
-	static int derBuff[DERIV_LENGTH], derI = 0 ;
-	int y ;
 	if(init != 0)
 		{
-		for(derI = 0; derI < DERIV_LENGTH; ++derI)
-			derBuff[derI] = 0 ;
-		derI = 0 ;
+		for(ctx->d1.derI = 0; ctx->d1.derI < ctx->rate.derivLength; ++ctx->d1.derI)
+			ctx->d1.derBuff[ctx->d1.derI] = 0 ;
+		ctx->d1.derI = 0 ;
 		return(0) ;
 		}
-	y = x - derBuff[derI] ;
-	derBuff[derI] = x ;
-	if(++derI == DERIV_LENGTH)
-		derI = 0 ;
-	return(y) ;
+	return(DerivStep(&ctx->d1, x, ctx->rate.derivLength)) ;
 	}
-int deriv2(int x, int init)
+int deriv2(OseaContext *ctx, int x, int init)
 	{
-	static int derBuff[DERIV_LENGTH], derI = 0 ;
-	int y ;
 	if(init != 0)
 		{
-		for(derI = 0; derI < DERIV_LENGTH; ++derI)
-			derBuff[derI] = 0 ;
-		derI = 0 ;
+		for(ctx->d2.derI = 0; ctx->d2.derI < ctx->rate.derivLength; ++ctx->d2.derI)
+			ctx->d2.derBuff[ctx->d2.derI] = 0 ;
+		ctx->d2.derI = 0 ;
 		return(0) ;
 		}
-	y = x - derBuff[derI] ;
-	derBuff[derI] = x ;
-	if(++derI == DERIV_LENGTH)
-		derI = 0 ;
+	return(DerivStep(&ctx->d2, x, ctx->rate.derivLength)) ;
+	}
+
+static inline int DerivStep(OseaDeriv *d, int x, int lgth)
+	{
+	int y ;
+	y = x - d->derBuff[d->derI] ;
+	d->derBuff[d->derI] = x ;
+	if(++d->derI == lgth)
+		d->derI = 0 ;
 	return(y) ;
 	}
 
@@ -189,26 +245,184 @@ int deriv2(int x, int init)
 * mvwint() implements a moving window integrator.  Actually, mvwint() averages
 * the signal values over the last WINDOW_WIDTH samples.
 *****************************************************************************/
-int mvwint(int datum, int init)
+int mvwint(OseaContext *ctx, int datum, int init)
 	{
-	static long sum = 0 ;
-	static int data[WINDOW_WIDTH], ptr = 0 ;
-	int output;
 	if(init)
 		{
-		for(ptr = 0; ptr < WINDOW_WIDTH ; ++ptr)
-			data[ptr] = 0 ;
-		sum = 0 ;
-		ptr = 0 ;
+		for(ctx->mvw.ptr = 0; ctx->mvw.ptr < ctx->rate.windowWidth ; ++ctx->mvw.ptr)
+			ctx->mvw.data[ctx->mvw.ptr] = 0 ;
+		ctx->mvw.sum = 0 ;
+		ctx->mvw.ptr = 0 ;
 		}
-	sum += datum ;
-	sum -= data[ptr] ;
-	data[ptr] = datum ;
-	if(++ptr == WINDOW_WIDTH)
-		ptr = 0 ;
-	if((sum / WINDOW_WIDTH) > 32000)
+	return(MvwIntStep(&ctx->mvw, datum, ctx->rate.windowWidth)) ;
+	}
+
+static inline int MvwIntStep(OseaMvwInt *mvw, int datum, int width)
+	{
+	int output;
+	mvw->sum += datum ;
+	mvw->sum -= mvw->data[mvw->ptr] ;
+	mvw->data[mvw->ptr] = datum ;
+	if(++mvw->ptr == width)
+		mvw->ptr = 0 ;
+	if((mvw->sum / width) > 32000)
 		output = 32000 ;
 	else
-		output = sum / WINDOW_WIDTH ;
+		output = mvw->sum / width ;
 	return(output) ;
 	}
+
+/******************************************************************************
+* Syntax:
+*	void QRSFilterBlock(OseaContext *ctx, const int *datum, int *fdatum, int n) ;
+* Description:
+*	QRSFilterBlock() filters n consecutive samples from datum into fdatum.
+*	The output is identical to calling QRSFilter() for each sample, and the
+*	two can be mixed freely.
+*
+*	Instead of passing each sample through all the filters, each filter
+*	processes OSEA_BLOCK_LENGTH samples at a time.  The circular buffers are
+*	copied into contiguous arrays that hold the filter history followed by
+*	the block, so the delayed samples are plain array offsets.  The
+*	differences of the recurrences are computed in loops without
+*	dependencies between iterations, which the compiler can vectorize, and
+*	only the running sums are left sequential.
+*******************************************************************************/
+void QRSFilterBlock(OseaContext *ctx, const int *datum, int *fdatum, int n)
+	{
+	int m ;
+
+	for( ; n > 0; n -= m, datum += m, fdatum += m)
+		{
+		m = (n < OSEA_BLOCK_LENGTH) ? n : OSEA_BLOCK_LENGTH ;
+		switch(ctx->rate.sampleRate)
+			{
+			case 150 :
+				FilterBlock(ctx, datum, fdatum, m, DERIV_LENGTH_150,
+					LPBUFFER_LGTH_150, HPBUFFER_LGTH_150, WINDOW_WIDTH_150) ;
+				break ;
+			case 300 :
+				FilterBlock(ctx, datum, fdatum, m, DERIV_LENGTH_300,
+					LPBUFFER_LGTH_300, HPBUFFER_LGTH_300, WINDOW_WIDTH_300) ;
+				break ;
+			default :
+				FilterBlock(ctx, datum, fdatum, m, ctx->rate.derivLength,
+					ctx->rate.lpBufferLgth, ctx->rate.hpBufferLgth,
+					ctx->rate.windowWidth) ;
+				break ;
+			}
+		}
+	}
+
+/******************************************************************************
+*	FilterBlock() is the block version of FilterSample().  n must not be
+*	larger than OSEA_BLOCK_LENGTH.  Each xxBuf array holds the lgth most
+*	recent inputs of a filter, oldest first, followed by the n new inputs.
+*******************************************************************************/
+ALWAYS_INLINE void FilterBlock(OseaContext *ctx, const int *datum, int *fdatum,
+	int n, int derivLength, int lpLgth, int hpLgth, int windowWidth)
+	{
+	int lpBuf[LPBUFFER_SIZE + OSEA_BLOCK_LENGTH] ;
+	int hpBuf[HPBUFFER_SIZE + OSEA_BLOCK_LENGTH] ;
+	int derBuf[DERIV_SIZE + OSEA_BLOCK_LENGTH] ;
+	int mvwBuf[WINDOW_SIZE + OSEA_BLOCK_LENGTH] ;
+	long acc[OSEA_BLOCK_LENGTH] ;
+	long y0, y1, y2, sum ;
+	int i ;
+
+	LoadHistory(lpBuf, ctx->lp.data, ctx->lp.ptr, lpLgth) ;
+	LoadHistory(hpBuf, ctx->hp.data, ctx->hp.ptr, hpLgth) ;
+	LoadHistory(derBuf, ctx->d2.derBuff, ctx->d2.derI, derivLength) ;
+	LoadHistory(mvwBuf, ctx->mvw.data, ctx->mvw.ptr, windowWidth) ;
+	memcpy(&lpBuf[lpLgth], datum, n*sizeof(int)) ;
+
+	// Low pass: y[n] = 2*y[n-1] - y[n-2] + x[n] - 2*x[n-lgth/2] + x[n-lgth]
+
+	for(i = 0; i < n; ++i)
+		acc[i] = (long) lpBuf[lpLgth+i] - (lpBuf[lpLgth+i-lpLgth/2] << 1) + lpBuf[i] ;
+	y1 = ctx->lp.y1 ;
+	y2 = ctx->lp.y2 ;
+	for(i = 0; i < n; ++i)
+		{
+		y0 = (y1 << 1) - y2 + acc[i] ;
+		y2 = y1 ;
+		y1 = y0 ;
+		acc[i] = y0 ;
+		}
+	ctx->lp.y1 = y1 ;
+	ctx->lp.y2 = y2 ;
+	for(i = 0; i < n; ++i)
+		hpBuf[hpLgth+i] = acc[i] / ((lpLgth*lpLgth)/4) ;
+
+	// High pass: y[n] = y[n-1] + x[n] - x[n-lgth], z[n] = x[n-lgth/2] - y[n]/lgth
+
+	for(i = 0; i < n; ++i)
+		acc[i] = hpBuf[hpLgth+i] - hpBuf[i] ;
+	sum = ctx->hp.y ;
+	for(i = 0; i < n; ++i)
+		acc[i] = (sum += acc[i]) ;
+	ctx->hp.y = sum ;
+	for(i = 0; i < n; ++i)
+		derBuf[derivLength+i] = hpBuf[hpLgth+i-hpLgth/2] - (acc[i] / hpLgth) ;
+
+	// Derivative and absolute value.
+
+	for(i = 0; i < n; ++i)
+		mvwBuf[windowWidth+i] = abs(derBuf[derivLength+i] - derBuf[i]) ;
+
+	// Moving window integration.
+
+	for(i = 0; i < n; ++i)
+		acc[i] = (long) mvwBuf[windowWidth+i] - mvwBuf[i] ;
+	sum = ctx->mvw.sum ;
+	for(i = 0; i < n; ++i)
+		acc[i] = (sum += acc[i]) ;
+	ctx->mvw.sum = sum ;
+	for(i = 0; i < n; ++i)
+		{
+		y0 = acc[i] / windowWidth ;
+		fdatum[i] = (y0 > 32000) ? 32000 : y0 ;
+		}
+
+	StoreHistory(ctx->lp.data, &ctx->lp.ptr, &lpBuf[n], lpLgth) ;
+	StoreHistory(ctx->hp.data, &ctx->hp.ptr, &hpBuf[n], hpLgth) ;
+	StoreHistory(ctx->d2.derBuff, &ctx->d2.derI, &derBuf[n], derivLength) ;
+	StoreHistory(ctx->mvw.data, &ctx->mvw.ptr, &mvwBuf[n], windowWidth) ;
+	}
+
+/******************************************************************************
+*	Deriv1Block() is the block version of deriv1().
+*******************************************************************************/
+void Deriv1Block(OseaContext *ctx, const int *x, int *y, int n)
+	{
+	int buf[DERIV_SIZE + OSEA_BLOCK_LENGTH] ;
+	int lgth = ctx->rate.derivLength ;
+	int i, m ;
+
+	for( ; n > 0; n -= m, x += m, y += m)
+		{
+		m = (n < OSEA_BLOCK_LENGTH) ? n : OSEA_BLOCK_LENGTH ;
+		LoadHistory(buf, ctx->d1.derBuff, ctx->d1.derI, lgth) ;
+		memcpy(&buf[lgth], x, m*sizeof(int)) ;
+		for(i = 0; i < m; ++i)
+			y[i] = buf[lgth+i] - buf[i] ;
+		StoreHistory(ctx->d1.derBuff, &ctx->d1.derI, &buf[m], lgth) ;
+		}
+	}
+
+/******************************************************************************
+*	LoadHistory() copies a circular buffer, whose oldest sample is at ptr,
+*	to hist in time order.  StoreHistory() does the opposite, leaving the
+*	oldest sample at index 0.
+*******************************************************************************/
+static void LoadHistory(int *hist, const int *data, int ptr, int lgth)
+	{
+	memcpy(hist, &data[ptr], (lgth-ptr)*sizeof(int)) ;
+	memcpy(&hist[lgth-ptr], data, ptr*sizeof(int)) ;
+	}
+
+static void StoreHistory(int *data, int *ptr, const int *hist, int lgth)
+	{
+	memcpy(data, hist, lgth*sizeof(int)) ;
+	*ptr = 0 ;
+	}
@@ -48,6 +48,7 @@ MA 02143 USA).  For updates to this software, please visit our website
 #include "qrsdet.h"		// For time intervals.
 #include "ecgcodes.h"		// Defines codes of NORMAL, PVC, and UNKNOWN.
 #include <stdlib.h>		// For abs()
+#include "osea.h"
 
 // Define RR interval types.
 
@@ -57,32 +58,25 @@ MA 02143 USA).  For updates to this software, please visit our website
 #define VN	3	// PVC-Normal interval.
 #define VV	4	// PVC-PVC interval.
 
-#define RBB_LENGTH	8
 #define LEARNING	0
 #define READY	1
 
-#define BRADY_LIMIT	MS1500
-
 // Local prototypes.
 int RRMatch(int rr0,int rr1) ;
 int RRShort(int rr0,int rr1) ;
 int RRShort2(int *rrIntervals, int *rrTypes) ;
 int RRMatch2(int rr0,int rr1) ;
 
-// Global variables.
-int RRBuffer[RBB_LENGTH], RRTypes[RBB_LENGTH], BeatCount = 0;
-int ClassifyState	= LEARNING ;
-
-int BigeminyFlag ;
+// The rhythm classification state is in ctx->rhythm.
 
 /***************************************************************************
 	ResetRhythmChk() resets static variables used for rhythm classification.
 ****************************************************************************/
 
-void ResetRhythmChk(void)
+void ResetRhythmChk(OseaContext *ctx)
 	{
-	BeatCount = 0 ;
-	ClassifyState = LEARNING ;
+	ctx->rhythm.BeatCount = 0 ;
+	ctx->rhythm.ClassifyState = LEARNING ;
 	}
 
 /*****************************************************************************
@@ -90,43 +84,43 @@ void ResetRhythmChk(void)
 	intervals, classifys the interval as NORMAL, PVC, or UNKNOWN.
 ******************************************************************************/
 
-int RhythmChk(int rr)
+int RhythmChk(OseaContext *ctx, int rr)
 	{
 	int i, regular = 1 ;
 	int NNEst, NVEst ;
 
-	BigeminyFlag = 0 ;
+	ctx->rhythm.BigeminyFlag = 0 ;
 
 	// Wait for at least 4 beats before classifying anything.
 
-	if(BeatCount < 4)
+	if(ctx->rhythm.BeatCount < 4)
 		{
-		if(++BeatCount == 4)
-			ClassifyState = READY ;
+		if(++ctx->rhythm.BeatCount == 4)
+			ctx->rhythm.ClassifyState = READY ;
 		}
 
 	// Stick the new RR interval into the RR interval Buffer.
 
 	for(i = RBB_LENGTH-1; i > 0; --i)
 		{
-		RRBuffer[i] = RRBuffer[i-1] ;
-		RRTypes[i] = RRTypes[i-1] ;
+		ctx->rhythm.RRBuffer[i] = ctx->rhythm.RRBuffer[i-1] ;
+		ctx->rhythm.RRTypes[i] = ctx->rhythm.RRTypes[i-1] ;
 		}
 
-	RRBuffer[0] = rr ;
+	ctx->rhythm.RRBuffer[0] = rr ;
 
-	if(ClassifyState == LEARNING)
+	if(ctx->rhythm.ClassifyState == LEARNING)
 		{
-		RRTypes[0] = QQ ;
+		ctx->rhythm.RRTypes[0] = QQ ;
 		return(UNKNOWN) ;
 		}
 
 	// If we couldn't tell what the last interval was...
 
-	if(RRTypes[1] == QQ)
+	if(ctx->rhythm.RRTypes[1] == QQ)
 		{
 		for(i = 0, regular = 1; i < 3; ++i)
-			if(RRMatch(RRBuffer[i],RRBuffer[i+1]) == 0)
+			if(RRMatch(ctx->rhythm.RRBuffer[i],ctx->rhythm.RRBuffer[i+1]) == 0)
 				regular = 0 ;
 
 		// If this, and the last three intervals matched, classify
@@ -134,7 +128,7 @@ int RhythmChk(int rr)
 
 		if(regular == 1)
 			{
-			RRTypes[0] = NN ;
+			ctx->rhythm.RRTypes[0] = NN ;
 			return(NORMAL) ;
 			}
 
@@ -143,37 +137,37 @@ int RhythmChk(int rr)
 		// consecutive beats do not match.
 
 		for(i = 0, regular = 1; i < 6; ++i)
-			if(RRMatch(RRBuffer[i],RRBuffer[i+2]) == 0)
+			if(RRMatch(ctx->rhythm.RRBuffer[i],ctx->rhythm.RRBuffer[i+2]) == 0)
 				regular = 0 ;
 		for(i = 0; i < 6; ++i)
-			if(RRMatch(RRBuffer[i],RRBuffer[i+1]) != 0)
+			if(RRMatch(ctx->rhythm.RRBuffer[i],ctx->rhythm.RRBuffer[i+1]) != 0)
 				regular = 0 ;
 
 		if(regular == 1)
 			{
-			BigeminyFlag = 1 ;
-			if(RRBuffer[0] < RRBuffer[1])
+			ctx->rhythm.BigeminyFlag = 1 ;
+			if(ctx->rhythm.RRBuffer[0] < ctx->rhythm.RRBuffer[1])
 				{
-				RRTypes[0] = NV ;
-				RRTypes[1] = VN ;
+				ctx->rhythm.RRTypes[0] = NV ;
+				ctx->rhythm.RRTypes[1] = VN ;
 				return(PVC) ;
 				}
 			else
 				{
-				RRTypes[0] = VN ;
-				RRTypes[1] = NV ;
+				ctx->rhythm.RRTypes[0] = VN ;
+				ctx->rhythm.RRTypes[1] = NV ;
 				return(NORMAL) ;
 				}
 			}
 
 		// Check for NNVNNNV pattern.
 
-		if(RRShort(RRBuffer[0],RRBuffer[1]) && RRMatch(RRBuffer[1],RRBuffer[2])
-			&& RRMatch(RRBuffer[2]*2,RRBuffer[3]+RRBuffer[4]) &&
-			RRMatch(RRBuffer[4],RRBuffer[0]) && RRMatch(RRBuffer[5],RRBuffer[2]))
+		if(RRShort(ctx->rhythm.RRBuffer[0],ctx->rhythm.RRBuffer[1]) && RRMatch(ctx->rhythm.RRBuffer[1],ctx->rhythm.RRBuffer[2])
+			&& RRMatch(ctx->rhythm.RRBuffer[2]*2,ctx->rhythm.RRBuffer[3]+ctx->rhythm.RRBuffer[4]) &&
+			RRMatch(ctx->rhythm.RRBuffer[4],ctx->rhythm.RRBuffer[0]) && RRMatch(ctx->rhythm.RRBuffer[5],ctx->rhythm.RRBuffer[2]))
 			{
-			RRTypes[0] = NV ;
-			RRTypes[1] = NN ;
+			ctx->rhythm.RRTypes[0] = NV ;
+			ctx->rhythm.RRTypes[1] = NN ;
 			return(PVC) ;
 			}
 
@@ -182,24 +176,24 @@ int RhythmChk(int rr)
 
 		else
 			{
-			RRTypes[0] = QQ ;
+			ctx->rhythm.RRTypes[0] = QQ ;
 			return(UNKNOWN) ;
 			}
 		}
 
 	// If the previous two beats were normal...
 
-	else if(RRTypes[1] == NN)
+	else if(ctx->rhythm.RRTypes[1] == NN)
 		{
 
-		if(RRShort2(RRBuffer,RRTypes))
+		if(RRShort2(ctx->rhythm.RRBuffer,ctx->rhythm.RRTypes))
 			{
-			if(RRBuffer[1] < BRADY_LIMIT)
+			if(ctx->rhythm.RRBuffer[1] < ctx->rate.ms1500)	// Bradycardia limit.
 				{
-				RRTypes[0] = NV ;
+				ctx->rhythm.RRTypes[0] = NV ;
 				return(PVC) ;
 				}
-			else RRTypes[0] = QQ ;
+			else ctx->rhythm.RRTypes[0] = QQ ;
 				return(UNKNOWN) ;
 			}
 
@@ -207,31 +201,31 @@ int RhythmChk(int rr)
 		// If this interval matches the previous interval, then it
 		// is regular.
 
-		else if(RRMatch(RRBuffer[0],RRBuffer[1]))
+		else if(RRMatch(ctx->rhythm.RRBuffer[0],ctx->rhythm.RRBuffer[1]))
 			{
-			RRTypes[0] = NN ;
+			ctx->rhythm.RRTypes[0] = NN ;
 			return(NORMAL) ;
 			}
 
 		// If this interval is short..
 
-		else if(RRShort(RRBuffer[0],RRBuffer[1]))
+		else if(RRShort(ctx->rhythm.RRBuffer[0],ctx->rhythm.RRBuffer[1]))
 			{
 
 			// But matches the one before last and the one before
 			// last was NN, this is a normal interval.
 
-			if(RRMatch(RRBuffer[0],RRBuffer[2]) && (RRTypes[2] == NN))
+			if(RRMatch(ctx->rhythm.RRBuffer[0],ctx->rhythm.RRBuffer[2]) && (ctx->rhythm.RRTypes[2] == NN))
 				{
-				RRTypes[0] = NN ;
+				ctx->rhythm.RRTypes[0] = NN ;
 				return(NORMAL) ;
 				}
 
 			// If the rhythm wasn't bradycardia, call it a PVC.
 
-			else if(RRBuffer[1] < BRADY_LIMIT)
+			else if(ctx->rhythm.RRBuffer[1] < ctx->rate.ms1500)	// Bradycardia limit.
 				{
-				RRTypes[0] = NV ;
+				ctx->rhythm.RRTypes[0] = NV ;
 				return(PVC) ;
 				}
 
@@ -240,7 +234,7 @@ int RhythmChk(int rr)
 
 			else
 				{
-				RRTypes[0] = QQ ;
+				ctx->rhythm.RRTypes[0] = QQ ;
 				return(UNKNOWN) ;
 				}
 			}
@@ -251,17 +245,17 @@ int RhythmChk(int rr)
 
 		else
 			{
-			RRTypes[0] = QQ ;
+			ctx->rhythm.RRTypes[0] = QQ ;
 			return(NORMAL) ;
 			}
 		}
 
 	// If the previous beat was a PVC...
 
-	else if(RRTypes[1] == NV)
+	else if(ctx->rhythm.RRTypes[1] == NV)
 		{
 
-		if(RRShort2(&RRBuffer[1],&RRTypes[1]))
+		if(RRShort2(&ctx->rhythm.RRBuffer[1],&ctx->rhythm.RRTypes[1]))
 			{
 	/*		if(RRMatch2(RRBuffer[0],RRBuffer[1]))
 				{
@@ -269,20 +263,20 @@ int RhythmChk(int rr)
 				return(PVC) ;
 				} */
 
-			if(RRMatch(RRBuffer[0],RRBuffer[1]))
+			if(RRMatch(ctx->rhythm.RRBuffer[0],ctx->rhythm.RRBuffer[1]))
 				{
-				RRTypes[0] = NN ;
-				RRTypes[1] = NN ;
+				ctx->rhythm.RRTypes[0] = NN ;
+				ctx->rhythm.RRTypes[1] = NN ;
 				return(NORMAL) ;
 				}
-			else if(RRBuffer[0] > RRBuffer[1])
+			else if(ctx->rhythm.RRBuffer[0] > ctx->rhythm.RRBuffer[1])
 				{
-				RRTypes[0] = VN ;
+				ctx->rhythm.RRTypes[0] = VN ;
 				return(NORMAL) ;
 				}
 			else
 				{
-				RRTypes[0] = QQ ;
+				ctx->rhythm.RRTypes[0] = QQ ;
 				return(UNKNOWN) ;
 				}
 
@@ -292,18 +286,18 @@ int RhythmChk(int rr)
 		// If this interval matches the previous premature
 		// interval assume a ventricular couplet.
 
-		else if(RRMatch(RRBuffer[0],RRBuffer[1]))
+		else if(RRMatch(ctx->rhythm.RRBuffer[0],ctx->rhythm.RRBuffer[1]))
 			{
-			RRTypes[0] = VV ;
+			ctx->rhythm.RRTypes[0] = VV ;
 			return(PVC) ;
 			}
 
 		// If this interval is larger than the previous
 		// interval, assume that it is NORMAL.
 
-		else if(RRBuffer[0] > RRBuffer[1])
+		else if(ctx->rhythm.RRBuffer[0] > ctx->rhythm.RRBuffer[1])
 			{
-			RRTypes[0] = VN ;
+			ctx->rhythm.RRTypes[0] = VN ;
 			return(NORMAL) ;
 			}
 
@@ -312,41 +306,41 @@ int RhythmChk(int rr)
 
 		else
 			{
-			RRTypes[0] = QQ ;
+			ctx->rhythm.RRTypes[0] = QQ ;
 			return(UNKNOWN) ;
          }
 		}
 
 	// If the previous beat followed a PVC or couplet etc...
 
-	else if(RRTypes[1] == VN)
+	else if(ctx->rhythm.RRTypes[1] == VN)
 		{
 
 		// Find the last NN interval.
 
-		for(i = 2; (RRTypes[i] != NN) && (i < RBB_LENGTH); ++i) ;
+		for(i = 2; (ctx->rhythm.RRTypes[i] != NN) && (i < RBB_LENGTH); ++i) ;
 
 		// If there was an NN interval in the interval buffer...
 		if(i != RBB_LENGTH)
 			{
-			NNEst = RRBuffer[i] ;
+			NNEst = ctx->rhythm.RRBuffer[i] ;
 
 			// and it matches, classify this interval as NORMAL.
 
-			if(RRMatch(RRBuffer[0],NNEst))
+			if(RRMatch(ctx->rhythm.RRBuffer[0],NNEst))
 				{
-				RRTypes[0] = NN ;
+				ctx->rhythm.RRTypes[0] = NN ;
 				return(NORMAL) ;
 				}
 			}
 
 		else NNEst = 0 ;
-		for(i = 2; (RRTypes[i] != NV) && (i < RBB_LENGTH); ++i) ;
+		for(i = 2; (ctx->rhythm.RRTypes[i] != NV) && (i < RBB_LENGTH); ++i) ;
 		if(i != RBB_LENGTH)
-			NVEst = RRBuffer[i] ;
+			NVEst = ctx->rhythm.RRBuffer[i] ;
 		else NVEst = 0 ;
 		if((NNEst == 0) && (NVEst != 0))
-			NNEst = (RRBuffer[1]+NVEst) >> 1 ;
+			NNEst = (ctx->rhythm.RRBuffer[1]+NVEst) >> 1 ;
 
 		// NNEst is either the last NN interval or the average
 		// of the most recent NV and VN intervals.
@@ -355,10 +349,10 @@ int RhythmChk(int rr)
 		// matching to NN.
 
 		if((NVEst != 0) &&
-			(abs(NNEst - RRBuffer[0]) < abs(NVEst - RRBuffer[0])) &&
-			RRMatch(NNEst,RRBuffer[0]))
+			(abs(NNEst - ctx->rhythm.RRBuffer[0]) < abs(NVEst - ctx->rhythm.RRBuffer[0])) &&
+			RRMatch(NNEst,ctx->rhythm.RRBuffer[0]))
 			{
-			RRTypes[0] = NN ;
+			ctx->rhythm.RRTypes[0] = NN ;
 			return(NORMAL) ;
 			}
 
@@ -366,10 +360,10 @@ int RhythmChk(int rr)
 		// matching to NV.
 
 		else if((NVEst != 0) &&
-			(abs(NNEst - RRBuffer[0]) > abs(NVEst - RRBuffer[0])) &&
-			RRMatch(NVEst,RRBuffer[0]))
+			(abs(NNEst - ctx->rhythm.RRBuffer[0]) > abs(NVEst - ctx->rhythm.RRBuffer[0])) &&
+			RRMatch(NVEst,ctx->rhythm.RRBuffer[0]))
 			{
-			RRTypes[0] = NV ;
+			ctx->rhythm.RRTypes[0] = NV ;
 			return(PVC) ;
 			}
 
@@ -378,7 +372,7 @@ int RhythmChk(int rr)
 
 		else
 			{
-			RRTypes[0] = QQ ;
+			ctx->rhythm.RRTypes[0] = QQ ;
 			return(UNKNOWN) ;
 			}
 		}
@@ -390,9 +384,9 @@ int RhythmChk(int rr)
 
 		// Does this match previous VV.
 
-		if(RRMatch(RRBuffer[0],RRBuffer[1]))
+		if(RRMatch(ctx->rhythm.RRBuffer[0],ctx->rhythm.RRBuffer[1]))
 			{
-			RRTypes[0] = VV ;
+			ctx->rhythm.RRTypes[0] = VV ;
 			return(PVC) ;
 			}
 
@@ -401,14 +395,14 @@ int RhythmChk(int rr)
 
 		else
 			{
-			if(RRShort(RRBuffer[0],RRBuffer[1]))
+			if(RRShort(ctx->rhythm.RRBuffer[0],ctx->rhythm.RRBuffer[1]))
 				{
-				RRTypes[0] = QQ ;
+				ctx->rhythm.RRTypes[0] = QQ ;
 				return(UNKNOWN) ;
 				}
 			else
 				{
-				RRTypes[0] = VN ;
+				ctx->rhythm.RRTypes[0] = VN ;
 				return(NORMAL) ;
 				}
 			}
@@ -444,9 +438,9 @@ int RRShort(int rr0, int rr1)
 	a bigeminal rhythm is in progress.
 **************************************************************************/
 
-int IsBigeminy(void)
+int IsBigeminy(OseaContext *ctx)
 	{
-	return(BigeminyFlag) ;
+	return(ctx->rhythm.BigeminyFlag) ;
 	}
 
 /**************************************************************************
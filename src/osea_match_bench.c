@@ -0,0 +1,254 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi, Sampo Savola
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/**
+ * @file osea_match_bench.c
+ *
+ * @brief Compare the speed of the vectorized OSEA beat template matching
+ * to the original point-by-point version, and check that both give
+ * exactly the same results.
+ *
+ * Usage: osea_match_bench [-b BEATS] [-r ROUNDS]
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* System */
+#include <math.h>
+#include <stdlib.h>
+
+/* GLib */
+#include <glib.h>
+
+/* Other modules */
+#include "osea/match.h"
+
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+#define OSEA_MATCH_BENCH_SEED		1234
+
+typedef double (*CompareFunc)(int *beat1, int *beat2, int *shift_adj);
+
+typedef struct _BenchCompare {
+	const gchar *name;
+	CompareFunc reference;
+	CompareFunc function;
+} BenchCompare;
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+static void osea_match_bench_generate(int *beat, GRand *rand);
+
+static gint osea_match_bench_verify(
+		const BenchCompare *compare,
+		int **beats,
+		gint beat_count);
+
+static gdouble osea_match_bench_time(
+		CompareFunc function,
+		int **beats,
+		gint beat_count,
+		gint rounds);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+gint main(gint argc, gchar **argv)
+{
+	GOptionContext *context = NULL;
+	GError *error = NULL;
+	GRand *rand = NULL;
+	int **beats = NULL;
+	gint beat_count = 64;
+	gint rounds = 20;
+	gint mismatches = 0;
+	gint total_mismatches = 0;
+	gdouble reference_ns = 0;
+	gdouble function_ns = 0;
+	gint i;
+
+	BenchCompare compares[] = {
+		{ "CompareBeats", CompareBeatsScalar, CompareBeats },
+		{ "CompareBeats2", CompareBeats2Scalar, CompareBeats2 }
+	};
+
+	GOptionEntry entries[] = {
+		{ "beats", 'b', 0, G_OPTION_ARG_INT, &beat_count,
+			"Amount of beats, every pair is compared", "N" },
+		{ "rounds", 'r', 0, G_OPTION_ARG_INT, &rounds,
+			"Amount of times the comparisons are repeated", "N" },
+		{ NULL }
+	};
+
+	context = g_option_context_new(NULL);
+	g_option_context_add_main_entries(context, entries, NULL);
+	if(!g_option_context_parse(context, &argc, &argv, &error))
+	{
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free(context);
+
+	if(beat_count < 1 || rounds < 1)
+	{
+		g_printerr("Usage: %s [-b BEATS] [-r ROUNDS]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	rand = g_rand_new_with_seed(OSEA_MATCH_BENCH_SEED);
+	beats = g_new(int *, beat_count);
+	for(i = 0; i < beat_count; i++)
+	{
+		beats[i] = g_new(int, BEATLGTH);
+		osea_match_bench_generate(beats[i], rand);
+	}
+
+	for(i = 0; i < G_N_ELEMENTS(compares); i++)
+	{
+		mismatches = osea_match_bench_verify(&compares[i], beats,
+				beat_count);
+		total_mismatches += mismatches;
+		reference_ns = osea_match_bench_time(compares[i].reference,
+				beats, beat_count, rounds);
+		function_ns = osea_match_bench_time(compares[i].function,
+				beats, beat_count, rounds);
+
+		g_print("%s:\n", compares[i].name);
+		g_print("  Mismatches:    %d\n", mismatches);
+		g_print("  Scalar:        %.1f ns/compare\n", reference_ns);
+		g_print("  Vectorized:    %.1f ns/compare\n", function_ns);
+		if(function_ns > 0)
+		{
+			g_print("  Speedup:       %.2f\n",
+					reference_ns / function_ns);
+		}
+	}
+
+	for(i = 0; i < beat_count; i++)
+	{
+		g_free(beats[i]);
+	}
+	g_free(beats);
+	g_rand_free(rand);
+
+	return total_mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*****************************************************************************
+ * Private functions                                                         *
+ *****************************************************************************/
+
+/**
+ * @brief Generate a beat with a randomly sized and placed QRS complex,
+ * a T-wave, baseline offset and noise
+ */
+static void osea_match_bench_generate(int *beat, GRand *rand)
+{
+	gdouble amplitude = g_rand_double_range(rand, 300, 2000);
+	gdouble width = g_rand_double_range(rand, 2, 8);
+	gdouble center = FIDMARK + g_rand_int_range(rand, -4, 5);
+	gdouble t_wave = g_rand_double_range(rand, -0.3, 0.4) * amplitude;
+	gint offset = g_rand_int_range(rand, -200, 200);
+	gdouble t = 0;
+	gint i;
+
+	for(i = 0; i < BEATLGTH; i++)
+	{
+		t = (i - center) / width;
+		beat[i] = offset
+			+ (int)(amplitude * exp(-t * t / 2))
+			+ (int)(t_wave * exp(-(i - center - 40) *
+						(i - center - 40) / 200.0))
+			+ g_rand_int_range(rand, -20, 21);
+	}
+}
+
+static gint osea_match_bench_verify(
+		const BenchCompare *compare,
+		int **beats,
+		gint beat_count)
+{
+	gint mismatches = 0;
+	gint shift_ref, shift;
+	gdouble metric_ref, metric;
+	gint i, j;
+
+	for(i = 0; i < beat_count; i++)
+	{
+		for(j = 0; j < beat_count; j++)
+		{
+			metric_ref = compare->reference(beats[i], beats[j],
+					&shift_ref);
+			metric = compare->function(beats[i], beats[j], &shift);
+			if(metric != metric_ref || shift != shift_ref)
+			{
+				mismatches++;
+			}
+		}
+	}
+	return mismatches;
+}
+
+/**
+ * @brief Time comparing every pair of beats
+ *
+ * @return Time of a single comparison in nanoseconds
+ */
+static gdouble osea_match_bench_time(
+		CompareFunc function,
+		int **beats,
+		gint beat_count,
+		gint rounds)
+{
+	GTimer *timer = NULL;
+	volatile gdouble sum = 0;
+	gdouble elapsed = 0;
+	gint shift;
+	gint round, i, j;
+
+	timer = g_timer_new();
+	for(round = 0; round < rounds; round++)
+	{
+		for(i = 0; i < beat_count; i++)
+		{
+			for(j = 0; j < beat_count; j++)
+			{
+				sum += function(beats[i], beats[j], &shift);
+			}
+		}
+	}
+	g_timer_stop(timer);
+	elapsed = g_timer_elapsed(timer, NULL);
+	g_timer_destroy(timer);
+
+	return elapsed * 1e9 / ((gdouble)rounds * beat_count * beat_count);
+}
@@ -104,6 +104,12 @@ struct _OsmGpsMapPrivate
 
     //additional images or tracks added to the map
     GSList *tracks;
+    //tracks added as arrays of coord_t, and their bounding box
+    GPtrArray *track_arrays;
+    coord_t track_arrays_min;
+    coord_t track_arrays_max;
+    //zoom to the tracks when the widget gets its size
+    gboolean fit_tracks_pending;
     GSList *images;
     GSList *buttons;
     
@@ -513,6 +519,14 @@ osm_gps_map_free_tracks (OsmGpsMap *map)
         g_slist_free(priv->tracks);
         priv->tracks = NULL;
     }
+    if (priv->track_arrays)
+    {
+        guint i;
+        for (i = 0; i < priv->track_arrays->len; i++)
+            g_array_free(g_ptr_array_index(priv->track_arrays, i), TRUE);
+        g_ptr_array_set_size(priv->track_arrays, 0);
+    }
+    priv->fit_tracks_pending = FALSE;
 }
 
 /* free the poi image lists */
@@ -1125,11 +1139,99 @@ osm_gps_map_print_track (OsmGpsMap *map, GSList *trackpoint_list)
 #endif
 }
 
+/* Same as osm_gps_map_print_track, for a track added as an array */
+static void
+osm_gps_map_print_track_array (OsmGpsMap *map, GArray *track)
+{
+    OsmGpsMapPrivate *priv = map->priv;
+
+    const coord_t *tp;
+    guint i;
+    int x,y;
+    int last_x = 0, last_y = 0;
+    int min_x = G_MAXINT,min_y = G_MAXINT,max_x = G_MININT,max_y = G_MININT;
+    int lw = priv->ui_gps_track_width;
+    int map_x0, map_y0;
+#ifdef USE_CAIRO
+    cairo_t *cr;
+#else
+    GdkColor color;
+    GdkGC *gc;
+#endif
+
+    if (track->len == 0)
+        return;
+
+#ifdef USE_CAIRO
+    cr = gdk_cairo_create(priv->pixmap);
+    cairo_set_line_width (cr, lw);
+    cairo_set_source_rgba (cr, 60000.0/65535.0, 0.0, 0.0, 0.6);
+    cairo_set_line_cap (cr, CAIRO_LINE_CAP_ROUND);
+    cairo_set_line_join (cr, CAIRO_LINE_JOIN_ROUND);
+#else
+    gc = gdk_gc_new(priv->pixmap);
+    color.green = 0;
+    color.blue = 0;
+    color.red = 60000;
+    gdk_gc_set_rgb_fg_color(gc, &color);
+    gdk_gc_set_line_attributes(gc, lw, GDK_LINE_SOLID, GDK_CAP_ROUND, GDK_JOIN_ROUND);
+#endif
+
+    map_x0 = priv->map_x - EXTRA_BORDER;
+    map_y0 = priv->map_y - EXTRA_BORDER;
+    for (i = 0; i < track->len; i++)
+    {
+        tp = &g_array_index(track, coord_t, i);
+
+        x = lon2pixel(priv->map_zoom, tp->rlon) - map_x0;
+        y = lat2pixel(priv->map_zoom, tp->rlat) - map_y0;
+
+        if (i == 0) {
+#ifdef USE_CAIRO
+            cairo_move_to(cr, x, y);
+#endif
+            last_x = x;
+            last_y = y;
+        } else if (x == last_x && y == last_y) {
+            // points closer than a pixel add nothing when zoomed out
+            continue;
+        }
+
+#ifdef USE_CAIRO
+        cairo_line_to(cr, x, y);
+#else
+        gdk_draw_line (priv->pixmap, gc, x, y, last_x, last_y);
+#endif
+        last_x = x;
+        last_y = y;
+
+        max_x = MAX(x,max_x);
+        min_x = MIN(x,min_x);
+        max_y = MAX(y,max_y);
+        min_y = MIN(y,min_y);
+    }
+
+    gtk_widget_queue_draw_area (
+                                GTK_WIDGET(map),
+                                min_x - lw,
+                                min_y - lw,
+                                max_x - min_x + (lw * 2),
+                                max_y - min_y + (lw * 2));
+
+#ifdef USE_CAIRO
+    cairo_stroke(cr);
+    cairo_destroy(cr);
+#else
+    g_object_unref(gc);
+#endif
+}
+
 /* Prints the gps trip history, and any other tracks */
 static void
 osm_gps_map_print_tracks (OsmGpsMap *map)
 {
     OsmGpsMapPrivate *priv = map->priv;
+    guint i;
 
     if (priv->show_trip_history)
         osm_gps_map_print_track (map, priv->trip_history);
@@ -1143,6 +1245,10 @@ osm_gps_map_print_tracks (OsmGpsMap *map)
             tmp = g_slist_next(tmp);
         }
     }
+
+    for (i = 0; i < priv->track_arrays->len; i++)
+        osm_gps_map_print_track_array (map,
+                g_ptr_array_index(priv->track_arrays, i));
 }
 
 static gboolean
@@ -1226,6 +1332,8 @@ osm_gps_map_init (OsmGpsMap *object)
     priv->gps_valid = FALSE;
 
     priv->tracks = NULL;
+    priv->track_arrays = g_ptr_array_new();
+    priv->fit_tracks_pending = FALSE;
     priv->images = NULL;
 
     priv->drag_counter = 0;
@@ -1372,6 +1480,7 @@ osm_gps_map_finalize (GObject *object)
 
     osm_gps_map_free_trip(map);
     osm_gps_map_free_tracks(map);
+    g_ptr_array_free(priv->track_arrays, TRUE);
 
     G_OBJECT_CLASS (osm_gps_map_parent_class)->finalize (object);
 }
@@ -1717,6 +1826,9 @@ osm_gps_map_configure (GtkWidget *widget, GdkEventConfigure *event)
 
     priv->gc_map = gdk_gc_new(priv->pixmap);
 
+    if (priv->fit_tracks_pending)
+        osm_gps_map_zoom_fit_tracks(OSM_GPS_MAP(widget));
+
     osm_gps_map_map_redraw(OSM_GPS_MAP(widget));
 
     return FALSE;
@@ -2270,6 +2382,106 @@ osm_gps_map_add_track (OsmGpsMap *map, GSList *track)
     }
 }
 
+void
+osm_gps_map_add_track_array (OsmGpsMap *map, const coord_t *points, guint n_points)
+{
+    OsmGpsMapPrivate *priv;
+    GArray *track;
+    guint i;
+
+    g_return_if_fail (OSM_IS_GPS_MAP (map));
+    g_return_if_fail (points != NULL || n_points == 0);
+    priv = map->priv;
+
+    if (n_points == 0)
+        return;
+
+    track = g_array_sized_new(FALSE, FALSE, sizeof(coord_t), n_points);
+    g_array_append_vals(track, points, n_points);
+
+    if (priv->track_arrays->len == 0) {
+        priv->track_arrays_min = points[0];
+        priv->track_arrays_max = points[0];
+    }
+    for (i = 0; i < n_points; i++) {
+        priv->track_arrays_min.rlat = MIN(priv->track_arrays_min.rlat, points[i].rlat);
+        priv->track_arrays_min.rlon = MIN(priv->track_arrays_min.rlon, points[i].rlon);
+        priv->track_arrays_max.rlat = MAX(priv->track_arrays_max.rlat, points[i].rlat);
+        priv->track_arrays_max.rlon = MAX(priv->track_arrays_max.rlon, points[i].rlon);
+    }
+
+    g_ptr_array_add(priv->track_arrays, track);
+    osm_gps_map_map_redraw_idle(map);
+}
+
+gboolean
+osm_gps_map_get_tracks_bbox (OsmGpsMap *map, coord_t *pt1, coord_t *pt2)
+{
+    OsmGpsMapPrivate *priv;
+
+    g_return_val_if_fail (OSM_IS_GPS_MAP (map), FALSE);
+    priv = map->priv;
+
+    if (priv->track_arrays->len == 0)
+        return FALSE;
+
+    if (pt1 && pt2) {
+        pt1->rlat = priv->track_arrays_max.rlat;
+        pt1->rlon = priv->track_arrays_min.rlon;
+        pt2->rlat = priv->track_arrays_min.rlat;
+        pt2->rlon = priv->track_arrays_max.rlon;
+    }
+    return TRUE;
+}
+
+void
+osm_gps_map_zoom_fit_tracks (OsmGpsMap *map)
+{
+    OsmGpsMapPrivate *priv;
+    int width, height;
+    int zoom;
+    int x1, y1, x2, y2;
+
+    g_return_if_fail (OSM_IS_GPS_MAP (map));
+    priv = map->priv;
+
+    if (priv->track_arrays->len == 0)
+        return;
+
+    width = GTK_WIDGET(map)->allocation.width;
+    height = GTK_WIDGET(map)->allocation.height;
+
+    // not allocated yet, wait for the configure event
+    if (width <= 1 || height <= 1) {
+        priv->fit_tracks_pending = TRUE;
+        return;
+    }
+    priv->fit_tracks_pending = FALSE;
+
+    // the largest zoom at which the tracks fit, with a small margin
+    for (zoom = priv->max_zoom; zoom > priv->min_zoom; zoom--) {
+        x1 = lon2pixel(zoom, priv->track_arrays_min.rlon);
+        x2 = lon2pixel(zoom, priv->track_arrays_max.rlon);
+        y1 = lat2pixel(zoom, priv->track_arrays_max.rlat);
+        y2 = lat2pixel(zoom, priv->track_arrays_min.rlat);
+        if (x2 - x1 <= width - width/8 && y2 - y1 <= height - height/8)
+            break;
+    }
+
+    priv->map_zoom = zoom;
+    x1 = lon2pixel(zoom, priv->track_arrays_min.rlon);
+    x2 = lon2pixel(zoom, priv->track_arrays_max.rlon);
+    y1 = lat2pixel(zoom, priv->track_arrays_max.rlat);
+    y2 = lat2pixel(zoom, priv->track_arrays_min.rlat);
+    priv->map_x = (x1 + x2) / 2 - width/2;
+    priv->map_y = (y1 + y2) / 2 - height/2;
+    priv->center_rlat = pixel2lat(zoom, (y1 + y2) / 2);
+    priv->center_rlon = pixel2lon(zoom, (x1 + x2) / 2);
+    priv->center_coord_set = TRUE;
+
+    osm_gps_map_map_redraw_idle(map);
+}
+
 void
 osm_gps_map_clear_tracks (OsmGpsMap *map)
 {
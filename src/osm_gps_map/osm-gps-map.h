@@ -88,6 +88,9 @@ void osm_gps_map_set_mapcenter (OsmGpsMap *map, float latitude, float longitude,
 void osm_gps_map_set_center (OsmGpsMap *map, float latitude, float longitude);
 int osm_gps_map_set_zoom (OsmGpsMap *map, int zoom);
 void osm_gps_map_add_track (OsmGpsMap *map, GSList *track);
+void osm_gps_map_add_track_array (OsmGpsMap *map, const coord_t *points, guint n_points);
+gboolean osm_gps_map_get_tracks_bbox (OsmGpsMap *map, coord_t *pt1, coord_t *pt2);
+void osm_gps_map_zoom_fit_tracks (OsmGpsMap *map);
 void osm_gps_map_clear_tracks (OsmGpsMap *map);
 void osm_gps_map_add_image (OsmGpsMap *map, float latitude, float longitude, GdkPixbuf *image);
 void osm_gps_map_add_button (OsmGpsMap *map, int x, int y, GdkPixbuf *image);
@@ -0,0 +1,241 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi, Sampo Savola
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* This module */
+#include "ring_buffer.h"
+
+/* System */
+#include <string.h>
+
+/* Other modules */
+#include "debug.h"
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+/*===========================================================================*
+ * Public functions                                                          *
+ *===========================================================================*/
+
+RingBuffer *ring_buffer_new(guint capacity)
+{
+	RingBuffer *self = NULL;
+	guint size = 1;
+
+	g_return_val_if_fail(capacity > 0, NULL);
+	DEBUG_BEGIN();
+
+	while(size < capacity)
+	{
+		size = size << 1;
+	}
+
+	self = g_new0(RingBuffer, 1);
+	self->data = g_malloc(size);
+	self->capacity = size;
+	self->mask = size - 1;
+
+	DEBUG_END();
+	return self;
+}
+
+void ring_buffer_free(RingBuffer *self)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	g_free(self->data);
+	g_free(self);
+
+	DEBUG_END();
+}
+
+guint ring_buffer_write(RingBuffer *self, const guint8 *data, guint len)
+{
+	guint write_pos;
+	guint first;
+
+	g_return_val_if_fail(self != NULL, 0);
+	g_return_val_if_fail(data != NULL || len == 0, 0);
+
+	len = MIN(len, self->capacity - self->len);
+	if(len == 0)
+	{
+		return 0;
+	}
+
+	/* The free space may be split in two parts: from the write position
+	 * to the end of the storage, and from the beginning of the storage
+	 * to the read position */
+	write_pos = (self->read_pos + self->len) & self->mask;
+	first = MIN(len, self->capacity - write_pos);
+
+	memcpy(self->data + write_pos, data, first);
+	if(first < len)
+	{
+		memcpy(self->data, data + first, len - first);
+	}
+
+	self->len += len;
+	return len;
+}
+
+guint ring_buffer_write_from(
+		RingBuffer *self,
+		RingBuffer *src,
+		guint offset,
+		guint len)
+{
+	guint start;
+	guint first;
+	guint written;
+
+	g_return_val_if_fail(self != NULL, 0);
+	g_return_val_if_fail(src != NULL, 0);
+	g_return_val_if_fail(offset + len <= src->len, 0);
+
+	/* The source data may be split in two contiguous parts */
+	start = (src->read_pos + offset) & src->mask;
+	first = MIN(len, src->capacity - start);
+
+	written = ring_buffer_write(self, src->data + start, first);
+	if(written == first && first < len)
+	{
+		written += ring_buffer_write(self, src->data, len - first);
+	}
+
+	return written;
+}
+
+void ring_buffer_skip(RingBuffer *self, guint len)
+{
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(len <= self->len);
+
+	self->read_pos = (self->read_pos + len) & self->mask;
+	self->len -= len;
+
+	if(self->len == 0)
+	{
+		/* Rewind so that subsequent data is more likely to be
+		 * contiguous */
+		self->read_pos = 0;
+	}
+}
+
+void ring_buffer_clear(RingBuffer *self)
+{
+	g_return_if_fail(self != NULL);
+
+	self->read_pos = 0;
+	self->len = 0;
+}
+
+void ring_buffer_copy(RingBuffer *self, guint offset, guint8 *dest, guint len)
+{
+	guint start;
+	guint first;
+
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(dest != NULL || len == 0);
+	g_return_if_fail(offset + len <= self->len);
+
+	start = (self->read_pos + offset) & self->mask;
+	first = MIN(len, self->capacity - start);
+
+	memcpy(dest, self->data + start, first);
+	if(first < len)
+	{
+		memcpy(dest + first, self->data, len - first);
+	}
+}
+
+gint ring_buffer_find(
+		RingBuffer *self,
+		guint offset,
+		const guint8 *needle,
+		guint needle_len)
+{
+	guint pos;
+	guint start;
+	guint span;
+	guint i;
+	const guint8 *found;
+
+	g_return_val_if_fail(self != NULL, -1);
+	g_return_val_if_fail(needle != NULL, -1);
+	g_return_val_if_fail(needle_len > 0, -1);
+
+	pos = offset;
+	while(pos + needle_len <= self->len)
+	{
+		/* Scan for the first byte in the contiguous part of the
+		 * storage that starts at pos */
+		start = (self->read_pos + pos) & self->mask;
+		span = MIN(self->len - needle_len + 1 - pos,
+				self->capacity - start);
+
+		found = memchr(self->data + start, needle[0], span);
+		if(!found)
+		{
+			pos += span;
+			continue;
+		}
+
+		pos += found - (self->data + start);
+		for(i = 1; i < needle_len; i++)
+		{
+			if(ring_buffer_peek(self, pos + i) != needle[i])
+			{
+				break;
+			}
+		}
+		if(i == needle_len)
+		{
+			return (gint)pos;
+		}
+		pos++;
+	}
+
+	return -1;
+}
+
+guint8 ring_buffer_sum(RingBuffer *self, guint offset, guint len)
+{
+	guint8 sum = 0;
+	guint i;
+
+	g_return_val_if_fail(self != NULL, 0);
+	g_return_val_if_fail(offset + len <= self->len, 0);
+
+	for(i = 0; i < len; i++)
+	{
+		sum += ring_buffer_peek(self, offset + i);
+	}
+
+	return sum;
+}
@@ -0,0 +1,202 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi, Sampo Savola
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+#ifndef _RING_BUFFER_H
+#define _RING_BUFFER_H
+
+/* Configuration */
+#include "config.h"
+
+/* GLib */
+#include <glib.h>
+
+/**
+ * @brief Fixed-capacity FIFO byte buffer with a read cursor.
+ *
+ * Data is appended to the end of the buffer and consumed from the read
+ * cursor. Consuming data only advances the cursor, so removing bytes from
+ * the beginning of the buffer is O(1) regardless of how much data is
+ * buffered.
+ *
+ * Consider all the fields private; use the functions below instead.
+ */
+typedef struct _RingBuffer {
+	/** @brief Storage, capacity bytes long */
+	guint8 *data;
+
+	/** @brief Capacity of the buffer. Always a power of two. */
+	guint capacity;
+
+	/** @brief capacity - 1, used for wrapping the indices */
+	guint mask;
+
+	/** @brief Index of the first unread byte in data */
+	guint read_pos;
+
+	/** @brief Amount of unread bytes in the buffer */
+	guint len;
+} RingBuffer;
+
+/**
+ * @brief Create a new ring buffer
+ *
+ * @param capacity Minimum capacity in bytes. This is rounded up to the
+ * nearest power of two.
+ *
+ * @return Newly allocated ring buffer
+ */
+RingBuffer *ring_buffer_new(guint capacity);
+
+/**
+ * @brief Free a ring buffer and its storage
+ *
+ * @param self Pointer to #RingBuffer
+ */
+void ring_buffer_free(RingBuffer *self);
+
+/**
+ * @brief Append data to the end of the buffer
+ *
+ * Only as much data as there is free space is appended.
+ *
+ * @param self Pointer to #RingBuffer
+ * @param data Data to append
+ * @param len Length of the data
+ *
+ * @return Amount of bytes that were appended
+ */
+guint ring_buffer_write(RingBuffer *self, const guint8 *data, guint len);
+
+/**
+ * @brief Append data from another ring buffer
+ *
+ * The data is not removed from the source buffer. Only as much data as
+ * there is free space is appended.
+ *
+ * @param self Pointer to #RingBuffer where to append
+ * @param src Pointer to #RingBuffer where to read the data from
+ * @param offset Offset from the read cursor of src
+ * @param len Amount of bytes to append. offset + len must not be greater
+ * than the amount of data buffered in src.
+ *
+ * @return Amount of bytes that were appended
+ */
+guint ring_buffer_write_from(
+		RingBuffer *self,
+		RingBuffer *src,
+		guint offset,
+		guint len);
+
+/**
+ * @brief Remove data from the beginning of the buffer
+ *
+ * @param self Pointer to #RingBuffer
+ * @param len Amount of bytes to remove. Must not be greater than the
+ * amount of buffered data.
+ */
+void ring_buffer_skip(RingBuffer *self, guint len);
+
+/**
+ * @brief Remove all data from the buffer
+ *
+ * @param self Pointer to #RingBuffer
+ */
+void ring_buffer_clear(RingBuffer *self);
+
+/**
+ * @brief Copy data from the buffer without removing it
+ *
+ * @param self Pointer to #RingBuffer
+ * @param offset Offset from the read cursor where to start copying
+ * @param dest Where to copy the data
+ * @param len Amount of bytes to copy. offset + len must not be greater
+ * than the amount of buffered data.
+ */
+void ring_buffer_copy(RingBuffer *self, guint offset, guint8 *dest, guint len);
+
+/**
+ * @brief Search for a byte sequence in the buffer
+ *
+ * @param self Pointer to #RingBuffer
+ * @param offset Offset from the read cursor where to start the search
+ * @param needle Byte sequence to search for (may contain NUL bytes)
+ * @param needle_len Length of the byte sequence
+ *
+ * @return Offset of the first match from the read cursor, or -1 if
+ * the sequence was not found
+ */
+gint ring_buffer_find(
+		RingBuffer *self,
+		guint offset,
+		const guint8 *needle,
+		guint needle_len);
+
+/**
+ * @brief Calculate an 8-bit additive checksum of buffered data
+ *
+ * @param self Pointer to #RingBuffer
+ * @param offset Offset from the read cursor where to start
+ * @param len Amount of bytes to sum
+ *
+ * @return Sum of the bytes, modulo 256
+ */
+guint8 ring_buffer_sum(RingBuffer *self, guint offset, guint len);
+
+/**
+ * @brief Get the amount of buffered data
+ *
+ * @param self Pointer to #RingBuffer
+ *
+ * @return Amount of unread bytes
+ */
+static inline guint ring_buffer_get_length(const RingBuffer *self)
+{
+	return self->len;
+}
+
+/**
+ * @brief Get the amount of free space in the buffer
+ *
+ * @param self Pointer to #RingBuffer
+ *
+ * @return Amount of bytes that can be appended without losing data
+ */
+static inline guint ring_buffer_get_free_space(const RingBuffer *self)
+{
+	return self->capacity - self->len;
+}
+
+/**
+ * @brief Read one byte without removing it
+ *
+ * @param self Pointer to #RingBuffer
+ * @param offset Offset from the read cursor. Must be less than the amount
+ * of buffered data.
+ *
+ * @return The byte at the given offset
+ */
+static inline guint8 ring_buffer_peek(const RingBuffer *self, guint offset)
+{
+	return self->data[(self->read_pos + offset) & self->mask];
+}
+
+#endif /* _RING_BUFFER_H */
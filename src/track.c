@@ -44,7 +44,8 @@
  * Definitions                                                               *
  *****************************************************************************/
 
-#define TRACK_HELPER_AUTOSAVE_INTERVAL 5 * 60 * 1000
+/* Autosave only syncs the journal to the disk, so it can be done often */
+#define TRACK_HELPER_AUTOSAVE_INTERVAL 30 * 1000
 
 /*****************************************************************************
  * Private function prototypes                                               *
@@ -65,6 +66,34 @@ static void track_helper_data_changed(TrackHelper *self);
  */
 static gboolean track_helper_autosave(gpointer user_data);
 
+/**
+ * @brief Show an error if writing the track data failed
+ *
+ * @param error The error, or NULL if the data was written
+ * @param user_data Pointer to #TrackHelper
+ */
+static void track_helper_write_done(const GError *error, gpointer user_data);
+
+/**
+ * @brief Empty the speed window, when the track is started or resumed
+ *
+ * @param window Pointer to #TrackHelperSpeedWindow
+ */
+static void track_helper_speed_window_clear(TrackHelperSpeedWindow *window);
+
+/**
+ * @brief Add the distance and time between two points to the speed
+ * window, replacing the oldest ones if the window is full
+ *
+ * @param window Pointer to #TrackHelperSpeedWindow
+ * @param distance Distance in meters
+ * @param time Time in microseconds
+ */
+static void track_helper_speed_window_add(
+		TrackHelperSpeedWindow *window,
+		gdouble distance,
+		gint64 time);
+
 /*****************************************************************************
  * Function declarations for TrackHelperPoint                                *
  *****************************************************************************/
@@ -106,7 +135,11 @@ TrackHelper *track_helper_new()
 
 	self = g_new0(TrackHelper, 1);
 
-	self->gpx_storage = gpx_storage_new();
+	self->track_points = g_array_new(FALSE, FALSE,
+			sizeof(TrackHelperPoint));
+
+	self->gpx_storage = gpx_storage_new_recording();
+	gpx_storage_set_journal_enabled(self->gpx_storage, TRUE);
 
 	self->state = TRACK_HELPER_STOPPED;
 
@@ -165,8 +198,11 @@ void track_helper_add_track_point(
 	g_return_if_fail(point != NULL);
 	DEBUG_BEGIN();
 
-	/* Create a copy of the point */
-	point_copy = track_helper_point_new();
+	/* Add a copy of the point to the array. We still can operate on it
+	 * after this */
+	g_array_set_size(self->track_points, self->track_points->len + 1);
+	point_copy = &g_array_index(self->track_points, TrackHelperPoint,
+			self->track_points->len - 1);
 	point_copy->latitude		= point->latitude;
 	point_copy->longitude		= point->longitude;
 	point_copy->altitude_is_set	= point->altitude_is_set;
@@ -174,10 +210,6 @@ void track_helper_add_track_point(
 	memcpy(&point_copy->timestamp, &point->timestamp,
 			sizeof(struct timeval));
 
-	/* Add the point to the list. We still can operate on it after this */
-	self->track_points = g_slist_prepend(self->track_points,
-			point_copy);
-
 	switch(self->state)
 	{
 		case TRACK_HELPER_STOPPED:
@@ -216,8 +248,14 @@ void track_helper_add_track_point(
 				self->track_comment);
 	}
 
+	/* The point has been stored even if no statistics can be
+	 * calculated for it */
+	track_helper_data_changed(self);
+
+	/* A heart rate may have started the track before any point */
 	if(self->state == TRACK_HELPER_STOPPED ||
-			self->state == TRACK_HELPER_PAUSED)
+			self->state == TRACK_HELPER_PAUSED ||
+			self->track_points->len < 2)
 	{
 		self->state = TRACK_HELPER_STARTED;
 		/* No previous point. Distance and elapsed time cannot
@@ -229,11 +267,8 @@ void track_helper_add_track_point(
 		return;
 	}
 
-	track_helper_data_changed(self);
-
-	/* Get the previous point from the list */
-	prev_point = (TrackHelperPoint *)g_slist_nth(
-			self->track_points, 1)->data;
+	prev_point = &g_array_index(self->track_points, TrackHelperPoint,
+			self->track_points->len - 2);
 
 	/* Calculate distance to previous point */
 	point_copy->distance_to_prev = location_distance_between(
@@ -248,10 +283,56 @@ void track_helper_add_track_point(
 			&prev_point->timestamp,
 			&point_copy->time_to_prev);
 
-	util_add_time(&self->elapsed_time, &point_copy->time_to_prev,
+	DEBUG_END();
+}
+
+void track_helper_update_statistics(
+		TrackHelper *self,
+		const TrackHelperPoint *point)
+{
+	struct timeval timestamp;
+	struct timeval time_to_prev;
+	gdouble distance_to_prev;
+
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(point != NULL);
+	DEBUG_BEGIN();
+
+	if(!self->statistics_point_is_set)
+	{
+		/* Started or resumed. Distance and elapsed time cannot be
+		 * calculated until the next point. */
+		self->statistics_point = *point;
+		self->statistics_point_is_set = TRUE;
+		self->statistics_point_count++;
+		track_helper_speed_window_clear(&self->speed_window);
+		DEBUG_END();
+		return;
+	}
+
+	distance_to_prev = location_distance_between(
+			point->latitude,
+			point->longitude,
+			self->statistics_point.latitude,
+			self->statistics_point.longitude
+			) * 1000.0;
+	timestamp = point->timestamp;
+	util_subtract_time(&timestamp,
+			&self->statistics_point.timestamp,
+			&time_to_prev);
+
+	util_add_time(&self->elapsed_time, &time_to_prev,
 			&self->elapsed_time);
 
-	self->travelled_distance += point_copy->distance_to_prev;
+	self->travelled_distance += distance_to_prev;
+
+	track_helper_speed_window_add(&self->speed_window,
+			distance_to_prev,
+			(gint64)time_to_prev.tv_sec * 1000000 +
+			time_to_prev.tv_usec);
+
+	self->statistics_point = *point;
+	self->statistics_point_count++;
 
 	DEBUG_END();
 }
@@ -261,12 +342,36 @@ void track_helper_add_heart_rate(
 		struct timeval *time,
 		gint heart_rate)
 {
-	GpxStoragePointType point_type;
+	GpxStorageHeartRate rate;
 
 	g_return_if_fail(self != NULL);
 	g_return_if_fail(time != NULL);
 	DEBUG_BEGIN();
 
+	rate.time = *time;
+	rate.heart_rate = heart_rate;
+	track_helper_add_heart_rates(self, &rate, 1);
+
+	DEBUG_END();
+}
+
+void track_helper_add_heart_rates(
+		TrackHelper *self,
+		const GpxStorageHeartRate *heart_rates,
+		guint count)
+{
+	GpxStoragePointType point_type;
+
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(heart_rates != NULL || count == 0);
+	DEBUG_BEGIN();
+
+	if(count == 0)
+	{
+		DEBUG_END();
+		return;
+	}
+
 	switch(self->state)
 	{
 		case TRACK_HELPER_STOPPED:
@@ -292,12 +397,12 @@ void track_helper_add_heart_rate(
 		self->state = TRACK_HELPER_STARTED;
 	}
 
-	gpx_storage_add_heart_rate(
+	gpx_storage_add_heart_rates(
 			self->gpx_storage,
 			point_type,
 			&self->current_track_id,
-			time,
-			heart_rate);
+			heart_rates,
+			count);
 
 	if(point_type == GPX_STORAGE_POINT_TYPE_TRACK_START)
 	{
@@ -321,30 +426,27 @@ void track_helper_pause(TrackHelper *self)
 	DEBUG_BEGIN();
 
 	self->state = TRACK_HELPER_PAUSED;
+	self->statistics_point_is_set = FALSE;
 
 	DEBUG_END();
 }
 
 void track_helper_stop(TrackHelper *self)
 {
-	GError *error = NULL;
 	g_return_if_fail(self != NULL);
 	DEBUG_BEGIN();
 
 	self->state = TRACK_HELPER_STOPPED;
-	if(!gpx_storage_write(self->gpx_storage, &error))
-	{
-		ec_error_show_message_error(error->message);
-		g_error_free(error);
-		error = NULL;
-	}
+	self->statistics_point_is_set = FALSE;
+	gpx_storage_write_async(self->gpx_storage,
+			track_helper_write_done,
+			self);
+
+	DEBUG_END();
 }
 
 void track_helper_clear(TrackHelper *self, gboolean remove_tracks)
 {
-	GSList *temp = NULL;
-	TrackHelperPoint *point;
-
 	g_return_if_fail(self != NULL);
 	DEBUG_BEGIN();
 
@@ -354,13 +456,10 @@ void track_helper_clear(TrackHelper *self, gboolean remove_tracks)
 	}
 
 	/* Clear all the current track points and reset statistics */
-	for(temp = self->track_points; temp; temp = g_slist_next(temp))
-	{
-		point = (TrackHelperPoint *)temp->data;
-		track_helper_point_free(point);
-	}
-	g_slist_free(self->track_points);
-	self->track_points = NULL;
+	g_array_set_size(self->track_points, 0);
+	track_helper_speed_window_clear(&self->speed_window);
+	self->statistics_point_is_set = FALSE;
+	self->statistics_point_count = 0;
 
 	self->travelled_distance = 0;
 	self->elapsed_time.tv_sec = 0;
@@ -372,7 +471,8 @@ void track_helper_clear(TrackHelper *self, gboolean remove_tracks)
 	if(remove_tracks)
 	{
 		gpx_storage_free(self->gpx_storage);
-		self->gpx_storage = gpx_storage_new();
+		self->gpx_storage = gpx_storage_new_recording();
+		gpx_storage_set_journal_enabled(self->gpx_storage, TRUE);
 	}
 
 	DEBUG_END();
@@ -404,15 +504,7 @@ guint track_helper_get_elapsed_time(TrackHelper *self)
 
 gdouble track_helper_get_current_speed(TrackHelper *self)
 {
-	gdouble distance_sum = 0;
-	struct timeval time_sum;
-	gdouble elapsed_secs;
-	gint i = 0;
-	GSList *temp = NULL;
-	TrackHelperPoint *point = NULL;
-
-	time_sum.tv_sec = 0;
-	time_sum.tv_usec = 0;
+	TrackHelperSpeedWindow *window = NULL;
 
 	g_return_val_if_fail(self != NULL, -1);
 	DEBUG_BEGIN();
@@ -420,42 +512,31 @@ gdouble track_helper_get_current_speed(TrackHelper *self)
 	if(self->state != TRACK_HELPER_STARTED)
 	{
 		DEBUG("Activity is not in started state");
+		DEBUG_END();
 		return -1;
 	}
 
-	if(g_slist_length(self->track_points) < 6)
+	if(self->statistics_point_count <= TRACK_HELPER_SPEED_WINDOW)
 	{
-		/* Less than five points, return the average speed of all
+		/* Not enough points yet, return the average speed of all
 		 * points so far */
+		DEBUG_END();
 		return track_helper_get_average_speed(self);
 	}
 
-	temp = self->track_points;
-	for(i = 0; i < 5; i++)
-	{
-		point = (TrackHelperPoint *)temp->data;
-		if(point->distance_to_prev == -1)
-		{
-			DEBUG_END();
-			return -1;
-		}
-		distance_sum += point->distance_to_prev;
-		util_add_time(&time_sum, &point->time_to_prev, &time_sum);
-		temp = g_slist_next(temp);
-	}
-
-	elapsed_secs = (gdouble)time_sum.tv_sec +
-		(gdouble)time_sum.tv_usec / 1000000.0;
-
-	if(elapsed_secs == 0)
+	window = &self->speed_window;
+	if(window->count < TRACK_HELPER_SPEED_WINDOW ||
+			window->time_sum == 0)
 	{
+		/* The track was resumed too recently */
 		DEBUG_END();
 		return -1;
 	}
 
 	DEBUG_END();
 	/* Calculate the speed and convert to km/h */
-	return distance_sum / elapsed_secs * 3.6;
+	return window->distance_sum / ((gdouble)window->time_sum / 1000000.0)
+		* 3.6;
 }
 
 gdouble track_helper_get_average_speed(TrackHelper *self)
@@ -476,6 +557,21 @@ gdouble track_helper_get_average_speed(TrackHelper *self)
 	return self->travelled_distance / elapsed_secs * 3.6;
 }
 
+guint track_helper_get_track_point_count(TrackHelper *self)
+{
+	g_return_val_if_fail(self != NULL, 0);
+	return self->track_points->len;
+}
+
+const TrackHelperPoint *track_helper_get_track_point(
+		TrackHelper *self,
+		guint i)
+{
+	g_return_val_if_fail(self != NULL, NULL);
+	g_return_val_if_fail(i < self->track_points->len, NULL);
+	return &g_array_index(self->track_points, TrackHelperPoint, i);
+}
+
 /*===========================================================================*
  * Private functions                                                         *
  *===========================================================================*/
@@ -508,8 +604,13 @@ static gboolean track_helper_autosave(gpointer user_data)
 	g_return_val_if_fail(self != NULL, FALSE);
 	DEBUG_BEGIN();
 
-	if(!gpx_storage_write(self->gpx_storage, &error))
+	if(!self->gpx_storage->journal)
 	{
+		/* Without a journal, the whole file needs to be written */
+		gpx_storage_write_async(self->gpx_storage,
+				track_helper_write_done,
+				self);
+	} else if(!gpx_storage_sync(self->gpx_storage, &error)) {
 		ec_error_show_message_error_printf(
 				"Unable to autosave track data:\n%s",
 				error->message);
@@ -525,3 +626,55 @@ static gboolean track_helper_autosave(gpointer user_data)
 	 * if data changes again */
 	return FALSE;
 }
+
+static void track_helper_write_done(const GError *error, gpointer user_data)
+{
+	DEBUG_BEGIN();
+
+	if(error)
+	{
+		ec_error_show_message_error_printf(
+				"Unable to save track data:\n%s",
+				error->message);
+	}
+
+	DEBUG_END();
+}
+
+static void track_helper_speed_window_clear(TrackHelperSpeedWindow *window)
+{
+	memset(window, 0, sizeof(TrackHelperSpeedWindow));
+}
+
+static void track_helper_speed_window_add(
+		TrackHelperSpeedWindow *window,
+		gdouble distance,
+		gint64 time)
+{
+	guint i;
+
+	if(window->count == TRACK_HELPER_SPEED_WINDOW)
+	{
+		window->distance_sum -= window->distances[window->next];
+		window->time_sum -= window->times[window->next];
+	} else {
+		window->count++;
+	}
+
+	window->distances[window->next] = distance;
+	window->times[window->next] = time;
+	window->distance_sum += distance;
+	window->time_sum += time;
+
+	window->next = (window->next + 1) % TRACK_HELPER_SPEED_WINDOW;
+	if(window->next == 0)
+	{
+		/* Sum the distances again once per round, so that rounding
+		 * errors do not add up over a long exercise */
+		window->distance_sum = 0;
+		for(i = 0; i < window->count; i++)
+		{
+			window->distance_sum += window->distances[i];
+		}
+	}
+}
@@ -36,6 +36,9 @@
 /* Other modules */
 #include "gpx.h"
 
+/** @brief Amount of latest points that the current speed is computed from */
+#define TRACK_HELPER_SPEED_WINDOW	5
+
 typedef enum _TrackHelperState {
 	TRACK_HELPER_STOPPED,
 	TRACK_HELPER_PAUSED,
@@ -92,14 +95,52 @@ TrackHelperPoint *track_helper_point_new();
  */
 void track_helper_point_free(TrackHelperPoint *point);
 
+/**
+ * @brief Distances and times between the latest points, for computing
+ * the current speed without going through the points
+ */
+typedef struct _TrackHelperSpeedWindow {
+	/** @brief Distances to the previous points in meters */
+	gdouble distances[TRACK_HELPER_SPEED_WINDOW];
+
+	/** @brief Times to the previous points in microseconds */
+	gint64 times[TRACK_HELPER_SPEED_WINDOW];
+
+	/** @brief Index of the oldest item, which is replaced next */
+	guint next;
+
+	/** @brief Amount of items since the track was started or resumed */
+	guint count;
+
+	gdouble distance_sum;
+	gint64 time_sum;
+} TrackHelperSpeedWindow;
+
 typedef struct _TrackHelper {
 	/**
-	 * @brief List of track points
+	 * @brief Array of #TrackHelperPoint, oldest first
 	 *
-	 * @note The list points are in reverse order (latest point first),
-	 * because prepending to a linked list is faster than appending
+	 * The points are stored by value, so adding a point does not
+	 * allocate memory except when the array grows.
+	 */
+	GArray *track_points;
+
+	/** @brief The latest points, for the current speed */
+	TrackHelperSpeedWindow speed_window;
+
+	/**
+	 * @brief The previous point given to track_helper_update_statistics()
+	 */
+	TrackHelperPoint statistics_point;
+
+	/**
+	 * @brief Whether or not statistics_point is set. It is not after
+	 * the track has been paused or stopped.
 	 */
-	GSList *track_points;
+	gboolean statistics_point_is_set;
+
+	/** @brief Amount of points the statistics are computed from */
+	guint statistics_point_count;
 
 	time_t start;
 	time_t end;
@@ -184,12 +225,28 @@ void track_helper_set_comment(
  * @param point #TrackHelperPoint to be added to track (a copy of the
  * point is created, so a reference to a temporary object may be passed)
  *
- * Adding a point starts or resumes (on pause) the track helper
+ * Adding a point starts or resumes (on pause) the track helper. The point
+ * is only stored; the distance, elapsed time and speeds are computed from
+ * the points given to track_helper_update_statistics().
  */
 void track_helper_add_track_point(
 		TrackHelper *self,
 		const TrackHelperPoint *point);
 
+/**
+ * @brief Update the distance, elapsed time and speeds with a new point
+ *
+ * This is given every point that is received, also the ones that are not
+ * stored in the track, so that the statistics are up to date and as
+ * accurate as possible even when the track is simplified.
+ *
+ * @param self Pointer to #TrackHelper
+ * @param point The new point. Only the location and time stamp are used.
+ */
+void track_helper_update_statistics(
+		TrackHelper *self,
+		const TrackHelperPoint *point);
+
 /**
  * @brief Add a detected heart rate to a track. The heart rate can be added
  * to a "track" even when GPS is not in use.
@@ -203,6 +260,18 @@ void track_helper_add_heart_rate(
 		struct timeval *time,
 		gint heart_rate);
 
+/**
+ * @brief Add several heart rates to a track at once
+ *
+ * @param self Pointer to #TrackHelper
+ * @param heart_rates The heart rates, oldest first
+ * @param count Amount of heart rates
+ */
+void track_helper_add_heart_rates(
+		TrackHelper *self,
+		const GpxStorageHeartRate *heart_rates,
+		guint count);
+
 /**
  * @brief Add a pause to track
  *
@@ -238,6 +307,9 @@ guint track_helper_get_elapsed_time(TrackHelper *self);
 /**
  * @brief Get current speed (in km/h)
  *
+ * The speed is computed from the latest #TRACK_HELPER_SPEED_WINDOW points,
+ * in constant time.
+ *
  * @param self Pointer to #TrackHelper
  *
  * @return Current speed, or -1 if the speed cannot be calculated
@@ -270,13 +342,28 @@ gdouble track_helper_get_travelled_distance(TrackHelper *self);
  */
 
 /**
- * @brief Returns a GList of track points
+ * @brief Get the amount of track points
+ *
+ * @param self Pointer to #TrackHelper
+ *
+ * @return Amount of track points
+ */
+guint track_helper_get_track_point_count(TrackHelper *self);
+
+/**
+ * @brief Get a track point
  *
- * @note The list items are in reverse order, because prepending is much
- * more effective with linked lists than appending
+ * @param self Pointer to #TrackHelper
+ * @param i Index of the point, oldest first. Must be less than
+ * track_helper_get_track_point_count().
  *
- * @warning Do not modify or free the list or its elements.
+ * @return The point. It is valid until the next point is added or the
+ * points are cleared.
+ *
+ * @warning Do not modify or free the point.
  */
-const GSList *track_helper_get_track_points(TrackHelper *self);
+const TrackHelperPoint *track_helper_get_track_point(
+		TrackHelper *self,
+		guint i);
 
 #endif /* _TRACK_H */
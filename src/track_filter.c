@@ -0,0 +1,488 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* This module */
+#include "track_filter.h"
+
+/* System */
+#include <math.h>
+#include <string.h>
+
+/* Location */
+#include "location-distance-utils-fix.h"
+
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+/** @brief Length of one degree of latitude in meters */
+#define TRACK_FILTER_METERS_PER_DEGREE	111195.0
+
+struct _TrackFilter {
+	TrackFilterMode mode;
+
+	TrackFilterCallback callback;
+	gpointer user_data;
+
+	/* Thresholds, see track_filter_set_thresholds() */
+	gdouble distance;
+	gdouble altitude;
+	gdouble interval;
+	gdouble max_error;
+
+	/** @brief Whether or not a point has been recorded since reset */
+	gboolean has_anchor;
+
+	/** @brief The previously recorded point */
+	TrackHelperPoint anchor;
+
+	/**
+	 * @brief Array of #TrackHelperPoint that have been held back since
+	 * the anchor, in #TRACK_FILTER_MODE_MAX_ERROR mode
+	 */
+	GArray *pending;
+
+	guint points_in;
+	guint points_out;
+};
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Record a point and make it the anchor
+ *
+ * @param self Pointer to #TrackFilter
+ * @param point The point to record
+ */
+static void track_filter_record(
+		TrackFilter *self,
+		const TrackHelperPoint *point);
+
+/**
+ * @brief Check whether a point is to be recorded, in
+ * #TRACK_FILTER_MODE_FIXED and #TRACK_FILTER_MODE_ADAPTIVE modes
+ *
+ * @param self Pointer to #TrackFilter
+ * @param point The new point
+ * @param speed Speed in meters per second, or negative if not known
+ *
+ * @return TRUE if the point is to be recorded
+ */
+static gboolean track_filter_exceeds_thresholds(
+		TrackFilter *self,
+		const TrackHelperPoint *point,
+		gdouble speed);
+
+/**
+ * @brief Handle a new point in #TRACK_FILTER_MODE_MAX_ERROR mode
+ *
+ * @param self Pointer to #TrackFilter
+ * @param point The new point
+ */
+static void track_filter_add_point_max_error(
+		TrackFilter *self,
+		const TrackHelperPoint *point);
+
+/**
+ * @brief Check whether the line from the anchor to a point passes all
+ * the held back points within the maximum error
+ *
+ * @param self Pointer to #TrackFilter
+ * @param point End point of the line
+ *
+ * @return TRUE if the held back points can be dropped
+ */
+static gboolean track_filter_within_error(
+		TrackFilter *self,
+		const TrackHelperPoint *point);
+
+/**
+ * @brief Get the time between two points in seconds
+ *
+ * @param from The earlier point
+ * @param to The later point
+ *
+ * @return Time from the first point to the second one
+ */
+static gdouble track_filter_seconds_between(
+		const TrackHelperPoint *from,
+		const TrackHelperPoint *to);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+/*===========================================================================*
+ * Public functions                                                          *
+ *===========================================================================*/
+
+TrackFilter *track_filter_new(
+		TrackFilterCallback callback,
+		gpointer user_data)
+{
+	TrackFilter *self = NULL;
+
+	g_return_val_if_fail(callback != NULL, NULL);
+	DEBUG_BEGIN();
+
+	self = g_new0(TrackFilter, 1);
+	self->mode = TRACK_FILTER_MODE_FIXED;
+	self->callback = callback;
+	self->user_data = user_data;
+
+	self->distance = TRACK_FILTER_DEFAULT_DISTANCE;
+	self->altitude = TRACK_FILTER_DEFAULT_ALTITUDE;
+	self->interval = TRACK_FILTER_DEFAULT_INTERVAL;
+	self->max_error = TRACK_FILTER_DEFAULT_MAX_ERROR;
+
+	self->pending = g_array_new(FALSE, FALSE, sizeof(TrackHelperPoint));
+
+	DEBUG_END();
+	return self;
+}
+
+void track_filter_free(TrackFilter *self)
+{
+	if(!self)
+	{
+		return;
+	}
+
+	DEBUG_BEGIN();
+
+	DEBUG("Recorded %d of %d points", self->points_out, self->points_in);
+
+	g_array_free(self->pending, TRUE);
+	g_free(self);
+
+	DEBUG_END();
+}
+
+void track_filter_set_mode(TrackFilter *self, TrackFilterMode mode)
+{
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(mode >= 0 && mode < TRACK_FILTER_MODE_COUNT);
+	DEBUG_BEGIN();
+
+	track_filter_flush(self);
+	self->mode = mode;
+
+	DEBUG_END();
+}
+
+void track_filter_set_thresholds(
+		TrackFilter *self,
+		gdouble distance,
+		gdouble altitude,
+		gdouble interval,
+		gdouble max_error)
+{
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(distance >= 0 && altitude >= 0);
+	g_return_if_fail(interval >= 0 && max_error >= 0);
+	DEBUG_BEGIN();
+
+	self->distance = distance;
+	self->altitude = altitude;
+	self->interval = interval;
+	self->max_error = max_error;
+
+	DEBUG_END();
+}
+
+void track_filter_add_point(
+		TrackFilter *self,
+		const TrackHelperPoint *point,
+		gdouble speed)
+{
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(point != NULL);
+	DEBUG_BEGIN();
+
+	self->points_in++;
+
+	if(!self->has_anchor)
+	{
+		/* Always record the first point */
+		track_filter_record(self, point);
+		DEBUG_END();
+		return;
+	}
+
+	switch(self->mode)
+	{
+		case TRACK_FILTER_MODE_FIXED:
+		case TRACK_FILTER_MODE_ADAPTIVE:
+			if(track_filter_exceeds_thresholds(self, point, speed))
+			{
+				track_filter_record(self, point);
+			}
+			break;
+		case TRACK_FILTER_MODE_MAX_ERROR:
+			track_filter_add_point_max_error(self, point);
+			break;
+		default:
+			g_warning("Unknown track filter mode: %d", self->mode);
+			track_filter_record(self, point);
+			break;
+	}
+
+	DEBUG_END();
+}
+
+void track_filter_flush(TrackFilter *self)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	if(self->pending->len > 0)
+	{
+		track_filter_record(self, &g_array_index(self->pending,
+					TrackHelperPoint,
+					self->pending->len - 1));
+		g_array_set_size(self->pending, 0);
+	}
+
+	DEBUG_END();
+}
+
+void track_filter_reset(TrackFilter *self)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	self->has_anchor = FALSE;
+	g_array_set_size(self->pending, 0);
+
+	DEBUG_END();
+}
+
+void track_filter_get_counts(
+		TrackFilter *self,
+		guint *points_in,
+		guint *points_out)
+{
+	g_return_if_fail(self != NULL);
+
+	if(points_in)
+	{
+		*points_in = self->points_in;
+	}
+	if(points_out)
+	{
+		*points_out = self->points_out;
+	}
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static void track_filter_record(
+		TrackFilter *self,
+		const TrackHelperPoint *point)
+{
+	TrackHelperPoint point_copy;
+
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(point != NULL);
+	DEBUG_BEGIN();
+
+	/* The point may be in the pending array, which the callback must
+	 * not see change under it */
+	memcpy(&point_copy, point, sizeof(TrackHelperPoint));
+	memcpy(&self->anchor, point, sizeof(TrackHelperPoint));
+	self->has_anchor = TRUE;
+	self->points_out++;
+
+	self->callback(&point_copy, self->user_data);
+
+	DEBUG_END();
+}
+
+static gboolean track_filter_exceeds_thresholds(
+		TrackFilter *self,
+		const TrackHelperPoint *point,
+		gdouble speed)
+{
+	gdouble distance;
+	gdouble seconds;
+	gdouble threshold;
+
+	g_return_val_if_fail(self != NULL, TRUE);
+	g_return_val_if_fail(point != NULL, TRUE);
+
+	if(self->altitude > 0 &&
+			self->anchor.altitude_is_set &&
+			point->altitude_is_set &&
+			fabs(self->anchor.altitude - point->altitude) >=
+			self->altitude)
+	{
+		DEBUG("Altitude has changed at least %.1f meters",
+				self->altitude);
+		return TRUE;
+	}
+
+	distance = location_distance_between(
+			self->anchor.latitude,
+			self->anchor.longitude,
+			point->latitude,
+			point->longitude) * 1000.0;
+	seconds = track_filter_seconds_between(&self->anchor, point);
+
+	threshold = self->distance;
+	if(self->mode == TRACK_FILTER_MODE_ADAPTIVE)
+	{
+		if(speed < 0)
+		{
+			speed = seconds > 0 ? distance / seconds : 0;
+		}
+		threshold = CLAMP(speed * TRACK_FILTER_ADAPTIVE_TIME,
+				self->distance,
+				self->distance *
+				TRACK_FILTER_ADAPTIVE_MAX_FACTOR);
+	}
+
+	if(distance >= threshold)
+	{
+		DEBUG("Distance has changed at least %.1f meters",
+				threshold);
+		return TRUE;
+	}
+
+	if(self->interval > 0 && seconds >= self->interval)
+	{
+		DEBUG("At least %.0f seconds since the previous point",
+				self->interval);
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void track_filter_add_point_max_error(
+		TrackFilter *self,
+		const TrackHelperPoint *point)
+{
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(point != NULL);
+	DEBUG_BEGIN();
+
+	/* If the line to the new point would miss one of the held back
+	 * points, the track turned at the newest held back point. Record it
+	 * and start a new line from there. */
+	if(self->pending->len > 0)
+	{
+		if(self->pending->len >= TRACK_FILTER_MAX_PENDING ||
+				(self->interval > 0 &&
+				 track_filter_seconds_between(&self->anchor,
+					 point) >= self->interval) ||
+				!track_filter_within_error(self, point))
+		{
+			track_filter_flush(self);
+		}
+	}
+
+	g_array_append_val(self->pending, *point);
+
+	DEBUG_END();
+}
+
+static gboolean track_filter_within_error(
+		TrackFilter *self,
+		const TrackHelperPoint *point)
+{
+	const TrackHelperPoint *held;
+	gdouble scale_x;
+	gdouble dx, dy, length2;
+	gdouble px, py, t;
+	gdouble ex, ey;
+	gdouble altitude;
+	guint i;
+
+	g_return_val_if_fail(self != NULL, FALSE);
+	g_return_val_if_fail(point != NULL, FALSE);
+
+	/* Over the short distances between the points, the coordinates can
+	 * be treated as flat, in meters from the anchor */
+	scale_x = TRACK_FILTER_METERS_PER_DEGREE *
+		cos(self->anchor.latitude * M_PI / 180.0);
+	dx = (point->longitude - self->anchor.longitude) * scale_x;
+	dy = (point->latitude - self->anchor.latitude) *
+		TRACK_FILTER_METERS_PER_DEGREE;
+	length2 = dx * dx + dy * dy;
+
+	for(i = 0; i < self->pending->len; i++)
+	{
+		held = &g_array_index(self->pending, TrackHelperPoint, i);
+		px = (held->longitude - self->anchor.longitude) * scale_x;
+		py = (held->latitude - self->anchor.latitude) *
+			TRACK_FILTER_METERS_PER_DEGREE;
+
+		/* Nearest point of the line segment */
+		t = 0;
+		if(length2 > 0)
+		{
+			t = CLAMP((px * dx + py * dy) / length2, 0, 1);
+		}
+		ex = px - t * dx;
+		ey = py - t * dy;
+		if(ex * ex + ey * ey > self->max_error * self->max_error)
+		{
+			return FALSE;
+		}
+
+		if(self->altitude > 0 &&
+				held->altitude_is_set &&
+				self->anchor.altitude_is_set &&
+				point->altitude_is_set)
+		{
+			altitude = self->anchor.altitude + t *
+				(point->altitude - self->anchor.altitude);
+			if(fabs(held->altitude - altitude) >= self->altitude)
+			{
+				return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+static gdouble track_filter_seconds_between(
+		const TrackHelperPoint *from,
+		const TrackHelperPoint *to)
+{
+	g_return_val_if_fail(from != NULL, 0);
+	g_return_val_if_fail(to != NULL, 0);
+
+	return (to->timestamp.tv_sec - from->timestamp.tv_sec) +
+		(to->timestamp.tv_usec - from->timestamp.tv_usec) / 1000000.0;
+}
@@ -0,0 +1,217 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/**
+ * @file track_filter.h
+ *
+ * @brief Decimation of the GPS points before they are recorded
+ *
+ * The GPS device delivers a fix every few seconds, but most of them add
+ * nothing to the shape of the track. A #TrackFilter decides which of the
+ * points are passed on to the #TrackHelper, so that a long exercise does
+ * not store (and later draw and analyze) thousands of redundant points.
+ *
+ * The filter has three modes:
+ *
+ * - #TRACK_FILTER_MODE_FIXED: A point is recorded when it is far enough
+ *   from the previously recorded point, when the altitude has changed
+ *   enough, or when enough time has passed.
+ * - #TRACK_FILTER_MODE_ADAPTIVE: Like #TRACK_FILTER_MODE_FIXED, but the
+ *   distance grows with the speed, so that the points are roughly the
+ *   same time apart when moving fast.
+ * - #TRACK_FILTER_MODE_MAX_ERROR: A point is held back as long as the
+ *   track from the previously recorded point to the newest point stays
+ *   within the maximum error from all the points in between. This keeps
+ *   straight stretches as a single line and the corners where they are,
+ *   like the Douglas-Peucker algorithm does for a complete track. The
+ *   recorded points are delayed by one point.
+ *
+ * Only the stored track is simplified. The distance and speeds shown during
+ * the exercise are computed from every point with
+ * track_helper_update_statistics().
+ */
+
+#ifndef _TRACK_FILTER_H
+#define _TRACK_FILTER_H
+
+/* Configuration */
+#include "config.h"
+
+/* GLib */
+#include <glib.h>
+
+/* Other modules */
+#include "track.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+#define TRACK_FILTER_DEFAULT_DISTANCE		10
+#define TRACK_FILTER_DEFAULT_ALTITUDE		2
+#define TRACK_FILTER_DEFAULT_INTERVAL		0
+#define TRACK_FILTER_DEFAULT_MAX_ERROR		5
+
+/**
+ * @brief Time between points at which #TRACK_FILTER_MODE_ADAPTIVE starts
+ * to increase the distance, in seconds
+ */
+#define TRACK_FILTER_ADAPTIVE_TIME		5
+
+/**
+ * @brief How many times the configured distance #TRACK_FILTER_MODE_ADAPTIVE
+ * may use at most
+ */
+#define TRACK_FILTER_ADAPTIVE_MAX_FACTOR	5
+
+/**
+ * @brief Maximum amount of points #TRACK_FILTER_MODE_MAX_ERROR holds back
+ * before recording one anyway
+ */
+#define TRACK_FILTER_MAX_PENDING		120
+
+typedef enum _TrackFilterMode {
+	TRACK_FILTER_MODE_FIXED = 0,
+	TRACK_FILTER_MODE_ADAPTIVE,
+	TRACK_FILTER_MODE_MAX_ERROR,
+	TRACK_FILTER_MODE_COUNT
+} TrackFilterMode;
+
+typedef struct _TrackFilter TrackFilter;
+
+/**
+ * @brief Function that records a point that passed the filter
+ *
+ * @param point The point. Only the location, altitude and time stamp are
+ * set.
+ * @param user_data User data that was given with the callback
+ */
+typedef void (*TrackFilterCallback)(
+		TrackHelperPoint *point,
+		gpointer user_data);
+
+/*****************************************************************************
+ * Function prototypes                                                       *
+ *****************************************************************************/
+
+/**
+ * @brief Create a new filter in #TRACK_FILTER_MODE_FIXED mode with the
+ * default thresholds
+ *
+ * @param callback Function to call with the points to record
+ * @param user_data User data to pass to the callback
+ *
+ * @return Newly allocated #TrackFilter
+ */
+TrackFilter *track_filter_new(
+		TrackFilterCallback callback,
+		gpointer user_data);
+
+/**
+ * @brief Free a filter. Points that are held back are not recorded.
+ *
+ * @param self Pointer to #TrackFilter
+ */
+void track_filter_free(TrackFilter *self);
+
+/**
+ * @brief Set the mode of the filter
+ *
+ * The points that are held back are recorded first.
+ *
+ * @param self Pointer to #TrackFilter
+ * @param mode The mode
+ */
+void track_filter_set_mode(TrackFilter *self, TrackFilterMode mode);
+
+/**
+ * @brief Set the thresholds of the filter
+ *
+ * @param self Pointer to #TrackFilter
+ * @param distance Distance in meters after which a point is recorded. In
+ * #TRACK_FILTER_MODE_ADAPTIVE mode this is the shortest distance.
+ * @param altitude Change of altitude in meters after which a point is
+ * recorded, or 0 to ignore the altitude
+ * @param interval Time in seconds after which a point is recorded even if
+ * it has not moved, or 0 to record points only when moving
+ * @param max_error Maximum distance in meters between the recorded track
+ * and a dropped point, for #TRACK_FILTER_MODE_MAX_ERROR
+ */
+void track_filter_set_thresholds(
+		TrackFilter *self,
+		gdouble distance,
+		gdouble altitude,
+		gdouble interval,
+		gdouble max_error);
+
+/**
+ * @brief Pass a new GPS point to the filter
+ *
+ * The first point after creating or resetting the filter is always
+ * recorded.
+ *
+ * @param self Pointer to #TrackFilter
+ * @param point The point. Only the location, altitude and time stamp are
+ * used.
+ * @param speed The speed reported by the GPS device in meters per second,
+ * or a negative value if it is not known
+ */
+void track_filter_add_point(
+		TrackFilter *self,
+		const TrackHelperPoint *point,
+		gdouble speed);
+
+/**
+ * @brief Record the point that is held back, if any
+ *
+ * This must be called before pausing or stopping the track, so that the
+ * track ends where the user was.
+ *
+ * @param self Pointer to #TrackFilter
+ */
+void track_filter_flush(TrackFilter *self);
+
+/**
+ * @brief Forget the previous points, so that the next point is recorded
+ *
+ * Points that are held back are dropped; call track_filter_flush() first
+ * to record them.
+ *
+ * @param self Pointer to #TrackFilter
+ */
+void track_filter_reset(TrackFilter *self);
+
+/**
+ * @brief Get the amount of points given to the filter and the amount of
+ * points it has recorded since it was created
+ *
+ * @param self Pointer to #TrackFilter
+ * @param points_in Return location for the amount of points given, or NULL
+ * @param points_out Return location for the amount of points recorded, or
+ * NULL
+ */
+void track_filter_get_counts(
+		TrackFilter *self,
+		guint *points_in,
+		guint *points_out);
+
+#endif /* _TRACK_FILTER_H */
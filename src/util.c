@@ -35,22 +35,112 @@
 #include <glib/gmessages.h>
 #include <glib/gstrfuncs.h>
 #include <glib/gmem.h>
+#include <glib/gthread.h>
 
 /* Other modules */
 #include "debug.h"
 
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+#define UTIL_SECONDS_PER_DAY		86400
+
+/**
+ * @brief Offset of the local time from UTC during one local day
+ *
+ * Looking up the offset with localtime_r() for every time that is
+ * formatted would be slow, so it is looked up once and then reused for
+ * the rest of the day. On days when the offset changes (daylight saving
+ * time starts or ends), the offset is looked up every time.
+ */
+typedef struct _UtilUtcOffsetCache {
+	time_t valid_from;
+	time_t valid_until;
+	gboolean constant;
+	glong offset;
+	gchar timezone_string[8];
+} UtilUtcOffsetCache;
+
 /*****************************************************************************
  * Static variables                                                          *
  *****************************************************************************/
 
 static Settings *_util_settings = NULL;
 
+static UtilUtcOffsetCache _util_utc_offset_cache = { 0, 0, FALSE, 0, "" };
+G_LOCK_DEFINE_STATIC(_util_utc_offset_cache);
+
 /*****************************************************************************
  * Private function prototypes                                               *
  *****************************************************************************/
 
 static const gchar *util_get_timezone_string();
 
+/**
+ * @brief Get the offset of the local time from UTC at a given time
+ *
+ * @param time The time
+ * @param timezone_string Buffer of at least 8 bytes where to copy the time
+ * zone string that is written after the times, or NULL
+ *
+ * @return Offset in seconds east from UTC
+ */
+static glong util_get_utc_offset(time_t time, gchar *timezone_string);
+
+/**
+ * @brief Convert a time to local time
+ *
+ * @param time The time
+ * @param time_dest Return location for the local time
+ *
+ * @return Offset of the local time from UTC, in seconds east
+ */
+static glong util_get_local_time(time_t time, struct tm *time_dest);
+
+/**
+ * @brief Check whether a time is at midnight in local time
+ */
+static gboolean util_is_local_midnight(time_t time);
+
+/**
+ * @brief Get the amount of days from 1970-01-01 to a date in the proleptic
+ * Gregorian calendar
+ */
+static gint64 util_days_from_civil(gint64 year, gint month, gint day);
+
+/**
+ * @brief Get the date of a day counted from 1970-01-01
+ */
+static void util_civil_from_days(
+		gint64 days,
+		gint64 *year,
+		gint *month,
+		gint *day);
+
+/**
+ * @brief Write a non-negative number with at least the given amount of
+ * digits
+ *
+ * @return Pointer to the byte after the last written digit
+ */
+static gchar *util_write_digits(gchar *buf, gint64 value, gint width);
+
+/**
+ * @brief Read a number of exactly the given amount of digits
+ *
+ * @return TRUE if there were enough digits, FALSE otherwise
+ */
+static gboolean util_read_digits(const gchar *buf, gint width, gint *value);
+
+/**
+ * @brief Parse an XML dateTime string with strptime(), for strings that
+ * util_timeval_from_xml_date_time() cannot parse directly
+ */
+static gboolean util_timeval_from_xml_date_time_string_strptime(
+		const gchar *string,
+		struct timeval *time);
+
 /**
  * @brief Convert a time from a broken-down representation to time_t format,
  * with both input and output being in UTC
@@ -75,6 +165,15 @@ void util_initialize(Settings *settings)
 	tzset();
 }
 
+gboolean util_get_ignore_time_zones()
+{
+	if(!_util_settings)
+	{
+		return FALSE;
+	}
+	return settings_get_ignore_time_zones(_util_settings);
+}
+
 void util_replace_chars_with_char(
 		gchar *text,
 		gchar to_replace,
@@ -156,45 +255,77 @@ void util_add_time(struct timeval *time1, struct timeval *time2,
 
 gchar *util_xml_date_time_string_from_timeval(struct timeval *time)
 {
-	gchar *csecs_s = NULL;
-	gchar *retval = NULL;
-	glong csecs = 0;
-	time_t time_src;
-	struct tm time_dest;
+	gchar buf[UTIL_XML_DATE_TIME_BUF_SIZE];
 
 	g_return_val_if_fail(time != NULL, NULL);
 	DEBUG_BEGIN();
 
-	time_src = time->tv_sec;
-	localtime_r(&time_src, &time_dest);
+	util_xml_date_time_format(time, buf);
+
+	DEBUG_END();
+	return g_strdup(buf);
+}
+
+gsize util_xml_date_time_format(const struct timeval *time, gchar *buf)
+{
+	gchar timezone_string[8];
+	gchar *ptr = buf;
+	gint64 local;
+	gint64 days;
+	gint64 year;
+	gint month;
+	gint day;
+	glong seconds;
+	glong usecs;
+	gint digits;
+
+	g_return_val_if_fail(time != NULL, 0);
+	g_return_val_if_fail(buf != NULL, 0);
+
+	local = (gint64)time->tv_sec + util_get_utc_offset(time->tv_sec,
+			timezone_string);
+
+	days = local / UTIL_SECONDS_PER_DAY;
+	seconds = local % UTIL_SECONDS_PER_DAY;
+	if(seconds < 0)
+	{
+		days--;
+		seconds += UTIL_SECONDS_PER_DAY;
+	}
+	util_civil_from_days(days, &year, &month, &day);
+
+	ptr = util_write_digits(ptr, year, 4);
+	*ptr++ = '-';
+	ptr = util_write_digits(ptr, month, 2);
+	*ptr++ = '-';
+	ptr = util_write_digits(ptr, day, 2);
+	*ptr++ = 'T';
+	ptr = util_write_digits(ptr, seconds / 3600, 2);
+	*ptr++ = ':';
+	ptr = util_write_digits(ptr, (seconds / 60) % 60, 2);
+	*ptr++ = ':';
+	ptr = util_write_digits(ptr, seconds % 60, 2);
 
 	/* XML dateTime second fraction must not end with a zero, even though
 	 * seems a bit weird since it prevents including accuracy of the time
 	 * by including necessary amount of significant digits. */
-	csecs = time->tv_usec / 1000L;
-	if(csecs == 0)
+	usecs = time->tv_usec;
+	if(usecs > 0 && usecs < 1000000)
 	{
-		csecs_s = g_strdup("");
-	} else if(csecs % 10 == 0) {
-		csecs_s = g_strdup_printf(".%ld", csecs / 10);
-	} else {
-		csecs_s = g_strdup_printf(".%02ld", csecs);
+		digits = 6;
+		while(usecs % 10 == 0)
+		{
+			usecs /= 10;
+			digits--;
+		}
+		*ptr++ = '.';
+		ptr = util_write_digits(ptr, usecs, digits);
 	}
 
-	retval = g_strdup_printf("%04d-%02d-%02dT%02d:%02d:%02d%s%s",
-			time_dest.tm_year + 1900,
-			time_dest.tm_mon + 1,
-			time_dest.tm_mday,
-			time_dest.tm_hour,
-			time_dest.tm_min,
-			time_dest.tm_sec,
-			csecs_s,
-			util_get_timezone_string());
-
-	g_free(csecs_s);
+	strcpy(ptr, timezone_string);
+	ptr += strlen(timezone_string);
 
-	DEBUG_END();
-	return retval;
+	return ptr - buf;
 }
 
 gchar *util_date_string_from_timeval(struct timeval *time)
@@ -228,89 +359,104 @@ gboolean util_timeval_from_xml_date_time_string(
 		const gchar *string,
 		struct timeval *time)
 {
-	const gchar *remainder;
-	gchar *retval;
-	struct tm time_dest;
-	struct tm tz;
+	g_return_val_if_fail(string != NULL, FALSE);
+	g_return_val_if_fail(time != NULL, FALSE);
 
-	guint csecs = 0;
-	gchar csecs_c[2];
-	csecs_c[1] = '\0';
+	return util_timeval_from_xml_date_time(string, strlen(string), time);
+}
+
+gboolean util_timeval_from_xml_date_time(
+		const gchar *string,
+		gsize length,
+		struct timeval *time)
+{
+	const gchar *ptr = string;
+	const gchar *end = string + length;
+	gchar *tmp = NULL;
+	gboolean retval;
+	gint year, month, day;
+	gint hours, minutes, seconds;
+	gint tz_hours, tz_minutes;
+	glong usecs = 0;
+	glong scale = 100000;
+	glong tz_offset = 0;
+	gboolean has_tz = FALSE;
 
 	g_return_val_if_fail(string != NULL, FALSE);
 	g_return_val_if_fail(time != NULL, FALSE);
-	DEBUG_BEGIN();
-
-	/* Initialize the values in the time_dest and tz */
-	memset(&time_dest, 0, sizeof(struct tm));
-	memset(&tz, 0, sizeof(struct tm));
 
-	remainder = strptime(string, "%Y-%m-%dT%T", &time_dest);
-	if(remainder == NULL)
+	/* YYYY-MM-DDThh:mm:ss */
+	if(length < 19 ||
+			!util_read_digits(ptr, 4, &year) || ptr[4] != '-' ||
+			!util_read_digits(ptr + 5, 2, &month) || ptr[7] != '-' ||
+			!util_read_digits(ptr + 8, 2, &day) || ptr[10] != 'T' ||
+			!util_read_digits(ptr + 11, 2, &hours) ||
+			ptr[13] != ':' ||
+			!util_read_digits(ptr + 14, 2, &minutes) ||
+			ptr[16] != ':' ||
+			!util_read_digits(ptr + 17, 2, &seconds) ||
+			month < 1 || month > 12 || day < 1 || day > 31 ||
+			hours > 23 || minutes > 59 || seconds > 61)
 	{
-		g_warning("Incorrect time format: %s", string);
-		return FALSE;
+		goto slow_path;
 	}
+	ptr += 19;
 
-	if(*remainder == '.')
+	/* Fractional seconds, of which only microseconds are kept */
+	if(ptr < end && *ptr == '.')
 	{
-		remainder++;
-		if(*remainder)
+		for(ptr++; ptr < end && g_ascii_isdigit(*ptr); ptr++)
 		{
-			csecs_c[0] = *remainder;
-			csecs = g_ascii_strtoull(csecs_c, NULL, 10) * 10L;
-			remainder++;
-			if(*remainder)
-			{
-				csecs_c[0] = *remainder;
-				csecs += g_ascii_strtoull(csecs_c, NULL, 10);
-				*remainder++;
-			}
+			usecs += (*ptr - '0') * scale;
+			scale /= 10;
 		}
 	}
 
-	time->tv_sec = my_timegm(&time_dest);
-	time->tv_usec = csecs * 10000;
-
-	if(settings_get_ignore_time_zones(_util_settings))
+	/* Time zone */
+	if(ptr < end && (*ptr == '+' || *ptr == '-'))
 	{
-		/* Ignore time zone data, if there is any */
-		DEBUG_END();
-		return TRUE;
+		if(end - ptr != 6 ||
+				!util_read_digits(ptr + 1, 2, &tz_hours) ||
+				ptr[3] != ':' ||
+				!util_read_digits(ptr + 4, 2, &tz_minutes))
+		{
+			goto slow_path;
+		}
+		tz_offset = tz_hours * 3600 + tz_minutes * 60;
+		if(*ptr == '-')
+		{
+			tz_offset = -tz_offset;
+		}
+		has_tz = TRUE;
+		ptr = end;
+	} else if(ptr < end && *ptr == 'Z') {
+		has_tz = TRUE;
+		ptr++;
 	}
-
-	/* See if there is time zone information (mktime always assumes that
-	 * input is in local time) */
-	if(*remainder == '+' || *remainder == '-')
+	if(ptr != end)
 	{
-		if(*(remainder + 1) != '\0')
-		{
-			/* The time is in format <localtime>(+/-)<timezone> */
-			retval = strptime(remainder + 1, "%H:%M", &tz);
+		goto slow_path;
+	}
 
-			if(retval != NULL)
-			{
-				/* First, convert to UTC and then to local
-				 * time */
-				if(*remainder == '+')
-				{
-					time->tv_sec -= tz.tm_hour * 3600 +
-						tz.tm_min * 60;
-				} else {
-					time->tv_sec += tz.tm_hour * 3600 +
-						tz.tm_min * 60;
-				}
-				time->tv_sec -= timezone;
-			}
-		}
-	} else if(*remainder == 'Z') {
-		/* The time is represented as UTC */
-		time->tv_sec -= timezone;
+	time->tv_sec = util_days_from_civil(year, month, day) *
+		UTIL_SECONDS_PER_DAY + hours * 3600 + minutes * 60 + seconds;
+	time->tv_usec = usecs;
+
+	/* Ignore time zone data, if there is any. Otherwise convert to UTC
+	 * and then to local time, or assume that the data is in local time
+	 * zone if there is no time zone. */
+	if(has_tz && !settings_get_ignore_time_zones(_util_settings))
+	{
+		time->tv_sec -= tz_offset + timezone;
 	}
-	/* Otherwise assume that the data is in local time zone */
 
-	DEBUG_END();
 	return TRUE;
+
+slow_path:
+	tmp = g_strndup(string, length);
+	retval = util_timeval_from_xml_date_time_string_strptime(tmp, time);
+	g_free(tmp);
+	return retval;
 }
 
 gint util_compare_timevals(struct timeval *time_1, struct timeval *time_2)
@@ -366,7 +512,7 @@ static const gchar *util_get_timezone_string()
 		 * so for example GMT+02:00 would have the timezone value -2 * 60 * 60,
 		 * i.e., -7200 and so on */
 		hours = labs(timezone / 3600L);
-		minutes = labs((timezone % 60L) / 60L);
+		minutes = labs((timezone % 3600L) / 60L);
 		if(timezone > 0)
 		{
 			tzstring = g_strdup_printf("-%02ld:%02ld", hours, minutes);
@@ -378,6 +524,247 @@ static const gchar *util_get_timezone_string()
 	return tzstring;
 }
 
+static glong util_get_utc_offset(time_t time, gchar *timezone_string)
+{
+	UtilUtcOffsetCache *cache = &_util_utc_offset_cache;
+	struct tm time_dest;
+	time_t day_start;
+	time_t day_end;
+	glong offset;
+
+	G_LOCK(_util_utc_offset_cache);
+
+	if(time < cache->valid_from || time >= cache->valid_until)
+	{
+		g_strlcpy(cache->timezone_string, util_get_timezone_string(),
+				sizeof(cache->timezone_string));
+
+		cache->offset = util_get_local_time(time, &time_dest);
+
+		/* The offset can be reused if it is the same at both ends of
+		 * the local day */
+		day_start = time - (time_dest.tm_hour * 3600 +
+				time_dest.tm_min * 60 + time_dest.tm_sec);
+		day_end = day_start + UTIL_SECONDS_PER_DAY;
+		cache->constant =
+			util_is_local_midnight(day_start) &&
+			util_is_local_midnight(day_end);
+		cache->valid_from = day_start;
+		cache->valid_until = day_end;
+	}
+
+	if(cache->constant)
+	{
+		offset = cache->offset;
+	} else {
+		offset = util_get_local_time(time, &time_dest);
+	}
+
+	if(timezone_string)
+	{
+		strcpy(timezone_string, cache->timezone_string);
+	}
+
+	G_UNLOCK(_util_utc_offset_cache);
+
+	return offset;
+}
+
+static glong util_get_local_time(time_t time, struct tm *time_dest)
+{
+	localtime_r(&time, time_dest);
+
+	return util_days_from_civil(time_dest->tm_year + 1900,
+			time_dest->tm_mon + 1, time_dest->tm_mday) *
+		UTIL_SECONDS_PER_DAY + time_dest->tm_hour * 3600 +
+		time_dest->tm_min * 60 + time_dest->tm_sec - time;
+}
+
+static gboolean util_is_local_midnight(time_t time)
+{
+	struct tm time_dest;
+
+	localtime_r(&time, &time_dest);
+
+	return time_dest.tm_hour == 0 && time_dest.tm_min == 0 &&
+		time_dest.tm_sec == 0;
+}
+
+static gint64 util_days_from_civil(gint64 year, gint month, gint day)
+{
+	gint64 era;
+	gint64 year_of_era;
+	gint64 day_of_year;
+	gint64 day_of_era;
+
+	/* Count the years from March, so that the leap day is the last day
+	 * of the year */
+	year -= month <= 2;
+	era = (year >= 0 ? year : year - 399) / 400;
+	year_of_era = year - era * 400;
+	day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 +
+		day_of_year;
+
+	/* 719468 days from 0000-03-01 to 1970-01-01 */
+	return era * 146097 + day_of_era - 719468;
+}
+
+static void util_civil_from_days(
+		gint64 days,
+		gint64 *year,
+		gint *month,
+		gint *day)
+{
+	gint64 era;
+	gint64 year_of_era;
+	gint64 day_of_year;
+	gint64 day_of_era;
+	gint64 month_from_march;
+
+	days += 719468;
+	era = (days >= 0 ? days : days - 146096) / 146097;
+	day_of_era = days - era * 146097;
+	year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 -
+			day_of_era / 146096) / 365;
+	day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 -
+			year_of_era / 100);
+	month_from_march = (5 * day_of_year + 2) / 153;
+
+	*day = day_of_year - (153 * month_from_march + 2) / 5 + 1;
+	*month = month_from_march < 10 ? month_from_march + 3 :
+		month_from_march - 9;
+	*year = year_of_era + era * 400 + (*month <= 2);
+}
+
+static gchar *util_write_digits(gchar *buf, gint64 value, gint width)
+{
+	gchar digits[20];
+	gint count = 0;
+
+	do {
+		digits[count++] = '0' + value % 10;
+		value /= 10;
+	} while(value > 0 && count < sizeof(digits));
+
+	while(width-- > count)
+	{
+		*buf++ = '0';
+	}
+	while(count > 0)
+	{
+		*buf++ = digits[--count];
+	}
+
+	return buf;
+}
+
+static gboolean util_read_digits(const gchar *buf, gint width, gint *value)
+{
+	gint i;
+
+	*value = 0;
+	for(i = 0; i < width; i++)
+	{
+		if(!g_ascii_isdigit(buf[i]))
+		{
+			return FALSE;
+		}
+		*value = *value * 10 + (buf[i] - '0');
+	}
+
+	return TRUE;
+}
+
+static gboolean util_timeval_from_xml_date_time_string_strptime(
+		const gchar *string,
+		struct timeval *time)
+{
+	const gchar *remainder;
+	gchar *retval;
+	struct tm time_dest;
+	struct tm tz;
+
+	guint csecs = 0;
+	gchar csecs_c[2];
+	csecs_c[1] = '\0';
+
+	g_return_val_if_fail(string != NULL, FALSE);
+	g_return_val_if_fail(time != NULL, FALSE);
+	DEBUG_BEGIN();
+
+	/* Initialize the values in the time_dest and tz */
+	memset(&time_dest, 0, sizeof(struct tm));
+	memset(&tz, 0, sizeof(struct tm));
+
+	remainder = strptime(string, "%Y-%m-%dT%T", &time_dest);
+	if(remainder == NULL)
+	{
+		g_warning("Incorrect time format: %s", string);
+		return FALSE;
+	}
+
+	if(*remainder == '.')
+	{
+		remainder++;
+		if(*remainder)
+		{
+			csecs_c[0] = *remainder;
+			csecs = g_ascii_strtoull(csecs_c, NULL, 10) * 10L;
+			remainder++;
+			if(*remainder)
+			{
+				csecs_c[0] = *remainder;
+				csecs += g_ascii_strtoull(csecs_c, NULL, 10);
+				*remainder++;
+			}
+		}
+	}
+
+	time->tv_sec = my_timegm(&time_dest);
+	time->tv_usec = csecs * 10000;
+
+	if(settings_get_ignore_time_zones(_util_settings))
+	{
+		/* Ignore time zone data, if there is any */
+		DEBUG_END();
+		return TRUE;
+	}
+
+	/* See if there is time zone information (mktime always assumes that
+	 * input is in local time) */
+	if(*remainder == '+' || *remainder == '-')
+	{
+		if(*(remainder + 1) != '\0')
+		{
+			/* The time is in format <localtime>(+/-)<timezone> */
+			retval = strptime(remainder + 1, "%H:%M", &tz);
+
+			if(retval != NULL)
+			{
+				/* First, convert to UTC and then to local
+				 * time */
+				if(*remainder == '+')
+				{
+					time->tv_sec -= tz.tm_hour * 3600 +
+						tz.tm_min * 60;
+				} else {
+					time->tv_sec += tz.tm_hour * 3600 +
+						tz.tm_min * 60;
+				}
+				time->tv_sec -= timezone;
+			}
+		}
+	} else if(*remainder == 'Z') {
+		/* The time is represented as UTC */
+		time->tv_sec -= timezone;
+	}
+	/* Otherwise assume that the data is in local time zone */
+
+	DEBUG_END();
+	return TRUE;
+}
+
 time_t my_timegm(struct tm *tm)
 {
 	time_t retval;
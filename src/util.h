@@ -34,6 +34,12 @@
 
 /* Other modules */
 #include "settings.h"
+
+/**
+ * @brief Size of a buffer that can hold any string written by
+ * util_xml_date_time_format(), including the terminating null byte
+ */
+#define UTIL_XML_DATE_TIME_BUF_SIZE	40
  #ifdef __cplusplus
  extern "C" {
  #endif 
@@ -44,6 +50,13 @@
  */
 void util_initialize(Settings *settings);
 
+/**
+ * @brief Get whether or not time zones are ignored when parsing times
+ *
+ * @return TRUE if the time zones are ignored, FALSE otherwise
+ */
+gboolean util_get_ignore_time_zones();
+
 /**
  * @brief Replace characters in a string with a character
  *
@@ -88,6 +101,22 @@ void util_add_time(struct timeval *time1, struct timeval *time2,
  */
 gchar *util_xml_date_time_string_from_timeval(struct timeval *time);
 
+/**
+ * @brief Write an XML dateTime string representation of a struct timeval
+ * into a buffer
+ *
+ * The time is written in local time, with the time zone and as many
+ * fractional digits as are needed to represent the microseconds. Unlike
+ * util_xml_date_time_string_from_timeval(), this does not allocate
+ * memory, and the time zone offset is looked up only once a day.
+ *
+ * @param time Time to represent as a string
+ * @param buf Buffer of at least #UTIL_XML_DATE_TIME_BUF_SIZE bytes
+ *
+ * @return Length of the string written to buf
+ */
+gsize util_xml_date_time_format(const struct timeval *time, gchar *buf);
+
 /**
  * @brief Create a date string representation from a struct timeval, ignoring
  * the time
@@ -112,6 +141,25 @@ gboolean util_timeval_from_xml_date_time_string(
 		const gchar *string,
 		struct timeval *time);
 
+/**
+ * @brief Create a struct timeval representation from an xml dateTime string
+ * that is not necessarily null-terminated
+ *
+ * Times in the fixed-width format YYYY-MM-DDThh:mm:ss[.s+][Z|(+|-)hh:mm]
+ * are parsed without allocating memory. Fractional seconds are parsed up
+ * to microsecond precision.
+ *
+ * @param string The string to be parsed
+ * @param length Length of the string
+ * @param time The timeval representation of the time
+ *
+ * @return TRUE if the parsing succeeded, FALSE otherwise
+ */
+gboolean util_timeval_from_xml_date_time(
+		const gchar *string,
+		gsize length,
+		struct timeval *time);
+
 /**
  * @brief Compare two times
  *